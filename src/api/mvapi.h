@@ -14,8 +14,8 @@
 // MV_MIN_VERSION is the minimum required JK2MV version which implements this API-Level.
 // All future JK2MV versions are guaranteed to implement this API-Level.
 // ----------------------------------------------------------------------------------------- //
-#define MV_APILEVEL 2
-#define MV_MIN_VERSION "1.2"
+#define MV_APILEVEL 3
+#define MV_MIN_VERSION "1.3"
 // ----------------------------------------------------------------------------------------- //
 
 // ----------------------------------------- SHARED ---------------------------------------- //
@@ -84,6 +84,19 @@ typedef struct {
 	uint32_t	mvFlags;
 } mvsharedEntity_t;
 
+// arguments of one trap_Trace / trap_TraceCapsule call
+typedef struct {
+	float		start[3];
+	float		mins[3];
+	float		maxs[3];
+	float		end[3];
+	int			passEntityNum;
+	int			contentMask;
+	int			capsule;
+	int			traceFlags;
+	int			useLod;
+} mvtraceRequest_t;
+
 // ******** SYSCALLS ******** //
 
 // qboolean trap_MVAPI_SendConnectionlessPacket(const mvaddr_t *addr, const char *message);
@@ -98,6 +111,9 @@ typedef struct {
 // qboolean trap_MVAPI_DisableStructConversion(qboolean disable);
 #define MVAPI_DISABLE_STRUCT_CONVERSION 705		/* asm: -706 */
 
+// qboolean trap_MVAPI_TraceBatch(const mvtraceRequest_t *requests, trace_t *results, int numTraces);
+#define MVAPI_TRACE_BATCH 706					/* asm: -707 */
+
 // ******** VMCALLS ******** //
 
 // vmMain(MVAPI_RECV_CONNECTIONLESSPACKET, ...)
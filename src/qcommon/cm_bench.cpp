@@ -0,0 +1,458 @@
+// cm_bench.c -- collision model benchmark
+
+#include "cm_local.h"
+
+#include <mutex>
+
+/*
+==============================================================
+
+cm_record captures the world and inline model traces and point contents
+queries of a running game, cm_bench replays such a capture or a random
+set of queries on the loaded map. It reports the queries per second and
+a hash of all results, so changes to the collision code can be compared
+for speed and proven to give identical results.
+
+==============================================================
+*/
+
+#define CM_BENCH_MAGIC		"CMBQ"
+#define CM_BENCH_VERSION	1
+#define CM_BENCH_MAX_QUERIES	( 1 << 20 )
+
+typedef enum {
+	BQ_TRACE,
+	BQ_TRANSFORMED_TRACE,
+	BQ_POINT_CONTENTS
+} benchQueryType_t;
+
+// all fields are four bytes, so the file is just byte swapped words
+typedef struct {
+	int			type;
+	int			model;
+	int			brushmask;
+	int			capsule;
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		origin, angles;
+} benchQuery_t;
+
+typedef struct {
+	char		magic[4];
+	int			version;
+	char		mapname[MAX_QPATH];
+	int			numBrushes;		// to catch replays on another map
+	int			numQueries;
+} benchHeader_t;
+
+std::atomic<bool>		cm_benchRecording;
+
+static std::mutex		benchMutex;
+static benchQuery_t		*benchQueries;
+static int				benchNumQueries;
+static int				benchMaxQueries;
+static char				benchFilename[MAX_QPATH];
+static char				benchMapname[MAX_QPATH];
+static int				benchNumBrushes;
+
+/*
+================
+CM_BenchAddQuery
+================
+*/
+static void CM_BenchAddQuery( const benchQuery_t *query ) {
+	std::lock_guard<std::mutex> lock( benchMutex );
+
+	if ( !cm_benchRecording || benchNumQueries == CM_BENCH_MAX_QUERIES ) {
+		return;
+	}
+
+	if ( benchNumQueries == benchMaxQueries ) {
+		benchQuery_t	*queries;
+		int				maxQueries;
+
+		// may be called from any thread, so not on the zone
+		maxQueries = benchMaxQueries ? benchMaxQueries * 2 : 4096;
+		queries = (benchQuery_t *)realloc( benchQueries, maxQueries * sizeof( *queries ) );
+		if ( !queries ) {
+			return;
+		}
+
+		benchQueries = queries;
+		benchMaxQueries = maxQueries;
+	}
+
+	benchQueries[benchNumQueries++] = *query;
+}
+
+/*
+================
+CM_BenchRecordTrace
+
+angles is NULL for CM_BoxTrace
+================
+*/
+void CM_BenchRecordTrace( const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
+						 clipHandle_t model, int brushmask, const vec3_t origin, const vec3_t angles, int capsule ) {
+	benchQuery_t	query;
+
+	// temporary box models can't be replayed
+	if ( model < 0 || model >= cm.numSubModels ) {
+		return;
+	}
+
+	Com_Memset( &query, 0, sizeof( query ) );
+	query.type = angles ? BQ_TRANSFORMED_TRACE : BQ_TRACE;
+	query.model = model;
+	query.brushmask = brushmask;
+	query.capsule = capsule;
+	VectorCopy( start, query.start );
+	VectorCopy( end, query.end );
+	if ( mins ) {
+		VectorCopy( mins, query.mins );
+	}
+	if ( maxs ) {
+		VectorCopy( maxs, query.maxs );
+	}
+	if ( angles ) {
+		VectorCopy( origin, query.origin );
+		VectorCopy( angles, query.angles );
+	}
+
+	CM_BenchAddQuery( &query );
+}
+
+/*
+================
+CM_BenchRecordContents
+================
+*/
+void CM_BenchRecordContents( const vec3_t p, clipHandle_t model ) {
+	benchQuery_t	query;
+
+	if ( model < 0 || model >= cm.numSubModels ) {
+		return;
+	}
+
+	Com_Memset( &query, 0, sizeof( query ) );
+	query.type = BQ_POINT_CONTENTS;
+	query.model = model;
+	VectorCopy( p, query.start );
+
+	CM_BenchAddQuery( &query );
+}
+
+/*
+================
+CM_BenchSwapQueries
+================
+*/
+static void CM_BenchSwapQueries( benchQuery_t *queries, int numQueries ) {
+	int		*word;
+	int		i;
+
+	word = (int *)queries;
+	for ( i = 0 ; i < numQueries * (int)( sizeof( *queries ) / sizeof( int ) ) ; i++ ) {
+		word[i] = LittleLong( word[i] );
+	}
+}
+
+/*
+================
+CM_Record_f
+
+cm_record [filename]
+================
+*/
+static void CM_Record_f( void ) {
+	if ( cm_benchRecording ) {
+		Com_Printf( "Already recording to %s.\n", benchFilename );
+		return;
+	}
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "No map loaded.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() > 1 ) {
+		Com_sprintf( benchFilename, sizeof( benchFilename ), "benchmarks/%s", Cmd_Argv( 1 ) );
+	} else {
+		Com_sprintf( benchFilename, sizeof( benchFilename ), "benchmarks/%s", COM_SkipPath( cm.name ) );
+		COM_StripExtension( benchFilename, benchFilename, sizeof( benchFilename ) );
+	}
+	COM_DefaultExtension( benchFilename, sizeof( benchFilename ), ".cmb" );
+
+	Q_strncpyz( benchMapname, cm.name, sizeof( benchMapname ) );
+	benchNumBrushes = cm.numBrushes;
+	benchNumQueries = 0;
+	cm_benchRecording = true;
+
+	Com_Printf( "Recording collision queries to %s.\n", benchFilename );
+}
+
+/*
+================
+CM_StopRecord_f
+================
+*/
+static void CM_StopRecord_f( void ) {
+	benchHeader_t	header;
+	fileHandle_t	f;
+
+	if ( !cm_benchRecording ) {
+		Com_Printf( "Not recording collision queries.\n" );
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( benchMutex );
+		cm_benchRecording = false;
+	}
+
+	if ( strcmp( benchMapname, cm.name ) || benchNumBrushes != cm.numBrushes ) {
+		Com_Printf( "The map changed while recording, discarding the queries.\n" );
+		f = 0;
+	} else {
+		f = FS_FOpenFileWrite( benchFilename );
+		if ( !f ) {
+			Com_Printf( "ERROR: couldn't open %s.\n", benchFilename );
+		}
+	}
+
+	if ( !f ) {
+		free( benchQueries );
+		benchQueries = NULL;
+		benchNumQueries = 0;
+		benchMaxQueries = 0;
+		return;
+	}
+
+	Com_Memset( &header, 0, sizeof( header ) );
+	Com_Memcpy( header.magic, CM_BENCH_MAGIC, sizeof( header.magic ) );
+	header.version = LittleLong( CM_BENCH_VERSION );
+	Q_strncpyz( header.mapname, cm.name, sizeof( header.mapname ) );
+	header.numBrushes = LittleLong( cm.numBrushes );
+	header.numQueries = LittleLong( benchNumQueries );
+
+	CM_BenchSwapQueries( benchQueries, benchNumQueries );
+
+	FS_Write( &header, sizeof( header ), f );
+	FS_Write( benchQueries, benchNumQueries * sizeof( *benchQueries ), f );
+	FS_FCloseFile( f );
+
+	Com_Printf( "Wrote %i collision queries to %s.\n", benchNumQueries, benchFilename );
+
+	free( benchQueries );
+	benchQueries = NULL;
+	benchNumQueries = 0;
+	benchMaxQueries = 0;
+}
+
+/*
+================
+CM_BenchLoad
+================
+*/
+static benchQuery_t *CM_BenchLoad( const char *name, int *numQueries ) {
+	char			filename[MAX_QPATH];
+	benchHeader_t	*header;
+	benchQuery_t	*queries;
+	void			*buffer;
+	int				len;
+
+	Com_sprintf( filename, sizeof( filename ), "benchmarks/%s", name );
+	COM_DefaultExtension( filename, sizeof( filename ), ".cmb" );
+
+	len = FS_ReadFile( filename, &buffer );
+	if ( !buffer ) {
+		Com_Printf( "Couldn't load %s.\n", filename );
+		return NULL;
+	}
+
+	header = (benchHeader_t *)buffer;
+	if ( len < (int)sizeof( *header ) || memcmp( header->magic, CM_BENCH_MAGIC, sizeof( header->magic ) ) ||
+		LittleLong( header->version ) != CM_BENCH_VERSION ) {
+		Com_Printf( "%s is not a collision query capture.\n", filename );
+		FS_FreeFile( buffer );
+		return NULL;
+	}
+
+	*numQueries = LittleLong( header->numQueries );
+	if ( *numQueries < 0 || *numQueries > CM_BENCH_MAX_QUERIES || len < (int)sizeof( *header ) + *numQueries * (int)sizeof( *queries ) ) {
+		Com_Printf( "%s is truncated.\n", filename );
+		FS_FreeFile( buffer );
+		return NULL;
+	}
+
+	header->mapname[sizeof( header->mapname ) - 1] = '\0';
+	if ( Q_stricmp( header->mapname, cm.name ) || LittleLong( header->numBrushes ) != cm.numBrushes ) {
+		Com_Printf( "%s was recorded on %s.\n", filename, header->mapname );
+		FS_FreeFile( buffer );
+		return NULL;
+	}
+
+	queries = (benchQuery_t *)Z_Malloc( *numQueries * sizeof( *queries ) + 1, TAG_GENERAL, qfalse );
+	Com_Memcpy( queries, header + 1, *numQueries * sizeof( *queries ) );
+	CM_BenchSwapQueries( queries, *numQueries );
+	FS_FreeFile( buffer );
+
+	return queries;
+}
+
+/*
+================
+CM_BenchRandom
+
+Points, boxes and capsules the size of a player going up to 512 units in
+any direction, and a few position tests
+================
+*/
+static benchQuery_t *CM_BenchRandom( int numQueries, int seed ) {
+	static const vec3_t	playerMins = { -15, -15, -24 };
+	static const vec3_t	playerMaxs = { 15, 15, 40 };
+	benchQuery_t	*queries, *query;
+	vec3_t			worldMins, worldMaxs;
+	int				i, j;
+
+	CM_ModelBounds( 0, worldMins, worldMaxs );
+
+	queries = (benchQuery_t *)Z_Malloc( numQueries * sizeof( *queries ), TAG_GENERAL, qtrue );
+
+	for ( i = 0, query = queries ; i < numQueries ; i++, query++ ) {
+		query->type = ( i & 3 ) == 3 ? BQ_POINT_CONTENTS : BQ_TRACE;
+		query->brushmask = CONTENTS_SOLID | CONTENTS_PLAYERCLIP | CONTENTS_BODY;
+
+		for ( j = 0 ; j < 3 ; j++ ) {
+			query->start[j] = worldMins[j] + Q_random( &seed ) * ( worldMaxs[j] - worldMins[j] );
+			if ( ( i & 31 ) != 1 ) {
+				query->end[j] = query->start[j] + Q_crandom( &seed ) * 512;
+			} else {
+				query->end[j] = query->start[j];
+			}
+		}
+
+		if ( ( i & 3 ) != 0 ) {
+			VectorCopy( playerMins, query->mins );
+			VectorCopy( playerMaxs, query->maxs );
+			query->capsule = ( i & 3 ) == 2;
+		}
+	}
+
+	return queries;
+}
+
+/*
+================
+CM_BenchHash
+================
+*/
+static ID_INLINE unsigned CM_BenchHash( unsigned hash, const void *data, int len ) {
+	const byte	*p;
+	int			i;
+
+	// FNV-1a
+	p = (const byte *)data;
+	for ( i = 0 ; i < len ; i++ ) {
+		hash = ( hash ^ p[i] ) * 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+================
+CM_Bench_f
+
+cm_bench [count] [seed]
+cm_bench <capture>
+================
+*/
+static void CM_Bench_f( void ) {
+	benchQuery_t	*queries, *query;
+	trace_t			trace;
+	int				numQueries, contents;
+	int				counts[3];
+	unsigned		hash;
+	int64_t			start, end;
+	int				i;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "No map loaded.\n" );
+		return;
+	}
+
+	if ( cm_benchRecording ) {
+		Com_Printf( "Can't benchmark while recording.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() > 1 && !isdigit( Cmd_Argv( 1 )[0] ) ) {
+		queries = CM_BenchLoad( Cmd_Argv( 1 ), &numQueries );
+		if ( !queries ) {
+			return;
+		}
+	} else {
+		numQueries = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 100000;
+		if ( numQueries < 1 || numQueries > CM_BENCH_MAX_QUERIES ) {
+			Com_Printf( "Count must be between 1 and %i.\n", CM_BENCH_MAX_QUERIES );
+			return;
+		}
+		queries = CM_BenchRandom( numQueries, Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 1 );
+	}
+
+	Com_Memset( counts, 0, sizeof( counts ) );
+	hash = 2166136261u;
+
+	start = Sys_Nanoseconds();
+
+	for ( i = 0, query = queries ; i < numQueries ; i++, query++ ) {
+		switch ( query->type ) {
+		case BQ_TRACE:
+			CM_BoxTrace( &trace, query->start, query->end, query->mins, query->maxs,
+				query->model, query->brushmask, query->capsule );
+			break;
+		case BQ_TRANSFORMED_TRACE:
+			CM_TransformedBoxTrace( &trace, query->start, query->end, query->mins, query->maxs,
+				query->model, query->brushmask, query->origin, query->angles, query->capsule );
+			break;
+		case BQ_POINT_CONTENTS:
+			contents = CM_PointContents( query->start, query->model );
+			hash = CM_BenchHash( hash, &contents, sizeof( contents ) );
+			counts[BQ_POINT_CONTENTS]++;
+			continue;
+		default:
+			continue;
+		}
+
+		hash = CM_BenchHash( hash, &trace.allsolid, sizeof( trace.allsolid ) );
+		hash = CM_BenchHash( hash, &trace.startsolid, sizeof( trace.startsolid ) );
+		hash = CM_BenchHash( hash, &trace.fraction, sizeof( trace.fraction ) );
+		hash = CM_BenchHash( hash, trace.endpos, sizeof( trace.endpos ) );
+		hash = CM_BenchHash( hash, trace.plane.normal, sizeof( trace.plane.normal ) );
+		hash = CM_BenchHash( hash, &trace.plane.dist, sizeof( trace.plane.dist ) );
+		hash = CM_BenchHash( hash, &trace.surfaceFlags, sizeof( trace.surfaceFlags ) );
+		hash = CM_BenchHash( hash, &trace.contents, sizeof( trace.contents ) );
+		counts[query->type]++;
+	}
+
+	end = Sys_Nanoseconds();
+
+	Z_Free( queries );
+
+	Com_Printf( "%i traces, %i transformed traces, %i point contents\n",
+		counts[BQ_TRACE], counts[BQ_TRANSFORMED_TRACE], counts[BQ_POINT_CONTENTS] );
+	Com_Printf( "%.3f msec, %.0f queries/sec, hash %08x\n",
+		( end - start ) / 1e6, numQueries / ( ( end - start ) / 1e9 ), hash );
+}
+
+/*
+================
+CM_InitBench
+================
+*/
+void CM_InitBench( void ) {
+	Cmd_AddCommand( "cm_bench", CM_Bench_f );
+	Cmd_AddCommand( "cm_record", CM_Record_f );
+	Cmd_AddCommand( "cm_stoprecord", CM_StopRecord_f );
+}
@@ -0,0 +1,358 @@
+// cm_cache.c -- on-disk cache of generated patch collision
+
+#include "cm_local.h"
+#include "cm_patch.h"
+#include "mv_setup.h"
+
+/*
+==============================================================
+
+Building the collision facets of every curved surface is the slowest part
+of loading a map. With cm_patchCache set the generated planes, facets and
+facet trees of a map are written to cmcache/maps/<map>.cmc, and later
+loads of the same map copy them back instead of generating them again.
+The cache lives in fs_homepath outside of any game directory, so it never
+comes from a pk3 and reading it doesn't affect pure checks.
+
+A cache is only used if it was written for the same BSP checksum by the
+same engine version, anything else gets regenerated and overwritten.
+
+==============================================================
+*/
+
+#define CM_CACHE_MAGIC		"CMPC"
+#define CM_CACHE_VERSION	1
+
+typedef struct {
+	char		magic[4];
+	int			version;
+	char		engineVersion[32];
+	int			checksum;
+	int			numPatches;
+	int			planeSize;			// to catch layout changes
+	int			facetSize;
+	int			nodeSize;
+} patchCacheHeader_t;
+
+// followed by the planes, facets and nodes of the patch; all fields
+// are four bytes, so the patches are just byte swapped words
+typedef struct {
+	int			surface;
+	vec3_t		bounds[2];
+	int			numPlanes;
+	int			numFacets;
+	int			numNodes;
+} patchCacheEntry_t;
+
+/*
+================
+CM_PatchCacheName
+================
+*/
+static void CM_PatchCacheName( const char *name, char *filename, int size ) {
+	char	stripped[MAX_QPATH];
+
+	COM_StripExtension( name, stripped, sizeof( stripped ) );
+	Com_sprintf( filename, size, "cmcache/%s.cmc", stripped );
+}
+
+/*
+================
+CM_SwapPatchCache
+================
+*/
+static void CM_SwapPatchCache( void *data, int size ) {
+	int		*word;
+	int		i;
+
+	word = (int *)data;
+	for ( i = 0 ; i < size / (int)sizeof( int ) ; i++ ) {
+		word[i] = LittleLong( word[i] );
+	}
+}
+
+/*
+================
+CM_CachedPatchSize
+================
+*/
+static int CM_CachedPatchSize( int numPlanes, int numFacets, int numNodes ) {
+	return sizeof( patchCacheEntry_t ) + numPlanes * sizeof( patchPlane_t )
+		+ numFacets * sizeof( facet_t ) + numNodes * sizeof( patchNode_t );
+}
+
+/*
+================
+CM_CheckCachedPatch
+
+Returns the size of the cached patch, or 0 if it is damaged. Every index
+is checked, so a bad file can't send traces outside the arrays.
+================
+*/
+static int CM_CheckCachedPatch( const byte *data, int len ) {
+	const patchCacheEntry_t	*entry;
+	const patchPlane_t		*planes;
+	const facet_t			*facets;
+	const patchNode_t		*nodes;
+	int						size;
+	int						i, j;
+
+	if ( len < (int)sizeof( *entry ) ) {
+		return 0;
+	}
+
+	entry = (const patchCacheEntry_t *)data;
+	if ( entry->numPlanes < 0 || entry->numPlanes > MAX_PATCH_PLANES
+		|| entry->numFacets < 0 || entry->numFacets > MAX_FACETS
+		|| entry->numNodes < 0 || entry->numNodes > MAX_PATCH_NODES ) {
+		return 0;
+	}
+
+	size = CM_CachedPatchSize( entry->numPlanes, entry->numFacets, entry->numNodes );
+	if ( len < size ) {
+		return 0;
+	}
+
+	planes = (const patchPlane_t *)( entry + 1 );
+	facets = (const facet_t *)( planes + entry->numPlanes );
+	nodes = (const patchNode_t *)( facets + entry->numFacets );
+
+	for ( i = 0 ; i < entry->numPlanes ; i++ ) {
+		if ( planes[i].signbits < 0 || planes[i].signbits > 7 ) {
+			return 0;
+		}
+	}
+
+	for ( i = 0 ; i < entry->numFacets ; i++ ) {
+		if ( facets[i].surfacePlane < 0 || facets[i].surfacePlane >= entry->numPlanes
+			|| facets[i].numBorders < 0 || facets[i].numBorders > (int)ARRAY_LEN( facets[i].borderPlanes ) ) {
+			return 0;
+		}
+		for ( j = 0 ; j < facets[i].numBorders ; j++ ) {
+			if ( facets[i].borderPlanes[j] < 0 || facets[i].borderPlanes[j] >= entry->numPlanes ) {
+				return 0;
+			}
+		}
+	}
+
+	for ( i = 0 ; i < entry->numNodes ; i++ ) {
+		if ( nodes[i].firstFacet < 0 || nodes[i].numFacets < 0
+			|| nodes[i].numFacets > entry->numFacets - nodes[i].firstFacet
+			|| nodes[i].skipNode <= i || nodes[i].skipNode > entry->numNodes ) {
+			return 0;
+		}
+	}
+
+	return size;
+}
+
+/*
+================
+CM_LoadPatchCache
+
+Returns the cached patch collision of the map indexed by surface, or NULL
+if the patches have to be generated. The caller frees the array.
+================
+*/
+struct patchCollide_s **CM_LoadPatchCache( const char *name, int checksum, const dsurface_t *surfaces, int numSurfaces ) {
+	char					filename[MAX_QPATH];
+	fileHandle_t			f;
+	byte					*buffer;
+	int						len;
+	patchCacheHeader_t		*header;
+	const patchCacheEntry_t	*entry;
+	const byte				*data;
+	int						remaining, size;
+	int						numPatches;
+	int						i, surface;
+	patchCollide_t			*pc;
+	patchCollide_t			**patches;
+
+	if ( !cm_patchCache->integer ) {
+		return NULL;
+	}
+
+	CM_PatchCacheName( name, filename, sizeof( filename ) );
+	len = FS_SV_FOpenFileRead( filename, &f );
+	if ( !f ) {
+		return NULL;
+	}
+
+	buffer = (byte *)Z_Malloc( len + 1, TAG_GENERAL, qfalse );
+	if ( FS_Read( buffer, len, f ) != len ) {
+		len = 0;
+	}
+	FS_FCloseFile( f );
+
+	numPatches = 0;
+	for ( i = 0 ; i < numSurfaces ; i++ ) {
+		if ( LittleLong( surfaces[i].surfaceType ) == MST_PATCH ) {
+			numPatches++;
+		}
+	}
+
+	header = (patchCacheHeader_t *)buffer;
+	if ( len < (int)sizeof( *header ) || memcmp( header->magic, CM_CACHE_MAGIC, sizeof( header->magic ) )
+		|| LittleLong( header->version ) != CM_CACHE_VERSION
+		|| strncmp( header->engineVersion, JK2MV_VERSION, sizeof( header->engineVersion ) )
+		|| LittleLong( header->checksum ) != checksum
+		|| LittleLong( header->numPatches ) != numPatches
+		|| LittleLong( header->planeSize ) != (int)sizeof( patchPlane_t )
+		|| LittleLong( header->facetSize ) != (int)sizeof( facet_t )
+		|| LittleLong( header->nodeSize ) != (int)sizeof( patchNode_t ) ) {
+		Com_DPrintf( "%s is out of date.\n", filename );
+		Z_Free( buffer );
+		return NULL;
+	}
+
+	data = (const byte *)( header + 1 );
+	remaining = len - sizeof( *header );
+	CM_SwapPatchCache( (void *)data, remaining );
+
+	// check all of it before allocating anything on the hunk
+	surface = -1;
+	for ( i = 0 ; i < numPatches ; i++ ) {
+		size = CM_CheckCachedPatch( data, remaining );
+		if ( !size ) {
+			break;
+		}
+
+		entry = (const patchCacheEntry_t *)data;
+		if ( entry->surface <= surface || entry->surface >= numSurfaces
+			|| LittleLong( surfaces[entry->surface].surfaceType ) != MST_PATCH ) {
+			break;
+		}
+		surface = entry->surface;
+
+		data += size;
+		remaining -= size;
+	}
+
+	if ( i < numPatches ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %s is damaged, regenerating patches.\n", filename );
+		Z_Free( buffer );
+		return NULL;
+	}
+
+	patches = (patchCollide_t **)Z_Malloc( numSurfaces * sizeof( *patches ) + 1, TAG_GENERAL, qtrue );
+
+	data = (const byte *)( header + 1 );
+	for ( i = 0 ; i < numPatches ; i++ ) {
+		entry = (const patchCacheEntry_t *)data;
+		data = (const byte *)( entry + 1 );
+
+		pc = (patchCollide_t *)Hunk_Alloc( sizeof( *pc ), h_high );
+		VectorCopy( entry->bounds[0], pc->bounds[0] );
+		VectorCopy( entry->bounds[1], pc->bounds[1] );
+
+		pc->numPlanes = entry->numPlanes;
+		pc->planes = (patchPlane_t *)Hunk_Alloc( pc->numPlanes * sizeof( *pc->planes ), h_high );
+		Com_Memcpy( pc->planes, data, pc->numPlanes * sizeof( *pc->planes ) );
+		data += pc->numPlanes * sizeof( *pc->planes );
+
+		pc->numFacets = entry->numFacets;
+		pc->facets = (facet_t *)Hunk_Alloc( pc->numFacets * sizeof( *pc->facets ), h_high );
+		Com_Memcpy( pc->facets, data, pc->numFacets * sizeof( *pc->facets ) );
+		data += pc->numFacets * sizeof( *pc->facets );
+
+		pc->numNodes = entry->numNodes;
+		pc->nodes = (patchNode_t *)Hunk_Alloc( pc->numNodes * sizeof( *pc->nodes ), h_high );
+		Com_Memcpy( pc->nodes, data, pc->numNodes * sizeof( *pc->nodes ) );
+		data += pc->numNodes * sizeof( *pc->nodes );
+
+		patches[entry->surface] = pc;
+	}
+
+	Z_Free( buffer );
+
+	Com_DPrintf( "Loaded %i patches from %s.\n", numPatches, filename );
+
+	return patches;
+}
+
+/*
+================
+CM_WritePatchCache
+
+Writes the patch collision of the map that was just loaded
+================
+*/
+void CM_WritePatchCache( const char *name, int checksum ) {
+	char				filename[MAX_QPATH];
+	patchCacheHeader_t	*header;
+	patchCacheEntry_t	*entry;
+	const patchCollide_t	*pc;
+	byte				*buffer, *data;
+	fileHandle_t		f;
+	int					size;
+	int					numPatches;
+	int					i;
+
+	if ( !cm_patchCache->integer ) {
+		return;
+	}
+
+	size = sizeof( *header );
+	numPatches = 0;
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( !cm.surfaces[i] ) {
+			continue;
+		}
+		pc = cm.surfaces[i]->pc;
+		size += CM_CachedPatchSize( pc->numPlanes, pc->numFacets, pc->numNodes );
+		numPatches++;
+	}
+
+	buffer = (byte *)Z_Malloc( size, TAG_GENERAL, qtrue );
+
+	header = (patchCacheHeader_t *)buffer;
+	memcpy( header->magic, CM_CACHE_MAGIC, sizeof( header->magic ) );
+	header->version = LittleLong( CM_CACHE_VERSION );
+	Q_strncpyz( header->engineVersion, JK2MV_VERSION, sizeof( header->engineVersion ) );
+	header->checksum = LittleLong( checksum );
+	header->numPatches = LittleLong( numPatches );
+	header->planeSize = LittleLong( (int)sizeof( patchPlane_t ) );
+	header->facetSize = LittleLong( (int)sizeof( facet_t ) );
+	header->nodeSize = LittleLong( (int)sizeof( patchNode_t ) );
+
+	data = (byte *)( header + 1 );
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( !cm.surfaces[i] ) {
+			continue;
+		}
+		pc = cm.surfaces[i]->pc;
+
+		entry = (patchCacheEntry_t *)data;
+		entry->surface = i;
+		VectorCopy( pc->bounds[0], entry->bounds[0] );
+		VectorCopy( pc->bounds[1], entry->bounds[1] );
+		entry->numPlanes = pc->numPlanes;
+		entry->numFacets = pc->numFacets;
+		entry->numNodes = pc->numNodes;
+		data = (byte *)( entry + 1 );
+
+		Com_Memcpy( data, pc->planes, pc->numPlanes * sizeof( *pc->planes ) );
+		data += pc->numPlanes * sizeof( *pc->planes );
+		Com_Memcpy( data, pc->facets, pc->numFacets * sizeof( *pc->facets ) );
+		data += pc->numFacets * sizeof( *pc->facets );
+		Com_Memcpy( data, pc->nodes, pc->numNodes * sizeof( *pc->nodes ) );
+		data += pc->numNodes * sizeof( *pc->nodes );
+	}
+
+	CM_SwapPatchCache( header + 1, size - sizeof( *header ) );
+
+	CM_PatchCacheName( name, filename, sizeof( filename ) );
+	f = FS_SV_FOpenFileWrite( filename );
+	if ( f ) {
+		FS_Write( buffer, size, f );
+		FS_FCloseFile( f );
+	}
+	Z_Free( buffer );
+
+	if ( !f ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write %s\n", filename );
+		return;
+	}
+
+	Com_DPrintf( "Wrote %i patches to %s.\n", numPatches, filename );
+}
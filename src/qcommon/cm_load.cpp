@@ -20,32 +20,30 @@ void SetPlaneSignbits (cplane_t *out) {
 }
 #endif //BSPC
 
-// to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
-#define	BOX_BRUSHES		1
-#define	BOX_SIDES		6
-#define	BOX_LEAFS		2
-#define	BOX_PLANES		12
-
 #define	LL(x) x=LittleLong(x)
 
 
 clipMap_t	cm;
-int			c_pointcontents;
-int			c_traces, c_brush_traces, c_patch_traces;
+std::atomic<int>	c_pointcontents;
+std::atomic<int>	c_traces, c_brush_traces, c_patch_traces;
+std::atomic<int>	c_simdMismatches;
 
 
 byte		*cmod_base;
+static void	*cmod_mappedImage;		// the BSP file mapping lumps are used from in place
+static int	cmod_mappedLen;
 
 #ifndef BSPC
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_tightPlaneOffsets;
+cvar_t		*cm_patchCache;
+cvar_t		*cm_mmap;
+cvar_t		*cm_simdCheck;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
+thread_local cmBoxHull_t	box;
 
 
 
@@ -215,6 +213,10 @@ void CMod_LoadBrushes( lump_t *l ) {
 	dbrush_t	*in;
 	cbrush_t	*out;
 	int			i, count;
+#ifdef CM_SIMD
+	cbrushPlanes_t	*planes;
+	int			numBlocks;
+#endif
 
 	in = (dbrush_t *)(cmod_base + l->fileofs);
 	if (l->filelen % sizeof(*in)) {
@@ -240,6 +242,51 @@ void CMod_LoadBrushes( lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+#ifdef CM_SIMD
+	numBlocks = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		numBlocks += ( cm.brushes[i].numsides + 3 ) / 4;
+	}
+
+	planes = (cbrushPlanes_t *)Hunk_Alloc( numBlocks * sizeof( *planes ), h_high );
+
+	for ( i = 0 ; i < count ; i++ ) {
+		cm.brushes[i].planes = planes;
+		planes += ( cm.brushes[i].numsides + 3 ) / 4;
+		CM_SetBrushPlanes( &cm.brushes[i] );
+	}
+#endif
+}
+
+/*
+=================
+CM_SetBrushPlanes
+
+Copies the planes of the brush sides into brush->planes
+=================
+*/
+void CM_SetBrushPlanes( cbrush_t *brush ) {
+	cbrushPlanes_t	*block;
+	cplane_t		*plane;
+	int				i, lane;
+
+	for ( i = 0 ; i < ( brush->numsides + 3 ) / 4 * 4 ; i++ ) {
+		block = &brush->planes[i >> 2];
+		lane = i & 3;
+
+		if ( i < brush->numsides ) {
+			plane = brush->sides[i].plane;
+			block->normal[0][lane] = plane->normal[0];
+			block->normal[1][lane] = plane->normal[1];
+			block->normal[2][lane] = plane->normal[2];
+			block->dist[lane] = plane->dist;
+		} else {
+			block->normal[0][lane] = 0;
+			block->normal[1][lane] = 0;
+			block->normal[2][lane] = 0;
+			block->dist[lane] = BRUSH_PLANE_PADDING;
+		}
+	}
 }
 
 /*
@@ -370,6 +417,15 @@ void CMod_LoadLeafSurfaces( lump_t *l )
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 	count = l->filelen / sizeof(*in);
 
+#if !idppc
+	// the indexes are already in the right byte order, use them where they are
+	if ( cmod_mappedImage && !( (intptr_t)in & 3 ) ) {
+		cm.leafsurfaces = in;
+		cm.numLeafSurfaces = count;
+		return;
+	}
+#endif
+
 	cm.leafsurfaces = (int *)Hunk_Alloc( count * sizeof( *cm.leafsurfaces ), h_high );
 	cm.numLeafSurfaces = count;
 
@@ -424,6 +480,12 @@ CMod_LoadEntityString
 =================
 */
 void CMod_LoadEntityString( lump_t *l ) {
+	if ( cmod_mappedImage && l->filelen && !cmod_base[l->fileofs + l->filelen - 1] ) {
+		cm.entityString = (char *)cmod_base + l->fileofs;
+		cm.numEntityChars = l->filelen;
+		return;
+	}
+
 	cm.entityString = (char *)Hunk_Alloc( l->filelen, h_high );
 	cm.numEntityChars = l->filelen;
 	Com_Memcpy (cm.entityString, cmod_base + l->fileofs, l->filelen);
@@ -449,9 +511,13 @@ void CMod_LoadVisibility( lump_t *l ) {
 	buf = cmod_base + l->fileofs;
 
 	cm.vised = qtrue;
-	cm.visibility = (unsigned char *)Hunk_Alloc( len, h_high );
 	cm.numClusters = LittleLong( ((int *)buf)[0] );
 	cm.clusterBytes = LittleLong( ((int *)buf)[1] );
+	if ( cmod_mappedImage ) {
+		cm.visibility = buf + VIS_HEADER;
+		return;
+	}
+	cm.visibility = (unsigned char *)Hunk_Alloc( len, h_high );
 	Com_Memcpy (cm.visibility, buf + VIS_HEADER, len - VIS_HEADER );
 }
 
@@ -464,7 +530,7 @@ CMod_LoadPatches
 =================
 */
 #define	MAX_PATCH_VERTS		1024
-void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
+void CMod_LoadPatches( lump_t *surfs, lump_t *verts, const char *name, int checksum ) {
 	drawVert_t	*dv, *dv_p;
 	dsurface_t	*in;
 	int			count;
@@ -474,6 +540,7 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	vec3_t		points[MAX_PATCH_VERTS];
 	int			width, height;
 	int			shaderNum;
+	struct patchCollide_s	**cached;
 
 	in = (dsurface_t *)(cmod_base + surfs->fileofs);
 	if (surfs->filelen % sizeof(*in))
@@ -485,6 +552,12 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	if (verts->filelen % sizeof(*dv))
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 
+#ifndef BSPC
+	cached = CM_LoadPatchCache( name, checksum, in, count );
+#else
+	cached = NULL;
+#endif
+
 	// scan through all the surfaces, but only load patches,
 	// not planar faces
 	for ( i = 0 ; i < count ; i++, in++ ) {
@@ -495,6 +568,15 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 
 		cm.surfaces[ i ] = patch = (cPatch_t *)Hunk_Alloc( sizeof( *patch ), h_high );
 
+		shaderNum = LittleLong( in->shaderNum );
+		patch->contents = cm.shaders[shaderNum].contentFlags;
+		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
+
+		if ( cached ) {
+			patch->pc = cached[i];
+			continue;
+		}
+
 		// load the full drawverts onto the stack
 		width = LittleLong( in->patchWidth );
 		height = LittleLong( in->patchHeight );
@@ -510,13 +592,17 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 			points[j][2] = LittleFloat( dv_p->xyz[2] );
 		}
 
-		shaderNum = LittleLong( in->shaderNum );
-		patch->contents = cm.shaders[shaderNum].contentFlags;
-		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
-
 		// create the internal facet structure
 		patch->pc = CM_GeneratePatchCollide( width, height, points );
 	}
+
+#ifndef BSPC
+	if ( cached ) {
+		Z_Free( cached );
+	} else {
+		CM_WritePatchCache( name, checksum );
+	}
+#endif
 }
 
 //==================================================================
@@ -553,6 +639,22 @@ void *gpvCachedMapDiskImage = NULL;
 char  gsCachedMapDiskImage[MAX_QPATH];
 qboolean gbUsingCachedMapDataRightNow = qfalse;	// if true, signifies that you can't delete this at the moment!! (used during z_malloc()-fail recovery attempt)
 
+/*
+==================
+CM_FreeCachedMapDiskImage
+
+The disk image is either a Z_Malloc'd copy or the file mapping the
+collision model uses in place, which stays until CM_ClearMap
+==================
+*/
+void CM_FreeCachedMapDiskImage( void )
+{
+	if ( gpvCachedMapDiskImage != cmod_mappedImage ) {
+		Z_Free( gpvCachedMapDiskImage );
+	}
+	gpvCachedMapDiskImage = NULL;
+}
+
 // called in response to a "devmapbsp blah" or "devmapall blah" command, do NOT use inside CM_Load unless you pass in qtrue
 //
 // new bool return used to see if anything was freed, used during z_malloc failure re-try
@@ -567,10 +669,10 @@ qboolean CM_DeleteCachedMap(qboolean bGuaranteedOkToDelete)
 		//
 		if (gpvCachedMapDiskImage)
 		{
-			Z_Free(	gpvCachedMapDiskImage );
-					gpvCachedMapDiskImage = NULL;
+			// a file mapping holds no memory of its own
+			bActuallyFreedSomething = (qboolean)(gpvCachedMapDiskImage != cmod_mappedImage);
 
-			bActuallyFreedSomething = qtrue;
+			CM_FreeCachedMapDiskImage();
 		}
 		gsCachedMapDiskImage[0] = '\0';
 
@@ -600,6 +702,10 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
+	cm_tightPlaneOffsets = Cvar_Get ("cm_tightPlaneOffsets", "0", CVAR_ARCHIVE );
+	cm_patchCache = Cvar_Get ("cm_patchCache", "0", CVAR_ARCHIVE );
+	cm_mmap = Cvar_Get ("cm_mmap", "1", CVAR_ARCHIVE );
+	cm_simdCheck = Cvar_Get ("cm_simdCheck", "0", CVAR_CHEAT );
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -625,8 +731,7 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 	//
 	if (gpvCachedMapDiskImage)	// MP code: this'll only be NZ if we got an ERR_DROP during last map load,
 	{							//	so it's really just a safety measure.
-		Z_Free(	gpvCachedMapDiskImage);
-				gpvCachedMapDiskImage = NULL;
+		CM_FreeCachedMapDiskImage();
 	}
 
 #ifndef BSPC
@@ -635,19 +740,34 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 	//	then keep it long enough to save the renderer re-loading it (if not dedicated server),
 	//	then discard it after that...
 	//
+	// loose files and uncompressed pk3 entries are mapped instead, which
+	//	lets the lumps that need no conversion stay where they are
+	//
 	buf = NULL;
-	fileHandle_t h;
-	const int iBSPLen = FS_FOpenFileRead( name, &h, qfalse );
-	if (h)
-	{
-		gpvCachedMapDiskImage = Z_Malloc( iBSPLen, TAG_BSP_DISKIMAGE );
-		FS_Read( gpvCachedMapDiskImage, iBSPLen, h);
-		FS_FCloseFile( h );
+	int iBSPLen = 0;
+	if ( cm_mmap->integer ) {
+		cmod_mappedImage = FS_MapFile( name, &cmod_mappedLen );
+		if ( cmod_mappedImage ) {
+			iBSPLen = cmod_mappedLen;
+			gpvCachedMapDiskImage = cmod_mappedImage;
+			buf = (int*) gpvCachedMapDiskImage;
+		}
+	}
 
-		buf = (int*) gpvCachedMapDiskImage;	// so the rest of the code works as normal
+	if ( !buf ) {
+		fileHandle_t h;
+		iBSPLen = FS_FOpenFileRead( name, &h, qfalse );
+		if (h)
+		{
+			gpvCachedMapDiskImage = Z_Malloc( iBSPLen, TAG_BSP_DISKIMAGE );
+			FS_Read( gpvCachedMapDiskImage, iBSPLen, h);
+			FS_FCloseFile( h );
 
-		// carry on as before...
-		//
+			buf = (int*) gpvCachedMapDiskImage;	// so the rest of the code works as normal
+
+			// carry on as before...
+			//
+		}
 	}
 #else
 	const int iBSPLen = LoadQuakeFile((quakefile_t *) name, (void **)&buf);
@@ -666,8 +786,7 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 	}
 
 	if ( header.version != BSP_VERSION ) {
-		Z_Free(	gpvCachedMapDiskImage);
-				gpvCachedMapDiskImage = NULL;
+		CM_FreeCachedMapDiskImage();
 
 		Com_Error (ERR_DROP, "CM_LoadMap: %s has wrong version number (%i should be %i)"
 		, name, header.version, BSP_VERSION );
@@ -687,7 +806,7 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], name, last_checksum );
 
 	CM_InitBoxHull ();
 
@@ -720,6 +839,16 @@ CM_ClearMap
 */
 void CM_ClearMap( void )
 {
+#ifndef BSPC
+	if ( cmod_mappedImage ) {
+		if ( gpvCachedMapDiskImage == cmod_mappedImage ) {
+			gpvCachedMapDiskImage = NULL;
+		}
+		FS_UnmapFile( cmod_mappedImage, cmod_mappedLen );
+		cmod_mappedImage = NULL;
+	}
+#endif
+
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
 }
@@ -737,7 +866,7 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle ) {
 		return &cm.cmodels[handle];
 	}
 	if ( handle == BOX_MODEL_HANDLE ) {
-		return &box_model;
+		return &box.model;
 	}
 	if ( handle < MAX_SUBMODELS ) {
 		Com_Error( ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i",
@@ -796,44 +925,51 @@ CM_InitBoxHull
 
 Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
+
+The map only reserves the leaf brush pointing at the box brush, the
+brush itself is set up once per thread on first use.
 ===================
 */
 void CM_InitBoxHull (void)
 {
+	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+}
+
+/*
+===================
+CM_InitThreadBoxHull
+===================
+*/
+static void CM_InitThreadBoxHull( void ) {
 	int			i;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
 
-	box_planes = &cm.planes[cm.numPlanes];
+	box.brush.numsides = 6;
+	box.brush.sides = box.sides;
+	box.brush.planes = box.brushPlanes;
+	box.brush.contents = CONTENTS_BODY;
 
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
-
-	box_model.leaf.numLeafBrushes = 1;
-//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+	box.model.leaf.numLeafBrushes = 1;
 
 	for (i=0 ; i<6 ; i++)
 	{
 		side = i&1;
 
 		// brush sides
-		s = &cm.brushsides[cm.numBrushSides+i];
-		s->plane =	cm.planes + (cm.numPlanes+i*2+side);
+		s = &box.sides[i];
+		s->plane = &box.planes[i*2+side];
 		s->surfaceFlags = 0;
 
 		// planes
-		p = &box_planes[i*2];
+		p = &box.planes[i*2];
 		p->type = i>>1;
 		p->signbits = 0;
 		VectorClear (p->normal);
 		p->normal[i>>1] = 1;
 
-		p = &box_planes[i*2+1];
+		p = &box.planes[i*2+1];
 		p->type = 3 + (i>>1);
 		p->signbits = 0;
 		VectorClear (p->normal);
@@ -854,28 +990,38 @@ Capsules are handled differently though.
 */
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
 
-	VectorCopy( mins, box_model.mins );
-	VectorCopy( maxs, box_model.maxs );
+	if ( !box.brush.sides ) {
+		CM_InitThreadBoxHull();
+	}
+
+	VectorCopy( mins, box.model.mins );
+	VectorCopy( maxs, box.model.maxs );
 
 	if ( capsule ) {
 		return CAPSULE_MODEL_HANDLE;
 	}
 
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = -maxs[0];
-	box_planes[2].dist = mins[0];
-	box_planes[3].dist = -mins[0];
-	box_planes[4].dist = maxs[1];
-	box_planes[5].dist = -maxs[1];
-	box_planes[6].dist = mins[1];
-	box_planes[7].dist = -mins[1];
-	box_planes[8].dist = maxs[2];
-	box_planes[9].dist = -maxs[2];
-	box_planes[10].dist = mins[2];
-	box_planes[11].dist = -mins[2];
-
-	VectorCopy( mins, box_brush->bounds[0] );
-	VectorCopy( maxs, box_brush->bounds[1] );
+	box.model.leaf.firstLeafBrush = cm.numLeafBrushes;
+
+	box.planes[0].dist = maxs[0];
+	box.planes[1].dist = -maxs[0];
+	box.planes[2].dist = mins[0];
+	box.planes[3].dist = -mins[0];
+	box.planes[4].dist = maxs[1];
+	box.planes[5].dist = -maxs[1];
+	box.planes[6].dist = mins[1];
+	box.planes[7].dist = -mins[1];
+	box.planes[8].dist = maxs[2];
+	box.planes[9].dist = -maxs[2];
+	box.planes[10].dist = mins[2];
+	box.planes[11].dist = -mins[2];
+
+	VectorCopy( mins, box.brush.bounds[0] );
+	VectorCopy( maxs, box.brush.bounds[1] );
+
+#ifdef CM_SIMD
+	CM_SetBrushPlanes( &box.brush );
+#endif
 
 	return BOX_MODEL_HANDLE;
 }
@@ -3,6 +3,8 @@
 #include "qcommon.h"
 #include "cm_polylib.h"
 
+#include <atomic>
+
 #define	MAX_SUBMODELS			256
 #define	BOX_MODEL_HANDLE		255
 #define CAPSULE_MODEL_HANDLE	254
@@ -37,13 +39,33 @@ typedef struct {
 	int			damage;
 } cbrushside_t;
 
+// brush planes are also kept four at a time side by side for the SIMD
+// clipping in CM_TraceThroughBrush and CM_TestBoxInBrush
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define CM_SIMD_SSE2
+#elif defined( __aarch64__ ) && defined( __ARM_NEON )
+#define CM_SIMD_NEON
+#endif
+
+#if defined( CM_SIMD_SSE2 ) || defined( CM_SIMD_NEON )
+#define CM_SIMD
+#endif
+
+typedef struct {
+	float		normal[3][4];	// x, y and z of the four normals
+	float		dist[4];
+} cbrushPlanes_t;
+
+// padding lanes are this far in front of everything, never clipping
+#define BRUSH_PLANE_PADDING		1e30f
+
 typedef struct {
 	int			shaderNum;		// the shader that determined the contents
 	int			contents;
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
+	cbrushPlanes_t	*planes;	// ( numsides + 3 ) / 4 blocks, only with CM_SIMD
 } cbrush_t;
 
 class CCMShader
@@ -69,7 +91,6 @@ class CCMShader	*mNext;
 };
 
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -127,20 +148,51 @@ typedef struct {
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
 } clipMap_t;
 
+// to allow boxes to be treated as brush models, we allocate
+// some extra indexes along with those needed by the map
+#define	BOX_BRUSHES		1
+#define	BOX_SIDES		6
+#define	BOX_LEAFS		2
+#define	BOX_PLANES		12
+
+// the brush CM_TempBoxModel fills in, every thread has its own so
+// they can trace against different boxes at the same time
+typedef struct {
+	cmodel_t		model;
+	cplane_t		planes[BOX_PLANES];
+	cbrushside_t	sides[BOX_SIDES];
+	cbrushPlanes_t	brushPlanes[( BOX_SIDES + 3 ) / 4];
+	cbrush_t		brush;
+} cmBoxHull_t;
+
+// stamps to test a brush or patch touched by several leafs only once
+// per query, kept per thread instead of in the shared brushes
+typedef struct {
+	int			count;			// stamp of the current query
+	int			numBrushes;
+	int			*brushes;		// stamp of the last query that tested each brush
+	int			numPatches;
+	int			*patches;		// same for cm.surfaces
+} cmCheck_t;
+
 
 // keep 1/8 unit away to keep the position valid before network snapping
 // and to avoid various numeric issues
 #define	SURFACE_CLIP_EPSILON	(0.125)
 
 extern	clipMap_t	cm;
-extern	int			c_pointcontents;
-extern	int			c_traces, c_brush_traces, c_patch_traces;
+extern	thread_local cmBoxHull_t	box;
+extern	std::atomic<int>	c_pointcontents;
+extern	std::atomic<int>	c_traces, c_brush_traces, c_patch_traces;
+extern	std::atomic<int>	c_simdMismatches;
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
+extern	cvar_t		*cm_tightPlaneOffsets;
+extern	cvar_t		*cm_patchCache;
+extern	cvar_t		*cm_simdCheck;
 
 // cm_test.c
 
@@ -166,6 +218,9 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	cmCheck_t	*check;		// multi-check avoidance
+	int			brushTraces;	// for statistics
+	int			patchTraces;
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -175,9 +230,24 @@ typedef struct leafList_s {
 	int		*list;
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
+	cmCheck_t	*check;		// only used by CM_StoreBrushes
 	void	(*storeLeafs)( struct leafList_s *ll, int nodenum );
 } leafList_t;
 
+/*
+==================
+CM_LeafBrush
+
+The box hull brush is numbered right after the map's own brushes
+==================
+*/
+static ID_INLINE cbrush_t *CM_LeafBrush( int brushnum ) {
+	if ( brushnum == cm.numBrushes ) {
+		return &box.brush;
+	}
+	return &cm.brushes[brushnum];
+}
+
 
 int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int listsize );
 
@@ -187,6 +257,24 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum );
 void CM_BoxLeafnums_r( leafList_t *ll, int nodenum );
 
 cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle );
+void		CM_SetBrushPlanes( cbrush_t *brush );
+
+// cm_trace.c
+
+cmCheck_t	*CM_BeginCheck( void );
+
+// cm_cache.c
+
+struct patchCollide_s	**CM_LoadPatchCache( const char *name, int checksum, const dsurface_t *surfaces, int numSurfaces );
+void		CM_WritePatchCache( const char *name, int checksum );
+
+// cm_bench.c
+
+extern std::atomic<bool>	cm_benchRecording;
+
+void CM_BenchRecordTrace( const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
+						 clipHandle_t model, int brushmask, const vec3_t origin, const vec3_t angles, int capsule );
+void CM_BenchRecordContents( const vec3_t p, clipHandle_t model );
 
 // cm_patch.c
 
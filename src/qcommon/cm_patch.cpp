@@ -88,11 +88,16 @@ int	c_totalPatchBlocks;
 int	c_totalPatchSurfaces;
 int	c_totalPatchEdges;
 
-static const patchCollide_t	*debugPatchCollide;
-static const facet_t		*debugFacet;
+// traces on any thread may set these
+static std::atomic<const patchCollide_t *>	debugPatchCollide;
+static std::atomic<const facet_t *>			debugFacet;
 static qboolean		debugBlock;
 static vec3_t		debugBlockPoints[4];
 
+#ifndef BSPC
+static cvar_t		*cm_debugSurfaceUpdate;
+#endif //BSPC
+
 /*
 =================
 CM_ClearLevelPatches
@@ -101,6 +106,11 @@ CM_ClearLevelPatches
 void CM_ClearLevelPatches( void ) {
 	debugPatchCollide = NULL;
 	debugFacet = NULL;
+
+#ifndef BSPC
+	// registered here rather than on first hit, traces may run on other threads
+	cm_debugSurfaceUpdate = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+#endif //BSPC
 }
 
 /*
@@ -425,6 +435,10 @@ static	patchPlane_t	planes[MAX_PATCH_PLANES];
 
 static	int				numFacets;
 static	facet_t			facets[MAX_PATCH_PLANES]; //maybe MAX_FACETS ??
+static	vec3_t			facetBounds[MAX_PATCH_PLANES][2];
+
+static	int				numNodes;
+static	patchNode_t		nodes[MAX_PATCH_NODES];
 
 #define	NORMAL_EPSILON	0.0001
 #define	DIST_EPSILON	0.02
@@ -951,6 +965,91 @@ void CM_AddFacetBevels( facet_t *facet ) {
 
 }
 
+/*
+==================
+CM_SetFacetBounds
+
+Bounds the region a facet can collide with, which is the part of the
+surface plane inside its borders.  The axial bevels keep any trace
+against the facet within these bounds.
+==================
+*/
+static void CM_SetFacetBounds( facet_t *facet, vec3_t bounds[2] ) {
+	float		plane[4];
+	int			j;
+	winding_t	*w;
+
+	Vector4Copy( planes[ facet->surfacePlane ].plane, plane );
+	w = BaseWindingForPlane( plane,  plane[3] );
+	for ( j = 0 ; j < facet->numBorders && w ; j++ ) {
+		if ( facet->borderPlanes[j] == facet->surfacePlane ) continue;
+		Vector4Copy( planes[ facet->borderPlanes[j] ].plane, plane );
+
+		if ( !facet->borderInward[j] ) {
+			VectorSubtract( vec3_origin, plane, plane );
+			plane[3] = -plane[3];
+		}
+
+		ChopWindingInPlace( &w, plane, plane[3], 0.1f );
+	}
+
+	if ( !w ) {
+		// no bevels were added either, so never cull this facet
+		VectorSet( bounds[0], -MAX_MAP_BOUNDS, -MAX_MAP_BOUNDS, -MAX_MAP_BOUNDS );
+		VectorSet( bounds[1], MAX_MAP_BOUNDS, MAX_MAP_BOUNDS, MAX_MAP_BOUNDS );
+		return;
+	}
+
+	WindingBounds( w, bounds[0], bounds[1] );
+	FreeWinding( w );
+
+	// expand by one unit for epsilon purposes
+	for ( j = 0 ; j < 3 ; j++ ) {
+		bounds[0][j] -= 1;
+		bounds[1][j] += 1;
+	}
+}
+
+/*
+==================
+CM_BuildPatchNodes
+
+Splits a range of facets in half until each leaf holds at most
+MAX_PATCH_NODE_FACETS.  Grid order keeps neighbouring facets together,
+and visiting the leaves in order tests the facets in their original order.
+==================
+*/
+static void CM_BuildPatchNodes( int firstFacet, int count ) {
+	patchNode_t	*node, *child;
+	int			i, half;
+
+	node = &nodes[numNodes++];
+	node->firstFacet = firstFacet;
+	node->numFacets = count;
+	ClearBounds( node->bounds[0], node->bounds[1] );
+
+	if ( count <= MAX_PATCH_NODE_FACETS ) {
+		for ( i = firstFacet ; i < firstFacet + count ; i++ ) {
+			AddPointToBounds( facetBounds[i][0], node->bounds[0], node->bounds[1] );
+			AddPointToBounds( facetBounds[i][1], node->bounds[0], node->bounds[1] );
+		}
+	} else {
+		half = count / 2;
+
+		child = &nodes[numNodes];
+		CM_BuildPatchNodes( firstFacet, half );
+		AddPointToBounds( child->bounds[0], node->bounds[0], node->bounds[1] );
+		AddPointToBounds( child->bounds[1], node->bounds[0], node->bounds[1] );
+
+		child = &nodes[numNodes];
+		CM_BuildPatchNodes( firstFacet + half, count - half );
+		AddPointToBounds( child->bounds[0], node->bounds[0], node->bounds[1] );
+		AddPointToBounds( child->bounds[1], node->bounds[0], node->bounds[1] );
+	}
+
+	node->skipNode = numNodes;
+}
+
 typedef enum {
 	EN_TOP,
 	EN_RIGHT,
@@ -1060,6 +1159,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 				CM_SetBorderInward( facet, grid, gridPlanes, i, j, -1 );
 				if ( CM_ValidateFacet( facet ) ) {
 					CM_AddFacetBevels( facet );
+					CM_SetFacetBounds( facet, facetBounds[numFacets] );
 					numFacets++;
 				}
 			} else {
@@ -1080,6 +1180,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
  				CM_SetBorderInward( facet, grid, gridPlanes, i, j, 0 );
 				if ( CM_ValidateFacet( facet ) ) {
 					CM_AddFacetBevels( facet );
+					CM_SetFacetBounds( facet, facetBounds[numFacets] );
 					numFacets++;
 				}
 
@@ -1105,6 +1206,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 				CM_SetBorderInward( facet, grid, gridPlanes, i, j, 1 );
 				if ( CM_ValidateFacet( facet ) ) {
 					CM_AddFacetBevels( facet );
+					CM_SetFacetBounds( facet, facetBounds[numFacets] );
 					numFacets++;
 				}
 			}
@@ -1118,6 +1220,14 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 	Com_Memcpy( pf->facets, facets, numFacets * sizeof( *pf->facets ) );
 	pf->planes = (patchPlane_t *)Hunk_Alloc( numPlanes * sizeof( *pf->planes ), h_high );
 	Com_Memcpy( pf->planes, planes, numPlanes * sizeof( *pf->planes ) );
+
+	numNodes = 0;
+	if ( numFacets ) {
+		CM_BuildPatchNodes( 0, numFacets );
+	}
+	pf->numNodes = numNodes;
+	pf->nodes = (patchNode_t *)Hunk_Alloc( numNodes * sizeof( *pf->nodes ), h_high );
+	Com_Memcpy( pf->nodes, nodes, numNodes * sizeof( *pf->nodes ) );
 }
 
 
@@ -1308,102 +1418,144 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 
 /*
 ====================
-CM_TracePointThroughPatchCollide
+CM_TraceOverlapsPatchNode
+====================
+*/
+static ID_INLINE qboolean CM_TraceOverlapsPatchNode( const traceWork_t *tw, const patchNode_t *node ) {
+	if ( tw->bounds[0][0] > node->bounds[1][0]
+		|| tw->bounds[0][1] > node->bounds[1][1]
+		|| tw->bounds[0][2] > node->bounds[1][2]
+		|| tw->bounds[1][0] < node->bounds[0][0]
+		|| tw->bounds[1][1] < node->bounds[0][1]
+		|| tw->bounds[1][2] < node->bounds[0][2]
+		) {
+		return qfalse;
+	}
+	return qtrue;
+}
 
-  special case for point traces because the patch collide "brushes" have no volume
+/*
+====================
+CM_PointTracePlane
+
+Returns where a point trace crosses the plane, or 99999 if it doesn't
 ====================
 */
-void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
-	qboolean	frontFacing[MAX_PATCH_PLANES];
-	float		intersection[MAX_PATCH_PLANES];
-	float		intersect;
-	const patchPlane_t	*planes;
-	const facet_t	*facet;
-	int			i, j, k;
+static float CM_PointTracePlane( const traceWork_t *tw, const patchPlane_t *planes, qboolean *frontFacing ) {
 	float		offset;
 	float		d1, d2;
-#ifndef BSPC
-	static cvar_t *cv;
-#endif //BSPC
+	float		intersection;
 
-#ifndef BSPC
-	if ( !cm_playerCurveClip->integer && !tw->isPoint ) {
-		return;		// FIXME: until I get player sized clipping working right
+	offset = DotProduct( tw->offsets[ planes->signbits ], planes->plane );
+	d1 = DotProduct( tw->start, planes->plane ) - planes->plane[3] + offset;
+	d2 = DotProduct( tw->end, planes->plane ) - planes->plane[3] + offset;
+	if ( d1 <= 0 ) {
+		*frontFacing = qfalse;
+	} else {
+		*frontFacing = qtrue;
 	}
-#endif
+	if ( d1 == d2 ) {
+		return 99999;
+	}
+	intersection = d1 / ( d1 - d2 );
+	if ( intersection <= 0 ) {
+		return 99999;
+	}
+	return intersection;
+}
 
-	// determine the trace's relationship to all planes
-	planes = pc->planes;
-	for ( i = 0 ; i < pc->numPlanes ; i++, planes++ ) {
-		offset = DotProduct( tw->offsets[ planes->signbits ], planes->plane );
-		d1 = DotProduct( tw->start, planes->plane ) - planes->plane[3] + offset;
-		d2 = DotProduct( tw->end, planes->plane ) - planes->plane[3] + offset;
-		if ( d1 <= 0 ) {
-			frontFacing[i] = qfalse;
-		} else {
-			frontFacing[i] = qtrue;
-		}
-		if ( d1 == d2 ) {
-			intersection[i] = 99999;
+/*
+====================
+CM_TracePointThroughFacet
+====================
+*/
+static void CM_TracePointThroughFacet( traceWork_t *tw, const patchCollide_t *pc, const facet_t *facet ) {
+	const patchPlane_t	*planes;
+	qboolean	frontFacing;
+	float		intersect, intersection;
+	int			j;
+	float		offset;
+	float		d1, d2;
+
+	intersect = CM_PointTracePlane( tw, &pc->planes[facet->surfacePlane], &frontFacing );
+	if ( !frontFacing ) {
+		return;
+	}
+	if ( intersect < 0 ) {
+		return;		// surface is behind the starting point
+	}
+	if ( intersect > tw->trace.fraction ) {
+		return;		// already hit something closer
+	}
+	for ( j = 0 ; j < facet->numBorders ; j++ ) {
+		intersection = CM_PointTracePlane( tw, &pc->planes[facet->borderPlanes[j]], &frontFacing );
+		if ( frontFacing ^ facet->borderInward[j] ) {
+			if ( intersection > intersect ) {
+				return;
+			}
 		} else {
-			intersection[i] = d1 / ( d1 - d2 );
-			if ( intersection[i] <= 0 ) {
-				intersection[i] = 99999;
+			if ( intersection < intersect ) {
+				return;
 			}
 		}
 	}
 
-
-	// see if any of the surface planes are intersected
-	facet = pc->facets;
-	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
-		if ( !frontFacing[facet->surfacePlane] ) {
-			continue;
-		}
-		intersect = intersection[facet->surfacePlane];
-		if ( intersect < 0 ) {
-			continue;		// surface is behind the starting point
-		}
-		if ( intersect > tw->trace.fraction ) {
-			continue;		// already hit something closer
-		}
-		for ( j = 0 ; j < facet->numBorders ; j++ ) {
-			k = facet->borderPlanes[j];
-			if ( frontFacing[k] ^ facet->borderInward[j] ) {
-				if ( intersection[k] > intersect ) {
-					break;
-				}
-			} else {
-				if ( intersection[k] < intersect ) {
-					break;
-				}
-			}
-		}
-		if ( j == facet->numBorders ) {
-			// we hit this facet
+	// we hit this facet
 #ifndef BSPC
-			if (!cv) {
-				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-			}
-			if (cv->integer) {
-				debugPatchCollide = pc;
-				debugFacet = facet;
-			}
+	if (cm_debugSurfaceUpdate->integer) {
+		debugPatchCollide = pc;
+		debugFacet = facet;
+	}
 #endif //BSPC
-			planes = &pc->planes[facet->surfacePlane];
+	planes = &pc->planes[facet->surfacePlane];
 
-			// calculate intersection with a slight pushoff
-			offset = DotProduct( tw->offsets[ planes->signbits ], planes->plane );
-			d1 = DotProduct( tw->start, planes->plane ) - planes->plane[3] + offset;
-			d2 = DotProduct( tw->end, planes->plane ) - planes->plane[3] + offset;
-			tw->trace.fraction = ( d1 - SURFACE_CLIP_EPSILON ) / ( d1 - d2 );
+	// calculate intersection with a slight pushoff
+	offset = DotProduct( tw->offsets[ planes->signbits ], planes->plane );
+	d1 = DotProduct( tw->start, planes->plane ) - planes->plane[3] + offset;
+	d2 = DotProduct( tw->end, planes->plane ) - planes->plane[3] + offset;
+	tw->trace.fraction = ( d1 - SURFACE_CLIP_EPSILON ) / ( d1 - d2 );
 
-			if ( tw->trace.fraction < 0 ) {
-				tw->trace.fraction = 0;
-			}
+	if ( tw->trace.fraction < 0 ) {
+		tw->trace.fraction = 0;
+	}
 
-			VectorCopy( planes->plane,  tw->trace.plane.normal );
-			tw->trace.plane.dist = planes->plane[3];
+	VectorCopy( planes->plane,  tw->trace.plane.normal );
+	tw->trace.plane.dist = planes->plane[3];
+}
+
+/*
+====================
+CM_TracePointThroughPatchCollide
+
+  special case for point traces because the patch collide "brushes" have no volume
+====================
+*/
+void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
+	const patchNode_t	*node;
+	const facet_t	*facet;
+	int			i, n;
+
+#ifndef BSPC
+	if ( !cm_playerCurveClip->integer && !tw->isPoint ) {
+		return;		// FIXME: until I get player sized clipping working right
+	}
+#endif
+
+	// see if any of the surface planes are intersected, only looking
+	// at the planes of facets the trace comes near
+	for ( n = 0 ; n < pc->numNodes ; ) {
+		node = &pc->nodes[n];
+		if ( !CM_TraceOverlapsPatchNode( tw, node ) ) {
+			n = node->skipNode;
+			continue;
+		}
+		n++;
+		if ( node->numFacets > MAX_PATCH_NODE_FACETS ) {
+			continue;
+		}
+		facet = &pc->facets[node->firstFacet];
+		for ( i = 0 ; i < node->numFacets ; i++, facet++ ) {
+			CM_TracePointThroughFacet( tw, pc, facet );
 		}
 	}
 }
@@ -1457,39 +1609,64 @@ int CM_CheckFacetPlane(float *plane, vec3_t start, vec3_t end, float *enterFrac,
 
 /*
 ====================
-CM_TraceThroughPatchCollide
+CM_TraceThroughFacet
 ====================
 */
-void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc )
+static void CM_TraceThroughFacet( traceWork_t *tw, const patchCollide_t *pc, const facet_t *facet )
 {
-	int i, j, hit, hitnum;
+	int j, hit, hitnum;
 	float offset, enterFrac, leaveFrac, t;
-	patchPlane_t *planes;
-	facet_t	*facet;
+	const patchPlane_t *planes;
 	float plane[4], bestplane[4] = { 0 };
 	vec3_t startp, endp;
-#ifndef BSPC
-	static cvar_t *cv;
-#endif //BSPC
 
-	if (tw->isPoint) {
-		CM_TracePointThroughPatchCollide( tw, pc );
+	enterFrac = -1.0;
+	leaveFrac = 1.0;
+	hitnum = -1;
+	//
+	planes = &pc->planes[ facet->surfacePlane ];
+	VectorCopy(planes->plane, plane);
+	plane[3] = planes->plane[3];
+	if ( tw->sphere.use ) {
+		// adjust the plane distance apropriately for radius
+		plane[3] += tw->sphere.radius;
+
+		// find the closest point on the capsule to the plane
+		t = DotProduct( plane, tw->sphere.offset );
+		if ( t > 0 )
+		{
+			VectorSubtract( tw->start, tw->sphere.offset, startp );
+			VectorSubtract( tw->end, tw->sphere.offset, endp );
+		}
+		else
+		{
+			VectorAdd( tw->start, tw->sphere.offset, startp );
+			VectorAdd( tw->end, tw->sphere.offset, endp );
+		}
+	}
+	else {
+		offset = DotProduct( tw->offsets[ planes->signbits ], plane);
+		plane[3] -= offset;
+		VectorCopy( tw->start, startp );
+		VectorCopy( tw->end, endp );
+	}
+	//
+	if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit))
 		return;
+	if (hit) {
+		Vector4Copy(plane, bestplane);
 	}
-#ifndef ADDBEVELS
-	CM_TracePointThroughPatchCollide( tw, pc );
-	return;
-#endif
 	//
-	facet = pc->facets;
-	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
-		enterFrac = -1.0;
-		leaveFrac = 1.0;
-		hitnum = -1;
-		//
-		planes = &pc->planes[ facet->surfacePlane ];
-		VectorCopy(planes->plane, plane);
-		plane[3] = planes->plane[3];
+	for ( j = 0 ; j < facet->numBorders ; j++ ) {
+		planes = &pc->planes[ facet->borderPlanes[j] ];
+		if (facet->borderInward[j]) {
+			VectorNegate(planes->plane, plane);
+			plane[3] = -planes->plane[3];
+		}
+		else {
+			VectorCopy(planes->plane, plane);
+			plane[3] = planes->plane[3];
+		}
 		if ( tw->sphere.use ) {
 			// adjust the plane distance apropriately for radius
 			plane[3] += tw->sphere.radius;
@@ -1508,89 +1685,81 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 			}
 		}
 		else {
+			// NOTE: this works even though the plane might be flipped because the bbox is centered
 			offset = DotProduct( tw->offsets[ planes->signbits ], plane);
-			plane[3] -= offset;
+			plane[3] += fabs(offset);
 			VectorCopy( tw->start, startp );
 			VectorCopy( tw->end, endp );
 		}
 		//
 		if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit))
-			continue;
+			return;
 		if (hit) {
+			hitnum = j;
 			Vector4Copy(plane, bestplane);
 		}
-		//
-		for ( j = 0 ; j < facet->numBorders ; j++ ) {
-			planes = &pc->planes[ facet->borderPlanes[j] ];
-			if (facet->borderInward[j]) {
-				VectorNegate(planes->plane, plane);
-				plane[3] = -planes->plane[3];
-			}
-			else {
-				VectorCopy(planes->plane, plane);
-				plane[3] = planes->plane[3];
-			}
-			if ( tw->sphere.use ) {
-				// adjust the plane distance apropriately for radius
-				plane[3] += tw->sphere.radius;
-
-				// find the closest point on the capsule to the plane
-				t = DotProduct( plane, tw->sphere.offset );
-				if ( t > 0 )
-				{
-					VectorSubtract( tw->start, tw->sphere.offset, startp );
-					VectorSubtract( tw->end, tw->sphere.offset, endp );
-				}
-				else
-				{
-					VectorAdd( tw->start, tw->sphere.offset, startp );
-					VectorAdd( tw->end, tw->sphere.offset, endp );
-				}
-			}
-			else {
-				// NOTE: this works even though the plane might be flipped because the bbox is centered
-				offset = DotProduct( tw->offsets[ planes->signbits ], plane);
-				plane[3] += fabs(offset);
-				VectorCopy( tw->start, startp );
-				VectorCopy( tw->end, endp );
-			}
-			//
-			if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit))
-				break;
-			if (hit) {
-				hitnum = j;
-				Vector4Copy(plane, bestplane);
+	}
+	//never clip against the back side
+	if (hitnum == facet->numBorders - 1) return;
+	//
+	if (enterFrac < leaveFrac && enterFrac >= 0) {
+		if (enterFrac < tw->trace.fraction) {
+			if (enterFrac < 0) {
+				enterFrac = 0;
 			}
-		}
-		if (j < facet->numBorders) continue;
-		//never clip against the back side
-		if (hitnum == facet->numBorders - 1) continue;
-		//
-		if (enterFrac < leaveFrac && enterFrac >= 0) {
-			if (enterFrac < tw->trace.fraction) {
-				if (enterFrac < 0) {
-					enterFrac = 0;
-				}
 #ifndef BSPC
-				if (!cv) {
-					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-				}
-				if (cv && cv->integer) {
-					debugPatchCollide = pc;
-					debugFacet = facet;
-				}
+			if (cm_debugSurfaceUpdate->integer) {
+				debugPatchCollide = pc;
+				debugFacet = facet;
+			}
 #endif // BSPC
 
-				assert(bestplane[0] != 0.0f || bestplane[1] != 0.0f ||
-					   bestplane[2] != 0.0f || bestplane[3] != 0.0f);
-				tw->trace.fraction = enterFrac;
-				VectorCopy( bestplane, tw->trace.plane.normal );
-				tw->trace.plane.dist = bestplane[3];
-			}
+			assert(bestplane[0] != 0.0f || bestplane[1] != 0.0f ||
+				   bestplane[2] != 0.0f || bestplane[3] != 0.0f);
+			tw->trace.fraction = enterFrac;
+			VectorCopy( bestplane, tw->trace.plane.normal );
+			tw->trace.plane.dist = bestplane[3];
 		}
 	}
 }
 
+/*
+====================
+CM_TraceThroughPatchCollide
+====================
+*/
+void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc )
+{
+	const patchNode_t *node;
+	const facet_t *facet;
+	int i, n;
+
+	if (tw->isPoint) {
+		CM_TracePointThroughPatchCollide( tw, pc );
+		return;
+	}
+#ifndef ADDBEVELS
+	CM_TracePointThroughPatchCollide( tw, pc );
+	return;
+#endif
+	// only the facets whose bounds the swept box touches can be hit,
+	// and the leaves still visit them in their original order
+	for ( n = 0 ; n < pc->numNodes ; ) {
+		node = &pc->nodes[n];
+		if ( !CM_TraceOverlapsPatchNode( tw, node ) ) {
+			n = node->skipNode;
+			continue;
+		}
+		n++;
+		if ( node->numFacets > MAX_PATCH_NODE_FACETS ) {
+			continue;
+		}
+		facet = &pc->facets[node->firstFacet];
+		for ( i = 0 ; i < node->numFacets ; i++, facet++ ) {
+			CM_TraceThroughFacet( tw, pc, facet );
+		}
+	}
+}
 
 /*
 =======================================================================
@@ -1604,6 +1773,51 @@ POSITION DETECTION
 #define	BOX_BACK	1
 #define	BOX_CROSS	2
 
+/*
+====================
+CM_BoxPlaneCross
+====================
+*/
+static int CM_BoxPlaneCross( const traceWork_t *tw, const patchPlane_t *planes ) {
+	float		offset;
+	float		d;
+
+	d = DotProduct( tw->start, planes->plane ) - planes->plane[3];
+	offset = fabs( DotProduct( tw->offsets[ planes->signbits ], planes->plane ) );
+	if ( d < -offset ) {
+		return BOX_FRONT;
+	} else if ( d > offset ) {
+		return BOX_BACK;
+	}
+	return BOX_CROSS;
+}
+
+/*
+====================
+CM_PositionTestInFacet
+====================
+*/
+static qboolean CM_PositionTestInFacet( const traceWork_t *tw, const patchCollide_t *pc, const facet_t *facet ) {
+	int			j, cross;
+
+	// the facet plane must be in a cross state
+	if ( CM_BoxPlaneCross( tw, &pc->planes[facet->surfacePlane] ) != BOX_CROSS ) {
+		return qfalse;
+	}
+	// all of the boundaries must be either cross or back
+	for ( j = 0 ; j < facet->numBorders ; j++ ) {
+		cross = CM_BoxPlaneCross( tw, &pc->planes[facet->borderPlanes[j]] );
+		if ( cross == BOX_CROSS ) {
+			continue;
+		}
+		if ( cross ^ facet->borderInward[j] ) {
+			return qfalse;
+		}
+	}
+	// if we passed all borders, we are definately in this facet
+	return qtrue;
+}
+
 /*
 ====================
 CM_PositionTestInPatchCollide
@@ -1612,12 +1826,9 @@ Modifies tr->tr if any of the facets effect the trace
 ====================
 */
 qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
-	int			cross[MAX_PATCH_PLANES];
-	const patchPlane_t	*planes;
+	const patchNode_t	*node;
 	const facet_t	*facet;
-	int			i, j, k;
-	float		offset;
-	float		d;
+	int			i, n;
 
 //return qfalse;
 
@@ -1630,48 +1841,28 @@ qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchColli
 	}
 #endif
 
-	// determine if the box is in front, behind, or crossing each plane
-	planes = pc->planes;
-	for ( i = 0 ; i < pc->numPlanes ; i++, planes++ ) {
-		d = DotProduct( tw->start, planes->plane ) - planes->plane[3];
-		offset = fabs( DotProduct( tw->offsets[ planes->signbits ], planes->plane ) );
-		if ( d < -offset ) {
-			cross[i] = BOX_FRONT;
-		} else if ( d > offset ) {
-			cross[i] = BOX_BACK;
-		} else {
-			cross[i] = BOX_CROSS;
+	// see if the box is inside any of the facets it touches
+	for ( n = 0 ; n < pc->numNodes ; ) {
+		node = &pc->nodes[n];
+		if ( !CM_TraceOverlapsPatchNode( tw, node ) ) {
+			n = node->skipNode;
+			continue;
 		}
-	}
-
-
-	// see if any of the surface planes are intersected
-	facet = pc->facets;
-	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
-		// the facet plane must be in a cross state
-		if ( cross[facet->surfacePlane] != BOX_CROSS ) {
+		n++;
+		if ( node->numFacets > MAX_PATCH_NODE_FACETS ) {
 			continue;
 		}
-		// all of the boundaries must be either cross or back
-		for ( j = 0 ; j < facet->numBorders ; j++ ) {
-			k = facet->borderPlanes[j];
-			if ( cross[ k ] == BOX_CROSS ) {
-				continue;
+		facet = &pc->facets[node->firstFacet];
+		for ( i = 0 ; i < node->numFacets ; i++, facet++ ) {
+			if ( CM_PositionTestInFacet( tw, pc, facet ) ) {
+				return qtrue;
 			}
-			if ( cross[k] ^ facet->borderInward[j] ) {
-				break;
-			}
-		}
-		// if we passed all borders, we are definately in this facet
-		if ( j == facet->numBorders ) {
-			return qtrue;
 		}
 	}
 
 	return qfalse;
 }
 
-
 /*
 =======================================================================
 
@@ -55,12 +55,26 @@ typedef struct {
 	qboolean	borderNoAdjust[4+6+16];
 } facet_t;
 
+// the facets of a patch are kept in grid order and grouped into a bounding
+// volume hierarchy of contiguous facet ranges, stored depth first
+#define	MAX_PATCH_NODE_FACETS	4
+#define	MAX_PATCH_NODES			(MAX_FACETS * 2)
+
+typedef struct {
+	vec3_t	bounds[2];
+	int		firstFacet;
+	int		numFacets;			// a leaf if <= MAX_PATCH_NODE_FACETS
+	int		skipNode;			// first node after this subtree
+} patchNode_t;
+
 typedef struct patchCollide_s {
 	vec3_t	bounds[2];
 	int		numPlanes;			// surface planes plus edge planes
 	patchPlane_t	*planes;
 	int		numFacets;
 	facet_t	*facets;
+	int		numNodes;
+	patchNode_t	*nodes;
 } patchCollide_t;
 
 
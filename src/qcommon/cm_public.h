@@ -4,6 +4,7 @@
 
 void		CM_LoadMap( const char *name, qboolean clientload, int *checksum);
 void		CM_ClearMap( void );
+void		CM_FreeCachedMapDiskImage( void );	// once the renderer is done with the bsp
 clipHandle_t CM_InlineModel( int index );		// 0 = world, 1 + are bmodels
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule );
 
@@ -51,6 +52,9 @@ int			CM_LerpTag( orientation_t *tag,  clipHandle_t model, int startFrame, int e
 int	CM_MarkFragments( int numPoints, const vec3_t *points, const vec3_t projection,
 				   int maxPoints, vec3_t pointBuffer, int maxFragments, markFragment_t *fragmentBuffer );
 
+// cm_bench.c
+void CM_InitBench( void );
+
 // cm_patch.c
 void CM_DrawDebugSurface( void (*drawPoly)(int color, int numPoints, float *points) );
 
@@ -1,5 +1,11 @@
 #include "cm_local.h"
 
+#if defined( CM_SIMD_SSE2 )
+#include <emmintrin.h>
+#elif defined( CM_SIMD_NEON )
+#include <arm_neon.h>
+#endif
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice versa
@@ -128,41 +134,530 @@ float SquareRootFloat(float number) {
 /*
 ===============================================================================
 
-POSITION TESTING
+MULTI-CHECK AVOIDANCE
 
 ===============================================================================
 */
 
+// frees the stamps when a thread that traced exits
+typedef struct cmThreadCheck_s {
+	cmCheck_t	check;
+
+	~cmThreadCheck_s() {
+		free( check.brushes );
+		free( check.patches );
+	}
+} cmThreadCheck_t;
+
+static thread_local cmThreadCheck_t	cm_threadCheck;
+
 /*
 ================
-CM_TestBoxInBrush
+CM_GrowStamps
+
+Stamps of a previous map are all older than the current query, so they
+can stay as they are and only the new tail needs clearing
 ================
 */
-void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
+static void CM_GrowStamps( int **stamps, int *numStamps, int count ) {
+	int		*newStamps;
+
+	newStamps = (int *)realloc( *stamps, count * sizeof( **stamps ) );
+	if ( !newStamps ) {
+		Com_Error( ERR_FATAL, "CM_GrowStamps: failed on allocation of %i stamps", count );
+	}
+
+	Com_Memset( newStamps + *numStamps, 0, ( count - *numStamps ) * sizeof( *newStamps ) );
+	*stamps = newStamps;
+	*numStamps = count;
+}
+
+/*
+================
+CM_BeginCheck
+
+Starts a new query on this thread's stamps
+================
+*/
+cmCheck_t *CM_BeginCheck( void ) {
+	cmCheck_t	*check;
+
+	check = &cm_threadCheck.check;
+
+	if ( check->numBrushes < cm.numBrushes + BOX_BRUSHES ) {
+		CM_GrowStamps( &check->brushes, &check->numBrushes, cm.numBrushes + BOX_BRUSHES );
+	}
+	if ( check->numPatches < cm.numSurfaces ) {
+		CM_GrowStamps( &check->patches, &check->numPatches, cm.numSurfaces );
+	}
+
+	if ( ++check->count == INT_MAX ) {
+		Com_Memset( check->brushes, 0, check->numBrushes * sizeof( *check->brushes ) );
+		Com_Memset( check->patches, 0, check->numPatches * sizeof( *check->patches ) );
+		check->count = 1;
+	}
+
+	return check;
+}
+
+/*
+===============================================================================
+
+BRUSH PLANE CLIPPING
+
+With CM_SIMD four brush planes are clipped at a time. The vector code does
+the same float operations in the same order as the scalar loops, so strict
+IEEE builds give the same results. Builds with -ffast-math or /fp:fast let
+the compiler contract and reorder the scalar math, where they only agree up
+to rounding. cm_simdCheck runs both paths and counts the differences.
+
+===============================================================================
+*/
+
+#ifdef CM_SIMD
+
+#if defined( CM_SIMD_SSE2 )
+typedef __m128	cmFloat4_t;
+typedef __m128	cmMask4_t;
+
+#define CM_Load4( p )			_mm_loadu_ps( p )
+#define CM_Store4( p, a )		_mm_storeu_ps( p, a )
+#define CM_Splat4( f )			_mm_set1_ps( f )
+#define CM_Add4( a, b )			_mm_add_ps( a, b )
+#define CM_Sub4( a, b )			_mm_sub_ps( a, b )
+#define CM_Mul4( a, b )			_mm_mul_ps( a, b )
+#define CM_Div4( a, b )			_mm_div_ps( a, b )
+#define CM_Gt4( a, b )			_mm_cmpgt_ps( a, b )
+#define CM_Ge4( a, b )			_mm_cmpge_ps( a, b )
+#define CM_Lt4( a, b )			_mm_cmplt_ps( a, b )
+#define CM_Le4( a, b )			_mm_cmple_ps( a, b )
+#define CM_And4( a, b )			_mm_and_ps( a, b )
+#define CM_Or4( a, b )			_mm_or_ps( a, b )
+#define CM_AndNot4( a, b )		_mm_andnot_ps( b, a )		// a & ~b
+#define CM_Select4( m, a, b )	_mm_or_ps( _mm_and_ps( m, a ), _mm_andnot_ps( m, b ) )
+#define CM_True4()				_mm_castsi128_ps( _mm_set1_epi32( -1 ) )
+#define CM_False4()				_mm_setzero_ps()
+#define CM_Any4( m )			_mm_movemask_ps( m )
+#elif defined( CM_SIMD_NEON )
+typedef float32x4_t	cmFloat4_t;
+typedef uint32x4_t	cmMask4_t;
+
+#define CM_Load4( p )			vld1q_f32( p )
+#define CM_Store4( p, a )		vst1q_f32( p, a )
+#define CM_Splat4( f )			vdupq_n_f32( f )
+#define CM_Add4( a, b )			vaddq_f32( a, b )
+#define CM_Sub4( a, b )			vsubq_f32( a, b )
+#define CM_Mul4( a, b )			vmulq_f32( a, b )
+#define CM_Div4( a, b )			vdivq_f32( a, b )
+#define CM_Gt4( a, b )			vcgtq_f32( a, b )
+#define CM_Ge4( a, b )			vcgeq_f32( a, b )
+#define CM_Lt4( a, b )			vcltq_f32( a, b )
+#define CM_Le4( a, b )			vcleq_f32( a, b )
+#define CM_And4( a, b )			vandq_u32( a, b )
+#define CM_Or4( a, b )			vorrq_u32( a, b )
+#define CM_AndNot4( a, b )		vbicq_u32( a, b )			// a & ~b
+#define CM_Select4( m, a, b )	vbslq_f32( m, a, b )
+#define CM_True4()				vdupq_n_u32( 0xffffffff )
+#define CM_False4()				vdupq_n_u32( 0 )
+#define CM_Any4( m )			( vmaxvq_u32( m ) != 0 )
+#endif
+
+#define CM_Dot4( x, y, z, nx, ny, nz )	CM_Add4( CM_Add4( CM_Mul4( x, nx ), CM_Mul4( y, ny ) ), CM_Mul4( z, nz ) )
+
+typedef struct {
+	cmFloat4_t	start[3], end[3];
+	cmFloat4_t	size[2][3];
+	cmFloat4_t	sphereOffset[3];
+	cmFloat4_t	startMinus[3], startPlus[3];	// start -/+ sphere offset
+	cmFloat4_t	endMinus[3], endPlus[3];
+	cmFloat4_t	radius;
+} cmSIMDTrace_t;
+
+/*
+================
+CM_SetupSIMDTrace
+================
+*/
+static ID_INLINE void CM_SetupSIMDTrace( const traceWork_t *tw, cmSIMDTrace_t *st ) {
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		st->start[i] = CM_Splat4( tw->start[i] );
+		st->end[i] = CM_Splat4( tw->end[i] );
+
+		if ( tw->sphere.use ) {
+			st->sphereOffset[i] = CM_Splat4( tw->sphere.offset[i] );
+			st->startMinus[i] = CM_Splat4( tw->start[i] - tw->sphere.offset[i] );
+			st->startPlus[i] = CM_Splat4( tw->start[i] + tw->sphere.offset[i] );
+			st->endMinus[i] = CM_Splat4( tw->end[i] - tw->sphere.offset[i] );
+			st->endPlus[i] = CM_Splat4( tw->end[i] + tw->sphere.offset[i] );
+		} else {
+			st->size[0][i] = CM_Splat4( tw->size[0][i] );
+			st->size[1][i] = CM_Splat4( tw->size[1][i] );
+		}
+	}
+
+	st->radius = CM_Splat4( tw->sphere.radius );
+}
+
+/*
+================
+CM_PlaneDistances4
+
+Distances of the start and end point to four planes expanded by the box
+or capsule, as computed by the scalar loops
+================
+*/
+static ID_INLINE void CM_PlaneDistances4( const traceWork_t *tw, const cmSIMDTrace_t *st,
+										 const cbrushPlanes_t *block, cmFloat4_t *d1, cmFloat4_t *d2 ) {
+	cmFloat4_t	nx, ny, nz, dist;
+	cmFloat4_t	zero;
+
+	nx = CM_Load4( block->normal[0] );
+	ny = CM_Load4( block->normal[1] );
+	nz = CM_Load4( block->normal[2] );
+	dist = CM_Load4( block->dist );
+	zero = CM_Splat4( 0.0f );
+
+	if ( tw->sphere.use ) {
+		cmFloat4_t	t;
+		cmMask4_t	minus;
+
+		// adjust the plane distance apropriately for radius
+		dist = CM_Add4( dist, st->radius );
+
+		// find the closest point on the capsule to the plane
+		t = CM_Dot4( nx, ny, nz, st->sphereOffset[0], st->sphereOffset[1], st->sphereOffset[2] );
+		minus = CM_Gt4( t, zero );
+
+		*d1 = CM_Sub4( CM_Dot4(
+			CM_Select4( minus, st->startMinus[0], st->startPlus[0] ),
+			CM_Select4( minus, st->startMinus[1], st->startPlus[1] ),
+			CM_Select4( minus, st->startMinus[2], st->startPlus[2] ), nx, ny, nz ), dist );
+		*d2 = CM_Sub4( CM_Dot4(
+			CM_Select4( minus, st->endMinus[0], st->endPlus[0] ),
+			CM_Select4( minus, st->endMinus[1], st->endPlus[1] ),
+			CM_Select4( minus, st->endMinus[2], st->endPlus[2] ), nx, ny, nz ), dist );
+	} else {
+		cmFloat4_t	ox, oy, oz;
+
+		// tw->offsets[signbits], the corner furthest behind each plane
+		ox = CM_Select4( CM_Lt4( nx, zero ), st->size[1][0], st->size[0][0] );
+		oy = CM_Select4( CM_Lt4( ny, zero ), st->size[1][1], st->size[0][1] );
+		oz = CM_Select4( CM_Lt4( nz, zero ), st->size[1][2], st->size[0][2] );
+
+		// adjust the plane distance apropriately for mins/maxs
+		dist = CM_Sub4( dist, CM_Dot4( ox, oy, oz, nx, ny, nz ) );
+
+		*d1 = CM_Sub4( CM_Dot4( st->start[0], st->start[1], st->start[2], nx, ny, nz ), dist );
+		*d2 = CM_Sub4( CM_Dot4( st->end[0], st->end[1], st->end[2], nx, ny, nz ), dist );
+	}
+}
+
+/*
+================
+CM_ClipBrushPlanesSIMD
+
+The plane loop of CM_TraceThroughBrush. Returns qfalse if the trace is
+completely in front of one of the planes.
+================
+*/
+static qboolean CM_ClipBrushPlanesSIMD( const traceWork_t *tw, const cbrush_t *brush, float *enterFrac,
+								   float *leaveFrac, cbrushside_t **leadside, qboolean *getout, qboolean *startout ) {
+	cmSIMDTrace_t	st;
+	cmFloat4_t		d1, d2, denom, f, index, enterIndex;
+	cmFloat4_t		enter, leave;
+	cmFloat4_t		zero, one, four, eps;
+	cmMask4_t		front, crosses, entering, leaving, better;
+	cmMask4_t		getoutMask, startoutMask;
+	float			enterLanes[4], leaveLanes[4], indexLanes[4];
+	int				i, numBlocks, lane;
+	static const float	laneIndex[4] = { 0, 1, 2, 3 };
+
+	CM_SetupSIMDTrace( tw, &st );
+
+	zero = CM_Splat4( 0.0f );
+	one = CM_Splat4( 1.0f );
+	four = CM_Splat4( 4.0f );
+	eps = CM_Splat4( SURFACE_CLIP_EPSILON );
+
+	enter = CM_Splat4( -1.0f );
+	leave = one;
+	enterIndex = zero;
+	index = CM_Load4( laneIndex );
+	getoutMask = CM_False4();
+	startoutMask = CM_False4();
+
+	numBlocks = ( brush->numsides + 3 ) / 4;
+
+	for ( i = 0 ; i < numBlocks ; i++, index = CM_Add4( index, four ) ) {
+		CM_PlaneDistances4( tw, &st, &brush->planes[i], &d1, &d2 );
+
+		getoutMask = CM_Or4( getoutMask, CM_Gt4( d2, zero ) );		// endpoint is not in solid
+		startoutMask = CM_Or4( startoutMask, CM_Gt4( d1, zero ) );
+
+		// if completely in front of face, no intersection with the entire brush
+		front = CM_And4( CM_Gt4( d1, zero ), CM_Or4( CM_Ge4( d2, eps ), CM_Ge4( d2, d1 ) ) );
+		if ( CM_Any4( front ) ) {
+			return qfalse;
+		}
+
+		// if it doesn't cross the plane, the plane isn't relevent
+		crosses = CM_AndNot4( CM_True4(), CM_And4( CM_Le4( d1, zero ), CM_Le4( d2, zero ) ) );
+		entering = CM_And4( crosses, CM_Gt4( d1, d2 ) );
+		leaving = CM_AndNot4( crosses, CM_Gt4( d1, d2 ) );
+
+		// only the crossing lanes are used, the others may divide by zero
+		denom = CM_Sub4( d1, d2 );
+
+		f = CM_Div4( CM_Sub4( d1, eps ), denom );
+		f = CM_Select4( CM_Lt4( f, zero ), zero, f );
+		better = CM_And4( entering, CM_Gt4( f, enter ) );
+		enter = CM_Select4( better, f, enter );
+		enterIndex = CM_Select4( better, index, enterIndex );
+
+		f = CM_Div4( CM_Add4( d1, eps ), denom );
+		f = CM_Select4( CM_Gt4( f, one ), one, f );
+		better = CM_And4( leaving, CM_Lt4( f, leave ) );
+		leave = CM_Select4( better, f, leave );
+	}
+
+	*getout = CM_Any4( getoutMask ) ? qtrue : qfalse;
+	*startout = CM_Any4( startoutMask ) ? qtrue : qfalse;
+
+	CM_Store4( enterLanes, enter );
+	CM_Store4( indexLanes, enterIndex );
+	CM_Store4( leaveLanes, leave );
+
+	// the latest entry wins, the first side on a tie like in the scalar loop
+	lane = 0;
+	for ( i = 1 ; i < 4 ; i++ ) {
+		if ( enterLanes[i] > enterLanes[lane] ||
+			( enterLanes[i] == enterLanes[lane] && indexLanes[i] < indexLanes[lane] ) ) {
+			lane = i;
+		}
+		if ( leaveLanes[i] < leaveLanes[0] ) {
+			leaveLanes[0] = leaveLanes[i];
+		}
+	}
+
+	*enterFrac = enterLanes[lane];
+	*leaveFrac = leaveLanes[0];
+	*leadside = *enterFrac > -1.0f ? brush->sides + (int)indexLanes[lane] : NULL;
+
+	return qtrue;
+}
+
+/*
+================
+CM_BrushPlanesBehindSIMD
+
+The plane loop of CM_TestBoxInBrush, qtrue if the start is behind all
+planes past the six axial ones
+================
+*/
+static qboolean CM_BrushPlanesBehindSIMD( const traceWork_t *tw, const cbrush_t *brush ) {
+	cmSIMDTrace_t	st;
+	cmFloat4_t		d1, d2, index, six, four;
+	cmMask4_t		front;
+	int				i, numBlocks;
+	static const float	laneIndex[4] = { 0, 1, 2, 3 };
+
+	CM_SetupSIMDTrace( tw, &st );
+
+	six = CM_Splat4( 6.0f );
+	four = CM_Splat4( 4.0f );
+	index = CM_Add4( CM_Load4( laneIndex ), four );
+
+	numBlocks = ( brush->numsides + 3 ) / 4;
+
+	// the first block only holds axial planes
+	for ( i = 1 ; i < numBlocks ; i++, index = CM_Add4( index, four ) ) {
+		CM_PlaneDistances4( tw, &st, &brush->planes[i], &d1, &d2 );
+
+		// if completely in front of face, no intersection
+		front = CM_And4( CM_Gt4( d1, CM_Splat4( 0.0f ) ), CM_Ge4( index, six ) );
+		if ( CM_Any4( front ) ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+#endif // CM_SIMD
+
+/*
+================
+CM_ClipBrushPlanesScalar
+================
+*/
+static qboolean CM_ClipBrushPlanesScalar( const traceWork_t *tw, const cbrush_t *brush, float *enterFracOut,
+								   float *leaveFracOut, cbrushside_t **leadsideOut, qboolean *getoutOut, qboolean *startoutOut ) {
 	int			i;
 	cplane_t	*plane;
 	float		dist;
-	float		d1;
-	cbrushside_t	*side;
+	float		enterFrac, leaveFrac;
+	float		d1, d2;
+	qboolean	getout, startout;
+	float		f;
+	cbrushside_t	*side, *leadside;
 	float		t;
 	vec3_t		startp;
+	vec3_t		endp;
 
-	if (!brush->numsides) {
-		return;
-	}
+	enterFrac = -1.0;
+	leaveFrac = 1.0;
 
-	// special test for axial
-	if ( tw->bounds[0][0] > brush->bounds[1][0]
-		|| tw->bounds[0][1] > brush->bounds[1][1]
-		|| tw->bounds[0][2] > brush->bounds[1][2]
-		|| tw->bounds[1][0] < brush->bounds[0][0]
-		|| tw->bounds[1][1] < brush->bounds[0][1]
-		|| tw->bounds[1][2] < brush->bounds[0][2]
-		) {
-		return;
+	getout = qfalse;
+	startout = qfalse;
+
+	leadside = NULL;
+
+	if ( tw->sphere.use ) {
+		//
+		// compare the trace against all planes of the brush
+		// find the latest time the trace crosses a plane towards the interior
+		// and the earliest time the trace crosses a plane towards the exterior
+		//
+		for (i = 0; i < brush->numsides; i++) {
+			side = brush->sides + i;
+			plane = side->plane;
+
+			// adjust the plane distance apropriately for radius
+			dist = plane->dist + tw->sphere.radius;
+
+			// find the closest point on the capsule to the plane
+			t = DotProduct( plane->normal, tw->sphere.offset );
+			if ( t > 0 )
+			{
+				VectorSubtract( tw->start, tw->sphere.offset, startp );
+				VectorSubtract( tw->end, tw->sphere.offset, endp );
+			}
+			else
+			{
+				VectorAdd( tw->start, tw->sphere.offset, startp );
+				VectorAdd( tw->end, tw->sphere.offset, endp );
+			}
+
+			d1 = DotProduct( startp, plane->normal ) - dist;
+			d2 = DotProduct( endp, plane->normal ) - dist;
+
+			if (d2 > 0) {
+				getout = qtrue;	// endpoint is not in solid
+			}
+			if (d1 > 0) {
+				startout = qtrue;
+			}
+
+			// if completely in front of face, no intersection with the entire brush
+			if (d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 )  ) {
+				return qfalse;
+			}
+
+			// if it doesn't cross the plane, the plane isn't relevent
+			if (d1 <= 0 && d2 <= 0 ) {
+				continue;
+			}
+
+			// crosses face
+			if (d1 > d2) {	// enter
+				f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
+				if ( f < 0 ) {
+					f = 0;
+				}
+				if (f > enterFrac) {
+					enterFrac = f;
+					leadside = side;
+				}
+			} else {	// leave
+				f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
+				if ( f > 1 ) {
+					f = 1;
+				}
+				if (f < leaveFrac) {
+					leaveFrac = f;
+				}
+			}
+		}
+	} else {
+		//
+		// compare the trace against all planes of the brush
+		// find the latest time the trace crosses a plane towards the interior
+		// and the earliest time the trace crosses a plane towards the exterior
+		//
+		for (i = 0; i < brush->numsides; i++) {
+			side = brush->sides + i;
+			plane = side->plane;
+
+			// adjust the plane distance apropriately for mins/maxs
+			dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
+
+			d1 = DotProduct( tw->start, plane->normal ) - dist;
+			d2 = DotProduct( tw->end, plane->normal ) - dist;
+
+			if (d2 > 0) {
+				getout = qtrue;	// endpoint is not in solid
+			}
+			if (d1 > 0) {
+				startout = qtrue;
+			}
+
+			// if completely in front of face, no intersection with the entire brush
+			if (d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 )  ) {
+				return qfalse;
+			}
+
+			// if it doesn't cross the plane, the plane isn't relevent
+			if (d1 <= 0 && d2 <= 0 ) {
+				continue;
+			}
+
+			// crosses face
+			if (d1 > d2) {	// enter
+				f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
+				if ( f < 0 ) {
+					f = 0;
+				}
+				if (f > enterFrac) {
+					enterFrac = f;
+					leadside = side;
+				}
+			} else {	// leave
+				f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
+				if ( f > 1 ) {
+					f = 1;
+				}
+				if (f < leaveFrac) {
+					leaveFrac = f;
+				}
+			}
+		}
 	}
 
-   if ( tw->sphere.use ) {
+	*enterFracOut = enterFrac;
+	*leaveFracOut = leaveFrac;
+	*leadsideOut = leadside;
+	*getoutOut = getout;
+	*startoutOut = startout;
+
+	return qtrue;
+}
+
+/*
+================
+CM_BrushPlanesBehindScalar
+================
+*/
+static qboolean CM_BrushPlanesBehindScalar( const traceWork_t *tw, const cbrush_t *brush ) {
+	int			i;
+	cplane_t	*plane;
+	float		dist;
+	float		d1;
+	cbrushside_t	*side;
+	float		t;
+	vec3_t		startp;
+
+	if ( tw->sphere.use ) {
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
 		for ( i = 6 ; i < brush->numsides ; i++ ) {
@@ -184,7 +679,7 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 			d1 = DotProduct( startp, plane->normal ) - dist;
 			// if completely in front of face, no intersection
 			if ( d1 > 0 ) {
-				return;
+				return qfalse;
 			}
 		}
 	} else {
@@ -201,11 +696,124 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 
 			// if completely in front of face, no intersection
 			if ( d1 > 0 ) {
-				return;
+				return qfalse;
 			}
 		}
 	}
 
+	return qtrue;
+}
+
+#if defined( CM_SIMD ) && !defined( BSPC )
+/*
+================
+CM_CheckClipBrushPlanes
+
+Runs both paths for cm_simdCheck and returns the scalar result
+================
+*/
+static qboolean CM_CheckClipBrushPlanes( const traceWork_t *tw, const cbrush_t *brush, float *enterFrac,
+										float *leaveFrac, cbrushside_t **leadside, qboolean *getout, qboolean *startout ) {
+	float			simdEnterFrac, simdLeaveFrac;
+	cbrushside_t	*simdLeadside;
+	qboolean		simdGetout, simdStartout;
+	qboolean		ret, simdRet;
+
+	ret = CM_ClipBrushPlanesScalar( tw, brush, enterFrac, leaveFrac, leadside, getout, startout );
+	simdRet = CM_ClipBrushPlanesSIMD( tw, brush, &simdEnterFrac, &simdLeaveFrac, &simdLeadside, &simdGetout, &simdStartout );
+
+	// the other outputs aren't set when the trace misses the brush
+	if ( ret != simdRet || ( ret && ( *enterFrac != simdEnterFrac || *leaveFrac != simdLeaveFrac ||
+		*leadside != simdLeadside || *getout != simdGetout || *startout != simdStartout ) ) ) {
+		c_simdMismatches++;
+	}
+
+	return ret;
+}
+#endif
+
+/*
+================
+CM_ClipBrushPlanes
+
+The plane loop of CM_TraceThroughBrush. Returns qfalse if the trace is
+completely in front of one of the planes.
+================
+*/
+static ID_INLINE qboolean CM_ClipBrushPlanes( const traceWork_t *tw, const cbrush_t *brush, float *enterFrac,
+											 float *leaveFrac, cbrushside_t **leadside, qboolean *getout, qboolean *startout ) {
+#ifdef CM_SIMD
+#ifndef BSPC
+	if ( cm_simdCheck->integer ) {
+		return CM_CheckClipBrushPlanes( tw, brush, enterFrac, leaveFrac, leadside, getout, startout );
+	}
+#endif
+	return CM_ClipBrushPlanesSIMD( tw, brush, enterFrac, leaveFrac, leadside, getout, startout );
+#else
+	return CM_ClipBrushPlanesScalar( tw, brush, enterFrac, leaveFrac, leadside, getout, startout );
+#endif
+}
+
+/*
+================
+CM_BrushPlanesBehind
+
+The plane loop of CM_TestBoxInBrush, qtrue if the start is behind all
+planes past the six axial ones
+================
+*/
+static ID_INLINE qboolean CM_BrushPlanesBehind( const traceWork_t *tw, const cbrush_t *brush ) {
+#ifdef CM_SIMD
+#ifndef BSPC
+	if ( cm_simdCheck->integer ) {
+		qboolean	ret;
+
+		ret = CM_BrushPlanesBehindScalar( tw, brush );
+		if ( ret != CM_BrushPlanesBehindSIMD( tw, brush ) ) {
+			c_simdMismatches++;
+		}
+		return ret;
+	}
+#endif
+	return CM_BrushPlanesBehindSIMD( tw, brush );
+#else
+	return CM_BrushPlanesBehindScalar( tw, brush );
+#endif
+}
+
+/*
+===============================================================================
+
+POSITION TESTING
+
+===============================================================================
+*/
+
+/*
+================
+CM_TestBoxInBrush
+================
+*/
+void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
+	if (!brush->numsides) {
+		return;
+	}
+
+	// special test for axial
+	if ( tw->bounds[0][0] > brush->bounds[1][0]
+		|| tw->bounds[0][1] > brush->bounds[1][1]
+		|| tw->bounds[0][2] > brush->bounds[1][2]
+		|| tw->bounds[1][0] < brush->bounds[0][0]
+		|| tw->bounds[1][1] < brush->bounds[0][1]
+		|| tw->bounds[1][2] < brush->bounds[0][2]
+		) {
+		return;
+	}
+
+	if ( !CM_BrushPlanesBehind( tw, brush ) ) {
+		return;
+	}
+
 	// inside this brush
 	tw->trace.startsolid = tw->trace.allsolid = qtrue;
 	tw->trace.fraction = 0;
@@ -221,18 +829,18 @@ CM_TestInLeaf
 */
 void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, patchnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
 	// test box position against all brushes in the leaf
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if (tw->check->brushes[brushnum] == tw->check->count) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->check->brushes[brushnum] = tw->check->count;
+		b = CM_LeafBrush( brushnum );
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -251,14 +859,15 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			patchnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ patchnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->check->patches[patchnum] == tw->check->count ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->check->patches[patchnum] = tw->check->count;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -407,14 +1016,10 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
-
-	cm.checkcount++;
+	ll.check = NULL;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
-
-	cm.checkcount++;
-
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
 		CM_TestInLeaf( tw, &cm.leafs[leafs[i]] );
@@ -442,7 +1047,7 @@ CM_TraceThroughPatch
 void CM_TraceThroughPatch( traceWork_t *tw, cPatch_t *patch ) {
 	float		oldFrac;
 
-	c_patch_traces++;
+	tw->patchTraces++;
 
 	oldFrac = tw->trace.fraction;
 
@@ -460,155 +1065,21 @@ CM_TraceThroughBrush
 ================
 */
 void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
-	int			i;
-	cplane_t	*plane, *clipplane;
-	float		dist;
+	cplane_t	*clipplane;
 	float		enterFrac, leaveFrac;
-	float		d1, d2;
 	qboolean	getout, startout;
-	float		f;
-	cbrushside_t	*side, *leadside;
-	float		t;
-	vec3_t		startp;
-	vec3_t		endp;
-
-	enterFrac = -1.0;
-	leaveFrac = 1.0;
-	clipplane = NULL;
+	cbrushside_t	*leadside;
 
 	if ( !brush->numsides ) {
 		return;
 	}
 
-	c_brush_traces++;
-
-	getout = qfalse;
-	startout = qfalse;
-
-	leadside = NULL;
+	tw->brushTraces++;
 
-	if ( tw->sphere.use ) {
-		//
-		// compare the trace against all planes of the brush
-		// find the latest time the trace crosses a plane towards the interior
-		// and the earliest time the trace crosses a plane towards the exterior
-		//
-		for (i = 0; i < brush->numsides; i++) {
-			side = brush->sides + i;
-			plane = side->plane;
-
-			// adjust the plane distance apropriately for radius
-			dist = plane->dist + tw->sphere.radius;
-
-			// find the closest point on the capsule to the plane
-			t = DotProduct( plane->normal, tw->sphere.offset );
-			if ( t > 0 )
-			{
-				VectorSubtract( tw->start, tw->sphere.offset, startp );
-				VectorSubtract( tw->end, tw->sphere.offset, endp );
-			}
-			else
-			{
-				VectorAdd( tw->start, tw->sphere.offset, startp );
-				VectorAdd( tw->end, tw->sphere.offset, endp );
-			}
-
-			d1 = DotProduct( startp, plane->normal ) - dist;
-			d2 = DotProduct( endp, plane->normal ) - dist;
-
-			if (d2 > 0) {
-				getout = qtrue;	// endpoint is not in solid
-			}
-			if (d1 > 0) {
-				startout = qtrue;
-			}
-
-			// if completely in front of face, no intersection with the entire brush
-			if (d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 )  ) {
-				return;
-			}
-
-			// if it doesn't cross the plane, the plane isn't relevent
-			if (d1 <= 0 && d2 <= 0 ) {
-				continue;
-			}
-
-			// crosses face
-			if (d1 > d2) {	// enter
-				f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
-				if ( f < 0 ) {
-					f = 0;
-				}
-				if (f > enterFrac) {
-					enterFrac = f;
-					clipplane = plane;
-					leadside = side;
-				}
-			} else {	// leave
-				f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
-				if ( f > 1 ) {
-					f = 1;
-				}
-				if (f < leaveFrac) {
-					leaveFrac = f;
-				}
-			}
-		}
-	} else {
-		//
-		// compare the trace against all planes of the brush
-		// find the latest time the trace crosses a plane towards the interior
-		// and the earliest time the trace crosses a plane towards the exterior
-		//
-		for (i = 0; i < brush->numsides; i++) {
-			side = brush->sides + i;
-			plane = side->plane;
-
-			// adjust the plane distance apropriately for mins/maxs
-			dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
-
-			d1 = DotProduct( tw->start, plane->normal ) - dist;
-			d2 = DotProduct( tw->end, plane->normal ) - dist;
-
-			if (d2 > 0) {
-				getout = qtrue;	// endpoint is not in solid
-			}
-			if (d1 > 0) {
-				startout = qtrue;
-			}
-
-			// if completely in front of face, no intersection with the entire brush
-			if (d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 )  ) {
-				return;
-			}
-
-			// if it doesn't cross the plane, the plane isn't relevent
-			if (d1 <= 0 && d2 <= 0 ) {
-				continue;
-			}
-
-			// crosses face
-			if (d1 > d2) {	// enter
-				f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
-				if ( f < 0 ) {
-					f = 0;
-				}
-				if (f > enterFrac) {
-					enterFrac = f;
-					clipplane = plane;
-					leadside = side;
-				}
-			} else {	// leave
-				f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
-				if ( f > 1 ) {
-					f = 1;
-				}
-				if (f < leaveFrac) {
-					leaveFrac = f;
-				}
-			}
-		}
+	if ( !CM_ClipBrushPlanes( tw, brush, &enterFrac, &leaveFrac, &leadside, &getout, &startout ) ) {
+		return;
 	}
+	clipplane = leadside ? leadside->plane : NULL;
 
 	//
 	// all planes have been checked, and the trace was not
@@ -645,7 +1116,7 @@ CM_TraceThroughLeaf
 */
 void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, patchnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
@@ -653,11 +1124,11 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
-		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( tw->check->brushes[brushnum] == tw->check->count ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->check->brushes[brushnum] = tw->check->count;
+		b = CM_LeafBrush( brushnum );
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -676,14 +1147,15 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			patchnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ patchnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->check->patches[patchnum] == tw->check->count ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->check->patches[patchnum] = tw->check->count;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -1050,6 +1522,13 @@ void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, vec3_t
 
 			offset *= 2;
 			offset = tw->maxOffset;
+#endif
+#ifndef BSPC
+			if ( cm_tightPlaneOffsets->integer ) {
+				// distance from the center of the symetric box to the
+				// corner furthest behind the plane
+				offset = -DotProduct( tw->offsets[plane->signbits], plane->normal );
+			} else
 #endif
 			// this is silly
 			offset = 2048;
@@ -1133,17 +1612,17 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end,
 	traceWork_t	tw;
 	vec3_t		offset;
 	cmodel_t	*cmod;
+	PROF_SCOPE( "CM_Trace" );
 
 	cmod = CM_ClipHandleToModel( model );
 
-	cm.checkcount++;		// for multi-check avoidance
-
 	c_traces++;				// for statistics, may be zeroed
 
 	// fill in a default trace
 	Com_Memset( &tw, 0, sizeof(tw) );
 	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
 	VectorCopy(origin, tw.modelOrigin);
+	tw.check = CM_BeginCheck();	// for multi-check avoidance
 
 	if (!cm.numNodes) {
 		*results = tw.trace;
@@ -1337,6 +1816,14 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end,
         assert(tw.trace.allsolid ||
                tw.trace.fraction == 1.0 ||
                VectorLengthSquared(tw.trace.plane.normal) > 0.9999);
+
+	if ( tw.brushTraces ) {
+		c_brush_traces += tw.brushTraces;
+	}
+	if ( tw.patchTraces ) {
+		c_patch_traces += tw.patchTraces;
+	}
+
 	*results = tw.trace;
 }
 
@@ -1348,6 +1835,10 @@ CM_BoxTrace
 void CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						  const vec3_t mins, const vec3_t maxs,
 						  clipHandle_t model, int brushmask, int capsule ) {
+	if ( cm_benchRecording ) {
+		CM_BenchRecordTrace( start, end, mins, maxs, model, brushmask, vec3_origin, NULL, capsule );
+	}
+
 	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
 }
 
@@ -1375,6 +1866,10 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 	float		t;
 	sphere_t	sphere;
 
+	if ( cm_benchRecording ) {
+		CM_BenchRecordTrace( start, end, mins, maxs, model, brushmask, origin, angles, capsule );
+	}
+
 	if ( !mins ) {
 		mins = vec3_origin;
 	}
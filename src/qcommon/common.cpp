@@ -2,6 +2,7 @@
 
 #include <math.h>
 #include <setjmp.h>
+#include <atomic>
 #ifndef WIN32
 # include <fenv.h>
 #endif
@@ -787,6 +788,108 @@ cvar_t	*com_validateZone;
 zone_t	TheZone = {};
 
 
+// Small blocks are carved out of slabs instead of getting a malloc each.
+// Every size class keeps a free list of its released blocks, so the
+// strings, events and cvar values that come and go all the time stop
+// fragmenting the heap. The class is derived from the block size, the
+// headers, tails and tag accounting are the same as for any other block.
+
+#define ZONE_SLAB_SIZE		(64 * 1024)
+#define ZONE_SLAB_GRANULE	16
+#define ZONE_SLAB_MAX		512		// largest block, header and tail included
+#define ZONE_SLAB_CLASSES	(ZONE_SLAB_MAX / ZONE_SLAB_GRANULE)
+
+typedef struct zoneSlab_s
+{
+	struct zoneSlab_s	*pNext;
+	void				*pad;		// keep the blocks as aligned as malloc's
+} zoneSlab_t;
+
+typedef struct
+{
+	void		*pFree[ZONE_SLAB_CLASSES];	// released blocks of each class
+	zoneSlab_t	*pSlabs;
+	int			iNumSlabs;
+	int			iBlocks;					// small blocks in use
+} zoneSlabs_t;
+
+static zoneSlabs_t	TheSlabs;
+
+static inline int Zone_SlabClass(int iRealSize)
+{
+	return (iRealSize + ZONE_SLAB_GRANULE - 1) / ZONE_SLAB_GRANULE - 1;
+}
+
+// Returns NULL if the memory is exhausted, like malloc does
+static void *Zone_AllocBlock(int iRealSize, qboolean bZeroit)
+{
+	if (iRealSize > ZONE_SLAB_MAX)
+	{
+		if (bZeroit) {
+			return calloc ( iRealSize, 1 );
+		} else {
+			return malloc ( iRealSize );
+		}
+	}
+
+	int iClass = Zone_SlabClass(iRealSize);
+	int iBlockSize = (iClass + 1) * ZONE_SLAB_GRANULE;
+
+	if (!TheSlabs.pFree[iClass])
+	{
+		// carve a new slab into blocks of this class
+		zoneSlab_t *pSlab = (zoneSlab_t *) malloc ( ZONE_SLAB_SIZE );
+		if (!pSlab)
+		{
+			return NULL;
+		}
+
+		pSlab->pNext = TheSlabs.pSlabs;
+		TheSlabs.pSlabs = pSlab;
+		TheSlabs.iNumSlabs++;
+
+		byte *pBlock = (byte *)(pSlab + 1);
+		byte *pEnd = (byte *)pSlab + ZONE_SLAB_SIZE;
+		for ( ; pBlock + iBlockSize <= pEnd; pBlock += iBlockSize)
+		{
+			*(void **)pBlock = TheSlabs.pFree[iClass];
+			TheSlabs.pFree[iClass] = pBlock;
+		}
+	}
+
+	void *pvBlock = TheSlabs.pFree[iClass];
+	TheSlabs.pFree[iClass] = *(void **)pvBlock;
+	TheSlabs.iBlocks++;
+
+	if (bZeroit)
+	{
+		memset(pvBlock, 0, iRealSize);
+	}
+
+	return pvBlock;
+}
+
+static void Zone_ReleaseBlock(void *pvBlock, int iRealSize)
+{
+	if (iRealSize > ZONE_SLAB_MAX)
+	{
+		free (pvBlock);
+		return;
+	}
+
+	int iClass = Zone_SlabClass(iRealSize);
+
+	*(void **)pvBlock = TheSlabs.pFree[iClass];
+	TheSlabs.pFree[iClass] = pvBlock;
+	TheSlabs.iBlocks--;
+}
+
+static inline int Zone_RealSize(int iSize)
+{
+	return sizeof(zoneHeader_t) + PAD(iSize, Q_ALIGNOF(zoneTail_t)) + sizeof(zoneTail_t);
+}
+
+
 
 
 // Scans through the linked list of mallocs and makes sure no data has been overwritten
@@ -873,18 +976,14 @@ void *Z_Malloc(int iSize, memtag_t eTag, qboolean bZeroit /* = qfalse */)
 		return &pMemory[1];
 	}
 
-	int iRealSize = sizeof(zoneHeader_t) + PAD(iSize, Q_ALIGNOF(zoneTail_t)) + sizeof(zoneTail_t);
+	int iRealSize = Zone_RealSize(iSize);
 
 	// Allocate a chunk...
 	//
 	zoneHeader_t *pMemory = NULL;
 	while (pMemory == NULL)
 	{
-		if (bZeroit) {
-			pMemory = (zoneHeader_t *) calloc ( iRealSize, 1 );
-		} else {
-			pMemory = (zoneHeader_t *) malloc ( iRealSize );
-		}
+		pMemory = (zoneHeader_t *) Zone_AllocBlock ( iRealSize, bZeroit );
 		if (!pMemory)
 		{
 			// new bit, if we fail to malloc memory, try dumping some of the cached stuff that's non-vital and try again...
@@ -1034,7 +1133,7 @@ static void Zone_FreeBlock(zoneHeader_t *pMemory)
 		{
 			pMemory->pNext->pPrev = pMemory->pPrev;
 		}
-		free (pMemory);
+		Zone_ReleaseBlock (pMemory, Zone_RealSize(pMemory->iSize));
 
 
 		#ifdef DETAILED_ZONE_DEBUG_CODE
@@ -1191,6 +1290,12 @@ static void Z_Stats_f(void)
 									TheZone.Stats.iPeak,
 									         (float)TheZone.Stats.iPeak / 1024.0f / 1024.0f
 				);
+
+	Com_Printf("%d small blocks are kept in %d slabs (%.2fMB)\n",
+									TheSlabs.iBlocks,
+										TheSlabs.iNumSlabs,
+											(float)TheSlabs.iNumSlabs * ZONE_SLAB_SIZE / 1024.0f / 1024.0f
+				);
 }
 
 // Gives a detailed breakdown of the memory blocks in the zone
@@ -1242,6 +1347,17 @@ void Com_ShutdownZoneMemory(void)
 		assert(!TheZone.Stats.iCount);
 		assert(!TheZone.Stats.iCurrent);
 	}
+
+	if (!TheSlabs.iBlocks)
+	{
+		while (TheSlabs.pSlabs)
+		{
+			zoneSlab_t *pNext = TheSlabs.pSlabs->pNext;
+			free (TheSlabs.pSlabs);
+			TheSlabs.pSlabs = pNext;
+		}
+		memset(&TheSlabs, 0, sizeof(TheSlabs));
+	}
 }
 
 // Initialises the zone memory system
@@ -2188,6 +2304,7 @@ int Com_EventLoop( void ) {
 	netadr_t	evFrom;
 	byte		bufData[MAX_MSGLEN];
 	msg_t		buf;
+	PROF_SCOPE( "Com_EventLoop" );
 
 	MSG_Init( &buf, bufData, sizeof( bufData ) );
 
@@ -2450,6 +2567,8 @@ void Com_Init( char *commandLine ) {
 	}
 	Cmd_AddCommand ("quit", Com_Quit_f);
 	Cmd_AddCommand ("changeVectors", MSG_ReportChangeVectors_f );
+	Prof_Init();
+	CM_InitBench();
 	Cmd_AddCommand ("writeconfig", Com_WriteConfig_f );
 	Cmd_SetCommandCompletionFunc( "writeconfig", Cmd_CompleteCfgName );
 
@@ -2670,6 +2789,8 @@ void Com_Frame( void ) {
 		return;			// an ERR_DROP was thrown
 	}
 
+	Prof_Frame();
+
 	// write config file if anything changed
 	Com_WriteConfiguration();
 
@@ -2718,6 +2839,8 @@ void Com_Frame( void ) {
 		// Busy sleep the last millisecond for better timeout precision
 		if (com_busyWait->integer || timeVal < 1)
 			NET_Sleep(0);
+		else if (NET_SleepIsPrecise())
+			NET_Sleep(timeVal);
 		else
 			NET_Sleep(timeVal - 1);
 	} while ((timeVal = Com_TimeVal(minMsec)) != 0);
@@ -2816,17 +2939,27 @@ void Com_Frame( void ) {
 	//
 	if ( com_showtrace->integer ) {
 
-		extern	int c_traces, c_brush_traces, c_patch_traces;
-		extern	int	c_pointcontents;
+		extern	std::atomic<int>	c_traces, c_brush_traces, c_patch_traces;
+		extern	std::atomic<int>	c_pointcontents;
 
-		Com_Printf ("%4i traces  (%ib %ip) %4i points\n", c_traces,
-			c_brush_traces, c_patch_traces, c_pointcontents);
+		Com_Printf ("%4i traces  (%ib %ip) %4i points\n", c_traces.load(),
+			c_brush_traces.load(), c_patch_traces.load(), c_pointcontents.load());
 		c_traces = 0;
 		c_brush_traces = 0;
 		c_patch_traces = 0;
 		c_pointcontents = 0;
 	}
 
+	// differences found by cm_simdCheck
+	{
+		extern	std::atomic<int>	c_simdMismatches;
+
+		if ( c_simdMismatches.load( std::memory_order_relaxed ) ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: %i brush clipping results differ between the SIMD and scalar code\n",
+				c_simdMismatches.exchange( 0 ) );
+		}
+	}
+
 	com_frameNumber++;
 }
 
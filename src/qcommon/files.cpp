@@ -213,6 +213,17 @@ typedef struct {
 	fileInPack_t*	*hashTable;					// hash table
 	fileInPack_t*	buildBuffer;				// buffer with the filenames etc.
 	int				gvc;						// game-version compatibility
+	int				mvinfoGvc;					// compatibility from mv.info, -1 without one
+	int				*headerLongs;				// crcs the checksums are made of
+	int				numHeaderLongs;
+	int				zipOffset;					// bytes in front of the zip (self-extracting archives)
+	int				centralOffset;				// central directory
+	int				centralSize;
+	int64_t			fileSize;					// for the pk3 index
+	int64_t			fileTime;
+	byte			*mapped;					// whole pk3 with fs_mmap, read without minizip
+	int				mappedLen;
+	qboolean		indexed;					// written to the pk3 index
 } pack_t;
 
 typedef struct {
@@ -235,6 +246,8 @@ static	cvar_t		*fs_assetspath;
 static	cvar_t		*fs_basegame;
 static	cvar_t		*fs_copyfiles;
 static	cvar_t		*fs_gamedirvar;
+static	cvar_t		*fs_mmap;
+static	cvar_t		*fs_pk3Index;
 static	searchpath_t	*fs_searchpaths;
 static	int			fs_readCount;			// total bytes read
 static	int			fs_loadCount;			// total files read
@@ -262,6 +275,13 @@ typedef struct {
 	int			zipFilePos;
 	int			zipFileLen;
 	qboolean	zipFile;
+	const char	*zipFilename;
+	const byte	*zipMapped;			// the mapped pk3, NULL when reading through minizip
+	const byte	*zipData;			// stored or deflated data of the file in zipMapped
+	int			zipDataLen;
+	int			zipDataPos;			// uncompressed bytes read
+	qboolean	zipInflate;
+	z_stream	zipStream;
 	char		name[MAX_ZPATH];
 } fileHandleData_t;
 
@@ -363,7 +383,7 @@ static fileHandle_t	FS_HandleForFile(void) {
 	int		i;
 
 	for ( i = 1 ; i < MAX_FILE_HANDLES ; i++ ) {
-		if ( fsh[i].handleFiles.file.o == NULL ) {
+		if ( fsh[i].handleFiles.file.o == NULL && !fsh[i].zipMapped ) {
 			return i;
 		}
 	}
@@ -371,7 +391,7 @@ static fileHandle_t	FS_HandleForFile(void) {
 	return 0;
 }
 
-static FILE	*FS_FileForHandle( fileHandle_t f ) {
+FILE	*FS_FileForHandle( fileHandle_t f ) {
 	if ( f < 0 || f > MAX_FILE_HANDLES ) {
 		Com_Error( ERR_DROP, "FS_FileForHandle: out of reange" );
 	}
@@ -918,6 +938,175 @@ void FS_Rename( const char *from, const char *to ) {
 	}
 }
 
+/*
+==========================================================================
+
+MAPPED PK3 FILES
+
+With fs_mmap the whole pk3 is mapped and files in it are read straight
+from memory, stored ones by copying and deflated ones through zlib.
+
+==========================================================================
+*/
+
+#define ZIP_SHORT( p )			( (unsigned)(p)[0] | ( (unsigned)(p)[1] << 8 ) )
+#define ZIP_LONG( p )			( ZIP_SHORT( p ) | ( ZIP_SHORT( (p) + 2 ) << 16 ) )
+
+#define ZIP_LOCAL_MAGIC			0x04034b50
+#define ZIP_CENTRAL_MAGIC		0x02014b50
+#define ZIP_END_MAGIC			0x06054b50
+
+#define ZIP_LOCAL_SIZE			30
+#define ZIP_CENTRAL_SIZE		46
+#define ZIP_END_SIZE			22
+
+/*
+=================
+FS_MappedFileData
+
+Returns the data of a file in a mapped pk3, or NULL if its headers are
+damaged or it is neither stored nor deflated
+=================
+*/
+static const byte *FS_MappedFileData( const pack_t *pak, const fileInPack_t *pakFile, int *method, int *dataLen, unsigned *crc ) {
+	const byte	*entry, *local;
+	int64_t		offset;
+	unsigned	flag;
+
+	offset = (int64_t)pak->zipOffset + pakFile->pos;
+	if ( offset + ZIP_CENTRAL_SIZE > pak->mappedLen ) {
+		return NULL;
+	}
+
+	entry = pak->mapped + offset;
+	if ( ZIP_LONG( entry ) != ZIP_CENTRAL_MAGIC ) {
+		return NULL;
+	}
+
+	flag = ZIP_SHORT( entry + 8 );
+	*method = ZIP_SHORT( entry + 10 );
+	*crc = ZIP_LONG( entry + 16 );
+	*dataLen = ZIP_LONG( entry + 20 );
+	if ( ( flag & 1 ) || ( *method != 0 && *method != Z_DEFLATED ) || *dataLen < 0 ) {
+		return NULL;
+	}
+
+	offset = (int64_t)pak->zipOffset + ZIP_LONG( entry + 42 );
+	if ( offset + ZIP_LOCAL_SIZE > pak->mappedLen ) {
+		return NULL;
+	}
+
+	local = pak->mapped + offset;
+	if ( ZIP_LONG( local ) != ZIP_LOCAL_MAGIC ) {
+		return NULL;
+	}
+
+	offset += ZIP_LOCAL_SIZE + ZIP_SHORT( local + 26 ) + ZIP_SHORT( local + 28 );
+	if ( offset + *dataLen > pak->mappedLen || ( *method == 0 && *dataLen < (int)pakFile->len ) ) {
+		return NULL;
+	}
+
+	return pak->mapped + offset;
+}
+
+/*
+=================
+FS_OpenMappedFile
+=================
+*/
+static qboolean FS_OpenMappedFile( fileHandleData_t *fh, const pack_t *pak, const fileInPack_t *pakFile, unsigned *crc ) {
+	const byte	*data;
+	int			method;
+	int			dataLen;
+
+	data = FS_MappedFileData( pak, pakFile, &method, &dataLen, crc );
+	if ( !data ) {
+		return qfalse;
+	}
+
+	fh->zipMapped = pak->mapped;
+	fh->zipData = data;
+	fh->zipDataLen = dataLen;
+	fh->zipDataPos = 0;
+	fh->zipFileLen = pakFile->len;
+
+	if ( method == Z_DEFLATED ) {
+		Com_Memset( &fh->zipStream, 0, sizeof( fh->zipStream ) );
+		fh->zipStream.next_in = (Bytef *)data;
+		fh->zipStream.avail_in = dataLen;
+		if ( inflateInit2( &fh->zipStream, -MAX_WBITS ) != Z_OK ) {
+			fh->zipMapped = NULL;
+			return qfalse;
+		}
+		fh->zipInflate = qtrue;
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+FS_ReadMappedFile
+=================
+*/
+static int FS_ReadMappedFile( fileHandleData_t *fh, void *buffer, int len ) {
+	int		err;
+
+	if ( len > fh->zipFileLen - fh->zipDataPos ) {
+		len = fh->zipFileLen - fh->zipDataPos;
+	}
+
+	// inflate fails without room for output, minizip just returns 0
+	if ( len <= 0 ) {
+		return 0;
+	}
+
+	if ( !fh->zipInflate ) {
+		Com_Memcpy( buffer, fh->zipData + fh->zipDataPos, len );
+		fh->zipDataPos += len;
+		return len;
+	}
+
+	fh->zipStream.next_out = (Bytef *)buffer;
+	fh->zipStream.avail_out = len;
+	err = inflate( &fh->zipStream, Z_SYNC_FLUSH );
+	if ( err != Z_OK && err != Z_STREAM_END ) {
+		return -1;
+	}
+
+	len -= fh->zipStream.avail_out;
+	fh->zipDataPos += len;
+	return len;
+}
+
+/*
+=================
+FS_RewindMappedFile
+=================
+*/
+static void FS_RewindMappedFile( fileHandleData_t *fh ) {
+	fh->zipDataPos = 0;
+
+	if ( fh->zipInflate ) {
+		inflateReset( &fh->zipStream );
+		fh->zipStream.next_in = (Bytef *)fh->zipData;
+		fh->zipStream.avail_in = fh->zipDataLen;
+	}
+}
+
+/*
+=================
+FS_CloseMappedFile
+=================
+*/
+static void FS_CloseMappedFile( fileHandleData_t *fh ) {
+	if ( fh->zipInflate ) {
+		inflateEnd( &fh->zipStream );
+	}
+
+	Com_Memset( fh, 0, sizeof( *fh ) );
+}
+
 /*
 ==============
 FS_FCloseFile
@@ -933,6 +1122,11 @@ void FS_FCloseFile( fileHandle_t f ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
 	}
 
+	if ( fsh[f].zipMapped ) {
+		FS_CloseMappedFile( &fsh[f] );
+		return;
+	}
+
 	if (fsh[f].zipFile == qtrue) {
 		unzCloseCurrentFile( fsh[f].handleFiles.file.z );
 		if ( fsh[f].handleFiles.unique ) {
@@ -1146,6 +1340,8 @@ Reads a file from specified pak_t and saves it's data in buffer
 int FS_PakReadFile(pack_t *pak, const char *filename, char *buffer, int bufferlen) {
 	int hash, len;
 	fileInPack_t *pakFile;
+	fileHandleData_t fh;
+	unsigned crc;
 
 	hash = FS_HashFileName(filename, pak->hashSize);
 	pakFile = pak->hashTable[hash];
@@ -1153,6 +1349,17 @@ int FS_PakReadFile(pack_t *pak, const char *filename, char *buffer, int bufferle
 		do {
 			// case and separator insensitive comparisons
 			if (!FS_FilenameCompare(pakFile->name, filename)) {
+				if (pak->mapped) {
+					Com_Memset(&fh, 0, sizeof(fh));
+					if (!FS_OpenMappedFile(&fh, pak, pakFile, &crc)) {
+						return 0;
+					}
+					len = FS_ReadMappedFile(&fh, buffer, bufferlen);
+					FS_CloseMappedFile(&fh);
+
+					return len;
+				}
+
 				unzSetOffset(pak->handle, pakFile->pos);
 				unzOpenCurrentFile(pak->handle);
 				len = unzReadCurrentFile(pak->handle, buffer, bufferlen);
@@ -1193,6 +1400,7 @@ int FS_FOpenFileReadHash(const char *filename, fileHandle_t *file, qboolean uniq
 	directory_t		*dir;
 	int			hash;
 	int				l;
+	unsigned		crc;
 	char demoExt[16];
 
 	hash = 0;
@@ -1302,24 +1510,35 @@ int FS_FOpenFileReadHash(const char *filename, fileHandle_t *file, qboolean uniq
 						}
 					}
 
-					if (uniqueFILE)
-					{
-						// open a new file on the pakfile
-						fsh[*file].handleFiles.file.z = unzOpen(pak->pakFilename);
-
-						if (fsh[*file].handleFiles.file.z == NULL)
-							Com_Error(ERR_FATAL, "Couldn't open %s", pak->pakFilename);
-					} else
-						fsh[*file].handleFiles.file.z = pak->handle;
+					if (pak->mapped) {
+						// every handle inflates on its own, so they are all unique
+						if (!FS_OpenMappedFile(&fsh[*file], pak, pakFile, &crc)) {
+							Com_Printf(S_COLOR_YELLOW "WARNING: %s in %s is damaged\n", filename, pak->pakFilename);
+							Com_Memset(&fsh[*file], 0, sizeof(fsh[*file]));
+							*file = 0;
+							return -1;
+						}
+					} else {
+						if (uniqueFILE)
+						{
+							// open a new file on the pakfile
+							fsh[*file].handleFiles.file.z = unzOpen(pak->pakFilename);
+
+							if (fsh[*file].handleFiles.file.z == NULL)
+								Com_Error(ERR_FATAL, "Couldn't open %s", pak->pakFilename);
+						} else
+							fsh[*file].handleFiles.file.z = pak->handle;
+
+						// set the file position in the zip file (also sets the current file info)
+						unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
+
+						// open the file in the zip
+						unzOpenCurrentFile(fsh[*file].handleFiles.file.z);
+					}
 
 					Q_strncpyz(fsh[*file].name, filename, sizeof(fsh[*file].name));
 					fsh[*file].zipFile = qtrue;
-
-					// set the file position in the zip file (also sets the current file info)
-					unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
-
-					// open the file in the zip
-					unzOpenCurrentFile(fsh[*file].handleFiles.file.z);
+					fsh[*file].zipFilename = pak->pakFilename;
 					fsh[*file].zipFilePos = pakFile->pos;
 					fsh[*file].zipFileLen = pakFile->len;
 
@@ -1341,7 +1560,9 @@ int FS_FOpenFileReadHash(const char *filename, fileHandle_t *file, qboolean uniq
 					if (filehash) {
 						unz_file_info fi;
 
-						if (!unzGetCurrentFileInfo(fsh[*file].handleFiles.file.z, &fi, NULL, 0, NULL, 0, NULL, 0)) {
+						if (pak->mapped) {
+							*filehash = crc;
+						} else if (!unzGetCurrentFileInfo(fsh[*file].handleFiles.file.z, &fi, NULL, 0, NULL, 0, NULL, 0)) {
 							*filehash = fi.crc;
 						}
 					}
@@ -1475,6 +1696,8 @@ int FS_Read( void *buffer, int len, fileHandle_t f ) {
 			buf += read;
 		}
 		return len;
+	} else if (fsh[f].zipMapped) {
+		return FS_ReadMappedFile(&fsh[f], buffer, len);
 	} else {
 		return unzReadCurrentFile(fsh[f].handleFiles.file.z, buffer, len);
 	}
@@ -1555,7 +1778,18 @@ int FS_Seek( fileHandle_t f, int offset, int origin ) {
 		return -1;
 	}
 
-	if (fsh[f].zipFile == qtrue) {
+	if (fsh[f].zipMapped) {
+		if (offset == 0 && origin == FS_SEEK_SET) {
+			FS_RewindMappedFile(&fsh[f]);
+			return 0;
+		} else if (offset<65536) {
+			FS_RewindMappedFile(&fsh[f]);
+			return FS_Read(foo, offset, f);
+		} else {
+			Com_Error( ERR_FATAL, "ZIP FILE FSEEK NOT YET IMPLEMENTED\n" );
+			return -1;
+		}
+	} else if (fsh[f].zipFile == qtrue) {
 		if (offset == 0 && origin == FS_SEEK_SET) {
 			// set the file position in the zip file (also sets the current file info)
 			unzSetOffset(fsh[f].handleFiles.file.z, fsh[f].zipFilePos);
@@ -1824,6 +2058,83 @@ void FS_FreeFile( void *buffer ) {
 	Z_Free( buffer );
 }
 
+/*
+=============
+FS_MapFile
+
+Maps a loose file or a file stored uncompressed in a pk3 copy-on-write
+instead of reading it. Returns NULL if the file can't be mapped, then
+FS_ReadFile has to be used.
+=============
+*/
+void *FS_MapFile( const char *qpath, int *len ) {
+	fileHandle_t	h;
+	unz_file_info	fi;
+	FILE			*f;
+	int64_t			offset;
+	void			*data;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	*len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( !h ) {
+		return NULL;
+	}
+
+	data = NULL;
+	if ( *len > 0 ) {
+		if ( fsh[h].zipMapped ) {
+			// only stored entries can be used as they are
+			offset = fsh[h].zipData - fsh[h].zipMapped;
+			if ( !fsh[h].zipInflate && !( offset & 3 ) ) {
+				f = fopen( fsh[h].zipFilename, "rb" );
+				if ( f ) {
+					data = Sys_MapFile( f, offset, *len );
+					fclose( f );
+				}
+			}
+		} else if ( fsh[h].zipFile ) {
+			// only stored entries can be used as they are
+			if ( !unzGetCurrentFileInfo( fsh[h].handleFiles.file.z, &fi, NULL, 0, NULL, 0, NULL, 0 )
+				&& fi.compression_method == 0 && !( fi.flag & 1 ) ) {
+				offset = unzGetCurrentFileZStreamPos64( fsh[h].handleFiles.file.z );
+				f = fopen( fsh[h].zipFilename, "rb" );
+				if ( f && !( offset & 3 ) ) {
+					data = Sys_MapFile( f, offset, *len );
+				}
+				if ( f ) {
+					fclose( f );
+				}
+			}
+		} else {
+			data = Sys_MapFile( fsh[h].handleFiles.file.o, 0, *len );
+		}
+	}
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_MapFile: %s %s\n", qpath, data ? "mapped" : "can't be mapped" );
+	}
+
+	FS_FCloseFile( h );
+
+	return data;
+}
+
+/*
+=============
+FS_UnmapFile
+=============
+*/
+void FS_UnmapFile( void *data, int len ) {
+	if ( !data ) {
+		Com_Error( ERR_FATAL, "FS_UnmapFile( NULL )" );
+	}
+
+	Sys_UnmapFile( data, len );
+}
+
 /*
 ============
 FS_WriteFile
@@ -1855,6 +2166,398 @@ void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
 
 
 
+/*
+==========================================================================
+
+PK3 INDEX
+
+The file lists of the loaded pk3s are kept in pk3index.dat in fs_homepath,
+so startup doesn't have to go through every central directory again. A
+record is only used while its pk3 has the same size, modification time and
+end of central directory record.
+
+==========================================================================
+*/
+
+#define PK3INDEX_NAME			"pk3index.dat"
+#define PK3INDEX_IDENT			(('I'<<24)+('3'<<16)+('K'<<8)+'P')
+#define PK3INDEX_VERSION		1
+#define MAX_PK3INDEX_SIZE		( 64 * 1024 * 1024 )
+
+typedef struct {
+	const byte	*data;
+	int			len;
+	int			pos;
+	qboolean	overflowed;
+} pk3IndexReader_t;
+
+typedef struct {
+	const char	*path;
+	int64_t		fileSize;
+	int64_t		fileTime;
+	int			zipOffset;
+	int			centralOffset;
+	int			centralSize;
+	int			numfiles;
+	int			mvinfoGvc;
+	int			numHeaderLongs;
+	int			namesLen;
+	const byte	*headerLongs;
+	const byte	*files;					// pos and len of every file
+	const char	*names;
+	int			start;					// whole record in fs_pk3IndexData
+	int			len;
+	qboolean	replaced;				// a pk3 with this path was loaded
+} pk3IndexRecord_t;
+
+static byte				*fs_pk3IndexData;
+static pk3IndexRecord_t	*fs_pk3IndexRecords;
+static int				fs_numPk3IndexRecords;
+static qboolean			fs_pk3IndexModified;
+
+static int FS_IndexReadInt( pk3IndexReader_t *r ) {
+	int		v;
+
+	if ( r->len - r->pos < 4 ) {
+		r->overflowed = qtrue;
+		return 0;
+	}
+
+	Com_Memcpy( &v, r->data + r->pos, 4 );
+	r->pos += 4;
+
+	return LittleLong( v );
+}
+
+static int64_t FS_IndexReadInt64( pk3IndexReader_t *r ) {
+	unsigned	lo;
+	int			hi;
+
+	lo = (unsigned)FS_IndexReadInt( r );
+	hi = FS_IndexReadInt( r );
+
+	return (int64_t)( ( (uint64_t)(unsigned)hi << 32 ) | lo );
+}
+
+static const byte *FS_IndexReadData( pk3IndexReader_t *r, int len ) {
+	const byte	*data;
+
+	if ( len < 0 || r->len - r->pos < len ) {
+		r->overflowed = qtrue;
+		return NULL;
+	}
+
+	data = r->data + r->pos;
+	r->pos += len;
+
+	return data;
+}
+
+static void FS_IndexWriteInt( FILE *f, int v ) {
+	v = LittleLong( v );
+	fwrite( &v, 4, 1, f );
+}
+
+static void FS_IndexWriteInt64( FILE *f, int64_t v ) {
+	FS_IndexWriteInt( f, (int)( (uint64_t)v & 0xffffffff ) );
+	FS_IndexWriteInt( f, (int)( (uint64_t)v >> 32 ) );
+}
+
+/*
+=================
+FS_ParsePk3IndexRecord
+=================
+*/
+static qboolean FS_ParsePk3IndexRecord( pk3IndexReader_t *r, pk3IndexRecord_t *rec ) {
+	int		pathLen, numNames, i;
+
+	rec->start = r->pos;
+
+	pathLen = FS_IndexReadInt( r );
+	rec->path = (const char *)FS_IndexReadData( r, pathLen );
+	rec->fileSize = FS_IndexReadInt64( r );
+	rec->fileTime = FS_IndexReadInt64( r );
+	rec->zipOffset = FS_IndexReadInt( r );
+	rec->centralOffset = FS_IndexReadInt( r );
+	rec->centralSize = FS_IndexReadInt( r );
+	rec->numfiles = FS_IndexReadInt( r );
+	rec->mvinfoGvc = FS_IndexReadInt( r );
+	rec->numHeaderLongs = FS_IndexReadInt( r );
+	rec->namesLen = FS_IndexReadInt( r );
+
+	if ( r->overflowed || pathLen < 1 || rec->path[pathLen - 1] ||
+		rec->numfiles < 0 || rec->numfiles > 0xffff ||
+		rec->numHeaderLongs < 0 || rec->numHeaderLongs > rec->numfiles ) {
+		return qfalse;
+	}
+
+	rec->headerLongs = FS_IndexReadData( r, rec->numHeaderLongs * 4 );
+	rec->files = FS_IndexReadData( r, rec->numfiles * 8 );
+	rec->names = (const char *)FS_IndexReadData( r, rec->namesLen );
+	if ( r->overflowed ) {
+		return qfalse;
+	}
+
+	// every file needs exactly one terminated name
+	numNames = 0;
+	for ( i = 0 ; i < rec->namesLen ; i++ ) {
+		if ( !rec->names[i] ) {
+			numNames++;
+		}
+	}
+	if ( numNames != rec->numfiles || ( rec->namesLen && rec->names[rec->namesLen - 1] ) ) {
+		return qfalse;
+	}
+
+	rec->len = r->pos - rec->start;
+	rec->replaced = qfalse;
+
+	return qtrue;
+}
+
+/*
+=================
+FS_FreePk3Index
+=================
+*/
+static void FS_FreePk3Index( void ) {
+	Z_Free( fs_pk3IndexRecords );
+	Z_Free( fs_pk3IndexData );
+
+	fs_pk3IndexRecords = NULL;
+	fs_pk3IndexData = NULL;
+	fs_numPk3IndexRecords = 0;
+	fs_pk3IndexModified = qfalse;
+}
+
+/*
+=================
+FS_LoadPk3Index
+=================
+*/
+static void FS_LoadPk3Index( void ) {
+	char				ospath[MAX_OSPATH];
+	FILE				*f;
+	long				len;
+	pk3IndexReader_t	r;
+	int					i;
+
+	if ( !fs_pk3Index->integer || !fs_homepath->string[0] ) {
+		return;
+	}
+
+	Q_strncpyz( ospath, FS_BuildOSPath( fs_homepath->string, PK3INDEX_NAME ), sizeof( ospath ) );
+
+	f = fopen( ospath, "rb" );
+	if ( !f ) {
+		// written after the pk3s are loaded
+		fs_pk3IndexModified = qtrue;
+		return;
+	}
+
+	fseek( f, 0, SEEK_END );
+	len = ftell( f );
+	fseek( f, 0, SEEK_SET );
+
+	if ( len < 12 || len > MAX_PK3INDEX_SIZE ) {
+		fclose( f );
+		fs_pk3IndexModified = qtrue;
+		return;
+	}
+
+	fs_pk3IndexData = (byte *)Z_Malloc( (int)len, TAG_FILESYS, qfalse );
+	if ( fread( fs_pk3IndexData, 1, len, f ) != (size_t)len ) {
+		len = 0;
+	}
+	fclose( f );
+
+	Com_Memset( &r, 0, sizeof( r ) );
+	r.data = fs_pk3IndexData;
+	r.len = (int)len;
+
+	if ( FS_IndexReadInt( &r ) != PK3INDEX_IDENT || FS_IndexReadInt( &r ) != PK3INDEX_VERSION ) {
+		FS_FreePk3Index();
+		fs_pk3IndexModified = qtrue;
+		return;
+	}
+
+	// each record is at least 49 bytes
+	fs_numPk3IndexRecords = FS_IndexReadInt( &r );
+	if ( r.overflowed || fs_numPk3IndexRecords < 0 || fs_numPk3IndexRecords > ( r.len - r.pos ) / 49 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %s is damaged, rebuilding it\n", ospath );
+		FS_FreePk3Index();
+		fs_pk3IndexModified = qtrue;
+		return;
+	}
+
+	fs_pk3IndexRecords = (pk3IndexRecord_t *)Z_Malloc( fs_numPk3IndexRecords * sizeof( pk3IndexRecord_t ) + 1, TAG_FILESYS, qtrue );
+	for ( i = 0 ; i < fs_numPk3IndexRecords ; i++ ) {
+		if ( !FS_ParsePk3IndexRecord( &r, &fs_pk3IndexRecords[i] ) ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: %s is damaged, rebuilding it\n", ospath );
+			FS_FreePk3Index();
+			fs_pk3IndexModified = qtrue;
+			return;
+		}
+	}
+}
+
+/*
+=================
+FS_ReadPk3Index
+
+Fills in the file list of a pk3 from its index record, if it has a
+current one. FS_ReadZipEnd must have been called on the pack.
+=================
+*/
+static qboolean FS_ReadPk3Index( pack_t *pak, const char *zipfile ) {
+	pk3IndexRecord_t	*rec;
+	const char			*name;
+	int					i;
+
+	for ( i = 0 ; i < fs_numPk3IndexRecords ; i++ ) {
+		if ( !strcmp( fs_pk3IndexRecords[i].path, zipfile ) ) {
+			break;
+		}
+	}
+	if ( i == fs_numPk3IndexRecords ) {
+		return qfalse;
+	}
+
+	rec = &fs_pk3IndexRecords[i];
+	rec->replaced = qtrue;
+
+	if ( rec->fileSize != pak->fileSize || rec->fileTime != pak->fileTime ||
+		rec->zipOffset != pak->zipOffset || rec->centralOffset != pak->centralOffset ||
+		rec->centralSize != pak->centralSize || rec->numfiles != pak->numfiles ) {
+		return qfalse;
+	}
+
+	pak->mvinfoGvc = rec->mvinfoGvc;
+
+	pak->numHeaderLongs = rec->numHeaderLongs;
+	pak->headerLongs = (int *)Z_Malloc( pak->numfiles * sizeof( int ), TAG_FILESYS, qtrue );
+	for ( i = 0 ; i < rec->numHeaderLongs ; i++ ) {
+		Com_Memcpy( &pak->headerLongs[i], rec->headerLongs + i * 4, 4 );
+	}
+
+	pak->buildBuffer = (fileInPack_t *)Z_Malloc( pak->numfiles * sizeof( fileInPack_t ) + rec->namesLen, TAG_FILESYS, qtrue );
+	name = (char *)( pak->buildBuffer + pak->numfiles );
+	Com_Memcpy( (char *)name, rec->names, rec->namesLen );
+
+	for ( i = 0 ; i < pak->numfiles ; i++ ) {
+		pak->buildBuffer[i].name = (char *)name;
+		pak->buildBuffer[i].pos = (unsigned)LittleLong( ((const int *)rec->files)[i * 2] );
+		pak->buildBuffer[i].len = (unsigned)LittleLong( ((const int *)rec->files)[i * 2 + 1] );
+		name += strlen( name ) + 1;
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+FS_WritePk3Index
+
+Writes the records of all loaded pk3s, keeping those of pk3s that still
+exist but belong to other mods
+=================
+*/
+static void FS_WritePk3Index( void ) {
+	char			ospath[MAX_OSPATH];
+	char			tmppath[MAX_OSPATH];
+	FILE			*f;
+	searchpath_t	*search;
+	pack_t			*pak;
+	int				numRecords, namesLen, i;
+	qboolean		failed;
+
+	if ( !fs_pk3Index->integer || !fs_homepath->string[0] || !fs_pk3IndexModified ) {
+		return;
+	}
+
+	numRecords = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack && search->pack->indexed ) {
+			numRecords++;
+		}
+	}
+	for ( i = 0 ; i < fs_numPk3IndexRecords ; i++ ) {
+		if ( !fs_pk3IndexRecords[i].replaced && Sys_FileTime( fs_pk3IndexRecords[i].path ) != -1 ) {
+			numRecords++;
+		} else {
+			fs_pk3IndexRecords[i].replaced = qtrue;
+		}
+	}
+
+	Q_strncpyz( ospath, FS_BuildOSPath( fs_homepath->string, PK3INDEX_NAME ), sizeof( ospath ) );
+	Com_sprintf( tmppath, sizeof( tmppath ), "%s.tmp", ospath );
+
+	FS_CreatePath( tmppath );
+	f = fopen( tmppath, "wb" );
+	if ( !f ) {
+		Com_DPrintf( "Couldn't write %s\n", ospath );
+		return;
+	}
+
+	FS_IndexWriteInt( f, PK3INDEX_IDENT );
+	FS_IndexWriteInt( f, PK3INDEX_VERSION );
+	FS_IndexWriteInt( f, numRecords );
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		pak = search->pack;
+		if ( !pak || !pak->indexed ) {
+			continue;
+		}
+
+		namesLen = 0;
+		for ( i = 0 ; i < pak->numfiles ; i++ ) {
+			namesLen += (int)strlen( pak->buildBuffer[i].name ) + 1;
+		}
+
+		FS_IndexWriteInt( f, (int)strlen( pak->pakFilename ) + 1 );
+		fwrite( pak->pakFilename, strlen( pak->pakFilename ) + 1, 1, f );
+		FS_IndexWriteInt64( f, pak->fileSize );
+		FS_IndexWriteInt64( f, pak->fileTime );
+		FS_IndexWriteInt( f, pak->zipOffset );
+		FS_IndexWriteInt( f, pak->centralOffset );
+		FS_IndexWriteInt( f, pak->centralSize );
+		FS_IndexWriteInt( f, pak->numfiles );
+		FS_IndexWriteInt( f, pak->mvinfoGvc );
+		FS_IndexWriteInt( f, pak->numHeaderLongs );
+		FS_IndexWriteInt( f, namesLen );
+
+		// header longs are kept in the byte order they are checksummed in
+		fwrite( pak->headerLongs, 4, pak->numHeaderLongs, f );
+		for ( i = 0 ; i < pak->numfiles ; i++ ) {
+			FS_IndexWriteInt( f, (int)pak->buildBuffer[i].pos );
+			FS_IndexWriteInt( f, (int)pak->buildBuffer[i].len );
+		}
+		for ( i = 0 ; i < pak->numfiles ; i++ ) {
+			fwrite( pak->buildBuffer[i].name, strlen( pak->buildBuffer[i].name ) + 1, 1, f );
+		}
+	}
+
+	for ( i = 0 ; i < fs_numPk3IndexRecords ; i++ ) {
+		if ( !fs_pk3IndexRecords[i].replaced ) {
+			fwrite( fs_pk3IndexData + fs_pk3IndexRecords[i].start, fs_pk3IndexRecords[i].len, 1, f );
+		}
+	}
+
+	failed = (qboolean)( ferror( f ) != 0 );
+	if ( fclose( f ) ) {
+		failed = qtrue;
+	}
+
+	if ( failed ) {
+		Com_DPrintf( "Couldn't write %s\n", ospath );
+		remove( tmppath );
+		return;
+	}
+
+	remove( ospath );
+	rename( tmppath, ospath );
+}
+
 /*
 ==========================================================================
 
@@ -1865,16 +2568,144 @@ ZIP FILE LOADING
 
 /*
 =================
-FS_LoadZipFile
+FS_ReadZipEnd
 
-Creates a new pak_t in the search chain for the contents
-of a zip file.
+Finds the end of central directory record of a pk3 and reads where its
+central directory is. Zip64 and multi-disk archives are left to minizip.
 =================
 */
-static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
-{
-	fileInPack_t	*buildBuffer;
-	pack_t			*pack;
+static qboolean FS_ReadZipEnd( pack_t *pak, FILE *f ) {
+	byte		buf[ZIP_END_SIZE + 0xffff];
+	const byte	*tail, *end;
+	int			tailLen, i;
+	int64_t		centralPos;
+	unsigned	numEntries, centralSize, centralOffset;
+
+	if ( pak->fileSize < ZIP_END_SIZE ) {
+		return qfalse;
+	}
+
+	tailLen = (int)MIN( pak->fileSize, (int64_t)sizeof( buf ) );
+	if ( pak->mapped ) {
+		tail = pak->mapped + pak->mappedLen - tailLen;
+	} else {
+		// most pk3s have no comment, so try just the record first
+		if ( fseek( f, (long)( pak->fileSize - ZIP_END_SIZE ), SEEK_SET ) ||
+			fread( buf, ZIP_END_SIZE, 1, f ) != 1 ) {
+			return qfalse;
+		}
+
+		if ( ZIP_LONG( buf ) == ZIP_END_MAGIC ) {
+			tailLen = ZIP_END_SIZE;
+		} else if ( fseek( f, (long)( pak->fileSize - tailLen ), SEEK_SET ) ||
+			fread( buf, tailLen, 1, f ) != 1 ) {
+			return qfalse;
+		}
+		tail = buf;
+	}
+
+	end = NULL;
+	for ( i = tailLen - ZIP_END_SIZE ; i >= 0 ; i-- ) {
+		if ( ZIP_LONG( tail + i ) == ZIP_END_MAGIC ) {
+			end = tail + i;
+			break;
+		}
+	}
+
+	if ( !end || ZIP_SHORT( end + 4 ) || ZIP_SHORT( end + 6 ) ) {
+		return qfalse;
+	}
+
+	numEntries = ZIP_SHORT( end + 10 );
+	centralSize = ZIP_LONG( end + 12 );
+	centralOffset = ZIP_LONG( end + 16 );
+	if ( numEntries != ZIP_SHORT( end + 8 ) || numEntries == 0xffff ||
+		centralSize == 0xffffffff || centralOffset == 0xffffffff ) {
+		return qfalse;
+	}
+
+	centralPos = pak->fileSize - tailLen + ( end - tail );
+	if ( centralPos < (int64_t)centralOffset + centralSize || centralPos > 0x7fffffff ) {
+		return qfalse;
+	}
+
+	pak->numfiles = (int)numEntries;
+	pak->centralSize = (int)centralSize;
+	pak->centralOffset = (int)centralOffset;
+	pak->zipOffset = (int)( centralPos - centralOffset - centralSize );
+
+	return qtrue;
+}
+
+/*
+=================
+FS_ParseZipDirectory
+
+Builds the file list and the header longs of a pk3 from its central
+directory, the same way the minizip walk in FS_ReadZipDirectory does
+=================
+*/
+static qboolean FS_ParseZipDirectory( pack_t *pak, const byte *central ) {
+	const byte	*p, *centralEnd;
+	char		*namePtr;
+	int			i, len, nameLen;
+
+	// validate everything and size the names
+	p = central;
+	centralEnd = central + pak->centralSize;
+	len = 0;
+	for ( i = 0 ; i < pak->numfiles ; i++ ) {
+		if ( centralEnd - p < ZIP_CENTRAL_SIZE || ZIP_LONG( p ) != ZIP_CENTRAL_MAGIC ||
+			ZIP_LONG( p + 20 ) == 0xffffffff || ZIP_LONG( p + 24 ) >= 0x80000000u ) {
+			return qfalse;
+		}
+
+		nameLen = ZIP_SHORT( p + 28 );
+		if ( centralEnd - p < ZIP_CENTRAL_SIZE + nameLen + (int)ZIP_SHORT( p + 30 ) + (int)ZIP_SHORT( p + 32 ) ) {
+			return qfalse;
+		}
+
+		len += MIN( nameLen, MAX_ZPATH - 1 ) + 1;
+		p += ZIP_CENTRAL_SIZE + nameLen + ZIP_SHORT( p + 30 ) + ZIP_SHORT( p + 32 );
+	}
+
+	pak->buildBuffer = (fileInPack_t *)Z_Malloc( pak->numfiles * sizeof( fileInPack_t ) + len, TAG_FILESYS, qtrue );
+	pak->headerLongs = (int *)Z_Malloc( pak->numfiles * sizeof( int ), TAG_FILESYS, qtrue );
+	pak->numHeaderLongs = 0;
+	namePtr = (char *)( pak->buildBuffer + pak->numfiles );
+
+	p = central;
+	for ( i = 0 ; i < pak->numfiles ; i++ ) {
+		nameLen = MIN( (int)ZIP_SHORT( p + 28 ), MAX_ZPATH - 1 );
+
+		if ( ZIP_LONG( p + 24 ) > 0 ) {
+			pak->headerLongs[pak->numHeaderLongs++] = LittleLong( (int)ZIP_LONG( p + 16 ) );
+		}
+
+		pak->buildBuffer[i].name = namePtr;
+		Com_Memcpy( namePtr, p + ZIP_CENTRAL_SIZE, nameLen );
+		namePtr[nameLen] = '\0';
+		Q_strlwr( namePtr );
+		namePtr += nameLen + 1;
+
+		pak->buildBuffer[i].pos = pak->centralOffset + (int)( p - central );
+		pak->buildBuffer[i].len = ZIP_LONG( p + 24 );
+
+		p += ZIP_CENTRAL_SIZE + ZIP_SHORT( p + 28 ) + ZIP_SHORT( p + 30 ) + ZIP_SHORT( p + 32 );
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+FS_ReadZipDirectory
+
+Builds the file list and the header longs of a pk3 through minizip, for
+everything FS_ParseZipDirectory does not handle
+=================
+*/
+static qboolean FS_ReadZipDirectory( pack_t *pak, const char *zipfile ) {
 	unzFile			uf;
 	int				err;
 	unz_global_info gi;
@@ -1882,20 +2713,17 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 	unz_file_info	file_info;
 	int				i;
 	size_t			len;
-	int			hash;
-	int				fs_numHeaderLongs;
-	int				*fs_headerLongs;
 	char			*namePtr;
 
-	fs_numHeaderLongs = 0;
-
 	uf = unzOpen(zipfile);
 	err = unzGetGlobalInfo (uf,&gi);
 
-	if (err != UNZ_OK)
-		return NULL;
-
-	fs_packFiles += gi.number_entry;
+	if (err != UNZ_OK) {
+		if (uf) {
+			unzClose(uf);
+		}
+		return qfalse;
+	}
 
 	len = 0;
 	unzGoToFirstFile(uf);
@@ -1909,19 +2737,187 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 		unzGoToNextFile(uf);
 	}
 
-	buildBuffer = (struct fileInPack_s *)Z_Malloc((int)((gi.number_entry * sizeof(fileInPack_t)) + len), TAG_FILESYS, qtrue);
-	namePtr = ((char *) buildBuffer) + gi.number_entry * sizeof( fileInPack_t );
-	fs_headerLongs = (int *)Z_Malloc( gi.number_entry * sizeof(int), TAG_FILESYS, qtrue );
+	pak->buildBuffer = (struct fileInPack_s *)Z_Malloc((int)((gi.number_entry * sizeof(fileInPack_t)) + len), TAG_FILESYS, qtrue);
+	namePtr = ((char *) pak->buildBuffer) + gi.number_entry * sizeof( fileInPack_t );
+	pak->headerLongs = (int *)Z_Malloc( gi.number_entry * sizeof(int), TAG_FILESYS, qtrue );
+	pak->numHeaderLongs = 0;
+
+	pak->handle = uf;
+	pak->numfiles = gi.number_entry;
+	unzGoToFirstFile(uf);
+
+	for (i = 0; i < gi.number_entry; i++)
+	{
+		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
+		if (err != UNZ_OK) {
+			break;
+		}
+		if (file_info.uncompressed_size > 0) {
+			pak->headerLongs[pak->numHeaderLongs++] = LittleLong(file_info.crc);
+		}
+		Q_strlwr( filename_inzip );
+		pak->buildBuffer[i].name = namePtr;
+		strcpy( pak->buildBuffer[i].name, filename_inzip );
+		namePtr += strlen(filename_inzip) + 1;
+		// store the file position in the zip
+		pak->buildBuffer[i].pos = unzGetOffset(uf);
+		pak->buildBuffer[i].len = file_info.uncompressed_size;
+		unzGoToNextFile(uf);
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+FS_PakMVInfo
+
+Returns the game-version compatibility from the mv.info file in the
+root directory of a pk3, or -1 if it has none
+=================
+*/
+static int FS_PakMVInfo( pack_t *pack ) {
+	char	cversion[128];
+	int		cversionlen;
+	int		gvc;
+
+	cversionlen = FS_PakReadFile(pack, "mv.info", cversion, sizeof(cversion) - 1);
+	if (!cversionlen) {
+		return -1;
+	}
+
+	cversion[cversionlen] = '\0';
+	gvc = PACKGVC_UNKNOWN;
+
+	if (Q_stristr(cversion, "compatible 1.02")) {
+		gvc |= PACKGVC_1_02;
+	}
+
+	if (Q_stristr(cversion, "compatible 1.03")) {
+		gvc |= PACKGVC_1_03;
+	}
+
+	if (Q_stristr(cversion, "compatible 1.04")) {
+		gvc |= PACKGVC_1_04;
+	}
+
+	if (Q_stristr(cversion, "compatible all")) {
+		gvc = PACKGVC_1_02 | PACKGVC_1_03 | PACKGVC_1_04;
+	}
+
+	return gvc;
+}
+
+/*
+=================
+FS_FreePak
+=================
+*/
+static void FS_FreePak( pack_t *pak ) {
+	if ( pak->handle ) {
+		unzClose( pak->handle );
+	}
+	if ( pak->mapped ) {
+		Sys_UnmapFile( pak->mapped, pak->mappedLen );
+	}
+	Z_Free( pak->headerLongs );
+	Z_Free( pak->buildBuffer );
+	Z_Free( pak );
+}
+
+/*
+=================
+FS_LoadZipFile
+
+Creates a new pak_t in the search chain for the contents
+of a zip file.
+=================
+*/
+static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
+{
+	pack_t			index;
+	pack_t			*pack;
+	FILE			*f;
+	byte			*central;
+	qboolean		loaded, fromIndex;
+	int				i;
+	int				hash;
+
+	Com_Memset( &index, 0, sizeof( index ) );
+
+	f = fopen( zipfile, "rb" );
+	if ( !f ) {
+		return NULL;
+	}
+
+	fseek( f, 0, SEEK_END );
+	index.fileSize = ftell( f );
+	index.fileTime = (int64_t)Sys_FileTime( zipfile );
+
+	if ( fs_mmap->integer && index.fileSize >= ZIP_END_SIZE && index.fileSize <= 0x7fffffff ) {
+		index.mapped = (byte *)Sys_MapFile( f, 0, (int)index.fileSize );
+		if ( index.mapped ) {
+			index.mappedLen = (int)index.fileSize;
+		}
+	}
+
+	loaded = qfalse;
+	fromIndex = qfalse;
+	if ( FS_ReadZipEnd( &index, f ) ) {
+		if ( FS_ReadPk3Index( &index, zipfile ) ) {
+			loaded = qtrue;
+			fromIndex = qtrue;
+		} else if ( index.mapped ) {
+			loaded = FS_ParseZipDirectory( &index, index.mapped + index.zipOffset + index.centralOffset );
+		} else {
+			central = (byte *)Z_Malloc( index.centralSize + 1, TAG_FILESYS, qfalse );
+			if ( !fseek( f, (long)index.zipOffset + index.centralOffset, SEEK_SET ) &&
+				fread( central, 1, index.centralSize, f ) == (size_t)index.centralSize ) {
+				loaded = FS_ParseZipDirectory( &index, central );
+			}
+			Z_Free( central );
+		}
+	}
+	fclose( f );
+
+	if ( loaded ) {
+		index.indexed = (qboolean)( index.fileTime != -1 );
+
+		if ( !index.mapped ) {
+			index.handle = unzOpen( zipfile );
+		}
+	} else {
+		// zip64 and other unusual archives go through minizip only
+		Z_Free( index.buildBuffer );
+		Z_Free( index.headerLongs );
+		if ( index.mapped ) {
+			Sys_UnmapFile( index.mapped, index.mappedLen );
+		}
+		Com_Memset( &index, 0, sizeof( index ) );
+
+		if ( !FS_ReadZipDirectory( &index, zipfile ) ) {
+			return NULL;
+		}
+	}
+
+	if ( !index.mapped && !index.handle ) {
+		Z_Free( index.buildBuffer );
+		Z_Free( index.headerLongs );
+		return NULL;
+	}
+
+	fs_packFiles += index.numfiles;
 
 	// get the hash table size from the number of files in the zip
 	// because lots of custom pk3 files have less than 32 or 64 files
 	for (i = 1; i <= MAX_FILEHASH_SIZE; i <<= 1) {
-		if (i > gi.number_entry) {
+		if (i > index.numfiles) {
 			break;
 		}
 	}
 
 	pack = (pack_t *)Z_Malloc( sizeof( pack_t ) + i * sizeof(fileInPack_t *), TAG_FILESYS, qtrue );
+	*pack = index;
 	pack->hashSize = i;
 	pack->hashTable = (fileInPack_t **) (((char *) pack) + sizeof( pack_t ));
 	for(i = 0; i < pack->hashSize; i++) {
@@ -1936,41 +2932,21 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 		pack->pakBasename[strlen( pack->pakBasename ) - 4] = 0;
 	}
 
-	pack->handle = uf;
-	pack->numfiles = gi.number_entry;
-	unzGoToFirstFile(uf);
-
-	for (i = 0; i < gi.number_entry; i++)
-	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		if (err != UNZ_OK) {
+	for (i = 0; i < pack->numfiles; i++) {
+		// the minizip walk stops at the first damaged entry
+		if (!pack->buildBuffer[i].name) {
 			break;
 		}
-		if (file_info.uncompressed_size > 0) {
-			fs_headerLongs[fs_numHeaderLongs++] = LittleLong(file_info.crc);
-		}
-		Q_strlwr( filename_inzip );
-		hash = FS_HashFileName(filename_inzip, pack->hashSize);
-		buildBuffer[i].name = namePtr;
-		strcpy( buildBuffer[i].name, filename_inzip );
-		namePtr += strlen(filename_inzip) + 1;
-		// store the file position in the zip
-		buildBuffer[i].pos = unzGetOffset(uf);
-		buildBuffer[i].len = file_info.uncompressed_size;
-		buildBuffer[i].next = pack->hashTable[hash];
-		pack->hashTable[hash] = &buildBuffer[i];
-		unzGoToNextFile(uf);
+		hash = FS_HashFileName(pack->buildBuffer[i].name, pack->hashSize);
+		pack->buildBuffer[i].next = pack->hashTable[hash];
+		pack->hashTable[hash] = &pack->buildBuffer[i];
 	}
 
-	pack->checksum = Com_BlockChecksum( fs_headerLongs, 4 * fs_numHeaderLongs );
-	pack->pure_checksum = Com_BlockChecksumKey( fs_headerLongs, 4 * fs_numHeaderLongs, LittleLong(fs_checksumFeed) );
+	pack->checksum = Com_BlockChecksum( pack->headerLongs, 4 * pack->numHeaderLongs );
+	pack->pure_checksum = Com_BlockChecksumKey( pack->headerLongs, 4 * pack->numHeaderLongs, LittleLong(fs_checksumFeed) );
 	pack->checksum = LittleLong( pack->checksum );
 	pack->pure_checksum = LittleLong( pack->pure_checksum );
 
-	Z_Free(fs_headerLongs);
-
-	pack->buildBuffer = buildBuffer;
-
 	// which versions does this pk3 support?
 
 	// filename prefixes
@@ -1983,28 +2959,15 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 	}
 
 	// mv.info file in root directory of pk3 file
-	char cversion[128];
-	int cversionlen = FS_PakReadFile(pack, "mv.info", cversion, sizeof(cversion) - 1);
-	if (cversionlen) {
-		cversion[cversionlen] = '\0';
-		pack->gvc = PACKGVC_UNKNOWN; // mv.info file overwrites version prefixes
-
-		if (Q_stristr(cversion, "compatible 1.02")) {
-			pack->gvc |= PACKGVC_1_02;
-		}
-
-		if (Q_stristr(cversion, "compatible 1.03")) {
-			pack->gvc |= PACKGVC_1_03;
-		}
-
-		if (Q_stristr(cversion, "compatible 1.04")) {
-			pack->gvc |= PACKGVC_1_04;
-		}
-
-		if (Q_stristr(cversion, "compatible all")) {
-			pack->gvc = PACKGVC_1_02 | PACKGVC_1_03 | PACKGVC_1_04;
+	if (!fromIndex) {
+		pack->mvinfoGvc = FS_PakMVInfo(pack);
+		if (pack->indexed) {
+			fs_pk3IndexModified = qtrue;
 		}
 	}
+	if (pack->mvinfoGvc >= 0) {
+		pack->gvc = pack->mvinfoGvc; // mv.info file overwrites version prefixes
+	}
 
 	// assets are hardcoded
 	if (!Q_stricmp(pack->pakBasename, "assets0")) {
@@ -2668,7 +3631,7 @@ void FS_Path_f( void ) {
 
 	Com_Printf( "\n" );
 	for ( i = 1 ; i < MAX_FILE_HANDLES ; i++ ) {
-		if ( fsh[i].handleFiles.file.o ) {
+		if ( fsh[i].handleFiles.file.o || fsh[i].zipMapped ) {
 			Com_Printf( "handle %i: %s\n", i, fsh[i].name );
 		}
 	}
@@ -2818,9 +3781,7 @@ static void FS_AddGameDirectory( const char *path, const char *dir, qboolean ass
 
 			if (!found) {
 				// server has no interest in the file
-				unzClose(pak->handle);
-				Z_Free(pak->buildBuffer);
-				Z_Free(pak);
+				FS_FreePak(pak);
 				continue;
 			}
 		}
@@ -3024,9 +3985,7 @@ void FS_Shutdown( qboolean closemfp ) {
 		next = p->next;
 
 		if ( p->pack ) {
-			unzClose(p->pack->handle);
-			Z_Free( p->pack->buildBuffer );
-			Z_Free( p->pack );
+			FS_FreePak( p->pack );
 		}
 		if ( p->dir ) {
 			Z_Free( p->dir );
@@ -3065,6 +4024,8 @@ static void FS_Startup( const char *gameName ) {
 	fs_basegame = Cvar_Get ("fs_basegame", "", CVAR_INIT );
 	fs_homepath = Cvar_Get ("fs_homepath", Sys_DefaultHomePath(), CVAR_INIT | CVAR_VM_NOWRITE );
 	fs_gamedirvar = Cvar_Get ("fs_game", "", CVAR_INIT|CVAR_SYSTEMINFO );
+	fs_mmap = Cvar_Get( "fs_mmap", sizeof( void * ) == 8 ? "1" : "0", CVAR_ARCHIVE );
+	fs_pk3Index = Cvar_Get( "fs_pk3Index", "1", CVAR_ARCHIVE );
 
 	assetsPath = Sys_DefaultAssetsPath();
 	fs_assetspath = Cvar_Get("fs_assetspath", assetsPath ? assetsPath : "", CVAR_INIT | CVAR_VM_NOWRITE);
@@ -3085,6 +4046,8 @@ static void FS_Startup( const char *gameName ) {
 		return;
 	}
 
+	FS_LoadPk3Index();
+
 	// don't use the assetspath if assets files already found in fs_basepath or fs_homepath
 	if (assetsPath && !FS_BaseHome_Base_FileExists("assets5.pk3")) {
 		FS_AddGameDirectory(assetsPath, BASEGAME, qtrue);
@@ -3120,6 +4083,9 @@ static void FS_Startup( const char *gameName ) {
 		}
 	}
 
+	FS_WritePk3Index();
+	FS_FreePk3Index();
+
 	// add our commands
 	Cmd_AddCommand ("path", FS_Path_f);
 	Cmd_AddCommand ("dir", FS_Dir_f );
@@ -3722,7 +4688,9 @@ int FS_FOpenFileByModeHash( const char *qpath, fileHandle_t *f, fsMode_t mode, u
 
 int	FS_FTell( fileHandle_t f ) {
 	int pos;
-	if (fsh[f].zipFile == qtrue) {
+	if (fsh[f].zipMapped) {
+		pos = fsh[f].zipDataPos;
+	} else if (fsh[f].zipFile == qtrue) {
 		pos = unztell(fsh[f].handleFiles.file.z);
 	} else {
 		pos = ftell(fsh[f].handleFiles.file.o);
@@ -6,7 +6,8 @@
 #include "../qcommon/q_shared.h"
 #include "qcommon.h"
 
-static int			bloc = 0;
+// per thread, snapshots may be encoded on several threads at once
+static thread_local int	bloc = 0;
 
 void	Huff_putBit( int bit, byte *fout, int *offset) {
 	bloc = *offset;
@@ -352,7 +353,7 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 	Com_Memcpy(mbuf->data + offset, seq, cch);
 }
 
-extern	int oldsize;
+extern	thread_local int oldsize;
 
 void Huff_Compress(msg_t *mbuf, int offset) {
 	int			i, ch, size;
@@ -16,6 +16,21 @@ typedef struct {
 static huffman_t		msgHuff;
 
 static qboolean			msgInit = qfalse;
+
+// msgHuff never adapts after MSG_initHuffman, so its codes are flattened
+// into tables: the code of every byte with its bits in transmission order,
+// and a lookup of the next MSG_HUFF_LOOKUP_BITS bits of a stream that
+// resolves all but the rarest symbols without walking the tree
+#define MSG_HUFF_LOOKUP_BITS	11
+
+typedef struct {
+	short	symbol;
+	short	length;		// 0 = longer code, walk the tree
+} msgHuffLookup_t;
+
+static uint32_t			msgHuffCode[256];
+static int				msgHuffLength[256];
+static msgHuffLookup_t	msgHuffLookup[1 << MSG_HUFF_LOOKUP_BITS];
 #ifdef _NEWHUFFTABLE_
 static FILE				*fp = 0;
 #endif // _NEWHUFFTABLE_
@@ -37,13 +52,123 @@ netField_t ammoField = { "ammo" };
 netField_t powerupsField = { "powerups" };
 
 netField_t noField = { "<none>" };
-netField_t *gLastField = &noField;
+// statistics and debug info are kept per thread, snapshots may be
+// encoded on several threads at once
+thread_local netField_t *gLastField = &noField;
 
-int	fieldIndex;
-int oldsize = 0;
+thread_local int	fieldIndex;
+thread_local int oldsize = 0;
 
 void MSG_initHuffman();
 
+/*
+=================
+MSG_BuildHuffmanTables
+=================
+*/
+static void MSG_BuildHuffmanTables( void ) {
+	node_t		*node;
+	uint32_t	code;
+	int			ch, length, i;
+
+	for ( ch = 0; ch < 256; ch++ ) {
+		// walk up from the leaf, the root's branch ends up in bit 0 as it
+		// is the first one transmitted
+		code = 0;
+		length = 0;
+		for ( node = msgHuff.compressor.loc[ch]; node->parent; node = node->parent ) {
+			code = ( code << 1 ) | ( node->parent->right == node );
+			length++;
+		}
+
+		if ( length > 32 ) {
+			Com_Error( ERR_FATAL, "MSG_BuildHuffmanTables: code too long" );
+		}
+
+		msgHuffCode[ch] = code;
+		msgHuffLength[ch] = length;
+	}
+
+	Com_Memset( msgHuffLookup, 0, sizeof( msgHuffLookup ) );
+
+	for ( i = 0; i < ( 1 << MSG_HUFF_LOOKUP_BITS ); i++ ) {
+		node = msgHuff.decompressor.tree;
+		for ( length = 0; length < MSG_HUFF_LOOKUP_BITS && node->symbol == INTERNAL_NODE; length++ ) {
+			node = ( ( i >> length ) & 1 ) ? node->right : node->left;
+			if ( !node ) {
+				break;
+			}
+		}
+
+		if ( node && node->symbol != INTERNAL_NODE ) {
+			msgHuffLookup[i].symbol = node->symbol;
+			msgHuffLookup[i].length = length;
+		}
+	}
+}
+
+/*
+=================
+MSG_PutBits
+
+Writes up to 64 bits, bit 0 first, the way Huff_putBit would one at a time
+=================
+*/
+static ID_INLINE void MSG_PutBits( msg_t *msg, uint64_t bits, int numBits ) {
+	byte	*out;
+	int		shift;
+
+	if ( !numBits ) {
+		return;
+	}
+
+	out = msg->data + ( msg->bit >> 3 );
+	shift = msg->bit & 7;
+	msg->bit += numBits;
+
+	// a fresh byte is cleared, a partial one keeps the bits already in it
+	if ( shift ) {
+		*out |= (byte)( bits << shift );
+	} else {
+		*out = (byte)bits;
+	}
+	numBits -= 8 - shift;
+	bits >>= 8 - shift;
+
+	while ( numBits > 0 ) {
+		*++out = (byte)bits;
+		bits >>= 8;
+		numBits -= 8;
+	}
+}
+
+/*
+=================
+MSG_PeekBits
+
+The next 25 or more bits of the stream, zero past the end of the buffer
+=================
+*/
+static ID_INLINE uint32_t MSG_PeekBits( const msg_t *msg ) {
+	const byte	*in;
+	uint32_t	bits;
+	int			avail, i;
+
+	in = msg->data + ( msg->bit >> 3 );
+	avail = msg->maxsize - ( msg->bit >> 3 );
+
+	if ( avail >= 4 ) {
+		bits = in[0] | ( in[1] << 8 ) | ( in[2] << 16 ) | ( (uint32_t)in[3] << 24 );
+	} else {
+		bits = 0;
+		for ( i = 0; i < avail; i++ ) {
+			bits |= in[i] << ( 8 * i );
+		}
+	}
+
+	return bits >> ( msg->bit & 7 );
+}
+
 void MSG_Init(msg_t *buf, byte *data, int length) {
 	if (!msgInit) {
 		MSG_initHuffman();
@@ -95,7 +220,7 @@ bit functions
 =============================================================================
 */
 
-int	overflows;
+thread_local int	overflows;
 
 // negative bit values include signs
 void MSG_WriteBits(msg_t *msg, int value, int bits) {
@@ -155,14 +280,18 @@ void MSG_WriteBits(msg_t *msg, int value, int bits) {
 			Com_Error(ERR_DROP, "can't read %d bits\n", bits);
 		}
 	} else {
+		uint64_t	out;
+		int			numOut;
+
 		value &= (0xffffffff >> (32 - bits));
+		out = 0;
+		numOut = 0;
 		if (bits & 7) {
 			int nbits;
 			nbits = bits & 7;
-			for (i = 0; i<nbits; i++) {
-				Huff_putBit((value & 1), msg->data, &msg->bit);
-				value = (value >> 1);
-			}
+			out = value & ((1 << nbits) - 1);
+			numOut = nbits;
+			value = (value >> nbits);
 			bits = bits - nbits;
 		}
 		if (bits) {
@@ -170,14 +299,107 @@ void MSG_WriteBits(msg_t *msg, int value, int bits) {
 #ifdef _NEWHUFFTABLE_
 				fwrite(&value, 1, 1, fp);
 #endif // _NEWHUFFTABLE_
-				Huff_offsetTransmit(&msgHuff.compressor, (value & 0xff), msg->data, &msg->bit);
+				if (numOut + msgHuffLength[value & 0xff] > 64) {
+					MSG_PutBits(msg, out, numOut);
+					out = 0;
+					numOut = 0;
+				}
+				out |= (uint64_t)msgHuffCode[value & 0xff] << numOut;
+				numOut += msgHuffLength[value & 0xff];
 				value = (value >> 8);
 			}
 		}
+		MSG_PutBits(msg, out, numOut);
 		msg->cursize = (msg->bit >> 3) + 1;
 	}
 }
 
+/*
+=================
+MSG_WriteBitstream
+
+Appends bits that were already encoded into another message by
+MSG_WriteBits. The huffman codes don't depend on the bit position,
+so a bitstream can be reused at any offset.
+=================
+*/
+void MSG_WriteBitstream(msg_t *msg, const byte *data, int numBits) {
+	byte	*out;
+	int		numBytes;
+	int		shift;
+	int		i;
+
+	assert(!msg->oob);
+
+	if (!numBits) {
+		return;
+	}
+
+	numBytes = (numBits + 7) >> 3;
+
+	if (msg->maxsize - msg->cursize < 4 + numBytes) {
+		msg->overflowed = qtrue;
+		return;
+	}
+
+	out = msg->data + (msg->bit >> 3);
+	shift = msg->bit & 7;
+
+	if (!shift) {
+		Com_Memcpy(out, data, numBytes);
+	} else {
+		// bits past the end of data are always zero
+		*out &= (1 << shift) - 1;
+		for (i = 0; i < numBytes; i++) {
+			out[i] |= data[i] << shift;
+			out[i + 1] = data[i] >> (8 - shift);
+		}
+	}
+
+	msg->bit += numBits;
+	msg->cursize = (msg->bit >> 3) + 1;
+}
+
+/*
+=================
+MSG_CopyBitstream
+
+Copies the bits written to msg since startBit to data for a later
+MSG_WriteBitstream, clearing the unused bits of the last byte
+=================
+*/
+void MSG_CopyBitstream(const msg_t *msg, int startBit, byte *data) {
+	const byte	*in;
+	int		numBits;
+	int		numBytes;
+	int		shift;
+	int		i;
+
+	numBits = msg->bit - startBit;
+	if (numBits <= 0) {
+		return;
+	}
+
+	numBytes = (numBits + 7) >> 3;
+	in = msg->data + (startBit >> 3);
+	shift = startBit & 7;
+
+	if (!shift) {
+		Com_Memcpy(data, in, numBytes);
+	} else {
+		for (i = 0; i < numBytes; i++) {
+			data[i] = in[i] >> shift;
+			if ((i + 1) * 8 < numBits + shift) {
+				data[i] |= in[i + 1] << (8 - shift);
+			}
+		}
+	}
+
+	if (numBits & 7) {
+		data[numBytes - 1] &= (1 << (numBits & 7)) - 1;
+	}
+}
+
 int MSG_ReadBits(msg_t *msg, int bits) {
 	int			value;
 	int			get;
@@ -214,14 +436,20 @@ int MSG_ReadBits(msg_t *msg, int bits) {
 		nbits = 0;
 		if (bits & 7) {
 			nbits = bits & 7;
-			for (i = 0; i<nbits; i++) {
-				value |= (Huff_getBit(msg->data, &msg->bit) << i);
-			}
+			value = MSG_PeekBits(msg) & ((1 << nbits) - 1);
+			msg->bit += nbits;
 			bits = bits - nbits;
 		}
 		if (bits) {
 			for (i = 0; i<bits; i += 8) {
-				Huff_offsetReceive(msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+				const msgHuffLookup_t *lookup = &msgHuffLookup[MSG_PeekBits(msg) & ((1 << MSG_HUFF_LOOKUP_BITS) - 1)];
+
+				if (lookup->length) {
+					get = lookup->symbol;
+					msg->bit += lookup->length;
+				} else {
+					Huff_offsetReceive(msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+				}
 #ifdef _NEWHUFFTABLE_
 				fwrite(&get, 1, 1, fp);
 #endif // _NEWHUFFTABLE_
@@ -2431,6 +2659,8 @@ void MSG_initHuffman() {
 			Huff_addRef(&msgHuff.decompressor, (byte)i);			// Do update
 		}
 	}
+
+	MSG_BuildHuffmanTables();
 }
 
 #else
@@ -2466,6 +2696,7 @@ void MSG_initHuffman() {
 	}
 	Com_Printf("};\n");
 	FS_FreeFile(data);
+	MSG_BuildHuffmanTables();
 	Cbuf_AddText("condump dump.txt\n");
 }
 
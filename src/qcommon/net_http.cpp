@@ -75,6 +75,8 @@ static void NET_HTTP_ServerEvent(struct mg_connection *nc, int ev, void *ev_data
 		mgstr2str(srv.event.reqPath, sizeof(srv.event.reqPath), &hm->uri);
 		memmove(srv.event.reqPath, srv.event.reqPath + 1, strlen(srv.event.reqPath));
 
+		// don't leave the request waiting for the main loop to finish sleeping
+		NET_WakeUp();
 		srv.event.cv_processed.wait(lk, [] { return srv.event.processed; });
 
 		if (srv.event.allowed) {
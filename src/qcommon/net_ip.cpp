@@ -1,5 +1,10 @@
 #include "../qcommon/qcommon.h"
 
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
 #ifdef _WIN32
 	#include <winsock2.h>
 
@@ -47,6 +52,16 @@
 #include <sys/filio.h>
 #endif
 
+#ifdef __linux__
+// recvmmsg / sendmmsg
+#define NET_BATCHIO
+// epoll + timerfd frame wait for the dedicated server
+#define NET_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
 typedef int SOCKET;
 #define INVALID_SOCKET                -1
 #define SOCKET_ERROR                        -1
@@ -73,11 +88,42 @@ static cvar_t	*net_port;
 
 static cvar_t	*net_dropsim;
 
+#ifdef NET_BATCHIO
+static cvar_t	*net_batchIO;
+#endif
+
+static cvar_t	*net_recvThread;
+
 static struct sockaddr_in	socksRelayAddr;
 
 static SOCKET	ip_socket = INVALID_SOCKET;
 static SOCKET	socks_socket = INVALID_SOCKET;
 
+#ifdef NET_EPOLL
+enum {
+	EP_SOCKET,
+	EP_CONSOLE,
+	EP_TIMER,
+	EP_WAKEUP
+};
+
+// wake up early when the wall clock is set instead of waiting for the
+// old deadline
+#ifdef TFD_TIMER_CANCEL_ON_SET
+#define EP_TIMER_FLAGS	( TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET )
+#else
+#define EP_TIMER_FLAGS	TFD_TIMER_ABSTIME
+#endif
+
+static struct {
+	int		epfd;
+	int		timerfd;		// absolute CLOCK_REALTIME frame deadline
+	int		wakefd;			// eventfd kicked by NET_WakeUp
+	int		socket;			// ip_socket as currently registered
+	int		console;		// console fd as currently registered
+} ep = { -1, -1, -1, INVALID_SOCKET, -1 };
+#endif
+
 #define	MAX_IPS		16
 static	int		numIP;
 static	byte	localIP[MAX_IPS][4];
@@ -212,6 +258,179 @@ qboolean Sys_StringToAdr( const char *s, netadr_t *a ) {
 
 //=============================================================================
 
+#ifdef NET_BATCHIO
+/*
+=============================================================================
+
+Batched socket IO
+
+Incoming datagrams are drained with a single recvmmsg into a ring of
+buffers and handed out one by one by NET_GetPacket. Between
+NET_BeginSendBatch and NET_FlushSendBatch outgoing packets are queued and
+sent with a single sendmmsg, so a whole snapshot burst costs only a few
+syscalls.
+
+=============================================================================
+*/
+
+#define	MAX_BATCH_PACKETS		32
+#define	MAX_BATCH_PACKETLEN		1500
+
+static struct {
+	qboolean			unsupported;	// kernel without recvmmsg
+	int					count;
+	int					current;
+	struct mmsghdr		hdr[MAX_BATCH_PACKETS];
+	struct iovec		iov[MAX_BATCH_PACKETS];
+	struct sockaddr_in	from[MAX_BATCH_PACKETS];
+	byte				data[MAX_BATCH_PACKETS][MAX_MSGLEN + 1];
+} recvBatch;
+
+static struct {
+	qboolean			unsupported;	// kernel without sendmmsg
+	qboolean			active;
+	int					count;
+	struct mmsghdr		hdr[MAX_BATCH_PACKETS];
+	struct iovec		iov[MAX_BATCH_PACKETS];
+	struct sockaddr_in	to[MAX_BATCH_PACKETS];
+	netadrtype_t		type[MAX_BATCH_PACKETS];
+	byte				data[MAX_BATCH_PACKETS][MAX_BATCH_PACKETLEN];
+} sendBatch;
+
+/*
+==================
+NET_ReceiveBatched
+
+Works like recvfrom, but points net_message at the next buffer of the
+ring instead of copying
+==================
+*/
+static int NET_ReceiveBatched( msg_t *net_message, struct sockaddr_in *from, socklen_t *fromlen ) {
+	int		i, ret;
+
+	if ( recvBatch.current >= recvBatch.count ) {
+		recvBatch.current = recvBatch.count = 0;
+
+		for ( i = 0 ; i < MAX_BATCH_PACKETS ; i++ ) {
+			recvBatch.iov[i].iov_base = recvBatch.data[i];
+			recvBatch.iov[i].iov_len = sizeof( recvBatch.data[i] );
+			memset( &recvBatch.hdr[i], 0, sizeof( recvBatch.hdr[i] ) );
+			recvBatch.hdr[i].msg_hdr.msg_name = &recvBatch.from[i];
+			recvBatch.hdr[i].msg_hdr.msg_namelen = sizeof( recvBatch.from[i] );
+			recvBatch.hdr[i].msg_hdr.msg_iov = &recvBatch.iov[i];
+			recvBatch.hdr[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		ret = recvmmsg( ip_socket, recvBatch.hdr, MAX_BATCH_PACKETS, MSG_DONTWAIT, NULL );
+		if ( ret == SOCKET_ERROR ) {
+			return SOCKET_ERROR;
+		}
+		recvBatch.count = ret;
+	}
+
+	i = recvBatch.current++;
+
+	net_message->data = recvBatch.data[i];
+	net_message->maxsize = sizeof( recvBatch.data[i] );
+	*from = recvBatch.from[i];
+	*fromlen = recvBatch.hdr[i].msg_hdr.msg_namelen;
+
+	return recvBatch.hdr[i].msg_len;
+}
+
+/*
+==================
+NET_BeginSendBatch
+==================
+*/
+void NET_BeginSendBatch( void ) {
+	if ( !net_batchIO->integer || sendBatch.unsupported ) {
+		return;
+	}
+
+	sendBatch.active = qtrue;
+}
+
+/*
+==================
+NET_FlushSendBatch
+==================
+*/
+void NET_FlushSendBatch( void ) {
+	int		i, ret, err;
+
+	sendBatch.active = qfalse;
+
+	i = 0;
+	while ( i < sendBatch.count ) {
+		ret = sendmmsg( ip_socket, sendBatch.hdr + i, sendBatch.count - i, 0 );
+		if ( ret != SOCKET_ERROR ) {
+			i += ret;
+			continue;
+		}
+
+		err = socketError;
+
+		// on an old kernel send them one by one from now on, when the
+		// socket buffer is full hand the rest to sendto so each packet
+		// gets its own chance instead of dropping the whole tail
+		if ( err == ENOSYS || err == EAGAIN ) {
+			if ( err == ENOSYS ) {
+				sendBatch.unsupported = qtrue;
+			}
+			for ( ; i < sendBatch.count ; i++ ) {
+				sendto( ip_socket, (const char *)sendBatch.data[i], sendBatch.iov[i].iov_len, 0,
+					(sockaddr *)&sendBatch.to[i], sizeof( sendBatch.to[i] ) );
+			}
+			break;
+		}
+
+		// some PPP links do not allow broadcasts and return an error
+		if ( !( err == EADDRNOTAVAIL && sendBatch.type[i] == NA_BROADCAST ) ) {
+			Com_Printf( "NET_SendPacket: %s\n", NET_ErrorString() );
+		}
+
+		// skip the packet that failed
+		i++;
+	}
+
+	sendBatch.count = 0;
+}
+
+/*
+==================
+NET_QueuePacket
+==================
+*/
+static void NET_QueuePacket( int length, const void *data, struct sockaddr_in *addr, netadrtype_t type ) {
+	int		i;
+
+	i = sendBatch.count++;
+
+	memcpy( sendBatch.data[i], data, length );
+	sendBatch.to[i] = *addr;
+	sendBatch.type[i] = type;
+	sendBatch.iov[i].iov_base = sendBatch.data[i];
+	sendBatch.iov[i].iov_len = length;
+	memset( &sendBatch.hdr[i], 0, sizeof( sendBatch.hdr[i] ) );
+	sendBatch.hdr[i].msg_hdr.msg_name = &sendBatch.to[i];
+	sendBatch.hdr[i].msg_hdr.msg_namelen = sizeof( sendBatch.to[i] );
+	sendBatch.hdr[i].msg_hdr.msg_iov = &sendBatch.iov[i];
+	sendBatch.hdr[i].msg_hdr.msg_iovlen = 1;
+
+	if ( sendBatch.count == MAX_BATCH_PACKETS ) {
+		NET_FlushSendBatch();
+		sendBatch.active = qtrue;
+	}
+}
+#else
+void NET_BeginSendBatch( void ) {
+}
+
+void NET_FlushSendBatch( void ) {
+}
+#endif
+
 /*
 ==================
 NET_GetPacket
@@ -235,6 +454,15 @@ qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, fd_set *fdr ) {
 	fromlen = sizeof( from );
 #ifdef _DEBUG
 	recvfromCount++;		// performance check
+#endif
+#ifdef NET_BATCHIO
+	if ( net_batchIO->integer && !recvBatch.unsupported ) {
+		ret = NET_ReceiveBatched( net_message, &from, &fromlen );
+		if ( ret == SOCKET_ERROR && socketError == ENOSYS ) {
+			recvBatch.unsupported = qtrue;
+			ret = recvfrom( ip_socket, (char *)net_message->data, net_message->maxsize, 0, (struct sockaddr *)&from, &fromlen );
+		}
+	} else
 #endif
 	ret = recvfrom( ip_socket, (char *)net_message->data, net_message->maxsize, 0, (struct sockaddr *)&from, &fromlen );
 
@@ -310,7 +538,20 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 		memcpy( &socksBuf[10], data, length );
 		ret = sendto( ip_socket, socksBuf, length+10, 0, (sockaddr *)&socksRelayAddr, sizeof(socksRelayAddr) );
 	}
+#ifdef NET_BATCHIO
+	else if ( sendBatch.active && length <= MAX_BATCH_PACKETLEN ) {
+		NET_QueuePacket( length, data, &addr, to.type );
+		return;
+	}
+#endif
 	else {
+#ifdef NET_BATCHIO
+		// don't let an oversized packet overtake the queued ones
+		if ( sendBatch.active && sendBatch.count ) {
+			NET_FlushSendBatch();
+			sendBatch.active = qtrue;
+		}
+#endif
 		ret = sendto( ip_socket, (const char *)data, length, 0, (sockaddr *)&addr, sizeof(addr) );
 	}
 	if( ret == SOCKET_ERROR ) {
@@ -873,9 +1114,314 @@ static qboolean NET_GetCvars( void ) {
 
 	net_dropsim = Cvar_Get( "net_dropsim", "", CVAR_TEMP);
 
+#ifdef NET_BATCHIO
+	net_batchIO = Cvar_Get( "net_batchIO", "0", CVAR_ARCHIVE );
+#endif
+
+	net_recvThread = Cvar_Get( "net_recvThread", "0", CVAR_LATCH | CVAR_ARCHIVE );
+	modified += net_recvThread->modified;
+	net_recvThread->modified = qfalse;
+
 	return modified ? qtrue : qfalse;
 }
 
+#ifdef NET_EPOLL
+/*
+====================
+NET_EpollWatch
+
+Points an epoll registration slot at a new descriptor
+====================
+*/
+static void NET_EpollWatch( int *slot, int fd, int tag ) {
+	struct epoll_event ev;
+
+	if ( ep.epfd == -1 || *slot == fd )
+		return;
+
+	if ( *slot != -1 )
+		epoll_ctl( ep.epfd, EPOLL_CTL_DEL, *slot, NULL );
+
+	// remember the descriptor even if it can't be polled (regular files),
+	// so it isn't retried every frame
+	*slot = fd;
+
+	if ( fd != -1 ) {
+		memset( &ev, 0, sizeof( ev ) );
+		ev.events = EPOLLIN;
+		ev.data.u32 = tag;
+		if ( epoll_ctl( ep.epfd, EPOLL_CTL_ADD, fd, &ev ) == -1 && errno != EPERM )
+			Com_Printf( "WARNING: NET_EpollWatch: %s\n", strerror( errno ) );
+	}
+}
+
+/*
+====================
+NET_EpollShutdown
+====================
+*/
+static void NET_EpollShutdown( void ) {
+	if ( ep.epfd != -1 )
+		close( ep.epfd );
+	if ( ep.timerfd != -1 )
+		close( ep.timerfd );
+	if ( ep.wakefd != -1 )
+		close( ep.wakefd );
+
+	ep.epfd = ep.timerfd = ep.wakefd = -1;
+	ep.socket = INVALID_SOCKET;
+	ep.console = -1;
+}
+
+/*
+====================
+NET_EpollInit
+
+The dedicated server waits for its frame deadline, the game socket,
+console input and http server requests with a single epoll_wait.
+====================
+*/
+static void NET_EpollInit( void ) {
+	struct epoll_event ev;
+
+	if ( !com_dedicated || !com_dedicated->integer || ep.epfd != -1 )
+		return;
+
+	ep.epfd = epoll_create1( EPOLL_CLOEXEC );
+	ep.timerfd = timerfd_create( CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC );
+	ep.wakefd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+	if ( ep.epfd == -1 || ep.timerfd == -1 || ep.wakefd == -1 ) {
+		Com_Printf( "WARNING: epoll setup failed, using select: %s\n", strerror( errno ) );
+		NET_EpollShutdown();
+		return;
+	}
+
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = EPOLLIN;
+	ev.data.u32 = EP_TIMER;
+	epoll_ctl( ep.epfd, EPOLL_CTL_ADD, ep.timerfd, &ev );
+	ev.data.u32 = EP_WAKEUP;
+	epoll_ctl( ep.epfd, EPOLL_CTL_ADD, ep.wakefd, &ev );
+}
+#endif
+
+/*
+=============================================================================
+
+With net_recvThread set a second thread blocks on the game socket and
+queues every packet with the time it arrived, so packets don't sit in the
+socket buffer while a frame runs. The queue is a single producer, single
+consumer ring: the receive thread only moves the head, the main thread
+only moves the tail, and neither ever waits on the other.
+
+=============================================================================
+*/
+
+#define	NET_QUEUE_SIZE		128		// must be a power of two
+
+typedef struct {
+	netadr_t	from;
+	int64_t		time;				// Sys_Microseconds on arrival
+	int			length;
+	byte		data[MAX_MSGLEN + 1];
+} queuedPacket_t;
+
+static struct {
+	qboolean				active;		// only touched by the main thread
+	std::thread				thread;
+	std::atomic_bool		running;
+	std::atomic<uint32_t>	head;		// next slot the receive thread fills
+	std::atomic<uint32_t>	tail;		// next slot the main thread reads
+	queuedPacket_t			*packets;
+
+	// lets the select() path sleep until something is queued
+	std::mutex				mutex;
+	std::condition_variable	cv;
+} recvQueue;
+
+static int64_t	net_packetTime;
+
+/*
+====================
+NET_SignalReceiveQueue
+====================
+*/
+static void NET_SignalReceiveQueue( void ) {
+	{
+		std::lock_guard<std::mutex> lk( recvQueue.mutex );
+	}
+	recvQueue.cv.notify_one();
+	NET_WakeUp();
+}
+
+/*
+====================
+NET_ReceiveThread
+
+Never prints anything, errors NET_GetPacket would report are dropped
+====================
+*/
+static void NET_ReceiveThread( SOCKET sock ) {
+	struct timeval timeout;
+	struct sockaddr_in from;
+	socklen_t fromlen;
+	fd_set fdset;
+	queuedPacket_t *packet;
+	uint32_t head;
+	qboolean queued;
+	int ret;
+
+	while ( recvQueue.running ) {
+		FD_ZERO( &fdset );
+		FD_SET( sock, &fdset );
+
+		// wake up now and then to see if we should stop
+		timeout.tv_sec = 0;
+		timeout.tv_usec = 100000;
+
+		if ( select( sock + 1, &fdset, NULL, NULL, &timeout ) <= 0 )
+			continue;
+
+		queued = qfalse;
+		while ( 1 ) {
+			head = recvQueue.head.load( std::memory_order_relaxed );
+			if ( head - recvQueue.tail.load( std::memory_order_acquire ) == NET_QUEUE_SIZE ) {
+				// the main thread is behind, leave the rest in the socket buffer
+				NET_SignalReceiveQueue();
+				std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+				break;
+			}
+
+			packet = &recvQueue.packets[head & ( NET_QUEUE_SIZE - 1 )];
+			fromlen = sizeof( from );
+			ret = recvfrom( sock, (char *)packet->data, sizeof( packet->data ), 0, (struct sockaddr *)&from, &fromlen );
+			if ( ret == SOCKET_ERROR )
+				break;
+
+			packet->time = Sys_Microseconds();
+			memset( from.sin_zero, 0, 8 );
+			SockadrToNetadr( &from, &packet->from );
+			packet->length = ret;
+
+			recvQueue.head.store( head + 1, std::memory_order_release );
+			queued = qtrue;
+		}
+
+		if ( queued )
+			NET_SignalReceiveQueue();
+	}
+}
+
+/*
+====================
+NET_StartReceiveThread
+====================
+*/
+static void NET_StartReceiveThread( void ) {
+	if ( !net_recvThread->integer || ip_socket == INVALID_SOCKET )
+		return;
+
+	// the socks relay needs the packet headers parsed by NET_GetPacket
+	if ( usingSocks ) {
+		Com_Printf( "net_recvThread is ignored while using SOCKS.\n" );
+		return;
+	}
+
+	if ( !recvQueue.packets )
+		recvQueue.packets = (queuedPacket_t *)Z_Malloc( NET_QUEUE_SIZE * sizeof( queuedPacket_t ), TAG_GENERAL, qfalse );
+
+	recvQueue.head = 0;
+	recvQueue.tail = 0;
+	recvQueue.running = true;
+	recvQueue.thread = std::thread( NET_ReceiveThread, ip_socket );
+	recvQueue.active = qtrue;
+}
+
+/*
+====================
+NET_StopReceiveThread
+
+Must be called before the socket is closed
+====================
+*/
+static void NET_StopReceiveThread( void ) {
+	if ( !recvQueue.active )
+		return;
+
+	recvQueue.running = false;
+	recvQueue.thread.join();
+	recvQueue.active = qfalse;
+}
+
+/*
+====================
+NET_ReceiveQueueEmpty
+====================
+*/
+static bool NET_ReceiveQueueEmpty( void ) {
+	return recvQueue.tail.load( std::memory_order_relaxed ) == recvQueue.head.load( std::memory_order_acquire );
+}
+
+/*
+====================
+NET_DrainReceiveQueue
+
+Runs everything the receive thread has queued. A packet is copied out of
+its slot before it is run, since a command it carries may restart the
+network and with it the queue.
+====================
+*/
+static void NET_DrainReceiveQueue( void ) {
+	byte bufData[MAX_MSGLEN + 1];
+	queuedPacket_t *packet;
+	netadr_t from;
+	msg_t netmsg;
+	uint32_t tail;
+
+	while ( recvQueue.active && !NET_ReceiveQueueEmpty() ) {
+		tail = recvQueue.tail.load( std::memory_order_relaxed );
+		packet = &recvQueue.packets[tail & ( NET_QUEUE_SIZE - 1 )];
+
+		MSG_Init( &netmsg, bufData, sizeof( bufData ) );
+		netmsg.cursize = packet->length;
+		Com_Memcpy( bufData, packet->data, packet->length );
+		from = packet->from;
+		net_packetTime = packet->time;
+
+		recvQueue.tail.store( tail + 1, std::memory_order_release );
+
+		if ( netmsg.cursize >= netmsg.maxsize ) {
+			Com_Printf( "Oversize packet from %s\n", NET_AdrToString( from ) );
+			continue;
+		}
+
+		if ( net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f ) {
+			if ( rand() < (int)( ( (double)RAND_MAX ) / 100.0 * (double)net_dropsim->value ) )
+				continue;
+		}
+
+		if ( com_sv_running->integer )
+			Com_RunAndTimeServerPacket( &from, &netmsg );
+		else
+			CL_PacketEvent( from, &netmsg );
+	}
+
+	net_packetTime = 0;
+}
+
+/*
+====================
+NET_PacketTime
+
+Sys_Microseconds when the packet being run arrived, or 0 if it wasn't
+queued by the receive thread and only the frame time is known.
+====================
+*/
+int64_t NET_PacketTime( void ) {
+	return net_packetTime;
+}
+
 /*
 ====================
 NET_Config
@@ -919,7 +1465,20 @@ void NET_Config( qboolean enableNetworking ) {
 	}
 
 	if ( stop ) {
+		NET_StopReceiveThread();
+
+#ifdef NET_BATCHIO
+		// drop anything still queued for the old socket
+		recvBatch.current = recvBatch.count = 0;
+		sendBatch.count = 0;
+		sendBatch.active = qfalse;
+#endif
+
 		if ( ip_socket != INVALID_SOCKET ) {
+#ifdef NET_EPOLL
+			// a new socket may reuse the descriptor number
+			NET_EpollWatch( &ep.socket, INVALID_SOCKET, EP_SOCKET );
+#endif
 			closesocket( ip_socket );
 			ip_socket = INVALID_SOCKET;
 		}
@@ -933,8 +1492,10 @@ void NET_Config( qboolean enableNetworking ) {
 	}
 
 	if ( start ) {
-		if ( net_enabled->integer )
+		if ( net_enabled->integer ) {
 			NET_OpenIP();
+			NET_StartReceiveThread();
+		}
 	}
 }
 
@@ -955,6 +1516,11 @@ void NET_Init( void ) {
 	Com_Printf( "Winsock Initialized\n" );
 #endif
 
+#ifdef NET_EPOLL
+	// before the receive thread starts signaling it
+	NET_EpollInit();
+#endif
+
 	NET_Config( qtrue );
 
 	Cmd_AddCommand ("net_restart", NET_Restart_f );
@@ -971,6 +1537,13 @@ void NET_Shutdown( void ) {
 	}
 
 	NET_Config( qfalse );
+	if ( recvQueue.packets ) {
+		Z_Free( recvQueue.packets );
+		recvQueue.packets = NULL;
+	}
+#ifdef NET_EPOLL
+	NET_EpollShutdown();
+#endif
 #ifdef _WIN32
 	WSACleanup();
 	winsockInitialized = qfalse;
@@ -1014,6 +1587,114 @@ void NET_Event(fd_set *fdr)
 	}
 }
 
+#ifdef NET_EPOLL
+/*
+====================
+NET_SleepEpoll
+====================
+*/
+static void NET_SleepEpoll( int msec, qboolean pending ) {
+	struct epoll_event events[4];
+	struct itimerspec its;
+	struct timeval tp;
+	fd_set fdset;
+	uint64_t count;
+	int64_t usec;
+	int i, n;
+
+	// the receive thread owns the socket while it runs
+	NET_EpollWatch( &ep.socket, recvQueue.active ? INVALID_SOCKET : ip_socket, EP_SOCKET );
+	NET_EpollWatch( &ep.console, Sys_ConsoleInputFd(), EP_CONSOLE );
+
+	if ( recvQueue.active && !NET_ReceiveQueueEmpty() )
+		msec = 0;
+
+	if ( msec > 0 ) {
+		// Sys_Milliseconds ticks on whole wall clock milliseconds, so
+		// fire exactly on the boundary the frame deadline falls on
+		gettimeofday( &tp, NULL );
+		usec = ( (int64_t)( tp.tv_usec / 1000 ) + msec ) * 1000;
+
+		memset( &its, 0, sizeof( its ) );
+		its.it_value.tv_sec = tp.tv_sec + usec / 1000000;
+		its.it_value.tv_nsec = ( usec % 1000000 ) * 1000;
+		timerfd_settime( ep.timerfd, EP_TIMER_FLAGS, &its, NULL );
+	}
+
+	// the timeout only matters if the wall clock steps back, a relative
+	// wait like select's still ends in time then
+	n = epoll_wait( ep.epfd, events, ARRAY_LEN( events ), msec > 0 ? msec + 1 : 0 );
+	if ( n == -1 ) {
+		if ( errno != EINTR )
+			Com_Printf( "Warning: epoll_wait() syscall failed: %s\n", strerror( errno ) );
+		return;
+	}
+
+	FD_ZERO( &fdset );
+	if ( pending )
+		FD_SET( ip_socket, &fdset );
+
+	for ( i = 0; i < n; i++ ) {
+		switch ( events[i].data.u32 ) {
+		case EP_SOCKET:
+			FD_SET( ip_socket, &fdset );
+			pending = qtrue;
+			break;
+		case EP_CONSOLE:
+			Sys_QueConsoleInput();
+			break;
+		case EP_TIMER:
+			// fails with ECANCELED if the wall clock was set, which is
+			// just as much a reason to run a frame
+			if ( read( ep.timerfd, &count, sizeof( count ) ) < 0 ) {}
+			break;
+		case EP_WAKEUP:
+			if ( read( ep.wakefd, &count, sizeof( count ) ) < 0 ) {}
+			NET_HTTP_ProcessEvents();
+			break;
+		}
+	}
+
+	if ( recvQueue.active )
+		NET_DrainReceiveQueue();
+	else if ( pending )
+		NET_Event( &fdset );
+}
+#endif
+
+/*
+====================
+NET_WakeUp
+
+Interrupts a NET_Sleep in progress. Safe to call from any thread.
+====================
+*/
+void NET_WakeUp( void ) {
+#ifdef NET_EPOLL
+	uint64_t one = 1;
+
+	if ( ep.wakefd != -1 ) {
+		if ( write( ep.wakefd, &one, sizeof( one ) ) < 0 ) {}
+	}
+#endif
+}
+
+/*
+====================
+NET_SleepIsPrecise
+
+True if NET_Sleep wakes up on the millisecond it was asked to, so the
+caller doesn't need to busy wait the last one.
+====================
+*/
+qboolean NET_SleepIsPrecise( void ) {
+#ifdef NET_EPOLL
+	return ep.epfd != -1 ? qtrue : qfalse;
+#else
+	return qfalse;
+#endif
+}
+
 /*
 ====================
 NET_Sleep
@@ -1026,10 +1707,35 @@ void NET_Sleep(int msec) {
 	fd_set	fdset;
 	int retval;
 	SOCKET highestfd = INVALID_SOCKET;
+	qboolean pending = qfalse;
 
 	if (msec < 0)
 		msec = 0;
 
+#ifdef NET_BATCHIO
+	// packets left over in the receive ring don't wake up select
+	if (recvBatch.current < recvBatch.count) {
+		pending = qtrue;
+		msec = 0;
+	}
+#endif
+
+#ifdef NET_EPOLL
+	if (ep.epfd != -1) {
+		NET_SleepEpoll(msec, pending);
+		return;
+	}
+#endif
+
+	if (recvQueue.active) {
+		std::unique_lock<std::mutex> lk(recvQueue.mutex);
+		recvQueue.cv.wait_for(lk, std::chrono::milliseconds(msec), [] { return !NET_ReceiveQueueEmpty(); });
+		lk.unlock();
+
+		NET_DrainReceiveQueue();
+		return;
+	}
+
 	FD_ZERO(&fdset);
 	if (ip_socket != INVALID_SOCKET) {
 		FD_SET(ip_socket, &fdset); // network socket
@@ -1054,6 +1760,10 @@ void NET_Sleep(int msec) {
 		Com_Printf("Warning: select() syscall failed: %s\n", NET_ErrorString());
 	else if (retval > 0)
 		NET_Event(&fdset);
+	else if (pending) {
+		FD_SET(ip_socket, &fdset);
+		NET_Event(&fdset);
+	}
 }
 
 /*
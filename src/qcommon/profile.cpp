@@ -0,0 +1,221 @@
+// profile.c -- scoped frame profiler with chrome trace export
+
+#include "qcommon.h"
+
+#include <atomic>
+
+/*
+==============================================================
+
+While com_profile is set, every PROF_SCOPE records its name, start time
+and duration in nanoseconds into a ring of the last PROF_MAX_EVENTS
+events. profile_dump writes the ring in the Chrome trace event format,
+which chrome://tracing, Perfetto and speedscope can open.
+
+When profiling is off a scope costs a single branch.
+
+Any thread may record. Each slot carries the index of the event it holds,
+stored with release semantics once the event is complete, so the dump can
+skip slots that are still being written or were overwritten meanwhile.
+
+==============================================================
+*/
+
+#define PROF_MAX_EVENTS		(1 << 17)
+#define PROF_MAX_THREADS	64
+
+typedef struct {
+	std::atomic<uint64_t>		seq;		// event index + 1, 0 while being written
+	std::atomic<const char *>	name;
+	std::atomic<int64_t>		start;
+	std::atomic<int64_t>		duration;
+	std::atomic<int>			thread;
+} profEvent_t;
+
+std::atomic<bool>		prof_enabled;
+
+static cvar_t			*com_profile;
+static profEvent_t		*profEvents;
+static std::atomic<uint64_t>	profNext;
+static std::atomic<int>			profNumThreads;
+static thread_local int	profThread = -1;
+
+static char				profThreadNames[PROF_MAX_THREADS][32];
+static std::atomic<bool>	profThreadNamed[PROF_MAX_THREADS];
+
+/*
+================
+Prof_ThreadNum
+================
+*/
+static int Prof_ThreadNum( void ) {
+	if ( profThread == -1 ) {
+		profThread = profNumThreads++;
+	}
+
+	return profThread;
+}
+
+/*
+================
+Prof_SetThreadName
+
+Names the calling thread in the trace, call it once when the thread starts
+================
+*/
+void Prof_SetThreadName( const char *name ) {
+	int		thread;
+
+	thread = Prof_ThreadNum();
+	if ( thread >= PROF_MAX_THREADS || profThreadNamed[thread] ) {
+		return;
+	}
+
+	Q_strncpyz( profThreadNames[thread], name, sizeof( profThreadNames[thread] ) );
+	profThreadNamed[thread].store( true, std::memory_order_release );
+}
+
+/*
+================
+Prof_Record
+================
+*/
+void Prof_Record( const char *name, int64_t start, int64_t end ) {
+	profEvent_t	*ev;
+	uint64_t	i;
+
+	if ( !profEvents ) {
+		return;
+	}
+
+	i = profNext.fetch_add( 1, std::memory_order_relaxed );
+	ev = &profEvents[i & ( PROF_MAX_EVENTS - 1 )];
+
+	// invalidate the slot before touching the event
+	ev->seq.store( 0, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+
+	ev->name.store( name, std::memory_order_relaxed );
+	ev->start.store( start, std::memory_order_relaxed );
+	ev->duration.store( end - start, std::memory_order_relaxed );
+	ev->thread.store( Prof_ThreadNum(), std::memory_order_relaxed );
+
+	ev->seq.store( i + 1, std::memory_order_release );
+}
+
+/*
+================
+Prof_Frame
+
+Called once per frame on the main thread
+================
+*/
+void Prof_Frame( void ) {
+	if ( com_profile->integer && !profEvents ) {
+		profEvents = (profEvent_t *)Z_Malloc( PROF_MAX_EVENTS * sizeof( profEvent_t ), TAG_GENERAL, qtrue );
+		profNext = 0;
+	}
+
+	prof_enabled.store( com_profile->integer && profEvents, std::memory_order_relaxed );
+}
+
+/*
+================
+Prof_Dump_f
+
+profile_dump [filename]
+================
+*/
+static void Prof_Dump_f( void ) {
+	char			name[MAX_QPATH];
+	fileHandle_t	f;
+	profEvent_t		*ev;
+	const char		*evName;
+	int64_t			evStart, evDuration;
+	int				evThread;
+	uint64_t		i, first, last;
+	int				count, numThreads;
+
+	if ( !profEvents ) {
+		Com_Printf( "Nothing recorded, set com_profile 1 first.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() > 1 ) {
+		Com_sprintf( name, sizeof( name ), "profile/%s", Cmd_Argv( 1 ) );
+		COM_DefaultExtension( name, sizeof( name ), ".json" );
+	} else {
+		qtime_t	now;
+
+		Com_RealTime( &now );
+		Com_sprintf( name, sizeof( name ), "profile/%04d-%02d-%02d_%02d-%02d-%02d.json",
+			1900 + now.tm_year, 1 + now.tm_mon, now.tm_mday, now.tm_hour, now.tm_min, now.tm_sec );
+	}
+
+	f = FS_FOpenFileWrite( name );
+	if ( !f ) {
+		Com_Printf( "ERROR: couldn't open %s.\n", name );
+		return;
+	}
+
+	last = profNext.load( std::memory_order_relaxed );
+	first = last > PROF_MAX_EVENTS ? last - PROF_MAX_EVENTS : 0;
+
+	FS_Printf( f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" );
+
+	// the main thread is always named, so every later entry can start with a comma
+	numThreads = profNumThreads;
+	for ( i = 0 ; i < (uint64_t)numThreads && i < PROF_MAX_THREADS ; i++ ) {
+		if ( !profThreadNamed[i].load( std::memory_order_acquire ) ) {
+			continue;
+		}
+
+		FS_Printf( f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}",
+			i ? ",\n" : "", (int)i, profThreadNames[i] );
+	}
+
+	count = 0;
+	for ( i = first ; i < last ; i++ ) {
+		ev = &profEvents[i & ( PROF_MAX_EVENTS - 1 )];
+
+		// the slot may still be written by a worker or already hold a newer event
+		if ( ev->seq.load( std::memory_order_acquire ) != i + 1 ) {
+			continue;
+		}
+
+		evName = ev->name.load( std::memory_order_relaxed );
+		evStart = ev->start.load( std::memory_order_relaxed );
+		evDuration = ev->duration.load( std::memory_order_relaxed );
+		evThread = ev->thread.load( std::memory_order_relaxed );
+
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if ( ev->seq.load( std::memory_order_relaxed ) != i + 1 ) {
+			continue;
+		}
+
+		FS_Printf( f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%lld.%03d,\"dur\":%lld.%03d}",
+			evName, evThread,
+			(long long)( evStart / 1000 ), (int)( evStart % 1000 ),
+			(long long)( evDuration / 1000 ), (int)( evDuration % 1000 ) );
+		count++;
+	}
+
+	FS_Printf( f, "\n]}\n" );
+	FS_FCloseFile( f );
+
+	Com_Printf( "Wrote %i events to %s.\n", count, name );
+}
+
+/*
+================
+Prof_Init
+================
+*/
+void Prof_Init( void ) {
+	com_profile = Cvar_Get( "com_profile", "0", CVAR_TEMP );
+
+	// the main thread always shows up first
+	Prof_SetThreadName( "main" );
+
+	Cmd_AddCommand( "profile_dump", Prof_Dump_f );
+}
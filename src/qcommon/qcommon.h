@@ -3,6 +3,7 @@
 #define _QCOMMON_H_
 
 #include <stdint.h>
+#include <atomic>
 #include "../qcommon/cm_public.h"
 #include "../qcommon/q_shared.h"
 #include "../api/mvapi.h"
@@ -101,6 +102,8 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits( msg_t *msg, int value, int bits );
+void MSG_WriteBitstream( msg_t *msg, const byte *data, int numBits );
+void MSG_CopyBitstream( const msg_t *msg, int startBit, byte *data );
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -199,6 +202,11 @@ const char	*NET_AdrToString (netadr_t a);
 qboolean	NET_StringToAdr ( const char *s, netadr_t *a);
 qboolean	NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, msg_t *net_message);
 void		NET_Sleep(int msec);
+void		NET_BeginSendBatch( void );
+void		NET_FlushSendBatch( void );
+void		NET_WakeUp( void );
+qboolean	NET_SleepIsPrecise( void );
+int64_t		NET_PacketTime( void );
 
 #define	MAX_MSGLEN				16384		// max length of a message, which may
 											// be fragmented into multiple packets
@@ -344,6 +352,7 @@ intptr_t QDECL VM_Call(vm_t *vm, int callnum, ...);
 void	VM_Debug( int level );
 
 void	*VM_ArgPtr(intptr_t intValue);
+void	*VM_ArgBlock(intptr_t intValue, int count, size_t elemSize);
 
 static ID_INLINE float _vmf(intptr_t x)
 {
@@ -361,6 +370,37 @@ void	VM_Forced_Unload_Done(void);
 int	VM_MVAPILevel(const vm_t *vm);
 void VM_SetMVAPILevel(vm_t *vm, int level);
 
+/*
+==============================================================
+
+PROFILER
+
+==============================================================
+*/
+
+extern std::atomic<bool> prof_enabled;
+
+void	Prof_Init( void );
+void	Prof_Frame( void );
+void	Prof_SetThreadName( const char *name );
+void	Prof_Record( const char *name, int64_t start, int64_t end );
+
+// records the enclosing block while com_profile is set
+struct profScope_t {
+	const char	*name;
+	int64_t		start;
+
+	profScope_t( const char *n ) : name( n ), start( prof_enabled.load( std::memory_order_relaxed ) ? Sys_Nanoseconds() : 0 ) {}
+	~profScope_t() {
+		if ( start )
+			Prof_Record( name, start, Sys_Nanoseconds() );
+	}
+};
+
+#define PROF_CONCAT2( a, b )	a##b
+#define PROF_CONCAT( a, b )		PROF_CONCAT2( a, b )
+#define PROF_SCOPE( name )		profScope_t PROF_CONCAT( profScope, __LINE__ )( name )
+
 //Ignore __attribute__ on non-gcc platforms
 #ifndef __GNUC__
 #ifndef __attribute__
@@ -641,12 +681,23 @@ void	FS_ForceFlush( fileHandle_t f );
 void	FS_FreeFile( void *buffer );
 // frees the memory returned by FS_ReadFile
 
+void	*FS_MapFile( const char *qpath, int *len );
+// maps a loose or uncompressed pk3 file copy-on-write, NULL if it can't be
+// mapped; writes to the buffer never reach the file
+
+void	FS_UnmapFile( void *data, int len );
+// releases a buffer returned by FS_MapFile
+
 void	FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
 
 int		FS_filelength( fileHandle_t f );
 // doesn't work for files that are opened from a pack file
 
+FILE	*FS_FileForHandle( fileHandle_t f );
+// the stdio FILE of a file that isn't in a pack file, for code that has
+// to write without the filesystem, e.g. from another thread
+
 char	*FS_BuildOSPath(const char *base, const char *game, const char *qpath);
 char	*FS_BuildOSPath(const char *base, const char *path);
 
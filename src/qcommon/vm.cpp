@@ -76,6 +76,8 @@ void VM_Init( void ) {
 	Cvar_Get( "vm_cgame", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_game", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_ui", "2", CVAR_ARCHIVE );		// !@# SHIP WITH SET TO 2
+	Cvar_Get( "vm_optimize", "1", CVAR_ARCHIVE );
+	Cvar_Get( "vm_cache", "1", CVAR_ARCHIVE );
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f );
@@ -714,6 +716,33 @@ void *VM_ArgPtr( intptr_t intValue ) {
 	}
 }
 
+/*
+==============
+VM_ArgBlock
+
+Like VM_ArgPtr, for arrays of count elements passed to the engine. Makes
+sure the whole block lies within the data segment of an interpreted or
+compiled vm. The size is never multiplied out, so a huge count can't wrap
+around on 32 bit.
+==============
+*/
+void *VM_ArgBlock( intptr_t intValue, int count, size_t elemSize ) {
+	if ( !intValue || currentVM == NULL ) {
+		return NULL;
+	}
+
+	if ( currentVM->entryPoint ) {
+		return (void *)(currentVM->dataBase + intValue);
+	}
+
+	if ( (size_t)(intValue & currentVM->dataMask) != (size_t)intValue || count < 0 ||
+		(size_t)count > ( (size_t)currentVM->dataMask + 1 - (size_t)intValue ) / elemSize ) {
+		Com_Error( ERR_DROP, "VM_ArgBlock: block out of range" );
+	}
+
+	return (void *)(currentVM->dataBase + intValue);
+}
+
 void *VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue ) {
 	if ( !intValue ) {
 		return NULL;
@@ -763,6 +792,8 @@ intptr_t QDECL VM_Call( vm_t *vm, int callnum, ... )
 	intptr_t r;
 	int i;
 
+	PROF_SCOPE( "VM_Call" );
+
 	if(!vm || !vm->name[0])
 		Com_Error(ERR_FATAL, "VM_Call with NULL vm");
 
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // vm_x86.c -- load time compiler and execution environment for x86
 
 #include "vm_local.h"
+#include "mv_setup.h"
 #include <stdint.h>
 
 #ifdef _WIN32
@@ -60,10 +61,12 @@ x86_64:
 
 */
 
-#define VMFREE_BUFFERS() do {Z_Free(buf); Z_Free(jused);} while(0)
+#define VMFREE_BUFFERS() do {Z_Free(buf); Z_Free(jused); Z_Free(relocs);} while(0)
 static	byte	*buf = NULL;
 static	byte	*jused = NULL;
 static	int		jusedSize = 0;
+static	int		*relocs = NULL;		// code offset and target of every EmitPtr
+static	int		numRelocs, maxRelocs, entryRelocs;
 static	int		compiledOfs = 0;
 static	byte	*code = NULL;
 static	int		pc = 0;
@@ -147,10 +150,17 @@ static void Emit4(int v)
 	Emit1((v >> 24) & 0xFF);
 }
 
+#if idx64
+static void VM_AddReloc(void *ptr);
+#endif
+
 static void EmitPtr(void *ptr)
 {
 	intptr_t v = (intptr_t) ptr;
 
+#if idx64
+	VM_AddReloc(ptr);
+#endif
 	Emit4(v);
 #if idx64
 	Emit1((v >> 32) & 0xFF);
@@ -1057,214 +1067,1865 @@ qboolean ConstOptimize(vm_t *vm, int callProcOfsSyscall)
 	return qfalse;
 }
 
+#if idx64
+/*
+=================================================================
+
+OPTIMIZING CODE GENERATOR
+
+With vm_optimize set, x86_64 bytecode is translated by a second code
+generator. Instead of moving every operand through the opStack in memory
+it keeps track of the top opStack entries while compiling:
+
+  constants and local addresses are folded into immediates and memory
+  operands, LOCAL/LOAD4/LOCAL/STORE4 becomes two movs
+  computed values stay in eax, ecx, edx, r10 and r11
+  floating point math is done with SSE in xmm0 and xmm1
+
+The opStack and bl are only brought up to date ("flushed") before calls,
+branches, returns and at every jump target, so each basic block starts
+and ends with the opStack the legacy code would have. In between, values
+may be read or written up to OPT_MAX_DEPTH entries away from bl, which
+VM_CallCompiled leaves room for around the opStack.
+
+Anything it can't translate makes VM_Compile use the code generator
+above instead.
+
+=================================================================
+*/
+
+#define OPT_MAX_VALUES	8		// opStack entries tracked at once
+#define OPT_MAX_DEPTH	8		// entries above or below bl before flushing
+
+#define REG_EAX		0
+#define REG_ECX		1
+#define REG_EDX		2
+#define REG_R10		10
+#define REG_R11		11
+
+// eax and edx last, divisions need them
+static const int optRegs[] = { REG_R10, REG_R11, REG_ECX, REG_EAX, REG_EDX };
+
+typedef enum {
+	VAL_CONST,		// known at compile time
+	VAL_LOCAL,		// programStack + value
+	VAL_REG,		// in a register
+	VAL_MEM			// in the opStack
+} optValueKind_t;
+
+typedef struct {
+	optValueKind_t	kind;
+	int				value;
+} optValue_t;
+
+typedef enum {
+	ADDR_DATA,		// [r9 + reg]
+	ADDR_DATACONST,	// [r9 + 0x12345678]
+	ADDR_OPSTACK,	// [edi + ebx * 4 + entry * 4]
+	ADDR_LOCAL		// [esi + 0x12345678]
+} optAddr_t;
+
+static	optValue_t	optStack[OPT_MAX_VALUES];
+static	int			optCount;		// tracked entries at the top of the opStack
+static	int			optDepth;		// opStack top relative to bl
+static	int			optRegsUsed;	// one bit per register
+static	qboolean	optFailed;
+
 /*
 =================
-VM_Compile
+EmitRegOp
+Instruction with register operands, rm may also be an opcode extension
 =================
 */
-void VM_Compile(vm_t *vm, vmHeader_t *header)
+
+static void EmitRegOp(int prefix, int opcode, int reg, int rm)
 {
-	int		op;
-	int		maxLength;
-	int		v;
-	int		i;
-        int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+	int rex;
 
-	jusedSize = header->instructionCount + 2;
+	if(prefix)
+		Emit1(prefix);
 
-	// allocate a very large temp buffer, we will shrink it later
-	maxLength = header->codeLength * 8 + 64;
-	buf = (byte *)Z_Malloc(maxLength, TAG_VM, qtrue);
-	jused = (byte *)Z_Malloc(jusedSize, TAG_VM, qtrue);
-	code = (byte *)Z_Malloc(header->codeLength + 32, TAG_VM, qtrue);
+	rex = 0x40;
+	if(reg & 8)
+		rex |= 0x04;
+	if(rm & 8)
+		rex |= 0x01;
+	if(rex != 0x40)
+		Emit1(rex);
 
-	Com_Memset(jused, 0, jusedSize);
-	Com_Memset(buf, 0, maxLength);
+	if(opcode > 0xFF)
+		Emit1(opcode >> 8);
+	Emit1(opcode & 0xFF);
+	Emit1(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
 
-	// copy code in larger buffer and put some zeros at the end
-	// so we can safely look ahead for a few instructions in it
-	// without a chance to get false-positive because of some garbage bytes
-	Com_Memset(code, 0, header->codeLength+32);
-	Com_Memcpy(code, (byte *)header + header->codeOffset, header->codeLength );
+/*
+=================
+EmitRegImm
+Arithmetic instruction with an immediate, ext selects the operation
+=================
+*/
 
-	// ensure that the optimisation pass knows about all the jump
-	// table targets
-	pc = -1; // a bogus value to be printed in out-of-bounds error messages
-	for( i = 0; i < vm->numJumpTableTargets; i++ ) {
-		JUSED( *(int *)(vm->jumpTableTargets + ( i * sizeof( int ) ) ) );
+static void EmitRegImm(int ext, int reg, int v)
+{
+	if(iss8(v))
+	{
+		EmitRegOp(0, 0x83, ext, reg);		// op reg, 0x12
+		Emit1(v);
+	}
+	else
+	{
+		EmitRegOp(0, 0x81, ext, reg);		// op reg, 0x12345678
+		Emit4(v);
 	}
+}
 
-	// Start buffer with x86-VM specific procedures
-	compiledOfs = 0;
+/*
+=================
+EmitMovRegImm
+=================
+*/
 
-	callDoSyscallOfs = compiledOfs;
-	callProcOfs = EmitCallDoSyscall(vm);
-	callProcOfsSyscall = EmitCallProcedure(vm, callDoSyscallOfs);
-	vm->entryOfs = compiledOfs;
+static void EmitMovRegImm(int reg, int v)
+{
+	if(reg & 8)
+		Emit1(0x41);
+	Emit1(0xB8 | (reg & 7));			// mov reg, 0x12345678
+	Emit4(v);
+}
 
-	for(pass=0; pass < 3; pass++) {
-	oc0 = -23423;
-	oc1 = -234354;
-	pop0 = -43435;
-	pop1 = -545455;
+/*
+=================
+EmitMemOp
+Instruction with a memory operand
+=================
+*/
 
-	// translate all instructions
-	pc = 0;
-	instruction = 0;
-	//code = (byte *)header + header->codeOffset;
-	compiledOfs = vm->entryOfs;
+static void EmitMemOp(int prefix, int opcode, int reg, optAddr_t addr, int x)
+{
+	int rex;
+
+	if(prefix)
+		Emit1(prefix);
+
+	rex = 0x40;
+	if(reg & 8)
+		rex |= 0x04;
+	if(addr == ADDR_DATA && (x & 8))
+		rex |= 0x02;
+	if(addr == ADDR_DATA || addr == ADDR_DATACONST)
+		rex |= 0x01;
+	if(rex != 0x40)
+		Emit1(rex);
 
-	LastCommand = LAST_COMMAND_NONE;
+	if(opcode > 0xFF)
+		Emit1(opcode >> 8);
+	Emit1(opcode & 0xFF);
 
-	while(instruction < header->instructionCount)
+	switch(addr)
 	{
-		if(compiledOfs > maxLength - 16)
-		{
-	        	VMFREE_BUFFERS();
-			Com_Error(ERR_DROP, "VM_CompileX86: maxLength exceeded");
-		}
+	case ADDR_DATA:
+		Emit1(0x04 | ((reg & 7) << 3));
+		Emit1(((x & 7) << 3) | 0x01);
+	break;
+	case ADDR_DATACONST:
+		Emit1(0x81 | ((reg & 7) << 3));
+		Emit4(x);
+	break;
+	case ADDR_OPSTACK:
+		Emit1(0x44 | ((reg & 7) << 3));
+		Emit1(0x9F);
+		Emit1(x * 4);
+	break;
+	case ADDR_LOCAL:
+		Emit1(0x86 | ((reg & 7) << 3));
+		Emit4(x);
+	break;
+	}
+}
 
-		vm->instructionPointers[ instruction ] = compiledOfs;
+/*
+=================
+EmitJumpOpt
+Jump or call to constant instruction number
+=================
+*/
 
-		if ( !vm->jumpTableTargets )
-			jlabel = 1;
-		else
-			jlabel = jused[ instruction ];
+static void EmitJumpOpt(vm_t *vm, int opcode, int cdest)
+{
+	if(cdest < 0 || cdest >= vm->instructionCount)
+	{
+		optFailed = qtrue;
+		return;
+	}
 
-		instruction++;
+	if(opcode > 0xFF)
+		Emit1(opcode >> 8);
+	Emit1(opcode & 0xFF);			// j??? 0x12345678
 
-		if(pc > header->codeLength)
-		{
-		        VMFREE_BUFFERS();
-			Com_Error(ERR_DROP, "VM_CompileX86: pc > header->codeLength");
-		}
+	// the addresses of the first pass are only used to get the size right
+	Emit4(vm->instructionPointers[cdest] - compiledOfs - 4);
+}
 
-		op = code[ pc ];
-		pc++;
-		switch ( op ) {
-		case 0:
-			break;
-		case OP_BREAK:
-			EmitString("CC");				// int 3
-			break;
-		case OP_ENTER:
-			EmitString("81 EE");				// sub esi, 0x12345678
-			Emit4(Constant4());
-			break;
-		case OP_CONST:
-			if(ConstOptimize(vm, callProcOfsSyscall))
-				break;
+/*
+=================
+OptSlot
+opStack entry of a tracked value relative to bl
+=================
+*/
 
-			EmitPushStack(vm);
-			EmitString("C7 04 9F");				// mov dword ptr [edi + ebx * 4], 0x12345678
-			lastConst = Constant4();
+static int OptSlot(int index)
+{
+	return optDepth - optCount + 1 + index;
+}
 
-			Emit4(lastConst);
-			if(code[pc] == OP_JUMP)
-				JUSED(lastConst);
+/*
+=================
+OptFreeReg
+=================
+*/
 
-			break;
-		case OP_LOCAL:
-			EmitPushStack(vm);
-			EmitString("8D 86");				// lea eax, [0x12345678 + esi]
-			oc0 = oc1;
-			oc1 = Constant4();
-			Emit4(oc1);
-			EmitCommand(LAST_COMMAND_MOV_STACK_EAX);	// mov dword ptr [edi + ebx * 4], eax
-			break;
-		case OP_ARG:
-			EmitMovEAXStack(vm, 0);				// mov eax, dword ptr [edi + ebx * 4]
-			EmitString("8B D6");				// mov edx, esi
-			EmitString("81 C2");				// add edx, 0x12345678
-			Emit4((Constant1() & 0xFF));
-			MASK_REG("E2", vm->dataMask);			// and edx, 0x12345678
-#if idx64
-			EmitRexString(0x41, "89 04 11");		// mov dword ptr [r9 + edx], eax
-#else
-			EmitString("89 82");				// mov dword ptr [edx + 0x12345678], eax
-			Emit4((intptr_t) vm->dataBase);
-#endif
-			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
-			break;
-		case OP_CALL:
-			EmitCallRel(vm, callProcOfs);
-			break;
-		case OP_PUSH:
-			EmitPushStack(vm);
-			break;
-		case OP_POP:
-			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
-			break;
-		case OP_LEAVE:
-			v = Constant4();
-			EmitString("81 C6");				// add	esi, 0x12345678
-			Emit4(v);
-			EmitString("C3");				// ret
-			break;
-		case OP_LOAD4:
-			if (code[pc] == OP_CONST && code[pc+5] == OP_ADD && code[pc+6] == OP_STORE4)
-			{
-				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-				{
-					compiledOfs -= 12;
-					vm->instructionPointers[instruction - 1] = compiledOfs;
-				}
+static void OptFreeReg(const optValue_t *v)
+{
+	if(v->kind == VAL_REG)
+		optRegsUsed &= ~(1 << v->value);
+}
 
-				pc++;				// OP_CONST
-				v = Constant4();
+/*
+=================
+OptAllocReg
+Returns a free register, moving the deepest tracked register value to the
+opStack if there is none
+=================
+*/
 
-				EmitMovEDXStack(vm, vm->dataMask);
-				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-				{
-#if idx64
-					EmitRexString(0x41, "FF 04 11");	// inc dword ptr [r9 + edx]
-#else
-					EmitString("FF 82");			// inc dword ptr [edx + 0x12345678]
-					Emit4((intptr_t) vm->dataBase);
-#endif
-				}
-				else
-				{
-#if idx64
-					EmitRexString(0x41, "8B 04 11");	// mov eax, dword ptr [r9 + edx]
-#else
-					EmitString("8B 82");			// mov eax, dword ptr [edx + 0x12345678]
-					Emit4((intptr_t) vm->dataBase);
-#endif
-					EmitString("05");			// add eax, v
-					Emit4(v);
+static int OptAllocReg(int exclude)
+{
+	int i, r;
 
-					if (oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-					{
-#if idx64
-						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
-#else
-						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
-						Emit4((intptr_t) vm->dataBase);
-#endif
-					}
-					else
-					{
-						EmitCommand(LAST_COMMAND_SUB_BL_1);	// sub bl, 1
-						EmitString("8B 14 9F");			// mov edx, dword ptr [edi + ebx * 4]
-						MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
-#if idx64
-						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
-#else
-						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
-						Emit4((intptr_t) vm->dataBase);
-#endif
-					}
-				}
+	for(;;)
+	{
+		for(i = 0; i < (int)ARRAY_LEN(optRegs); i++)
+		{
+			r = optRegs[i];
+			if(!((optRegsUsed | exclude) & (1 << r)))
+			{
+				optRegsUsed |= 1 << r;
+				return r;
+			}
+		}
 
-				EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
-				pc++;						// OP_ADD
-				pc++;						// OP_STORE
-				instruction += 3;
+		for(i = 0; i < optCount; i++)
+		{
+			if(optStack[i].kind == VAL_REG)
 				break;
-			}
+		}
 
-			if(code[pc] == OP_CONST && code[pc+5] == OP_SUB && code[pc+6] == OP_STORE4)
+		if(i == optCount)
+		{
+			optFailed = qtrue;
+			return REG_EAX;
+		}
+
+		EmitMemOp(0, 0x89, optStack[i].value, ADDR_OPSTACK, OptSlot(i));	// mov [edi + ebx * 4 + slot], reg
+		OptFreeReg(&optStack[i]);
+		optStack[i].kind = VAL_MEM;
+	}
+}
+
+/*
+=================
+OptToReg
+=================
+*/
+
+static int OptToReg(optValue_t *v)
+{
+	int r;
+
+	switch(v->kind)
+	{
+	case VAL_REG:
+		return v->value;
+	case VAL_CONST:
+		r = OptAllocReg(0);
+		EmitMovRegImm(r, v->value);
+	break;
+	case VAL_LOCAL:
+		r = OptAllocReg(0);
+		EmitMemOp(0, 0x8D, r, ADDR_LOCAL, v->value);	// lea reg, [esi + 0x12345678]
+	break;
+	default:
+		optFailed = qtrue;
+		r = REG_EAX;
+	break;
+	}
+
+	v->kind = VAL_REG;
+	v->value = r;
+
+	return r;
+}
+
+/*
+=================
+OptMoveReg
+Moves a register value to a register that isn't in exclude
+=================
+*/
+
+static void OptMoveReg(optValue_t *v, int exclude)
+{
+	int r;
+
+	r = OptAllocReg(exclude);
+	EmitRegOp(0, 0x89, v->value, r);		// mov r, reg
+	OptFreeReg(v);
+	v->value = r;
+}
+
+/*
+=================
+OptPush
+=================
+*/
+
+static void OptPush(optValueKind_t kind, int value)
+{
+	if(optCount >= OPT_MAX_VALUES)
+	{
+		optFailed = qtrue;
+		return;
+	}
+
+	optStack[optCount].kind = kind;
+	optStack[optCount].value = value;
+	optCount++;
+	optDepth++;
+}
+
+/*
+=================
+OptPop
+Values that are still in the opStack are loaded into a register right away
+=================
+*/
+
+static optValue_t OptPop(void)
+{
+	optValue_t	v;
+	int			slot;
+
+	slot = optDepth;
+
+	if(optCount > 0)
+		v = optStack[--optCount];
+	else
+		v.kind = VAL_MEM;
+
+	optDepth--;
+
+	if(v.kind == VAL_MEM)
+	{
+		v.kind = VAL_REG;
+		v.value = OptAllocReg(0);
+		EmitMemOp(0, 0x8B, v.value, ADDR_OPSTACK, slot);	// mov reg, [edi + ebx * 4 + slot]
+	}
+
+	return v;
+}
+
+/*
+=================
+OptFlush
+Writes the tracked values to the opStack and updates bl
+=================
+*/
+
+static void OptFlush(void)
+{
+	int i, r;
+
+	for(i = 0; i < optCount; i++)
+	{
+		switch(optStack[i].kind)
+		{
+		case VAL_REG:
+			EmitMemOp(0, 0x89, optStack[i].value, ADDR_OPSTACK, OptSlot(i));	// mov [edi + ebx * 4 + slot], reg
+			OptFreeReg(&optStack[i]);
+			optStack[i].kind = VAL_MEM;
+		break;
+		case VAL_CONST:
+			EmitMemOp(0, 0xC7, 0, ADDR_OPSTACK, OptSlot(i));	// mov dword ptr [edi + ebx * 4 + slot], 0x12345678
+			Emit4(optStack[i].value);
+			optStack[i].kind = VAL_MEM;
+		break;
+		default:
+		break;
+		}
+	}
+
+	// all registers of the entries are free now
+	for(i = 0; i < optCount; i++)
+	{
+		if(optStack[i].kind == VAL_LOCAL)
+		{
+			r = OptAllocReg(0);
+			EmitMemOp(0, 0x8D, r, ADDR_LOCAL, optStack[i].value);	// lea r, [esi + 0x12345678]
+			EmitMemOp(0, 0x89, r, ADDR_OPSTACK, OptSlot(i));	// mov [edi + ebx * 4 + slot], r
+			optRegsUsed &= ~(1 << r);
+			optStack[i].kind = VAL_MEM;
+		}
+	}
+
+	if(optDepth > 0)
+	{
+		STACK_PUSH(optDepth);		// add bl, depth
+	}
+	else if(optDepth < 0)
+	{
+		STACK_POP(-optDepth);		// sub bl, depth
+	}
+
+	optCount = 0;
+	optDepth = 0;
+}
+
+/*
+=================
+OptAddress
+Masks an address for a data access of the given alignment
+=================
+*/
+
+static optAddr_t OptAddress(optValue_t *v, int mask, int *x)
+{
+	if(v->kind == VAL_CONST)
+	{
+		*x = v->value & mask;
+		return ADDR_DATACONST;
+	}
+
+	*x = OptToReg(v);
+	EmitRegImm(4, *x, mask);			// and reg, mask
+
+	return ADDR_DATA;
+}
+
+/*
+=================
+OptFoldConst
+=================
+*/
+
+static int OptFoldConst(int op, int a, int b)
+{
+	switch(op)
+	{
+	case OP_ADD:
+		return (int)((unsigned)a + (unsigned)b);
+	case OP_SUB:
+		return (int)((unsigned)a - (unsigned)b);
+	case OP_MULI:
+	case OP_MULU:
+		return (int)((unsigned)a * (unsigned)b);
+	case OP_BAND:
+		return a & b;
+	case OP_BOR:
+		return a | b;
+	case OP_BXOR:
+		return a ^ b;
+	case OP_LSH:
+		return (int)((unsigned)a << (b & 31));
+	case OP_RSHI:
+		return a >> (b & 31);
+	case OP_RSHU:
+		return (int)((unsigned)a >> (b & 31));
+	}
+
+	return 0;
+}
+
+/*
+=================
+OptBinary
+Integer operations with a register or immediate operand
+=================
+*/
+
+static void OptBinary(int op)
+{
+	optValue_t	a, b, t;
+	int			ra, rb;
+
+	b = OptPop();
+	a = OptPop();
+
+	if(a.kind == VAL_CONST && b.kind == VAL_CONST)
+	{
+		OptPush(VAL_CONST, OptFoldConst(op, a.value, b.value));
+		return;
+	}
+
+	// local addresses plus offsets are still local addresses
+	if(op == OP_ADD && a.kind == VAL_CONST && b.kind == VAL_LOCAL)
+	{
+		t = a;
+		a = b;
+		b = t;
+	}
+
+	if(a.kind == VAL_LOCAL && b.kind == VAL_CONST && (op == OP_ADD || op == OP_SUB))
+	{
+		OptPush(VAL_LOCAL, OptFoldConst(op, a.value, b.value));
+		return;
+	}
+
+	// immediates go second
+	if(a.kind == VAL_CONST && op != OP_SUB)
+	{
+		t = a;
+		a = b;
+		b = t;
+	}
+
+	ra = OptToReg(&a);
+
+	if(b.kind == VAL_CONST)
+	{
+		switch(op)
+		{
+		case OP_ADD:
+			EmitRegImm(0, ra, b.value);		// add reg, 0x12345678
+		break;
+		case OP_SUB:
+			EmitRegImm(5, ra, b.value);		// sub reg, 0x12345678
+		break;
+		case OP_BAND:
+			EmitRegImm(4, ra, b.value);		// and reg, 0x12345678
+		break;
+		case OP_BOR:
+			EmitRegImm(1, ra, b.value);		// or reg, 0x12345678
+		break;
+		case OP_BXOR:
+			EmitRegImm(6, ra, b.value);		// xor reg, 0x12345678
+		break;
+		case OP_MULI:
+		case OP_MULU:
+			if(iss8(b.value))
+			{
+				EmitRegOp(0, 0x6B, ra, ra);	// imul reg, reg, 0x12
+				Emit1(b.value);
+			}
+			else
+			{
+				EmitRegOp(0, 0x69, ra, ra);	// imul reg, reg, 0x12345678
+				Emit4(b.value);
+			}
+		break;
+		case OP_LSH:
+			EmitRegOp(0, 0xC1, 4, ra);		// shl reg, 0x12
+			Emit1(b.value & 31);
+		break;
+		case OP_RSHI:
+			EmitRegOp(0, 0xC1, 7, ra);		// sar reg, 0x12
+			Emit1(b.value & 31);
+		break;
+		case OP_RSHU:
+			EmitRegOp(0, 0xC1, 5, ra);		// shr reg, 0x12
+			Emit1(b.value & 31);
+		break;
+		}
+
+		OptPush(VAL_REG, ra);
+		return;
+	}
+
+	rb = OptToReg(&b);
+
+	switch(op)
+	{
+	case OP_ADD:
+		EmitRegOp(0, 0x01, rb, ra);			// add ra, rb
+	break;
+	case OP_SUB:
+		EmitRegOp(0, 0x29, rb, ra);			// sub ra, rb
+	break;
+	case OP_BAND:
+		EmitRegOp(0, 0x21, rb, ra);			// and ra, rb
+	break;
+	case OP_BOR:
+		EmitRegOp(0, 0x09, rb, ra);			// or ra, rb
+	break;
+	case OP_BXOR:
+		EmitRegOp(0, 0x31, rb, ra);			// xor ra, rb
+	break;
+	case OP_MULI:
+	case OP_MULU:
+		EmitRegOp(0, 0x0FAF, ra, rb);		// imul ra, rb
+	break;
+	}
+
+	OptFreeReg(&b);
+	OptPush(VAL_REG, ra);
+}
+
+/*
+=================
+OptShift
+Shift by a count that is only known at runtime, it has to be in cl
+=================
+*/
+
+static void OptShift(int op)
+{
+	optValue_t	a, b;
+
+	b = OptPop();
+	a = OptPop();
+
+	if(b.kind == VAL_CONST)
+	{
+		OptPush(a.kind, a.value);
+		OptPush(b.kind, b.value);
+		OptBinary(op);
+		return;
+	}
+
+	OptToReg(&b);
+	OptToReg(&a);
+	OptFlush();
+
+	if(b.value != REG_ECX)
+	{
+		if(a.value == REG_ECX)
+			OptMoveReg(&a, 1 << REG_ECX);
+
+		optRegsUsed |= 1 << REG_ECX;
+		EmitRegOp(0, 0x89, b.value, REG_ECX);	// mov ecx, reg
+		OptFreeReg(&b);
+		b.value = REG_ECX;
+	}
+
+	switch(op)
+	{
+	case OP_LSH:
+		EmitRegOp(0, 0xD3, 4, a.value);		// shl reg, cl
+	break;
+	case OP_RSHI:
+		EmitRegOp(0, 0xD3, 7, a.value);		// sar reg, cl
+	break;
+	case OP_RSHU:
+		EmitRegOp(0, 0xD3, 5, a.value);		// shr reg, cl
+	break;
+	}
+
+	OptFreeReg(&b);
+	OptPush(VAL_REG, a.value);
+}
+
+/*
+=================
+OptDivide
+The dividend goes into eax, the quotient comes out in eax and the
+remainder in edx
+=================
+*/
+
+static void OptDivide(int op)
+{
+	optValue_t	a, b;
+
+	b = OptPop();
+	a = OptPop();
+
+	OptToReg(&b);
+	OptToReg(&a);
+	OptFlush();
+
+	if(b.value == REG_EAX || b.value == REG_EDX)
+		OptMoveReg(&b, (1 << REG_EAX) | (1 << REG_EDX));
+
+	if(a.value != REG_EAX)
+	{
+		optRegsUsed |= 1 << REG_EAX;
+		EmitRegOp(0, 0x89, a.value, REG_EAX);	// mov eax, reg
+		OptFreeReg(&a);
+	}
+
+	optRegsUsed |= 1 << REG_EDX;
+
+	if(op == OP_DIVI || op == OP_MODI)
+	{
+		EmitString("99");				// cdq
+		EmitRegOp(0, 0xF7, 7, b.value);		// idiv reg
+	}
+	else
+	{
+		EmitString("31 D2");			// xor edx, edx
+		EmitRegOp(0, 0xF7, 6, b.value);		// div reg
+	}
+
+	OptFreeReg(&b);
+
+	if(op == OP_DIVI || op == OP_DIVU)
+	{
+		optRegsUsed &= ~(1 << REG_EDX);
+		OptPush(VAL_REG, REG_EAX);
+	}
+	else
+	{
+		optRegsUsed &= ~(1 << REG_EAX);
+		OptPush(VAL_REG, REG_EDX);
+	}
+}
+
+/*
+=================
+OptFloat
+Float operations, done in xmm0 and xmm1
+=================
+*/
+
+static void OptFloat(int op)
+{
+	optValue_t	a, b;
+
+	b = OptPop();
+	a = OptPop();
+
+	OptToReg(&a);
+	OptToReg(&b);
+
+	EmitRegOp(0x66, 0x0F6E, 0, a.value);		// movd xmm0, ra
+	EmitRegOp(0x66, 0x0F6E, 1, b.value);		// movd xmm1, rb
+
+	switch(op)
+	{
+	case OP_ADDF:
+		EmitString("F3 0F 58 C1");			// addss xmm0, xmm1
+	break;
+	case OP_SUBF:
+		EmitString("F3 0F 5C C1");			// subss xmm0, xmm1
+	break;
+	case OP_MULF:
+		EmitString("F3 0F 59 C1");			// mulss xmm0, xmm1
+	break;
+	case OP_DIVF:
+		EmitString("F3 0F 5E C1");			// divss xmm0, xmm1
+	break;
+	}
+
+	EmitRegOp(0x66, 0x0F7E, 0, a.value);		// movd ra, xmm0
+
+	OptFreeReg(&b);
+	OptPush(VAL_REG, a.value);
+}
+
+/*
+=================
+OptBranch
+Conditional jump, everything is flushed before the compare
+=================
+*/
+
+static void OptBranch(vm_t *vm, int op, int cdest)
+{
+	static const int jcc[] = {
+		0x0F84, 0x0F85,							// EQ, NE
+		0x0F8C, 0x0F8E, 0x0F8F, 0x0F8D,			// LTI, LEI, GTI, GEI
+		0x0F82, 0x0F86, 0x0F87, 0x0F83,			// LTU, LEU, GTU, GEU
+		// ucomiss sets the flags like an unsigned compare, unordered
+		// operands branch like the x87 code does
+		0x0F84, 0x0F85,							// EQF, NEF
+		0x0F82, 0x0F86, 0x0F87, 0x0F83			// LTF, LEF, GTF, GEF
+	};
+	optValue_t	a, b;
+
+	b = OptPop();
+	a = OptPop();
+
+	OptToReg(&a);
+	if(op >= OP_EQF || b.kind != VAL_CONST)
+		OptToReg(&b);
+
+	// flushing changes the flags
+	OptFlush();
+
+	if(op >= OP_EQF)
+	{
+		EmitRegOp(0x66, 0x0F6E, 0, a.value);	// movd xmm0, ra
+		EmitRegOp(0x66, 0x0F6E, 1, b.value);	// movd xmm1, rb
+		EmitString("0F 2E C1");			// ucomiss xmm0, xmm1
+	}
+	else if(b.kind == VAL_CONST)
+		EmitRegImm(7, a.value, b.value);	// cmp ra, 0x12345678
+	else
+		EmitRegOp(0, 0x39, b.value, a.value);	// cmp ra, rb
+
+	EmitJumpOpt(vm, jcc[op - OP_EQ], cdest);
+
+	OptFreeReg(&a);
+	OptFreeReg(&b);
+}
+
+/*
+=================
+OptFindJumpTargets
+Marks every instruction a block starts at in jused
+=================
+*/
+
+static qboolean OptFindJumpTargets(vm_t *vm, vmHeader_t *header)
+{
+	int i, op, v;
+
+	// q3asm doesn't list jump table targets, but the tables are
+	// instruction numbers in the data segment. Any data word that could
+	// be one starts a block, computed jumps anywhere else hit ErrJump.
+	if(!vm->jumpTableTargets)
+	{
+		for(i = 0; i + 4 <= header->dataLength; i += 4)
+		{
+			v = *(int *)(vm->dataBase + i);
+			if(v >= 0 && v < vm->instructionCount)
+				jused[v] = 1;
+		}
+	}
+
+	pc = 0;
+	for(i = 0; i < header->instructionCount; i++)
+	{
+		if(pc >= header->codeLength)
+			return qfalse;
+
+		op = code[pc++];
+		switch(op)
+		{
+		case OP_EQ:
+		case OP_NE:
+		case OP_LTI:
+		case OP_LEI:
+		case OP_GTI:
+		case OP_GEI:
+		case OP_LTU:
+		case OP_LEU:
+		case OP_GTU:
+		case OP_GEU:
+		case OP_EQF:
+		case OP_NEF:
+		case OP_LTF:
+		case OP_LEF:
+		case OP_GTF:
+		case OP_GEF:
+			v = Constant4();
+			if(v < 0 || v >= vm->instructionCount)
+				return qfalse;
+			jused[v] = 1;
+		break;
+		case OP_CONST:
+			v = Constant4();
+			if(code[pc] == OP_JUMP)
+			{
+				if(v < 0 || v >= vm->instructionCount)
+					return qfalse;
+				jused[v] = 1;
+			}
+			// constant calls go straight to their target, which has to
+			// start a block like the ones checked at runtime
+			else if(code[pc] == OP_CALL && v >= 0)
+			{
+				if(v >= vm->instructionCount)
+					return qfalse;
+				jused[v] = 1;
+			}
+		break;
+		case OP_ENTER:
+			jused[i] = 1;
+			pc += 4;
+		break;
+		case OP_LEAVE:
+		case OP_LOCAL:
+		case OP_BLOCK_COPY:
+			pc += 4;
+		break;
+		case OP_ARG:
+			pc += 1;
+		break;
+		default:
+			if(op == OP_IGNORE || op > OP_CVFI)
+				return qfalse;
+		break;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+VM_CompileOptimized
+Returns qfalse if the bytecode has to be compiled by the legacy code generator
+=================
+*/
+
+static qboolean VM_CompileOptimized(vm_t *vm, vmHeader_t *header, int maxLength, int callDoSyscallOfs, int callProcOfs, int callProcOfsSyscall)
+{
+	optValue_t	a;
+	int			op;
+	int			v;
+	int			t;
+	int			i;
+	int			bits;
+	int			lastOfs;
+	int			jumpMapOfs;
+	int			jumpMapLen;
+	int			jmpSystemCall, jmpBadAddr, jmpBlockStart;
+
+	if(!OptFindJumpTargets(vm, header))
+		return qfalse;
+
+	// the first pass only finds the instruction addresses
+	lastOfs = 0;
+	jumpMapOfs = 0;
+	jumpMapLen = (header->instructionCount + 7) / 8;
+	for(pass = 0; pass < 2; pass++)
+	{
+		pc = 0;
+		instruction = 0;
+		compiledOfs = vm->entryOfs;
+		numRelocs = entryRelocs;
+
+		optCount = 0;
+		optDepth = 0;
+		optRegsUsed = 0;
+		optFailed = qfalse;
+
+		while(instruction < header->instructionCount)
+		{
+			if(compiledOfs > maxLength - 128 || pc >= header->codeLength)
+				return qfalse;
+
+			op = code[pc];
+
+			// blocks start with everything in the opStack
+			if(jused[instruction] || op == OP_ENTER || optCount >= OPT_MAX_VALUES
+				|| optDepth > OPT_MAX_DEPTH || optDepth < -OPT_MAX_DEPTH)
+			{
+				OptFlush();
+				jused[instruction] = 1;
+			}
+
+			vm->instructionPointers[instruction] = compiledOfs;
+			instruction++;
+			pc++;
+
+			switch(op)
+			{
+			case OP_UNDEF:
+			break;
+			case OP_BREAK:
+				OptFlush();
+				EmitString("CC");			// int 3
+			break;
+			case OP_ENTER:
+				EmitString("81 EE");			// sub esi, 0x12345678
+				Emit4(Constant4());
+			break;
+			case OP_LEAVE:
+				v = Constant4();
+				OptFlush();
+				EmitString("81 C6");			// add esi, 0x12345678
+				Emit4(v);
+				EmitString("C3");			// ret
+			break;
+			case OP_CALL:
+				if(optCount > 0 && optStack[optCount - 1].kind == VAL_CONST)
+				{
+					v = optStack[optCount - 1].value;
+					optCount--;
+					optDepth--;
+					OptFlush();
+
+					// only happens with folded targets, which can't be
+					// checked before compiling
+					if(v >= 0 && v < vm->instructionCount && !jused[v])
+					{
+						optFailed = qtrue;
+						break;
+					}
+
+					if(v < 0)
+					{
+						EmitString("B8");	// mov eax, 0x12345678
+						Emit4(v);
+						EmitCallRel(vm, callProcOfsSyscall);
+					}
+					else
+						EmitJumpOpt(vm, 0xE8, v);	// call 0x12345678
+				}
+				else
+				{
+					OptFlush();
+
+					// the call procedure only checks the range, calls
+					// into the middle of a block have to trap as well
+					EmitString("8B 04 9F");		// mov eax, dword ptr [edi + ebx * 4]
+					EmitString("85 C0");		// test eax, eax
+					EmitString("7C");		// jl call (system call)
+					jmpSystemCall = compiledOfs++;
+					EmitString("81 F8");		// cmp eax, vm->instructionCount
+					Emit4(vm->instructionCount);
+					EmitString("73");		// jae call (traps there)
+					jmpBadAddr = compiledOfs++;
+					EmitString("48 8D 0D");		// lea rcx, [rip + jumpMap]
+					Emit4(jumpMapOfs - compiledOfs - 4);
+					EmitString("0F A3 01");		// bt dword ptr [rcx], eax
+					EmitString("72");		// jc call
+					jmpBlockStart = compiledOfs++;
+					EmitCallErrJump(vm, callDoSyscallOfs);
+
+					SET_JMPOFS(jmpSystemCall);
+					SET_JMPOFS(jmpBadAddr);
+					SET_JMPOFS(jmpBlockStart);
+					EmitCallRel(vm, callProcOfs);
+				}
+
+				// the return value took the place of the call target
+			break;
+			case OP_PUSH:
+				OptPush(VAL_MEM, 0);
+			break;
+			case OP_POP:
+				if(optCount > 0)
+					OptFreeReg(&optStack[--optCount]);
+				optDepth--;
+			break;
+			case OP_CONST:
+				OptPush(VAL_CONST, Constant4());
+			break;
+			case OP_LOCAL:
+				OptPush(VAL_LOCAL, Constant4());
+			break;
+			case OP_JUMP:
+				if(optCount > 0 && optStack[optCount - 1].kind == VAL_CONST)
+				{
+					v = optStack[optCount - 1].value;
+					optCount--;
+					optDepth--;
+					OptFlush();
+					EmitJumpOpt(vm, 0xE9, v);	// jmp 0x12345678
+					break;
+				}
+
+				// only block starts have everything in the opStack, the
+				// jump map after the code has a bit set for each of them
+				a = OptPop();
+				OptToReg(&a);
+				OptFlush();
+				t = OptAllocReg(1 << a.value);
+				EmitRegImm(7, a.value, vm->instructionCount);	// cmp reg, vm->instructionCount
+				Emit1(0x73);				// jae ErrJump
+				Emit1(((a.value | t) & 8) ? 17 : 16);
+				Emit1(0x48 | ((t & 8) >> 1));
+				Emit1(0x8D);				// lea t, [rip + jumpMap]
+				Emit1(0x05 | ((t & 7) << 3));
+				Emit4(jumpMapOfs - compiledOfs - 4);
+				if((a.value | t) & 8)
+					Emit1(0x40 | ((a.value & 8) >> 1) | ((t & 8) >> 3));
+				EmitString("0F A3");			// bt dword ptr [t], reg
+				Emit1(((a.value & 7) << 3) | (t & 7));
+				EmitString("73 04");			// jnc ErrJump
+				Emit1(0x41 | ((a.value & 8) >> 2));
+				EmitString("FF 24");			// jmp qword ptr [r8 + reg * 8]
+				Emit1(0xC0 | ((a.value & 7) << 3));
+				EmitCallErrJump(vm, callDoSyscallOfs);
+				optRegsUsed &= ~(1 << t);
+				OptFreeReg(&a);
+			break;
+			case OP_EQ:
+			case OP_NE:
+			case OP_LTI:
+			case OP_LEI:
+			case OP_GTI:
+			case OP_GEI:
+			case OP_LTU:
+			case OP_LEU:
+			case OP_GTU:
+			case OP_GEU:
+			case OP_EQF:
+			case OP_NEF:
+			case OP_LTF:
+			case OP_LEF:
+			case OP_GTF:
+			case OP_GEF:
+				OptBranch(vm, op, Constant4());
+			break;
+			case OP_LOAD1:
+			case OP_LOAD2:
+			case OP_LOAD4:
+			{
+				optAddr_t	addr;
+				int			x, r;
+
+				a = OptPop();
+
+				if(op == OP_LOAD4)
+					addr = OptAddress(&a, vm->dataMask & ~3, &x);
+				else if(op == OP_LOAD2)
+					addr = OptAddress(&a, vm->dataMask & ~1, &x);
+				else
+					addr = OptAddress(&a, vm->dataMask, &x);
+
+				r = (a.kind == VAL_REG) ? a.value : OptAllocReg(0);
+
+				if(op == OP_LOAD4)
+					EmitMemOp(0, 0x8B, r, addr, x);		// mov reg, dword ptr [address]
+				else if(op == OP_LOAD2)
+					EmitMemOp(0, 0x0FB7, r, addr, x);	// movzx reg, word ptr [address]
+				else
+					EmitMemOp(0, 0x0FB6, r, addr, x);	// movzx reg, byte ptr [address]
+
+				OptPush(VAL_REG, r);
+			}
+			break;
+			case OP_STORE1:
+			case OP_STORE2:
+			case OP_STORE4:
+			{
+				optValue_t	b;
+				optAddr_t	addr;
+				int			x;
+
+				b = OptPop();
+				a = OptPop();
+
+				if(b.kind == VAL_LOCAL)
+					OptToReg(&b);
+
+				if(op == OP_STORE4)
+					addr = OptAddress(&a, vm->dataMask & ~3, &x);
+				else if(op == OP_STORE2)
+					addr = OptAddress(&a, vm->dataMask & ~1, &x);
+				else
+					addr = OptAddress(&a, vm->dataMask, &x);
+
+				if(b.kind == VAL_CONST)
+				{
+					if(op == OP_STORE4)
+					{
+						EmitMemOp(0, 0xC7, 0, addr, x);		// mov dword ptr [address], 0x12345678
+						Emit4(b.value);
+					}
+					else if(op == OP_STORE2)
+					{
+						EmitMemOp(0x66, 0xC7, 0, addr, x);	// mov word ptr [address], 0x1234
+						Emit2(b.value);
+					}
+					else
+					{
+						EmitMemOp(0, 0xC6, 0, addr, x);		// mov byte ptr [address], 0x12
+						Emit1(b.value);
+					}
+				}
+				else
+				{
+					if(op == OP_STORE4)
+						EmitMemOp(0, 0x89, b.value, addr, x);	// mov dword ptr [address], reg
+					else if(op == OP_STORE2)
+						EmitMemOp(0x66, 0x89, b.value, addr, x);	// mov word ptr [address], reg
+					else
+						EmitMemOp(0, 0x88, b.value, addr, x);	// mov byte ptr [address], reg
+				}
+
+				OptFreeReg(&a);
+				OptFreeReg(&b);
+			}
+			break;
+			case OP_ARG:
+			{
+				int r;
+
+				v = Constant1();
+				a = OptPop();
+
+				if(a.kind == VAL_LOCAL)
+					OptToReg(&a);
+
+				r = OptAllocReg(0);
+				EmitMemOp(0, 0x8D, r, ADDR_LOCAL, v);		// lea r, [esi + 0x12]
+				EmitRegImm(4, r, vm->dataMask & ~3);		// and r, 0x12345678
+
+				if(a.kind == VAL_CONST)
+				{
+					EmitMemOp(0, 0xC7, 0, ADDR_DATA, r);	// mov dword ptr [r9 + r], 0x12345678
+					Emit4(a.value);
+				}
+				else
+					EmitMemOp(0, 0x89, a.value, ADDR_DATA, r);	// mov dword ptr [r9 + r], reg
+
+				optRegsUsed &= ~(1 << r);
+				OptFreeReg(&a);
+			}
+			break;
+			case OP_BLOCK_COPY:
+				v = Constant4();
+				OptFlush();
+				EmitString("B8");			// mov eax, 0x12345678
+				Emit4(VM_BLOCK_COPY);
+				EmitString("B9");			// mov ecx, 0x12345678
+				Emit4(v);
+
+				EmitCallRel(vm, callDoSyscallOfs);
+
+				// the sub bl, 2 happens with the next flush
+				optDepth = -2;
+			break;
+			case OP_SEX8:
+			case OP_SEX16:
+			case OP_NEGI:
+			case OP_BCOM:
+			case OP_NEGF:
+				a = OptPop();
+
+				if(a.kind == VAL_CONST)
+				{
+					if(op == OP_SEX8)
+						v = (signed char)a.value;
+					else if(op == OP_SEX16)
+						v = (short)a.value;
+					else if(op == OP_NEGI)
+						v = (int)(0U - (unsigned)a.value);
+					else if(op == OP_BCOM)
+						v = ~a.value;
+					else
+						v = a.value ^ 0x80000000;
+
+					OptPush(VAL_CONST, v);
+					break;
+				}
+
+				OptToReg(&a);
+
+				if(op == OP_SEX8)
+					EmitRegOp(0, 0x0FBE, a.value, a.value);	// movsx reg, reg8
+				else if(op == OP_SEX16)
+					EmitRegOp(0, 0x0FBF, a.value, a.value);	// movsx reg, reg16
+				else if(op == OP_NEGI)
+					EmitRegOp(0, 0xF7, 3, a.value);		// neg reg
+				else if(op == OP_BCOM)
+					EmitRegOp(0, 0xF7, 2, a.value);		// not reg
+				else
+					EmitRegImm(6, a.value, 0x80000000);	// xor reg, 0x80000000
+
+				OptPush(VAL_REG, a.value);
+			break;
+			case OP_ADD:
+			case OP_SUB:
+			case OP_MULI:
+			case OP_MULU:
+			case OP_BAND:
+			case OP_BOR:
+			case OP_BXOR:
+				OptBinary(op);
+			break;
+			case OP_LSH:
+			case OP_RSHI:
+			case OP_RSHU:
+				OptShift(op);
+			break;
+			case OP_DIVI:
+			case OP_DIVU:
+			case OP_MODI:
+			case OP_MODU:
+				OptDivide(op);
+			break;
+			case OP_ADDF:
+			case OP_SUBF:
+			case OP_MULF:
+			case OP_DIVF:
+				OptFloat(op);
+			break;
+			case OP_CVIF:
+				a = OptPop();
+
+				if(a.kind == VAL_CONST)
+				{
+					float f = (float)a.value;
+
+					Com_Memcpy(&v, &f, sizeof(v));
+					OptPush(VAL_CONST, v);
+					break;
+				}
+
+				OptToReg(&a);
+				EmitRegOp(0xF3, 0x0F2A, 0, a.value);	// cvtsi2ss xmm0, reg
+				EmitRegOp(0x66, 0x0F7E, 0, a.value);	// movd reg, xmm0
+				OptPush(VAL_REG, a.value);
+			break;
+			case OP_CVFI:
+				a = OptPop();
+				OptToReg(&a);
+				EmitRegOp(0x66, 0x0F6E, 0, a.value);	// movd xmm0, reg
+				EmitRegOp(0xF3, 0x0F2C, a.value, 0);	// cvttss2si reg, xmm0
+				OptPush(VAL_REG, a.value);
+			break;
+			default:
+				return qfalse;
+			}
+
+			if(optFailed)
+				return qfalse;
+		}
+
+		OptFlush();
+
+		if(compiledOfs > maxLength - jumpMapLen)
+			return qfalse;
+
+		jumpMapOfs = compiledOfs;
+		for(v = 0; v < header->instructionCount; v += 8)
+		{
+			bits = 0;
+			for(i = 0; i < 8 && v + i < header->instructionCount; i++)
+				bits |= jused[v + i] << i;
+			Emit1(bits);
+		}
+
+		if(pass == 1 && compiledOfs != lastOfs)
+			return qfalse;
+		lastOfs = compiledOfs;
+	}
+
+	return qtrue;
+}
+#endif
+
+/*
+=================
+VM_AllocCode
+Writable memory for compiled code, VM_ProtectCode makes it executable
+=================
+*/
+static byte *VM_AllocCode(int length)
+{
+	byte *code;
+
+#ifdef VM_X86_MMAP
+	code = (byte *)mmap(NULL, length, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(code == MAP_FAILED)
+		Com_Error(ERR_FATAL, "VM_CompileX86: can't mmap memory");
+#elif _WIN32
+	// allocate memory with EXECUTE permissions under windows.
+	code = (byte*)VirtualAlloc(NULL, length, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+	if(!code)
+		Com_Error(ERR_FATAL, "VM_CompileX86: VirtualAlloc failed");
+#else
+	code = (byte *)malloc(length);
+	if(!code)
+	        Com_Error(ERR_FATAL, "VM_CompileX86: malloc failed");
+#endif
+
+	return code;
+}
+
+/*
+=================
+VM_ProtectCode
+=================
+*/
+static void VM_ProtectCode(byte *code, int length)
+{
+#ifdef VM_X86_MMAP
+	if(mprotect(code, length, PROT_READ|PROT_EXEC))
+		Com_Error(ERR_FATAL, "VM_CompileX86: mprotect failed");
+#elif _WIN32
+	{
+		DWORD oldProtect = 0;
+
+		// remove write permissions.
+		if(!VirtualProtect(code, length, PAGE_EXECUTE_READ, &oldProtect))
+			Com_Error(ERR_FATAL, "VM_CompileX86: VirtualProtect failed");
+	}
+#endif
+}
+
+#if idx64
+/*
+=================================================================
+
+COMPILED CODE CACHE
+
+With vm_cache set the compiled code of a QVM is written to
+vmcache/<name>-<checksum>.vmc, and the next time the same QVM is loaded
+by the same engine build the code is mapped from there instead of being
+compiled again. x86_64 code only contains absolute addresses where
+EmitPtr wrote them, these are recorded and patched on load.
+
+The cache holds native code, so it is only ever read from fs_homepath
+or fs_basepath and never from a pk3.
+
+=================================================================
+*/
+
+#define VM_CACHE_MAGIC		"QVMC"
+#define VM_CACHE_VERSION	1
+
+typedef struct {
+	char		magic[4];
+	int			version;
+	char		build[64];
+	unsigned	codeChecksum;
+	unsigned	dataChecksum;		// jump targets are found in the data
+	int			instructionCount;
+	int			dataMask;
+	int			optimize;
+	int			entryOfs;
+	int			codeLength;
+	int			numRelocs;
+} vmCacheHeader_t;
+
+// followed by the code offset of every instruction, the code offset and
+// target of every relocation, and the code
+
+// generated code and cache files must come from the same binary
+static const char vmCacheBuild[] = JK2MV_VERSION " " __DATE__ " " __TIME__;
+
+// everything EmitPtr is used for
+static void *const vmRelocTargets[] = {
+	(void *)DoSyscall,
+	&vm_syscallNum,
+	&vm_programStack,
+	&vm_opStackOfs,
+	&vm_opStackBase,
+	&vm_arg,
+	(void *)Q_VMftol
+};
+
+/*
+=================
+VM_AddReloc
+=================
+*/
+static void VM_AddReloc(void *ptr)
+{
+	int i;
+
+	if(!relocs)
+		return;
+
+	for(i = 0; i < (int)ARRAY_LEN(vmRelocTargets); i++)
+	{
+		if(vmRelocTargets[i] == ptr)
+			break;
+	}
+
+	if(i == (int)ARRAY_LEN(vmRelocTargets) || numRelocs >= maxRelocs)
+	{
+		// the code can't be cached
+		Z_Free(relocs);
+		relocs = NULL;
+		return;
+	}
+
+	relocs[numRelocs * 2] = compiledOfs;
+	relocs[numRelocs * 2 + 1] = i;
+	numRelocs++;
+}
+
+/*
+=================
+VM_CacheName
+=================
+*/
+static void VM_CacheName(vm_t *vm, vmHeader_t *header, vmCacheHeader_t *cache, char *filename, int size)
+{
+	Com_Memset(cache, 0, sizeof(*cache));
+	Com_Memcpy(cache->magic, VM_CACHE_MAGIC, sizeof(cache->magic));
+	cache->version = VM_CACHE_VERSION;
+	Q_strncpyz(cache->build, vmCacheBuild, sizeof(cache->build));
+	cache->codeChecksum = Com_BlockChecksum((byte *)header + header->codeOffset, header->codeLength);
+	cache->dataChecksum = Com_BlockChecksum((byte *)header + header->dataOffset, header->dataLength + header->litLength);
+	cache->instructionCount = vm->instructionCount;
+	cache->dataMask = vm->dataMask;
+	cache->optimize = Cvar_VariableIntegerValue("vm_optimize") ? 1 : 0;
+
+	Com_sprintf(filename, size, "vmcache/%s-%08x.vmc", vm->name, cache->codeChecksum);
+}
+
+/*
+=================
+VM_LoadCachedCode
+Maps the cached code of the QVM, returns qfalse if it has to be compiled
+=================
+*/
+static qboolean VM_LoadCachedCode(vm_t *vm, vmHeader_t *header)
+{
+	char				filename[MAX_QPATH];
+	vmCacheHeader_t		expected;
+	vmCacheHeader_t		*cache;
+	fileHandle_t		f;
+	byte				*buffer;
+	const int			*offsets, *cacheRelocs;
+	const byte			*code;
+	intptr_t			v;
+	int64_t				size;
+	qboolean			damaged;
+	int					len;
+	int					i;
+
+	if(!Cvar_VariableIntegerValue("vm_cache"))
+		return qfalse;
+
+	VM_CacheName(vm, header, &expected, filename, sizeof(filename));
+
+	len = FS_SV_FOpenFileRead(filename, &f);
+	if(!f)
+		return qfalse;
+
+	buffer = (byte *)Z_Malloc(len + 1, TAG_VM, qfalse);
+	if(FS_Read(buffer, len, f) != len)
+		len = 0;
+	FS_FCloseFile(f);
+
+	cache = (vmCacheHeader_t *)buffer;
+	if(len < (int)sizeof(*cache) || memcmp(cache, &expected, offsetof(vmCacheHeader_t, entryOfs))
+		|| cache->codeLength <= 0 || cache->codeLength > len
+		|| cache->entryOfs < 0 || cache->entryOfs >= cache->codeLength
+		|| cache->numRelocs < 0 || cache->numRelocs > len)
+	{
+		Com_DPrintf("%s is out of date.\n", filename);
+		Z_Free(buffer);
+		return qfalse;
+	}
+
+	size = sizeof(*cache) + (int64_t)vm->instructionCount * sizeof(int)
+		+ (int64_t)cache->numRelocs * 2 * sizeof(int) + cache->codeLength;
+
+	offsets = (const int *)(cache + 1);
+	cacheRelocs = offsets + vm->instructionCount;
+	code = (const byte *)(cacheRelocs + cache->numRelocs * 2);
+
+	// nothing in there may point outside the code
+	damaged = (qboolean)(size != len);
+	for(i = 0; !damaged && i < vm->instructionCount; i++)
+	{
+		if(offsets[i] < cache->entryOfs || offsets[i] >= cache->codeLength)
+			damaged = qtrue;
+	}
+	for(i = 0; !damaged && i < cache->numRelocs; i++)
+	{
+		if(cacheRelocs[i * 2] < 0 || cacheRelocs[i * 2] > cache->codeLength - (int)sizeof(v)
+			|| cacheRelocs[i * 2 + 1] < 0 || cacheRelocs[i * 2 + 1] >= (int)ARRAY_LEN(vmRelocTargets))
+			damaged = qtrue;
+	}
+
+	if(damaged)
+	{
+		Com_Printf(S_COLOR_YELLOW "WARNING: %s is damaged, compiling %s.\n", filename, vm->name);
+		Z_Free(buffer);
+		return qfalse;
+	}
+
+	vm->codeLength = cache->codeLength;
+	vm->entryOfs = cache->entryOfs;
+	vm->codeBase = VM_AllocCode(vm->codeLength);
+
+	Com_Memcpy(vm->codeBase, code, vm->codeLength);
+	for(i = 0; i < cache->numRelocs; i++)
+	{
+		v = (intptr_t) vmRelocTargets[cacheRelocs[i * 2 + 1]];
+		Com_Memcpy(vm->codeBase + cacheRelocs[i * 2], &v, sizeof(v));
+	}
+
+	VM_ProtectCode(vm->codeBase, vm->codeLength);
+
+	for(i = 0; i < vm->instructionCount; i++)
+		vm->instructionPointers[i] = (intptr_t) vm->codeBase + offsets[i];
+
+	vm->destroy = VM_Destroy_Compiled;
+
+	Z_Free(buffer);
+	Com_Printf("VM file %s loaded from %s\n", vm->name, filename);
+
+	return qtrue;
+}
+
+/*
+=================
+VM_WriteCachedCode
+Called with the instruction pointers still relative to the code
+=================
+*/
+static void VM_WriteCachedCode(vm_t *vm, vmHeader_t *header)
+{
+	char				filename[MAX_QPATH];
+	vmCacheHeader_t		cache;
+	fileHandle_t		f;
+	int					*offsets;
+	int					i;
+
+	if(!relocs || !Cvar_VariableIntegerValue("vm_cache"))
+		return;
+
+	VM_CacheName(vm, header, &cache, filename, sizeof(filename));
+	cache.entryOfs = vm->entryOfs;
+	cache.codeLength = vm->codeLength;
+	cache.numRelocs = numRelocs;
+
+	f = FS_SV_FOpenFileWrite(filename);
+	if(!f)
+	{
+		Com_Printf(S_COLOR_YELLOW "WARNING: couldn't write %s\n", filename);
+		return;
+	}
+
+	offsets = (int *)Z_Malloc(vm->instructionCount * sizeof(*offsets), TAG_VM, qfalse);
+	for(i = 0; i < vm->instructionCount; i++)
+		offsets[i] = (int)vm->instructionPointers[i];
+
+	FS_Write(&cache, sizeof(cache), f);
+	FS_Write(offsets, vm->instructionCount * sizeof(*offsets), f);
+	FS_Write(relocs, numRelocs * 2 * sizeof(*relocs), f);
+	FS_Write(vm->codeBase, vm->codeLength, f);
+	FS_FCloseFile(f);
+
+	Z_Free(offsets);
+}
+#endif
+
+/*
+=================
+VM_Compile
+=================
+*/
+void VM_Compile(vm_t *vm, vmHeader_t *header)
+{
+	int		op;
+	int		maxLength;
+	int		v;
+	int		i;
+        int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+	qboolean	optimized;
+
+#if idx64
+	if(VM_LoadCachedCode(vm, header))
+		return;
+#endif
+
+	jusedSize = header->instructionCount + 2;
+
+	// allocate a very large temp buffer, we will shrink it later
+	maxLength = header->codeLength * 8 + 64;
+	buf = (byte *)Z_Malloc(maxLength, TAG_VM, qtrue);
+	jused = (byte *)Z_Malloc(jusedSize, TAG_VM, qtrue);
+	code = (byte *)Z_Malloc(header->codeLength + 32, TAG_VM, qtrue);
+
+	Com_Memset(jused, 0, jusedSize);
+	Com_Memset(buf, 0, maxLength);
+
+	numRelocs = 0;
+#if idx64
+	maxRelocs = maxLength / 10 + 1;
+	relocs = (int *)Z_Malloc(maxRelocs * 2 * sizeof(*relocs), TAG_VM, qfalse);
+#endif
+
+	// copy code in larger buffer and put some zeros at the end
+	// so we can safely look ahead for a few instructions in it
+	// without a chance to get false-positive because of some garbage bytes
+	Com_Memset(code, 0, header->codeLength+32);
+	Com_Memcpy(code, (byte *)header + header->codeOffset, header->codeLength );
+
+	// ensure that the optimisation pass knows about all the jump
+	// table targets
+	pc = -1; // a bogus value to be printed in out-of-bounds error messages
+	for( i = 0; i < vm->numJumpTableTargets; i++ ) {
+		JUSED( *(int *)(vm->jumpTableTargets + ( i * sizeof( int ) ) ) );
+	}
+
+	// Start buffer with x86-VM specific procedures
+	compiledOfs = 0;
+
+	callDoSyscallOfs = compiledOfs;
+	callProcOfs = EmitCallDoSyscall(vm);
+	callProcOfsSyscall = EmitCallProcedure(vm, callDoSyscallOfs);
+	vm->entryOfs = compiledOfs;
+	entryRelocs = numRelocs;
+
+	optimized = qfalse;
+#if idx64
+	if(Cvar_VariableIntegerValue("vm_optimize"))
+	{
+		optimized = VM_CompileOptimized(vm, header, maxLength, callDoSyscallOfs, callProcOfs, callProcOfsSyscall);
+		if(!optimized)
+			Com_DPrintf("VM file %s can't be optimized, using the legacy compiler\n", vm->name);
+	}
+#endif
+
+	for(pass=0; !optimized && pass < 3; pass++) {
+	oc0 = -23423;
+	oc1 = -234354;
+	pop0 = -43435;
+	pop1 = -545455;
+
+	// translate all instructions
+	pc = 0;
+	instruction = 0;
+	//code = (byte *)header + header->codeOffset;
+	compiledOfs = vm->entryOfs;
+	numRelocs = entryRelocs;
+
+	LastCommand = LAST_COMMAND_NONE;
+
+	while(instruction < header->instructionCount)
+	{
+		if(compiledOfs > maxLength - 16)
+		{
+	        	VMFREE_BUFFERS();
+			Com_Error(ERR_DROP, "VM_CompileX86: maxLength exceeded");
+		}
+
+		vm->instructionPointers[ instruction ] = compiledOfs;
+
+		if ( !vm->jumpTableTargets )
+			jlabel = 1;
+		else
+			jlabel = jused[ instruction ];
+
+		instruction++;
+
+		if(pc > header->codeLength)
+		{
+		        VMFREE_BUFFERS();
+			Com_Error(ERR_DROP, "VM_CompileX86: pc > header->codeLength");
+		}
+
+		op = code[ pc ];
+		pc++;
+		switch ( op ) {
+		case 0:
+			break;
+		case OP_BREAK:
+			EmitString("CC");				// int 3
+			break;
+		case OP_ENTER:
+			EmitString("81 EE");				// sub esi, 0x12345678
+			Emit4(Constant4());
+			break;
+		case OP_CONST:
+			if(ConstOptimize(vm, callProcOfsSyscall))
+				break;
+
+			EmitPushStack(vm);
+			EmitString("C7 04 9F");				// mov dword ptr [edi + ebx * 4], 0x12345678
+			lastConst = Constant4();
+
+			Emit4(lastConst);
+			if(code[pc] == OP_JUMP)
+				JUSED(lastConst);
+
+			break;
+		case OP_LOCAL:
+			EmitPushStack(vm);
+			EmitString("8D 86");				// lea eax, [0x12345678 + esi]
+			oc0 = oc1;
+			oc1 = Constant4();
+			Emit4(oc1);
+			EmitCommand(LAST_COMMAND_MOV_STACK_EAX);	// mov dword ptr [edi + ebx * 4], eax
+			break;
+		case OP_ARG:
+			EmitMovEAXStack(vm, 0);				// mov eax, dword ptr [edi + ebx * 4]
+			EmitString("8B D6");				// mov edx, esi
+			EmitString("81 C2");				// add edx, 0x12345678
+			Emit4((Constant1() & 0xFF));
+			MASK_REG("E2", vm->dataMask);			// and edx, 0x12345678
+#if idx64
+			EmitRexString(0x41, "89 04 11");		// mov dword ptr [r9 + edx], eax
+#else
+			EmitString("89 82");				// mov dword ptr [edx + 0x12345678], eax
+			Emit4((intptr_t) vm->dataBase);
+#endif
+			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
+			break;
+		case OP_CALL:
+			EmitCallRel(vm, callProcOfs);
+			break;
+		case OP_PUSH:
+			EmitPushStack(vm);
+			break;
+		case OP_POP:
+			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
+			break;
+		case OP_LEAVE:
+			v = Constant4();
+			EmitString("81 C6");				// add	esi, 0x12345678
+			Emit4(v);
+			EmitString("C3");				// ret
+			break;
+		case OP_LOAD4:
+			if (code[pc] == OP_CONST && code[pc+5] == OP_ADD && code[pc+6] == OP_STORE4)
+			{
+				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+				{
+					compiledOfs -= 12;
+					vm->instructionPointers[instruction - 1] = compiledOfs;
+				}
+
+				pc++;				// OP_CONST
+				v = Constant4();
+
+				EmitMovEDXStack(vm, vm->dataMask);
+				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+				{
+#if idx64
+					EmitRexString(0x41, "FF 04 11");	// inc dword ptr [r9 + edx]
+#else
+					EmitString("FF 82");			// inc dword ptr [edx + 0x12345678]
+					Emit4((intptr_t) vm->dataBase);
+#endif
+				}
+				else
+				{
+#if idx64
+					EmitRexString(0x41, "8B 04 11");	// mov eax, dword ptr [r9 + edx]
+#else
+					EmitString("8B 82");			// mov eax, dword ptr [edx + 0x12345678]
+					Emit4((intptr_t) vm->dataBase);
+#endif
+					EmitString("05");			// add eax, v
+					Emit4(v);
+
+					if (oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+					{
+#if idx64
+						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
+#else
+						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
+						Emit4((intptr_t) vm->dataBase);
+#endif
+					}
+					else
+					{
+						EmitCommand(LAST_COMMAND_SUB_BL_1);	// sub bl, 1
+						EmitString("8B 14 9F");			// mov edx, dword ptr [edi + ebx * 4]
+						MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
+#if idx64
+						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
+#else
+						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
+						Emit4((intptr_t) vm->dataBase);
+#endif
+					}
+				}
+
+				EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
+				pc++;						// OP_ADD
+				pc++;						// OP_STORE
+				instruction += 3;
+				break;
+			}
+
+			if(code[pc] == OP_CONST && code[pc+5] == OP_SUB && code[pc+6] == OP_STORE4)
 			{
 				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
 				{
@@ -1642,39 +3303,19 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 
 	// copy to an exact sized buffer with the appropriate permission bits
 	vm->codeLength = compiledOfs;
-#ifdef VM_X86_MMAP
-	vm->codeBase = (byte *)mmap(NULL, compiledOfs, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-	if(vm->codeBase == MAP_FAILED)
-		Com_Error(ERR_FATAL, "VM_CompileX86: can't mmap memory");
-#elif _WIN32
-	// allocate memory with EXECUTE permissions under windows.
-	vm->codeBase = (byte*)VirtualAlloc(NULL, compiledOfs, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-	if(!vm->codeBase)
-		Com_Error(ERR_FATAL, "VM_CompileX86: VirtualAlloc failed");
-#else
-	vm->codeBase = malloc(compiledOfs);
-	if(!vm->codeBase)
-	        Com_Error(ERR_FATAL, "VM_CompileX86: malloc failed");
-#endif
-
+	vm->codeBase = VM_AllocCode(compiledOfs);
 	Com_Memcpy( vm->codeBase, buf, compiledOfs );
+	VM_ProtectCode(vm->codeBase, compiledOfs);
 
-#ifdef VM_X86_MMAP
-	if(mprotect(vm->codeBase, compiledOfs, PROT_READ|PROT_EXEC))
-		Com_Error(ERR_FATAL, "VM_CompileX86: mprotect failed");
-#elif _WIN32
-	{
-		DWORD oldProtect = 0;
-
-		// remove write permissions.
-		if(!VirtualProtect(vm->codeBase, compiledOfs, PAGE_EXECUTE_READ, &oldProtect))
-			Com_Error(ERR_FATAL, "VM_CompileX86: VirtualProtect failed");
-	}
+#if idx64
+	VM_WriteCachedCode(vm, header);
 #endif
 
 	Z_Free( code );
 	Z_Free( buf );
 	Z_Free( jused );
+	Z_Free( relocs );
+	relocs = NULL;
 	Com_Printf( "VM file %s compiled to %i bytes of code\n", vm->name, compiledOfs );
 
 	vm->destroy = VM_Destroy_Compiled;
@@ -1704,13 +3345,17 @@ This function is called directly by the generated code
 ==============
 */
 
+// the optimizing compiler addresses entries up to OPT_MAX_DEPTH away from
+// bl, which may reach past either end of the opStack
+#define OPSTACK_GUARD	64
+
 #if defined(_MSC_VER) && defined(idx64)
 extern "C" uint8_t qvmcall64(int *programStack, int *opStack, intptr_t *instructionPointers, byte *dataBase);
 #endif
 
 int VM_CallCompiled(vm_t *vm, int *args)
 {
-	byte	stack[OPSTACK_SIZE + 15];
+	byte	stack[OPSTACK_SIZE + 2 * OPSTACK_GUARD + 15];
 	void	*entryPoint;
 	int		programStack, stackOnEntry;
 	byte	*image;
@@ -1739,7 +3384,7 @@ int VM_CallCompiled(vm_t *vm, int *args)
 
 	// off we go into generated code...
 	entryPoint = vm->codeBase + vm->entryOfs;
-	opStack = (int *)PADP(stack, 16);
+	opStack = (int *)PADP(stack + OPSTACK_GUARD, 16);
 	*opStack = 0xDEADBEEF;
 	opStackOfs = 0;
 
@@ -1780,7 +3425,7 @@ int VM_CallCompiled(vm_t *vm, int *args)
 		"pop %%r15\n"
 		: "+S" (programStack), "+D" (opStack), "+b" (opStackOfs)
 		: "g" (vm->instructionPointers), "g" (vm->dataBase), "g" (entryPoint)
-		: "cc", "memory", "%rax", "%rcx", "%rdx", "%r8", "%r9", "%r10", "%r11"
+		: "cc", "memory", "%rax", "%rcx", "%rdx", "%r8", "%r9", "%r10", "%r11", "%xmm0", "%xmm1"
 	);
 #else
 	__asm__ volatile(
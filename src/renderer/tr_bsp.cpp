@@ -2019,8 +2019,7 @@ static void RE_LoadWorldMap_Actual( const char *name ) {
 
 	if (gpvCachedMapDiskImage)
 	{
-		Z_Free( gpvCachedMapDiskImage );
-				gpvCachedMapDiskImage = NULL;
+		CM_FreeCachedMapDiskImage();
 	}
 	else
 	{
@@ -32,6 +32,16 @@ typedef struct svEntity_s {
 	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
 
+// entities visible through the PVS and area portals from a given
+// cluster / area pair, shared between all clients of a server frame
+#define	MAX_SNAPSHOT_VIS_CACHE	64
+
+typedef struct {
+	int				cluster;
+	int				area;
+	byte			visible[MAX_GENTITIES/8];
+} snapshotVisCache_t;
+
 typedef enum {
 	SS_DEAD,			// no map loaded
 	SS_LOADING,			// spawning level entities
@@ -46,6 +56,7 @@ typedef struct {
 	int				checksumFeed;		//
 	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
+	int				frameRemainder;		// 1000 % sv_fps carried into the next frame
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	struct cmodel_s	*models[MAX_MODELS];
 	char			*configstrings[MAX_CONFIGSTRINGS];
@@ -71,6 +82,10 @@ typedef struct {
 	int				  gentitySizeMV;
 
 	mvfix_t			fixes;
+
+	int				visCacheTime;		// svs.time the visibility cache was built for
+	int				numVisCache;		// cleared whenever an entity is linked or an areaportal changes
+	snapshotVisCache_t	visCache[MAX_SNAPSHOT_VIS_CACHE];
 } server_t;
 
 typedef struct {
@@ -84,6 +99,8 @@ typedef struct {
 	int				messageSent;		// time the message was transmitted
 	int				messageAcked;		// time the message was acked
 	int				messageSize;		// used to rate drop packets
+	int64_t			messageSentTime;	// Sys_Microseconds when transmitted
+	int64_t			messageAckedTime;	// arrival of the ack, 0 if unknown
 } clientSnapshot_t;
 
 typedef struct {
@@ -153,6 +170,12 @@ typedef struct client_s {
 	int				ping;
 	int				rate;				// bytes / second
 	int				snapshotMsec;		// requests a snapshot every snapshotMsec unless rate choked
+	int				rateControl;		// bytes / second measured by sv_rateControl, 0 until the first ack
+	int				rateMinRtt;			// lowest snapshot round trip seen lately, msec
+	int				rateMinRttTime;		// svs.time rateMinRtt was measured
+	int				rateSmoothRtt;		// smoothed snapshot round trip, msec
+	int				rateAdjustTime;		// svs.time rateControl was last adjusted
+	int				rateAckedBytes;		// bytes acked since rateAdjustTime
 	int				pureAuthentic;
 	netchan_t		netchan;
 
@@ -215,6 +238,7 @@ extern	server_t		sv;					// cleared each map
 extern	vm_t			*gvm;				// game virtual machine
 
 extern	cvar_t	*sv_fps;
+extern	cvar_t	*sv_frameExact;
 extern	cvar_t	*sv_timeout;
 extern	cvar_t	*sv_zombietime;
 extern	cvar_t	*sv_rconPassword;
@@ -229,11 +253,15 @@ extern	cvar_t	*sv_master[MAX_MASTER_SERVERS];
 extern	cvar_t	*sv_reconnectlimit;
 extern	cvar_t	*sv_showloss;
 extern	cvar_t	*sv_padPackets;
+extern	cvar_t	*sv_snapshotThreads;
+extern	cvar_t	*sv_autoDemo;
 extern	cvar_t	*sv_killserver;
 extern	cvar_t	*sv_mapname;
 extern	cvar_t	*sv_mapChecksum;
 extern	cvar_t	*sv_serverid;
 extern	cvar_t	*sv_maxRate;
+extern	cvar_t	*sv_rateControl;
+extern	cvar_t	*sv_syscallStats;
 extern	cvar_t	*sv_minPing;
 extern	cvar_t	*sv_maxPing;
 extern	cvar_t	*sv_gametype;
@@ -286,6 +314,8 @@ void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ...);
 void SV_AddOperatorCommands (void);
 void SV_RemoveOperatorCommands (void);
 
+void SV_FrameStats_f (void);
+
 
 void SV_MasterHeartbeat (void);
 void SV_MasterShutdown (void);
@@ -293,6 +323,7 @@ void SV_MasterShutdown (void);
 qboolean MVAPI_GetConnectionlessPacket(mvaddr_t *addr, char *buf, unsigned int bufsize);
 qboolean MVAPI_SendConnectionlessPacket(const mvaddr_t *addr, const char *message);
 qboolean MVAPI_DisableStructConversion(qboolean disable);
+qboolean MVAPI_TraceBatch(intptr_t requests, intptr_t results, int numTraces);
 extern qboolean mvStructConversionDisabled;
 
 //
@@ -336,15 +367,29 @@ void SV_WriteDownloadToClient( client_t *cl , msg_t *msg );
 //
 void SV_Heartbeat_f( void );
 
+//
+// sv_demo.c
+//
+void SV_DemoFrame( void );
+void SV_DemoConfigstringModified( int index );
+void SV_DemoServerCommand( const char *cmd );
+void SV_DemoAutoStart( void );
+void SV_DemoStop( void );
+void SV_Record_f( void );
+void SV_StopRecord_f( void );
+
 //
 // sv_snapshot.c
 //
 void SV_AddServerCommand( client_t *client, const char *cmd );
 void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg );
 void SV_WriteFrameToClient (client_t *client, msg_t *msg);
+int SV_ClientRate( client_t *client, qboolean download );
+void SV_RateControlAck( client_t *client, clientSnapshot_t *frame );
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_ShutdownSnapshotWorkers( void );
 
 //
 // sv_game.c
@@ -358,6 +403,7 @@ sharedEntity_t *SV_GEntityForSvEntity( svEntity_t *svEnt );
 void		SV_InitGameProgs ( void );
 void		SV_ShutdownGameProgs ( void );
 void		SV_RestartGameProgs( void );
+void		SV_SyscallStats_f( void );
 qboolean	SV_inPVS (const vec3_t p1, const vec3_t p2);
 
 qboolean SV_MVAPI_ControlFixes(mvfix_t fixes);
@@ -431,6 +431,8 @@ SV_BotFrame
 ==================
 */
 void SV_BotFrame( int time ) {
+	PROF_SCOPE( "SV_BotFrame" );
+
 	if (!bot_enable) return;
 	//NOTE: maybe the game is already shutdown
 	if (!gvm) return;
@@ -861,6 +861,10 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("framestats", SV_FrameStats_f);
+	Cmd_AddCommand ("syscallstats", SV_SyscallStats_f);
+	Cmd_AddCommand ("svrecord", SV_Record_f);
+	Cmd_AddCommand ("svstoprecord", SV_StopRecord_f);
 	Cmd_AddCommand ("map", SV_Map_f);
 	Cmd_SetCommandCompletionFunc( "map", SV_CompleteMapName );
 #ifndef PRE_RELEASE_DEMO
@@ -901,6 +905,10 @@ void SV_RemoveOperatorCommands( void ) {
 	Cmd_RemoveCommand ("dumpuser");
 	Cmd_RemoveCommand ("map_restart");
 	Cmd_RemoveCommand ("sectorlist");
+	Cmd_RemoveCommand ("framestats");
+	Cmd_RemoveCommand ("syscallstats");
+	Cmd_RemoveCommand ("svrecord");
+	Cmd_RemoveCommand ("svstoprecord");
 	Cmd_RemoveCommand ("svsay");
 #endif
 }
@@ -883,15 +883,7 @@ void SV_WriteDownloadToClient( client_t *cl , msg_t *msg )
 
 	// based on the rate, how many bytes can we fit in the snapMsec time of the client
 	// normal rate / snapshotMsec calculation
-	rate = cl->rate;
-	if ( sv_maxRate->integer ) {
-		if ( sv_maxRate->integer < 1000 ) {
-			Cvar_Set( "sv_MaxRate", "1000" );
-		}
-		if ( sv_maxRate->integer < rate ) {
-			rate = sv_maxRate->integer;
-		}
-	}
+	rate = SV_ClientRate( cl, qtrue );
 
 	if (!rate) {
 		blockspersnap = 1;
@@ -1556,6 +1548,7 @@ static void SV_UserMove( client_t *cl, msg_t *msg, qboolean delta ) {
 
 	// save time for ping calculation
 	cl->frames[ cl->messageAcknowledge & PACKET_MASK ].messageAcked = svs.time;
+	cl->frames[ cl->messageAcknowledge & PACKET_MASK ].messageAckedTime = NET_PacketTime();
 
 	// if this is the first usercmd we have received
 	// this gamestate, put the client into the world
@@ -1616,6 +1609,7 @@ Parse a client packet
 void SV_ExecuteClientMessage( client_t *cl, msg_t *msg ) {
 	int			c;
 	int			serverId;
+	clientSnapshot_t	*frame;
 
 	MSG_Bitstream(msg);
 
@@ -1629,6 +1623,16 @@ void SV_ExecuteClientMessage( client_t *cl, msg_t *msg ) {
 		return;
 	}
 
+	// the first ack of a message feeds the rate control, this can't wait
+	// for SV_UserMove as downloading clients don't send usercmds
+	frame = &cl->frames[ cl->messageAcknowledge & PACKET_MASK ];
+	if ( cl->netchan.outgoingSequence - cl->messageAcknowledge > 0 &&
+		cl->netchan.outgoingSequence - cl->messageAcknowledge <= PACKET_BACKUP &&
+		frame->messageAcked == -1 ) {
+		SV_RateControlAck( cl, frame );
+		frame->messageAcked = svs.time;
+	}
+
 	cl->reliableAcknowledge = MSG_ReadLong( msg );
 
 	// NOTE: when the client message is fux0red the acknowledgement numbers
@@ -0,0 +1,538 @@
+// sv_demo.c -- server side demo recording
+
+#include "server.h"
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+/*
+=============================================================================
+
+A server demo holds the complete world once per server frame instead of
+what a single client could see, so any player's view can be reconstructed
+from it.
+
+The file starts with the magic "SVDM", the format version and the
+protocol, followed by messages of
+
+4	length
+<length bytes of a huffman compressed bitstream>
+
+The first message carries the time, sv_maxclients and all configstrings.
+Every following message is one server frame:
+
+4	svs.time
+1	flags (SVDEMO_KEYFRAME: nothing is delta compressed against the
+	previous frame and all configstrings are repeated)
+<svc_configstring, svc_serverCommand ops>
+1	svc_snapshot
+	for every active client:
+	1	clientNum
+	<playerState delta against the previous frame>
+1	MAX_CLIENTS
+<packet entities against the previous frame, terminated by MAX_GENTITIES-1>
+1	svc_EOF
+
+Frames are encoded on the main thread right after the game has run and
+handed to a writer thread, so the frame loop never waits on the disk. The
+filesystem isn't thread safe, the writer only ever fwrites to the FILE
+of the demo and leaves reporting errors to the main thread.
+
+=============================================================================
+*/
+
+#define SVDEMO_VERSION			1
+#define SVDEMO_KEYFRAME			1
+#define SVDEMO_KEYFRAME_MSEC	10000				// self contained frame for seeking
+#define SVDEMO_MAX_FRAME		(256 * 1024)
+#define SVDEMO_BUFFER_SIZE		(8 * 1024 * 1024)	// frames queued for the writer thread
+#define SVDEMO_MAX_COMMANDS		(64 * 1024)
+
+static struct {
+	qboolean		recording;
+	char			name[MAX_OSPATH];
+	fileHandle_t	file;
+
+	int				lastKeyframe;
+	qboolean		forceKeyframe;
+
+	entityState_t	*ents;							// as of the last written frame
+	byte			entValid[MAX_GENTITIES/8];
+	playerState_t	*players;
+	qboolean		playerValid[MAX_CLIENTS];
+	qboolean		csModified[MAX_CONFIGSTRINGS];
+
+	char			commands[SVDEMO_MAX_COMMANDS];	// broadcast commands of this frame
+	int				commandsLen;
+} svDemo;
+
+static struct {
+	std::thread				thread;
+	std::mutex				mutex;
+	std::condition_variable	cv;
+
+	byte					*buffer;
+	size_t					head, tail;				// not wrapped
+	bool					quit;
+	std::atomic_bool		failed;
+} demoWriter;
+
+// room for the length in front of the message
+static byte demoFrameBuf[4 + SVDEMO_MAX_FRAME];
+
+/*
+==================
+SV_DemoWriterThread
+==================
+*/
+static void SV_DemoWriterThread( FILE *file ) {
+	std::unique_lock<std::mutex> lk( demoWriter.mutex );
+
+	for (;;) {
+		size_t start, len;
+
+		demoWriter.cv.wait( lk, [] { return demoWriter.quit || demoWriter.head != demoWriter.tail; } );
+
+		if ( demoWriter.head == demoWriter.tail ) {
+			return;	// quit and flushed
+		}
+
+		start = demoWriter.tail % SVDEMO_BUFFER_SIZE;
+		len = demoWriter.head - demoWriter.tail;
+		if ( start + len > SVDEMO_BUFFER_SIZE ) {
+			len = SVDEMO_BUFFER_SIZE - start;
+		}
+
+		// the main thread only appends behind head, so the range is ours
+		lk.unlock();
+		if ( !demoWriter.failed && fwrite( demoWriter.buffer + start, 1, len, file ) != len ) {
+			demoWriter.failed = true;
+		}
+		lk.lock();
+
+		demoWriter.tail += len;
+	}
+}
+
+/*
+==================
+SV_DemoQueue
+
+Hands data to the writer thread. Returns qfalse if it can't keep up.
+==================
+*/
+static qboolean SV_DemoQueue( const void *data, size_t len ) {
+	const byte	*src = (const byte *)data;
+	size_t		start, first;
+
+	{
+		std::lock_guard<std::mutex> lk( demoWriter.mutex );
+
+		if ( demoWriter.head - demoWriter.tail + len > SVDEMO_BUFFER_SIZE ) {
+			return qfalse;
+		}
+	}
+
+	// only this thread moves head, the writer never touches the free space
+	start = demoWriter.head % SVDEMO_BUFFER_SIZE;
+	first = SVDEMO_BUFFER_SIZE - start;
+	if ( first > len ) {
+		first = len;
+	}
+	memcpy( demoWriter.buffer + start, src, first );
+	memcpy( demoWriter.buffer, src + first, len - first );
+
+	{
+		std::lock_guard<std::mutex> lk( demoWriter.mutex );
+		demoWriter.head += len;
+	}
+	demoWriter.cv.notify_one();
+
+	return qtrue;
+}
+
+/*
+==================
+SV_DemoBeginMessage
+==================
+*/
+static void SV_DemoBeginMessage( msg_t *msg ) {
+	MSG_Init( msg, demoFrameBuf + 4, SVDEMO_MAX_FRAME );
+	MSG_Bitstream( msg );
+}
+
+/*
+==================
+SV_DemoQueueMessage
+==================
+*/
+static qboolean SV_DemoQueueMessage( msg_t *msg ) {
+	int		len;
+
+	len = LittleLong( msg->cursize );
+	memcpy( demoFrameBuf, &len, 4 );
+
+	return SV_DemoQueue( demoFrameBuf, 4 + msg->cursize );
+}
+
+/*
+==================
+SV_DemoWriteConfigstrings
+==================
+*/
+static void SV_DemoWriteConfigstrings( msg_t *msg, qboolean all ) {
+	int		i;
+
+	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
+		if ( all ? !sv.configstrings[i][0] : !svDemo.csModified[i] ) {
+			continue;
+		}
+		MSG_WriteByte( msg, svc_configstring );
+		MSG_WriteShort( msg, i );
+		MSG_WriteBigString( msg, sv.configstrings[i] );
+	}
+
+	memset( svDemo.csModified, 0, sizeof( svDemo.csModified ) );
+}
+
+/*
+==================
+SV_DemoWritePlayers
+==================
+*/
+static void SV_DemoWritePlayers( msg_t *msg, qboolean keyframe ) {
+	client_t		*cl;
+	playerState_t	*ps;
+	int				i;
+
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->state != CS_ACTIVE ) {
+			svDemo.playerValid[i] = qfalse;
+			continue;
+		}
+
+		ps = SV_GameClientNum( i );
+
+		MSG_WriteByte( msg, i );
+		MSG_WriteDeltaPlayerstate( msg, ( !keyframe && svDemo.playerValid[i] ) ? &svDemo.players[i] : NULL, ps );
+
+		svDemo.players[i] = *ps;
+		svDemo.playerValid[i] = qtrue;
+	}
+
+	MSG_WriteByte( msg, MAX_CLIENTS );
+}
+
+/*
+==================
+SV_DemoWriteEntities
+
+Everything a client could possibly be sent, in packet entities format
+==================
+*/
+static void SV_DemoWriteEntities( msg_t *msg, qboolean keyframe ) {
+	sharedEntity_t	*ent;
+	entityState_t	nullstate, state;
+	qboolean		valid;
+	int				e;
+
+	for ( e = 0 ; e < MAX_GENTITIES - 1 ; e++ ) {
+		valid = (qboolean)( ( svDemo.entValid[e >> 3] & ( 1 << ( e & 7 ) ) ) && !keyframe );
+
+		if ( e < sv.num_entities ) {
+			ent = SV_GentityNum( e );
+			if ( !ent->r.linked || ( ent->r.svFlags & SVF_NOCLIENT ) ) {
+				ent = NULL;
+			}
+		} else {
+			ent = NULL;
+		}
+
+		if ( !ent ) {
+			if ( valid ) {
+				// removed since the last frame
+				MSG_WriteDeltaEntity( msg, &svDemo.ents[e], NULL, qtrue );
+			}
+			svDemo.entValid[e >> 3] &= ~( 1 << ( e & 7 ) );
+			continue;
+		}
+
+		state = ent->s;
+		state.number = e;
+
+		if ( valid ) {
+			MSG_WriteDeltaEntity( msg, &svDemo.ents[e], &state, qfalse );
+		} else {
+			Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+			nullstate.number = e;
+			MSG_WriteDeltaEntity( msg, &nullstate, &state, qtrue );
+		}
+
+		svDemo.ents[e] = state;
+		svDemo.entValid[e >> 3] |= 1 << ( e & 7 );
+	}
+
+	MSG_WriteBits( msg, ( MAX_GENTITIES - 1 ), GENTITYNUM_BITS );
+}
+
+/*
+==================
+SV_DemoFrame
+
+Called once per server frame after the game has run
+==================
+*/
+void SV_DemoFrame( void ) {
+	msg_t		msg;
+	qboolean	keyframe;
+	int			i;
+
+	if ( !svDemo.recording ) {
+		return;
+	}
+
+	// SV_DemoStop reports it
+	if ( demoWriter.failed ) {
+		SV_DemoStop();
+		return;
+	}
+
+	keyframe = (qboolean)( svDemo.forceKeyframe || svs.time - svDemo.lastKeyframe >= SVDEMO_KEYFRAME_MSEC ||
+		svs.time < svDemo.lastKeyframe );
+
+	SV_DemoBeginMessage( &msg );
+
+	MSG_WriteLong( &msg, svs.time );
+	MSG_WriteByte( &msg, keyframe ? SVDEMO_KEYFRAME : 0 );
+
+	SV_DemoWriteConfigstrings( &msg, keyframe );
+
+	for ( i = 0 ; i < svDemo.commandsLen ; i += strlen( svDemo.commands + i ) + 1 ) {
+		MSG_WriteByte( &msg, svc_serverCommand );
+		MSG_WriteString( &msg, svDemo.commands + i );
+	}
+	svDemo.commandsLen = 0;
+
+	MSG_WriteByte( &msg, svc_snapshot );
+	SV_DemoWritePlayers( &msg, keyframe );
+	SV_DemoWriteEntities( &msg, keyframe );
+
+	MSG_WriteByte( &msg, svc_EOF );
+
+	if ( msg.overflowed ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: server demo frame overflowed, dropped\n" );
+		svDemo.forceKeyframe = qtrue;
+		return;
+	}
+
+	if ( !SV_DemoQueueMessage( &msg ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: server demo writer can't keep up, dropped a frame\n" );
+		svDemo.forceKeyframe = qtrue;
+		return;
+	}
+
+	if ( keyframe ) {
+		svDemo.lastKeyframe = svs.time;
+		svDemo.forceKeyframe = qfalse;
+	}
+}
+
+/*
+==================
+SV_DemoConfigstringModified
+==================
+*/
+void SV_DemoConfigstringModified( int index ) {
+	if ( svDemo.recording ) {
+		svDemo.csModified[index] = qtrue;
+	}
+}
+
+/*
+==================
+SV_DemoServerCommand
+
+Records a command broadcast to all clients
+==================
+*/
+void SV_DemoServerCommand( const char *cmd ) {
+	int		len;
+
+	if ( !svDemo.recording ) {
+		return;
+	}
+
+	len = (int)strlen( cmd ) + 1;
+	if ( svDemo.commandsLen + len > SVDEMO_MAX_COMMANDS ) {
+		return;
+	}
+
+	memcpy( svDemo.commands + svDemo.commandsLen, cmd, len );
+	svDemo.commandsLen += len;
+}
+
+/*
+==================
+SV_DemoStart
+==================
+*/
+static void SV_DemoStart( const char *name ) {
+	msg_t	msg;
+	int		header[3];
+
+	svDemo.file = FS_FOpenFileWrite( name );
+	if ( !svDemo.file ) {
+		Com_Printf( "ERROR: couldn't open %s.\n", name );
+		return;
+	}
+
+	Com_Printf( "recording server demo to %s.\n", name );
+	Q_strncpyz( svDemo.name, name, sizeof( svDemo.name ) );
+
+	svDemo.ents = new entityState_t[MAX_GENTITIES];
+	svDemo.players = new playerState_t[MAX_CLIENTS];
+	memset( svDemo.entValid, 0, sizeof( svDemo.entValid ) );
+	memset( svDemo.playerValid, 0, sizeof( svDemo.playerValid ) );
+	memset( svDemo.csModified, 0, sizeof( svDemo.csModified ) );
+	svDemo.commandsLen = 0;
+	svDemo.forceKeyframe = qtrue;
+	svDemo.lastKeyframe = svs.time;
+
+	demoWriter.buffer = new byte[SVDEMO_BUFFER_SIZE];
+	demoWriter.head = demoWriter.tail = 0;
+	demoWriter.quit = false;
+	demoWriter.failed = false;
+
+	header[0] = LittleLong( ('S') | ('V' << 8) | ('D' << 16) | ('M' << 24) );
+	header[1] = LittleLong( SVDEMO_VERSION );
+	header[2] = LittleLong( MV_GetCurrentProtocol() );
+	SV_DemoQueue( header, sizeof( header ) );
+
+	// world header
+	SV_DemoBeginMessage( &msg );
+	MSG_WriteLong( &msg, svs.time );
+	MSG_WriteLong( &msg, sv_maxclients->integer );
+	SV_DemoWriteConfigstrings( &msg, qtrue );
+	MSG_WriteByte( &msg, svc_EOF );
+	SV_DemoQueueMessage( &msg );
+
+	demoWriter.thread = std::thread( SV_DemoWriterThread, FS_FileForHandle( svDemo.file ) );
+	svDemo.recording = qtrue;
+}
+
+/*
+==================
+SV_DemoStop
+==================
+*/
+void SV_DemoStop( void ) {
+	if ( !svDemo.recording ) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lk( demoWriter.mutex );
+		demoWriter.quit = true;
+	}
+	demoWriter.cv.notify_one();
+	demoWriter.thread.join();
+
+	if ( demoWriter.failed ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write server demo %s\n", svDemo.name );
+	}
+
+	FS_FCloseFile( svDemo.file );
+	svDemo.file = 0;
+	svDemo.recording = qfalse;
+
+	delete[] demoWriter.buffer;
+	demoWriter.buffer = NULL;
+	delete[] svDemo.ents;
+	svDemo.ents = NULL;
+	delete[] svDemo.players;
+	svDemo.players = NULL;
+
+	Com_Printf( "stopped server demo %s.\n", svDemo.name );
+}
+
+/*
+==================
+SV_DemoFilename
+==================
+*/
+static void SV_DemoFilename( const char *demoName, char *name, int size ) {
+	qtime_t	now;
+
+	if ( demoName ) {
+		Com_sprintf( name, size, "demos/server/%s.svdm_%d", demoName, MV_GetCurrentProtocol() );
+		return;
+	}
+
+	Com_RealTime( &now );
+	Com_sprintf( name, size, "demos/server/%04d-%02d-%02d_%02d-%02d-%02d_%s.svdm_%d",
+		1900 + now.tm_year, 1 + now.tm_mon, now.tm_mday, now.tm_hour, now.tm_min, now.tm_sec,
+		sv_mapname->string, MV_GetCurrentProtocol() );
+}
+
+/*
+==================
+SV_DemoAutoStart
+
+Called when a level has been spawned
+==================
+*/
+void SV_DemoAutoStart( void ) {
+	char	name[MAX_OSPATH];
+
+	if ( !sv_autoDemo->integer || svDemo.recording ) {
+		return;
+	}
+
+	SV_DemoFilename( NULL, name, sizeof( name ) );
+	SV_DemoStart( name );
+}
+
+/*
+==================
+SV_Record_f
+
+svrecord [demoname]
+==================
+*/
+void SV_Record_f( void ) {
+	char	name[MAX_OSPATH];
+
+	if ( Cmd_Argc() > 2 ) {
+		Com_Printf( "svrecord [demoname]\n" );
+		return;
+	}
+
+	if ( !com_sv_running->integer || sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( svDemo.recording ) {
+		Com_Printf( "Already recording %s.\n", svDemo.name );
+		return;
+	}
+
+	SV_DemoFilename( Cmd_Argc() == 2 ? Cmd_Argv( 1 ) : NULL, name, sizeof( name ) );
+	SV_DemoStart( name );
+}
+
+/*
+==================
+SV_StopRecord_f
+==================
+*/
+void SV_StopRecord_f( void ) {
+	if ( !svDemo.recording ) {
+		Com_Printf( "Not recording a server demo.\n" );
+		return;
+	}
+
+	SV_DemoStop();
+}
@@ -217,6 +217,7 @@ void SV_AdjustAreaPortalState( sharedEntity_t *ent, qboolean open ) {
 		return;
 	}
 	CM_AdjustAreaPortalState( svEnt->areanum, svEnt->areanum2, open );
+	sv.numVisCache = 0;
 }
 
 
@@ -287,802 +288,1571 @@ qboolean MVAPI_LocateGameData(mvsharedEntity_t *mvEnts, int numGEntities, int si
 	return qfalse;
 }
 
+/*
+===============
+MVAPI_TraceBatch
+
+Runs a whole array of traces with a single system call. Takes the raw
+vm pointers so the arrays can be range checked as a whole.
+===============
+*/
+qboolean MVAPI_TraceBatch(intptr_t requests, intptr_t results, int numTraces) {
+	const mvtraceRequest_t	*req;
+	trace_t					*tr;
+	int						i;
+
+	if (VM_MVAPILevel(gvm) < 3) {
+		return qtrue;
+	}
+
+	if (numTraces <= 0) {
+		return qfalse;
+	}
+
+	req = (const mvtraceRequest_t *)VM_ArgBlock(requests, numTraces, sizeof(*req));
+	tr = (trace_t *)VM_ArgBlock(results, numTraces, sizeof(*tr));
+	if (!req || !tr) {
+		return qtrue;
+	}
+
+	for (i = 0; i < numTraces; i++, req++, tr++) {
+		SV_Trace(tr, req->start, req->mins, req->maxs, req->end, req->passEntityNum,
+			req->contentMask, req->capsule, req->traceFlags, req->useLod);
+	}
+
+	return qfalse;
+}
+
+/*
+===============
+SV_GetUsercmd
+
+===============
+*/
+void SV_GetUsercmd( int clientNum, usercmd_t *cmd ) {
+	if ( clientNum < 0 || clientNum >= sv_maxclients->integer ) {
+		Com_Error( ERR_DROP, "SV_GetUsercmd: bad clientNum:%i", clientNum );
+	}
+	*cmd = svs.clients[clientNum].lastUsercmd;
+
+	if ( cmd->forcesel == FP_LEVITATION && mv_blockchargejump->integer && !(sv.fixes & MVFIX_CHARGEJUMP)) cmd->forcesel = FP_PUSH; // Prevent modified clients from using the "ChargeJump" (higher jumping, double-kicks, ...), but let the server toggle this (in case they are using a mod where it is a feature).
+	if ( mv_blockspeedhack->integer && !(sv.fixes & MVFIX_SPEEDHACK)) cmd->angles[ROLL] = 0; // Prevent modified clients from gaining more speed than others...
+}
+
+//==============================================
+
+/*
+==============================================================
+
+GAME SYSTEM CALLS
+
+Every trap of the game module is a function of its own. SV_GameSystemCalls
+looks them up in a table indexed by the trap number, and with
+sv_syscallStats set it counts the calls and the time spent in each.
+
+==============================================================
+*/
+
+//rcg010207 - see my comments in VM_DllSyscall(), in qcommon/vm.c ...
+#if ((defined __linux__) && (defined __powerpc__))
+#define VMA(x) ((void *) args[x])
+#else
+#define	VMA(x) VM_ArgPtr(args[x])
+#endif
+
+extern bool RicksCrazyOnServer;
+
+typedef intptr_t (*gameTrap_t)( intptr_t *args );
+
+#define GAME_TRAP( num )		static intptr_t SV_Trap_##num( intptr_t *args )
+
+GAME_TRAP( G_PRINT ) {
+	Com_Printf( "%s", VMA(1) );
+	return 0;
+}
+
+GAME_TRAP( G_ERROR ) {
+	Com_Error( ERR_DROP, "%s", VMA(1) );
+	return 0;
+}
+
+GAME_TRAP( G_MILLISECONDS ) {
+	return Sys_Milliseconds();
+}
+
+GAME_TRAP( G_CVAR_REGISTER ) {
+	Cvar_Register( (vmCvar_t *)VMA(1), (const char *)VMA(2), (const char *)VMA(3), args[4] );
+	return 0;
+}
+
+GAME_TRAP( G_CVAR_UPDATE ) {
+	Cvar_Update( (vmCvar_t *)VMA(1) );
+	return 0;
+}
+
+GAME_TRAP( G_CVAR_SET ) {
+	Cvar_Set2( (const char *)VMA(1), (const char *)VMA(2), qtrue, qtrue );
+	return 0;
+}
+
+GAME_TRAP( G_CVAR_VARIABLE_INTEGER_VALUE ) {
+	return Cvar_VariableIntegerValue( (const char *)VMA(1), qtrue );
+}
+
+GAME_TRAP( G_CVAR_VARIABLE_STRING_BUFFER ) {
+	Cvar_VariableStringBuffer( (const char *)VMA(1), (char *)VMA(2), args[3], qtrue );
+	return 0;
+}
+
+GAME_TRAP( G_ARGC ) {
+	return Cmd_Argc();
+}
+
+GAME_TRAP( G_ARGV ) {
+	Cmd_ArgvBuffer( args[1], (char *)VMA(2), args[3] );
+	return 0;
+}
+
+GAME_TRAP( G_SEND_CONSOLE_COMMAND ) {
+	Cbuf_ExecuteText( args[1], (const char *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( G_FS_FOPEN_FILE ) {
+	return FS_FOpenFileByMode( (const char *)VMA(1), (int *)VMA(2), (fsMode_t)args[3] );
+}
+
+GAME_TRAP( G_FS_READ ) {
+	FS_Read2( VMA(1), args[2], args[3] );
+	return 0;
+}
+
+GAME_TRAP( G_FS_WRITE ) {
+	FS_Write( VMA(1), args[2], args[3] );
+	return 0;
+}
+
+GAME_TRAP( G_FS_FCLOSE_FILE ) {
+	FS_FCloseFile( args[1] );
+	return 0;
+}
+
+GAME_TRAP( G_FS_GETFILELIST ) {
+	return FS_GetFileList( (const char *)VMA(1), (const char *)VMA(2), (char *)VMA(3), args[4] );
+}
+
+GAME_TRAP( G_LOCATE_GAME_DATA ) {
+	SV_LocateGameData( (sharedEntity_t *)VMA(1), args[2], args[3], (struct playerState_s *)VMA(4), args[5] );
+	return 0;
+}
+
+GAME_TRAP( MVAPI_LOCATE_GAME_DATA ) {
+	return MVAPI_LocateGameData((mvsharedEntity_t *)VMA(1), args[2], args[3]);
+}
+
+GAME_TRAP( G_DROP_CLIENT ) {
+	SV_GameDropClient( args[1], (const char *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( G_SEND_SERVER_COMMAND ) {
+	SV_GameSendServerCommand( args[1], (const char *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( G_LINKENTITY ) {
+	SV_LinkEntity( (sharedEntity_t *)VMA(1) );
+	return 0;
+}
+
+GAME_TRAP( G_UNLINKENTITY ) {
+	SV_UnlinkEntity( (sharedEntity_t *)VMA(1) );
+	return 0;
+}
+
+GAME_TRAP( G_ENTITIES_IN_BOX ) {
+	return SV_AreaEntities( (const float *)VMA(1), (const float *)VMA(2), (int *)VMA(3), args[4] );
+}
+
+GAME_TRAP( G_ENTITY_CONTACT ) {
+	return SV_EntityContact( (const float *)VMA(1), (const float *)VMA(2), (const sharedEntity_t *)VMA(3), /*int capsule*/ qfalse );
+}
+
+GAME_TRAP( G_ENTITY_CONTACTCAPSULE ) {
+	return SV_EntityContact( (const float *)VMA(1), (const float *)VMA(2), (const sharedEntity_t *)VMA(3), /*int capsule*/ qtrue );
+}
+
+GAME_TRAP( G_TRACE ) {
+	SV_Trace( (trace_t *)VMA(1), (const float *)VMA(2), (const float *)VMA(3), (const float *)VMA(4), (const float *)VMA(5), args[6], args[7], /*int capsule*/ qfalse, args[8], args[9] );
+	return 0;
+}
+
+GAME_TRAP( G_TRACECAPSULE ) {
+	SV_Trace( (trace_t *)VMA(1), (const float *)VMA(2), (const float *)VMA(3), (const float *)VMA(4), (const float *)VMA(5), args[6], args[7], /*int capsule*/ qtrue, args[8], args[9]  );
+	return 0;
+}
+
+GAME_TRAP( G_POINT_CONTENTS ) {
+	return SV_PointContents( (const float *)VMA(1), args[2] );
+}
+
+GAME_TRAP( G_SET_BRUSH_MODEL ) {
+	SV_SetBrushModel( (sharedEntity_t *)VMA(1), (const char *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( G_IN_PVS ) {
+	return SV_inPVS( (const float *)VMA(1), (const float *)VMA(2) );
+}
+
+GAME_TRAP( G_IN_PVS_IGNORE_PORTALS ) {
+	return SV_inPVSIgnorePortals( (const float *)VMA(1), (const float *)VMA(2) );
+}
+
+GAME_TRAP( G_SET_CONFIGSTRING ) {
+	SV_SetConfigstring( args[1], (const char *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( G_GET_CONFIGSTRING ) {
+	SV_GetConfigstring( args[1], (char *)VMA(2), args[3] );
+	return 0;
+}
+
+GAME_TRAP( G_SET_USERINFO ) {
+	SV_SetUserinfo( args[1], (const char *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( G_GET_USERINFO ) {
+	SV_GetUserinfo( args[1], (char *)VMA(2), args[3] );
+	return 0;
+}
+
+GAME_TRAP( G_GET_SERVERINFO ) {
+	SV_GetServerinfo( (char *)VMA(1), args[2] );
+	return 0;
+}
+
+GAME_TRAP( G_ADJUST_AREA_PORTAL_STATE ) {
+	SV_AdjustAreaPortalState( (sharedEntity_t *)VMA(1), (qboolean)args[2] );
+	return 0;
+}
+
+GAME_TRAP( G_AREAS_CONNECTED ) {
+	return CM_AreasConnected( args[1], args[2] );
+}
+
+GAME_TRAP( G_BOT_ALLOCATE_CLIENT ) {
+	return SV_BotAllocateClient();
+}
+
+GAME_TRAP( G_BOT_FREE_CLIENT ) {
+	SV_BotFreeClient( args[1] );
+	return 0;
+}
+
+GAME_TRAP( G_GET_USERCMD ) {
+	SV_GetUsercmd( args[1], (struct usercmd_s *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( G_GET_ENTITY_TOKEN ) {
+	const char	*s;
+
+	s = COM_Parse( (const char **) &sv.entityParsePoint );
+	Q_strncpyz( (char *)VMA(1), s, args[2] );
+	if ( !sv.entityParsePoint && !s[0] ) {
+		return qfalse;
+	} else {
+		return qtrue;
+	}
+}
+
+GAME_TRAP( G_DEBUG_POLYGON_CREATE ) {
+	return BotImport_DebugPolygonCreate( args[1], args[2], (float (*)[3])VMA(3) );
+}
+
+GAME_TRAP( G_DEBUG_POLYGON_DELETE ) {
+	BotImport_DebugPolygonDelete( args[1] );
+	return 0;
+}
+
+GAME_TRAP( G_REAL_TIME ) {
+	return Com_RealTime( (struct qtime_s *)VMA(1) );
+}
+
+GAME_TRAP( G_SNAPVECTOR ) {
+	Sys_SnapVector(*(vec3_t *)VMA(1));
+	return 0;
+}
+
+GAME_TRAP( SP_REGISTER_SERVER_CMD ) {
+	return SP_RegisterServer( (const char *)VMA(1) );
+}
+
+GAME_TRAP( SP_GETSTRINGTEXTSTRING ) {
+	//return (int)SP_GetStringTextString((char *)VMA(1));
+	const char* text;
+
+	assert(VMA(1));
+	assert(VMA(2));
+
+//		if (args[0] == CG_SP_GETSTRINGTEXT)
+//		{
+//			text = SP_GetStringText( args[1] );
+//		}
+//		else
+	{
+		text = SP_GetStringTextString( (const char *) VMA(1) );
+	}
+
+	if ( text[0] )
+	{
+		Q_strncpyz( (char *) VMA(2), text, args[3] );
+		return qtrue;
+	}
+	else
+	{
+		Q_strncpyz( (char *) VMA(2), "??", args[3] );
+		return qfalse;
+	}
+}
+
+GAME_TRAP( G_ROFF_CLEAN ) {
+	return theROFFSystem.Clean(qfalse);
+}
+
+GAME_TRAP( G_ROFF_UPDATE_ENTITIES ) {
+	theROFFSystem.UpdateEntities(qfalse);
+	return 0;
+}
+
+GAME_TRAP( G_ROFF_CACHE ) {
+	return theROFFSystem.Cache( (char *)VMA(1), qfalse );
+}
+
+GAME_TRAP( G_ROFF_PLAY ) {
+	return theROFFSystem.Play(args[1], args[2], (qboolean)args[3], qfalse );
+}
+
+GAME_TRAP( G_ROFF_PURGE_ENT ) {
+	return theROFFSystem.PurgeEnt( args[1], qfalse );
+}
+
+//====================================
+
+GAME_TRAP( BOTLIB_SETUP ) {
+	return SV_BotLibSetup();
+}
+
+GAME_TRAP( BOTLIB_SHUTDOWN ) {
+	return SV_BotLibShutdown();
+}
+
+GAME_TRAP( BOTLIB_LIBVAR_SET ) {
+	return botlib_export->BotLibVarSet( (char *)VMA(1), (char *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_LIBVAR_GET ) {
+	return botlib_export->BotLibVarGet( (char *)VMA(1), (char *)VMA(2), args[3] );
+}
+
+GAME_TRAP( BOTLIB_PC_ADD_GLOBAL_DEFINE ) {
+	return botlib_export->PC_AddGlobalDefine( (char *)VMA(1) );
+}
+
+GAME_TRAP( BOTLIB_PC_LOAD_SOURCE ) {
+	return botlib_export->PC_LoadSourceHandle( (const char *)VMA(1) );
+}
+
+GAME_TRAP( BOTLIB_PC_FREE_SOURCE ) {
+	return botlib_export->PC_FreeSourceHandle( args[1] );
+}
+
+GAME_TRAP( BOTLIB_PC_READ_TOKEN ) {
+	return botlib_export->PC_ReadTokenHandle( args[1], (struct pc_token_s *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_PC_SOURCE_FILE_AND_LINE ) {
+	return botlib_export->PC_SourceFileAndLine( args[1], (char *)VMA(2), (int *)VMA(3) );
+}
+
+GAME_TRAP( BOTLIB_START_FRAME ) {
+	return botlib_export->BotLibStartFrame( VMF(1) );
+}
+
+GAME_TRAP( BOTLIB_LOAD_MAP ) {
+	return botlib_export->BotLibLoadMap( (const char *)VMA(1) );
+}
+
+GAME_TRAP( BOTLIB_UPDATENTITY ) {
+	return botlib_export->BotLibUpdateEntity( args[1], (struct bot_entitystate_s *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_TEST ) {
+	return botlib_export->Test( args[1], (char *)VMA(2), (float *)VMA(3), (float *)VMA(4) );
+}
+
+GAME_TRAP( BOTLIB_GET_SNAPSHOT_ENTITY ) {
+	return SV_BotGetSnapshotEntity( args[1], args[2] );
+}
+
+GAME_TRAP( BOTLIB_GET_CONSOLE_MESSAGE ) {
+	return SV_BotGetConsoleMessage( args[1], (char *)VMA(2), args[3] );
+}
+
+GAME_TRAP( BOTLIB_USER_COMMAND ) {
+	SV_ClientThink( &svs.clients[args[1]], (struct usercmd_s *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AAS_BBOX_AREAS ) {
+	return botlib_export->aas.AAS_BBoxAreas( (float *)VMA(1), (float *)VMA(2), (int *)VMA(3), args[4] );
+}
+
+GAME_TRAP( BOTLIB_AAS_AREA_INFO ) {
+	return botlib_export->aas.AAS_AreaInfo( args[1], (struct aas_areainfo_s *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AAS_ALTERNATIVE_ROUTE_GOAL ) {
+	return botlib_export->aas.AAS_AlternativeRouteGoals( (float *)VMA(1), args[2], (float *)VMA(3), args[4], args[5], (struct aas_altroutegoal_s *)VMA(6), args[7], args[8] );
+}
+
+GAME_TRAP( BOTLIB_AAS_ENTITY_INFO ) {
+	botlib_export->aas.AAS_EntityInfo( args[1], (struct aas_entityinfo_s *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AAS_INITIALIZED ) {
+	return botlib_export->aas.AAS_Initialized();
+}
+
+GAME_TRAP( BOTLIB_AAS_PRESENCE_TYPE_BOUNDING_BOX ) {
+	botlib_export->aas.AAS_PresenceTypeBoundingBox( args[1], (float *)VMA(2), (float *)VMA(3) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AAS_TIME ) {
+	return FloatAsInt( botlib_export->aas.AAS_Time() );
+}
+
+GAME_TRAP( BOTLIB_AAS_POINT_AREA_NUM ) {
+	return botlib_export->aas.AAS_PointAreaNum( (float *)VMA(1) );
+}
+
+GAME_TRAP( BOTLIB_AAS_POINT_REACHABILITY_AREA_INDEX ) {
+	return botlib_export->aas.AAS_PointReachabilityAreaIndex( (float *)VMA(1) );
+}
+
+GAME_TRAP( BOTLIB_AAS_TRACE_AREAS ) {
+	return botlib_export->aas.AAS_TraceAreas( (float *)VMA(1), (float *)VMA(2), (int *)VMA(3), (float (*)[3])VMA(4), args[5] );
+}
+
+GAME_TRAP( BOTLIB_AAS_POINT_CONTENTS ) {
+	return botlib_export->aas.AAS_PointContents( (float *)VMA(1) );
+}
+
+GAME_TRAP( BOTLIB_AAS_NEXT_BSP_ENTITY ) {
+	return botlib_export->aas.AAS_NextBSPEntity( args[1] );
+}
+
+GAME_TRAP( BOTLIB_AAS_VALUE_FOR_BSP_EPAIR_KEY ) {
+	return botlib_export->aas.AAS_ValueForBSPEpairKey( args[1], (char *)VMA(2), (char *)VMA(3), args[4] );
+}
+
+GAME_TRAP( BOTLIB_AAS_VECTOR_FOR_BSP_EPAIR_KEY ) {
+	return botlib_export->aas.AAS_VectorForBSPEpairKey( args[1], (char *)VMA(2), (float *)VMA(3) );
+}
+
+GAME_TRAP( BOTLIB_AAS_FLOAT_FOR_BSP_EPAIR_KEY ) {
+	return botlib_export->aas.AAS_FloatForBSPEpairKey( args[1], (char *)VMA(2), (float *)VMA(3) );
+}
+
+GAME_TRAP( BOTLIB_AAS_INT_FOR_BSP_EPAIR_KEY ) {
+	return botlib_export->aas.AAS_IntForBSPEpairKey( args[1], (char *)VMA(2), (int *)VMA(3) );
+}
+
+GAME_TRAP( BOTLIB_AAS_AREA_REACHABILITY ) {
+	return botlib_export->aas.AAS_AreaReachability( args[1] );
+}
+
+GAME_TRAP( BOTLIB_AAS_AREA_TRAVEL_TIME_TO_GOAL_AREA ) {
+	return botlib_export->aas.AAS_AreaTravelTimeToGoalArea( args[1], (float *)VMA(2), args[3], args[4] );
+}
+
+GAME_TRAP( BOTLIB_AAS_ENABLE_ROUTING_AREA ) {
+	return botlib_export->aas.AAS_EnableRoutingArea( args[1], args[2] );
+}
+
+GAME_TRAP( BOTLIB_AAS_PREDICT_ROUTE ) {
+	return botlib_export->aas.AAS_PredictRoute( (struct aas_predictroute_s *)VMA(1), args[2], (float *)VMA(3), args[4], args[5], args[6], args[7], args[8], args[9], args[10], args[11] );
+}
+
+GAME_TRAP( BOTLIB_AAS_SWIMMING ) {
+	return botlib_export->aas.AAS_Swimming( (float *)VMA(1) );
+}
+
+GAME_TRAP( BOTLIB_AAS_PREDICT_CLIENT_MOVEMENT ) {
+	return botlib_export->aas.AAS_PredictClientMovement( (struct aas_clientmove_s *)VMA(1), args[2], (float *)VMA(3), args[4], args[5],
+		(float *)VMA(6), (float *)VMA(7), args[8], args[9], VMF(10), args[11], args[12], args[13] );
+}
+
+GAME_TRAP( BOTLIB_EA_SAY ) {
+	botlib_export->ea.EA_Say( args[1], (char *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_SAY_TEAM ) {
+	botlib_export->ea.EA_SayTeam( args[1], (char *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_COMMAND ) {
+	botlib_export->ea.EA_Command( args[1], (char *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_ACTION ) {
+	botlib_export->ea.EA_Action( args[1], args[2] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_GESTURE ) {
+	botlib_export->ea.EA_Gesture( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_TALK ) {
+	botlib_export->ea.EA_Talk( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_ATTACK ) {
+	botlib_export->ea.EA_Attack( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_ALT_ATTACK ) {
+	botlib_export->ea.EA_Alt_Attack( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_FORCEPOWER ) {
+	botlib_export->ea.EA_ForcePower( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_USE ) {
+	botlib_export->ea.EA_Use( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_RESPAWN ) {
+	botlib_export->ea.EA_Respawn( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_CROUCH ) {
+	botlib_export->ea.EA_Crouch( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_MOVE_UP ) {
+	botlib_export->ea.EA_MoveUp( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_MOVE_DOWN ) {
+	botlib_export->ea.EA_MoveDown( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_MOVE_FORWARD ) {
+	botlib_export->ea.EA_MoveForward( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_MOVE_BACK ) {
+	botlib_export->ea.EA_MoveBack( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_MOVE_LEFT ) {
+	botlib_export->ea.EA_MoveLeft( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_MOVE_RIGHT ) {
+	botlib_export->ea.EA_MoveRight( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_SELECT_WEAPON ) {
+	botlib_export->ea.EA_SelectWeapon( args[1], args[2] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_JUMP ) {
+	botlib_export->ea.EA_Jump( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_DELAYED_JUMP ) {
+	botlib_export->ea.EA_DelayedJump( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_MOVE ) {
+	botlib_export->ea.EA_Move( args[1], (float *)VMA(2), VMF(3) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_VIEW ) {
+	botlib_export->ea.EA_View( args[1], (float *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_END_REGULAR ) {
+	botlib_export->ea.EA_EndRegular( args[1], VMF(2) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_GET_INPUT ) {
+	botlib_export->ea.EA_GetInput( args[1], VMF(2), (struct bot_input_s *)VMA(3) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_EA_RESET_INPUT ) {
+	botlib_export->ea.EA_ResetInput( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_LOAD_CHARACTER ) {
+	return botlib_export->ai.BotLoadCharacter( (char *)VMA(1), VMF(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_FREE_CHARACTER ) {
+	botlib_export->ai.BotFreeCharacter( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_CHARACTERISTIC_FLOAT ) {
+	return FloatAsInt( botlib_export->ai.Characteristic_Float( args[1], args[2] ) );
+}
+
+GAME_TRAP( BOTLIB_AI_CHARACTERISTIC_BFLOAT ) {
+	return FloatAsInt( botlib_export->ai.Characteristic_BFloat( args[1], args[2], VMF(3), VMF(4) ) );
+}
+
+GAME_TRAP( BOTLIB_AI_CHARACTERISTIC_INTEGER ) {
+	return botlib_export->ai.Characteristic_Integer( args[1], args[2] );
+}
+
+GAME_TRAP( BOTLIB_AI_CHARACTERISTIC_BINTEGER ) {
+	return botlib_export->ai.Characteristic_BInteger( args[1], args[2], args[3], args[4] );
+}
+
+GAME_TRAP( BOTLIB_AI_CHARACTERISTIC_STRING ) {
+	botlib_export->ai.Characteristic_String( args[1], args[2], (char *)VMA(3), args[4] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_ALLOC_CHAT_STATE ) {
+	return botlib_export->ai.BotAllocChatState();
+}
+
+GAME_TRAP( BOTLIB_AI_FREE_CHAT_STATE ) {
+	botlib_export->ai.BotFreeChatState( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_QUEUE_CONSOLE_MESSAGE ) {
+	botlib_export->ai.BotQueueConsoleMessage( args[1], args[2], (char *)VMA(3) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_REMOVE_CONSOLE_MESSAGE ) {
+	botlib_export->ai.BotRemoveConsoleMessage( args[1], args[2] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_NEXT_CONSOLE_MESSAGE ) {
+	return botlib_export->ai.BotNextConsoleMessage( args[1], (struct bot_consolemessage_s *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_NUM_CONSOLE_MESSAGE ) {
+	return botlib_export->ai.BotNumConsoleMessages( args[1] );
+}
+
+GAME_TRAP( BOTLIB_AI_INITIAL_CHAT ) {
+	botlib_export->ai.BotInitialChat( args[1], (char *)VMA(2), args[3], (char *)VMA(4), (char *)VMA(5), (char *)VMA(6), (char *)VMA(7), (char *)VMA(8), (char *)VMA(9), (char *)VMA(10), (char *)VMA(11) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_NUM_INITIAL_CHATS ) {
+	return botlib_export->ai.BotNumInitialChats( args[1], (char *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_REPLY_CHAT ) {
+	return botlib_export->ai.BotReplyChat( args[1], (char *)VMA(2), args[3], args[4], (char *)VMA(5), (char *)VMA(6), (char *)VMA(7), (char *)VMA(8), (char *)VMA(9), (char *)VMA(10), (char *)VMA(11), (char *)VMA(12) );
+}
+
+GAME_TRAP( BOTLIB_AI_CHAT_LENGTH ) {
+	return botlib_export->ai.BotChatLength( args[1] );
+}
+
+GAME_TRAP( BOTLIB_AI_ENTER_CHAT ) {
+	botlib_export->ai.BotEnterChat( args[1], args[2], args[3] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_GET_CHAT_MESSAGE ) {
+	botlib_export->ai.BotGetChatMessage( args[1], (char *)VMA(2), args[3] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_STRING_CONTAINS ) {
+	return botlib_export->ai.StringContains( (char *)VMA(1), (char *)VMA(2), args[3] );
+}
+
+GAME_TRAP( BOTLIB_AI_FIND_MATCH ) {
+	return botlib_export->ai.BotFindMatch( (char *)VMA(1), (struct bot_match_s *)VMA(2), args[3] );
+}
+
+GAME_TRAP( BOTLIB_AI_MATCH_VARIABLE ) {
+	botlib_export->ai.BotMatchVariable( (struct bot_match_s *)VMA(1), args[2], (char *)VMA(3), args[4] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_UNIFY_WHITE_SPACES ) {
+	botlib_export->ai.UnifyWhiteSpaces( (char *)VMA(1) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_REPLACE_SYNONYMS ) {
+	botlib_export->ai.BotReplaceSynonyms( (char *)VMA(1), args[2] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_LOAD_CHAT_FILE ) {
+	return botlib_export->ai.BotLoadChatFile( args[1], (char *)VMA(2), (char *)VMA(3) );
+}
 
-/*
-===============
-SV_GetUsercmd
+GAME_TRAP( BOTLIB_AI_SET_CHAT_GENDER ) {
+	botlib_export->ai.BotSetChatGender( args[1], args[2] );
+	return 0;
+}
 
-===============
-*/
-void SV_GetUsercmd( int clientNum, usercmd_t *cmd ) {
-	if ( clientNum < 0 || clientNum >= sv_maxclients->integer ) {
-		Com_Error( ERR_DROP, "SV_GetUsercmd: bad clientNum:%i", clientNum );
-	}
-	*cmd = svs.clients[clientNum].lastUsercmd;
+GAME_TRAP( BOTLIB_AI_SET_CHAT_NAME ) {
+	botlib_export->ai.BotSetChatName( args[1], (char *)VMA(2), args[3] );
+	return 0;
+}
 
-	if ( cmd->forcesel == FP_LEVITATION && mv_blockchargejump->integer && !(sv.fixes & MVFIX_CHARGEJUMP)) cmd->forcesel = FP_PUSH; // Prevent modified clients from using the "ChargeJump" (higher jumping, double-kicks, ...), but let the server toggle this (in case they are using a mod where it is a feature).
-	if ( mv_blockspeedhack->integer && !(sv.fixes & MVFIX_SPEEDHACK)) cmd->angles[ROLL] = 0; // Prevent modified clients from gaining more speed than others...
+GAME_TRAP( BOTLIB_AI_RESET_GOAL_STATE ) {
+	botlib_export->ai.BotResetGoalState( args[1] );
+	return 0;
 }
 
-//==============================================
+GAME_TRAP( BOTLIB_AI_RESET_AVOID_GOALS ) {
+	botlib_export->ai.BotResetAvoidGoals( args[1] );
+	return 0;
+}
 
-/*
-====================
-SV_GameSystemCalls
+GAME_TRAP( BOTLIB_AI_REMOVE_FROM_AVOID_GOALS ) {
+	botlib_export->ai.BotRemoveFromAvoidGoals( args[1], args[2] );
+	return 0;
+}
 
-The module is making a system call
-====================
-*/
-//rcg010207 - see my comments in VM_DllSyscall(), in qcommon/vm.c ...
-#if ((defined __linux__) && (defined __powerpc__))
-#define VMA(x) ((void *) args[x])
-#else
-#define	VMA(x) VM_ArgPtr(args[x])
-#endif
+GAME_TRAP( BOTLIB_AI_PUSH_GOAL ) {
+	botlib_export->ai.BotPushGoal( args[1], (struct bot_goal_s *)VMA(2) );
+	return 0;
+}
 
-extern bool RicksCrazyOnServer;
+GAME_TRAP( BOTLIB_AI_POP_GOAL ) {
+	botlib_export->ai.BotPopGoal( args[1] );
+	return 0;
+}
 
-intptr_t SV_GameSystemCalls( intptr_t *args ) {
-	// fix syscalls from 1.02 to match 1.04
-	// this is a mess... can it be done better?
-	if (MV_GetCurrentGameversion() == VERSION_1_02) {
-		if (args[0] > G_G2_GETBOLT_NOREC && args[0] <= G_G2_COLLISIONDETECT) {
-			args[0]++;
-		}
-	}
+GAME_TRAP( BOTLIB_AI_EMPTY_GOAL_STACK ) {
+	botlib_export->ai.BotEmptyGoalStack( args[1] );
+	return 0;
+}
 
-	switch( args[0] ) {
-	case G_PRINT:
-		Com_Printf( "%s", VMA(1) );
-		return 0;
-	case G_ERROR:
-		Com_Error( ERR_DROP, "%s", VMA(1) );
-		return 0;
-	case G_MILLISECONDS:
-		return Sys_Milliseconds();
-	case G_CVAR_REGISTER:
-		Cvar_Register( (vmCvar_t *)VMA(1), (const char *)VMA(2), (const char *)VMA(3), args[4] );
-		return 0;
-	case G_CVAR_UPDATE:
-		Cvar_Update( (vmCvar_t *)VMA(1) );
-		return 0;
-	case G_CVAR_SET:
-		Cvar_Set2( (const char *)VMA(1), (const char *)VMA(2), qtrue, qtrue );
-		return 0;
-	case G_CVAR_VARIABLE_INTEGER_VALUE:
-		return Cvar_VariableIntegerValue( (const char *)VMA(1), qtrue );
-	case G_CVAR_VARIABLE_STRING_BUFFER:
-		Cvar_VariableStringBuffer( (const char *)VMA(1), (char *)VMA(2), args[3], qtrue );
-		return 0;
-	case G_ARGC:
-		return Cmd_Argc();
-	case G_ARGV:
-		Cmd_ArgvBuffer( args[1], (char *)VMA(2), args[3] );
-		return 0;
-	case G_SEND_CONSOLE_COMMAND:
-		Cbuf_ExecuteText( args[1], (const char *)VMA(2) );
-		return 0;
-
-	case G_FS_FOPEN_FILE:
-		return FS_FOpenFileByMode( (const char *)VMA(1), (int *)VMA(2), (fsMode_t)args[3] );
-	case G_FS_READ:
-		FS_Read2( VMA(1), args[2], args[3] );
-		return 0;
-	case G_FS_WRITE:
-		FS_Write( VMA(1), args[2], args[3] );
-		return 0;
-	case G_FS_FCLOSE_FILE:
-		FS_FCloseFile( args[1] );
-		return 0;
-	case G_FS_GETFILELIST:
-		return FS_GetFileList( (const char *)VMA(1), (const char *)VMA(2), (char *)VMA(3), args[4] );
-
-	case G_LOCATE_GAME_DATA:
-		SV_LocateGameData( (sharedEntity_t *)VMA(1), args[2], args[3], (struct playerState_s *)VMA(4), args[5] );
-		return 0;
-	case MVAPI_LOCATE_GAME_DATA:
-		return MVAPI_LocateGameData((mvsharedEntity_t *)VMA(1), args[2], args[3]);
-	case G_DROP_CLIENT:
-		SV_GameDropClient( args[1], (const char *)VMA(2) );
-		return 0;
-	case G_SEND_SERVER_COMMAND:
-		SV_GameSendServerCommand( args[1], (const char *)VMA(2) );
-		return 0;
-	case G_LINKENTITY:
-		SV_LinkEntity( (sharedEntity_t *)VMA(1) );
-		return 0;
-	case G_UNLINKENTITY:
-		SV_UnlinkEntity( (sharedEntity_t *)VMA(1) );
-		return 0;
-	case G_ENTITIES_IN_BOX:
-		return SV_AreaEntities( (const float *)VMA(1), (const float *)VMA(2), (int *)VMA(3), args[4] );
-	case G_ENTITY_CONTACT:
-		return SV_EntityContact( (const float *)VMA(1), (const float *)VMA(2), (const sharedEntity_t *)VMA(3), /*int capsule*/ qfalse );
-	case G_ENTITY_CONTACTCAPSULE:
-		return SV_EntityContact( (const float *)VMA(1), (const float *)VMA(2), (const sharedEntity_t *)VMA(3), /*int capsule*/ qtrue );
-	case G_TRACE:
-		SV_Trace( (trace_t *)VMA(1), (const float *)VMA(2), (const float *)VMA(3), (const float *)VMA(4), (const float *)VMA(5), args[6], args[7], /*int capsule*/ qfalse, args[8], args[9] );
-		return 0;
-	case G_TRACECAPSULE:
-		SV_Trace( (trace_t *)VMA(1), (const float *)VMA(2), (const float *)VMA(3), (const float *)VMA(4), (const float *)VMA(5), args[6], args[7], /*int capsule*/ qtrue, args[8], args[9]  );
-		return 0;
-	case G_POINT_CONTENTS:
-		return SV_PointContents( (const float *)VMA(1), args[2] );
-	case G_SET_BRUSH_MODEL:
-		SV_SetBrushModel( (sharedEntity_t *)VMA(1), (const char *)VMA(2) );
-		return 0;
-	case G_IN_PVS:
-		return SV_inPVS( (const float *)VMA(1), (const float *)VMA(2) );
-	case G_IN_PVS_IGNORE_PORTALS:
-		return SV_inPVSIgnorePortals( (const float *)VMA(1), (const float *)VMA(2) );
-
-	case G_SET_CONFIGSTRING:
-		SV_SetConfigstring( args[1], (const char *)VMA(2) );
-		return 0;
-	case G_GET_CONFIGSTRING:
-		SV_GetConfigstring( args[1], (char *)VMA(2), args[3] );
-		return 0;
-	case G_SET_USERINFO:
-		SV_SetUserinfo( args[1], (const char *)VMA(2) );
-		return 0;
-	case G_GET_USERINFO:
-		SV_GetUserinfo( args[1], (char *)VMA(2), args[3] );
-		return 0;
-	case G_GET_SERVERINFO:
-		SV_GetServerinfo( (char *)VMA(1), args[2] );
-		return 0;
-	case G_ADJUST_AREA_PORTAL_STATE:
-		SV_AdjustAreaPortalState( (sharedEntity_t *)VMA(1), (qboolean)args[2] );
-		return 0;
-	case G_AREAS_CONNECTED:
-		return CM_AreasConnected( args[1], args[2] );
-
-	case G_BOT_ALLOCATE_CLIENT:
-		return SV_BotAllocateClient();
-	case G_BOT_FREE_CLIENT:
-		SV_BotFreeClient( args[1] );
-		return 0;
-
-	case G_GET_USERCMD:
-		SV_GetUsercmd( args[1], (struct usercmd_s *)VMA(2) );
-		return 0;
-	case G_GET_ENTITY_TOKEN:
-		{
-			const char	*s;
-
-			s = COM_Parse( (const char **) &sv.entityParsePoint );
-			Q_strncpyz( (char *)VMA(1), s, args[2] );
-			if ( !sv.entityParsePoint && !s[0] ) {
-				return qfalse;
-			} else {
-				return qtrue;
-			}
-		}
+GAME_TRAP( BOTLIB_AI_DUMP_AVOID_GOALS ) {
+	botlib_export->ai.BotDumpAvoidGoals( args[1] );
+	return 0;
+}
 
-		/*
-	case G_BOT_GET_MEMORY:
-		void *ptr;
-		ptr = Bot_GetMemoryGame(args[1]);
-		return (int)ptr;
-	case G_BOT_FREE_MEMORY:
-		Bot_FreeMemoryGame((void *)VMA(1));
-		return 0;
-		*/
-	case G_DEBUG_POLYGON_CREATE:
-		return BotImport_DebugPolygonCreate( args[1], args[2], (float (*)[3])VMA(3) );
-	case G_DEBUG_POLYGON_DELETE:
-		BotImport_DebugPolygonDelete( args[1] );
-		return 0;
-	case G_REAL_TIME:
-		return Com_RealTime( (struct qtime_s *)VMA(1) );
-	case G_SNAPVECTOR:
-		Sys_SnapVector(*(vec3_t *)VMA(1));
-		return 0;
-
-	case SP_REGISTER_SERVER_CMD:
-		return SP_RegisterServer( (const char *)VMA(1) );
-	case SP_GETSTRINGTEXTSTRING:
-		//return (int)SP_GetStringTextString((char *)VMA(1));
-		const char* text;
-
-		assert(VMA(1));
-		assert(VMA(2));
+GAME_TRAP( BOTLIB_AI_DUMP_GOAL_STACK ) {
+	botlib_export->ai.BotDumpGoalStack( args[1] );
+	return 0;
+}
 
-//		if (args[0] == CG_SP_GETSTRINGTEXT)
-//		{
-//			text = SP_GetStringText( args[1] );
-//		}
-//		else
-		{
-			text = SP_GetStringTextString( (const char *) VMA(1) );
-		}
+GAME_TRAP( BOTLIB_AI_GOAL_NAME ) {
+	botlib_export->ai.BotGoalName( args[1], (char *)VMA(2), args[3] );
+	return 0;
+}
 
-		if ( text[0] )
-		{
-			Q_strncpyz( (char *) VMA(2), text, args[3] );
-			return qtrue;
-		}
-		else
-		{
-			Q_strncpyz( (char *) VMA(2), "??", args[3] );
-			return qfalse;
-		}
-		break;
-
-	case G_ROFF_CLEAN:
-		return theROFFSystem.Clean(qfalse);
-
-	case G_ROFF_UPDATE_ENTITIES:
-		theROFFSystem.UpdateEntities(qfalse);
-		return 0;
-
-	case G_ROFF_CACHE:
-		return theROFFSystem.Cache( (char *)VMA(1), qfalse );
-
-	case G_ROFF_PLAY:
-		return theROFFSystem.Play(args[1], args[2], (qboolean)args[3], qfalse );
-
-	case G_ROFF_PURGE_ENT:
-		return theROFFSystem.PurgeEnt( args[1], qfalse );
-
-
-
-
-		//====================================
-
-	case BOTLIB_SETUP:
-		return SV_BotLibSetup();
-	case BOTLIB_SHUTDOWN:
-		return SV_BotLibShutdown();
-	case BOTLIB_LIBVAR_SET:
-		return botlib_export->BotLibVarSet( (char *)VMA(1), (char *)VMA(2) );
-	case BOTLIB_LIBVAR_GET:
-		return botlib_export->BotLibVarGet( (char *)VMA(1), (char *)VMA(2), args[3] );
-
-	case BOTLIB_PC_ADD_GLOBAL_DEFINE:
-		return botlib_export->PC_AddGlobalDefine( (char *)VMA(1) );
-	case BOTLIB_PC_LOAD_SOURCE:
-		return botlib_export->PC_LoadSourceHandle( (const char *)VMA(1) );
-	case BOTLIB_PC_FREE_SOURCE:
-		return botlib_export->PC_FreeSourceHandle( args[1] );
-	case BOTLIB_PC_READ_TOKEN:
-		return botlib_export->PC_ReadTokenHandle( args[1], (struct pc_token_s *)VMA(2) );
-	case BOTLIB_PC_SOURCE_FILE_AND_LINE:
-		return botlib_export->PC_SourceFileAndLine( args[1], (char *)VMA(2), (int *)VMA(3) );
-
-	case BOTLIB_START_FRAME:
-		return botlib_export->BotLibStartFrame( VMF(1) );
-	case BOTLIB_LOAD_MAP:
-		return botlib_export->BotLibLoadMap( (const char *)VMA(1) );
-	case BOTLIB_UPDATENTITY:
-		return botlib_export->BotLibUpdateEntity( args[1], (struct bot_entitystate_s *)VMA(2) );
-	case BOTLIB_TEST:
-		return botlib_export->Test( args[1], (char *)VMA(2), (float *)VMA(3), (float *)VMA(4) );
-
-	case BOTLIB_GET_SNAPSHOT_ENTITY:
-		return SV_BotGetSnapshotEntity( args[1], args[2] );
-	case BOTLIB_GET_CONSOLE_MESSAGE:
-		return SV_BotGetConsoleMessage( args[1], (char *)VMA(2), args[3] );
-	case BOTLIB_USER_COMMAND:
-		SV_ClientThink( &svs.clients[args[1]], (struct usercmd_s *)VMA(2) );
-		return 0;
-
-	case BOTLIB_AAS_BBOX_AREAS:
-		return botlib_export->aas.AAS_BBoxAreas( (float *)VMA(1), (float *)VMA(2), (int *)VMA(3), args[4] );
-	case BOTLIB_AAS_AREA_INFO:
-		return botlib_export->aas.AAS_AreaInfo( args[1], (struct aas_areainfo_s *)VMA(2) );
-	case BOTLIB_AAS_ALTERNATIVE_ROUTE_GOAL:
-		return botlib_export->aas.AAS_AlternativeRouteGoals( (float *)VMA(1), args[2], (float *)VMA(3), args[4], args[5], (struct aas_altroutegoal_s *)VMA(6), args[7], args[8] );
-	case BOTLIB_AAS_ENTITY_INFO:
-		botlib_export->aas.AAS_EntityInfo( args[1], (struct aas_entityinfo_s *)VMA(2) );
-		return 0;
-
-	case BOTLIB_AAS_INITIALIZED:
-		return botlib_export->aas.AAS_Initialized();
-	case BOTLIB_AAS_PRESENCE_TYPE_BOUNDING_BOX:
-		botlib_export->aas.AAS_PresenceTypeBoundingBox( args[1], (float *)VMA(2), (float *)VMA(3) );
-		return 0;
-	case BOTLIB_AAS_TIME:
-		return FloatAsInt( botlib_export->aas.AAS_Time() );
-
-	case BOTLIB_AAS_POINT_AREA_NUM:
-		return botlib_export->aas.AAS_PointAreaNum( (float *)VMA(1) );
-	case BOTLIB_AAS_POINT_REACHABILITY_AREA_INDEX:
-		return botlib_export->aas.AAS_PointReachabilityAreaIndex( (float *)VMA(1) );
-	case BOTLIB_AAS_TRACE_AREAS:
-		return botlib_export->aas.AAS_TraceAreas( (float *)VMA(1), (float *)VMA(2), (int *)VMA(3), (float (*)[3])VMA(4), args[5] );
-
-	case BOTLIB_AAS_POINT_CONTENTS:
-		return botlib_export->aas.AAS_PointContents( (float *)VMA(1) );
-	case BOTLIB_AAS_NEXT_BSP_ENTITY:
-		return botlib_export->aas.AAS_NextBSPEntity( args[1] );
-	case BOTLIB_AAS_VALUE_FOR_BSP_EPAIR_KEY:
-		return botlib_export->aas.AAS_ValueForBSPEpairKey( args[1], (char *)VMA(2), (char *)VMA(3), args[4] );
-	case BOTLIB_AAS_VECTOR_FOR_BSP_EPAIR_KEY:
-		return botlib_export->aas.AAS_VectorForBSPEpairKey( args[1], (char *)VMA(2), (float *)VMA(3) );
-	case BOTLIB_AAS_FLOAT_FOR_BSP_EPAIR_KEY:
-		return botlib_export->aas.AAS_FloatForBSPEpairKey( args[1], (char *)VMA(2), (float *)VMA(3) );
-	case BOTLIB_AAS_INT_FOR_BSP_EPAIR_KEY:
-		return botlib_export->aas.AAS_IntForBSPEpairKey( args[1], (char *)VMA(2), (int *)VMA(3) );
-
-	case BOTLIB_AAS_AREA_REACHABILITY:
-		return botlib_export->aas.AAS_AreaReachability( args[1] );
-
-	case BOTLIB_AAS_AREA_TRAVEL_TIME_TO_GOAL_AREA:
-		return botlib_export->aas.AAS_AreaTravelTimeToGoalArea( args[1], (float *)VMA(2), args[3], args[4] );
-	case BOTLIB_AAS_ENABLE_ROUTING_AREA:
-		return botlib_export->aas.AAS_EnableRoutingArea( args[1], args[2] );
-	case BOTLIB_AAS_PREDICT_ROUTE:
-		return botlib_export->aas.AAS_PredictRoute( (struct aas_predictroute_s *)VMA(1), args[2], (float *)VMA(3), args[4], args[5], args[6], args[7], args[8], args[9], args[10], args[11] );
-
-	case BOTLIB_AAS_SWIMMING:
-		return botlib_export->aas.AAS_Swimming( (float *)VMA(1) );
-	case BOTLIB_AAS_PREDICT_CLIENT_MOVEMENT:
-		return botlib_export->aas.AAS_PredictClientMovement( (struct aas_clientmove_s *)VMA(1), args[2], (float *)VMA(3), args[4], args[5],
-			(float *)VMA(6), (float *)VMA(7), args[8], args[9], VMF(10), args[11], args[12], args[13] );
-
-	case BOTLIB_EA_SAY:
-		botlib_export->ea.EA_Say( args[1], (char *)VMA(2) );
-		return 0;
-	case BOTLIB_EA_SAY_TEAM:
-		botlib_export->ea.EA_SayTeam( args[1], (char *)VMA(2) );
-		return 0;
-	case BOTLIB_EA_COMMAND:
-		botlib_export->ea.EA_Command( args[1], (char *)VMA(2) );
-		return 0;
-
-	case BOTLIB_EA_ACTION:
-		botlib_export->ea.EA_Action( args[1], args[2] );
-		break;
-	case BOTLIB_EA_GESTURE:
-		botlib_export->ea.EA_Gesture( args[1] );
-		return 0;
-	case BOTLIB_EA_TALK:
-		botlib_export->ea.EA_Talk( args[1] );
-		return 0;
-	case BOTLIB_EA_ATTACK:
-		botlib_export->ea.EA_Attack( args[1] );
-		return 0;
-	case BOTLIB_EA_ALT_ATTACK:
-		botlib_export->ea.EA_Alt_Attack( args[1] );
-		return 0;
-	case BOTLIB_EA_FORCEPOWER:
-		botlib_export->ea.EA_ForcePower( args[1] );
-		return 0;
-	case BOTLIB_EA_USE:
-		botlib_export->ea.EA_Use( args[1] );
-		return 0;
-	case BOTLIB_EA_RESPAWN:
-		botlib_export->ea.EA_Respawn( args[1] );
-		return 0;
-	case BOTLIB_EA_CROUCH:
-		botlib_export->ea.EA_Crouch( args[1] );
-		return 0;
-	case BOTLIB_EA_MOVE_UP:
-		botlib_export->ea.EA_MoveUp( args[1] );
-		return 0;
-	case BOTLIB_EA_MOVE_DOWN:
-		botlib_export->ea.EA_MoveDown( args[1] );
-		return 0;
-	case BOTLIB_EA_MOVE_FORWARD:
-		botlib_export->ea.EA_MoveForward( args[1] );
-		return 0;
-	case BOTLIB_EA_MOVE_BACK:
-		botlib_export->ea.EA_MoveBack( args[1] );
-		return 0;
-	case BOTLIB_EA_MOVE_LEFT:
-		botlib_export->ea.EA_MoveLeft( args[1] );
-		return 0;
-	case BOTLIB_EA_MOVE_RIGHT:
-		botlib_export->ea.EA_MoveRight( args[1] );
-		return 0;
-
-	case BOTLIB_EA_SELECT_WEAPON:
-		botlib_export->ea.EA_SelectWeapon( args[1], args[2] );
-		return 0;
-	case BOTLIB_EA_JUMP:
-		botlib_export->ea.EA_Jump( args[1] );
-		return 0;
-	case BOTLIB_EA_DELAYED_JUMP:
-		botlib_export->ea.EA_DelayedJump( args[1] );
-		return 0;
-	case BOTLIB_EA_MOVE:
-		botlib_export->ea.EA_Move( args[1], (float *)VMA(2), VMF(3) );
-		return 0;
-	case BOTLIB_EA_VIEW:
-		botlib_export->ea.EA_View( args[1], (float *)VMA(2) );
-		return 0;
-
-	case BOTLIB_EA_END_REGULAR:
-		botlib_export->ea.EA_EndRegular( args[1], VMF(2) );
-		return 0;
-	case BOTLIB_EA_GET_INPUT:
-		botlib_export->ea.EA_GetInput( args[1], VMF(2), (struct bot_input_s *)VMA(3) );
-		return 0;
-	case BOTLIB_EA_RESET_INPUT:
-		botlib_export->ea.EA_ResetInput( args[1] );
-		return 0;
-
-	case BOTLIB_AI_LOAD_CHARACTER:
-		return botlib_export->ai.BotLoadCharacter( (char *)VMA(1), VMF(2) );
-	case BOTLIB_AI_FREE_CHARACTER:
-		botlib_export->ai.BotFreeCharacter( args[1] );
-		return 0;
-	case BOTLIB_AI_CHARACTERISTIC_FLOAT:
-		return FloatAsInt( botlib_export->ai.Characteristic_Float( args[1], args[2] ) );
-	case BOTLIB_AI_CHARACTERISTIC_BFLOAT:
-		return FloatAsInt( botlib_export->ai.Characteristic_BFloat( args[1], args[2], VMF(3), VMF(4) ) );
-	case BOTLIB_AI_CHARACTERISTIC_INTEGER:
-		return botlib_export->ai.Characteristic_Integer( args[1], args[2] );
-	case BOTLIB_AI_CHARACTERISTIC_BINTEGER:
-		return botlib_export->ai.Characteristic_BInteger( args[1], args[2], args[3], args[4] );
-	case BOTLIB_AI_CHARACTERISTIC_STRING:
-		botlib_export->ai.Characteristic_String( args[1], args[2], (char *)VMA(3), args[4] );
-		return 0;
-
-	case BOTLIB_AI_ALLOC_CHAT_STATE:
-		return botlib_export->ai.BotAllocChatState();
-	case BOTLIB_AI_FREE_CHAT_STATE:
-		botlib_export->ai.BotFreeChatState( args[1] );
-		return 0;
-	case BOTLIB_AI_QUEUE_CONSOLE_MESSAGE:
-		botlib_export->ai.BotQueueConsoleMessage( args[1], args[2], (char *)VMA(3) );
-		return 0;
-	case BOTLIB_AI_REMOVE_CONSOLE_MESSAGE:
-		botlib_export->ai.BotRemoveConsoleMessage( args[1], args[2] );
-		return 0;
-	case BOTLIB_AI_NEXT_CONSOLE_MESSAGE:
-		return botlib_export->ai.BotNextConsoleMessage( args[1], (struct bot_consolemessage_s *)VMA(2) );
-	case BOTLIB_AI_NUM_CONSOLE_MESSAGE:
-		return botlib_export->ai.BotNumConsoleMessages( args[1] );
-	case BOTLIB_AI_INITIAL_CHAT:
-		botlib_export->ai.BotInitialChat( args[1], (char *)VMA(2), args[3], (char *)VMA(4), (char *)VMA(5), (char *)VMA(6), (char *)VMA(7), (char *)VMA(8), (char *)VMA(9), (char *)VMA(10), (char *)VMA(11) );
-		return 0;
-	case BOTLIB_AI_NUM_INITIAL_CHATS:
-		return botlib_export->ai.BotNumInitialChats( args[1], (char *)VMA(2) );
-	case BOTLIB_AI_REPLY_CHAT:
-		return botlib_export->ai.BotReplyChat( args[1], (char *)VMA(2), args[3], args[4], (char *)VMA(5), (char *)VMA(6), (char *)VMA(7), (char *)VMA(8), (char *)VMA(9), (char *)VMA(10), (char *)VMA(11), (char *)VMA(12) );
-	case BOTLIB_AI_CHAT_LENGTH:
-		return botlib_export->ai.BotChatLength( args[1] );
-	case BOTLIB_AI_ENTER_CHAT:
-		botlib_export->ai.BotEnterChat( args[1], args[2], args[3] );
-		return 0;
-	case BOTLIB_AI_GET_CHAT_MESSAGE:
-		botlib_export->ai.BotGetChatMessage( args[1], (char *)VMA(2), args[3] );
-		return 0;
-	case BOTLIB_AI_STRING_CONTAINS:
-		return botlib_export->ai.StringContains( (char *)VMA(1), (char *)VMA(2), args[3] );
-	case BOTLIB_AI_FIND_MATCH:
-		return botlib_export->ai.BotFindMatch( (char *)VMA(1), (struct bot_match_s *)VMA(2), args[3] );
-	case BOTLIB_AI_MATCH_VARIABLE:
-		botlib_export->ai.BotMatchVariable( (struct bot_match_s *)VMA(1), args[2], (char *)VMA(3), args[4] );
-		return 0;
-	case BOTLIB_AI_UNIFY_WHITE_SPACES:
-		botlib_export->ai.UnifyWhiteSpaces( (char *)VMA(1) );
-		return 0;
-	case BOTLIB_AI_REPLACE_SYNONYMS:
-		botlib_export->ai.BotReplaceSynonyms( (char *)VMA(1), args[2] );
-		return 0;
-	case BOTLIB_AI_LOAD_CHAT_FILE:
-		return botlib_export->ai.BotLoadChatFile( args[1], (char *)VMA(2), (char *)VMA(3) );
-	case BOTLIB_AI_SET_CHAT_GENDER:
-		botlib_export->ai.BotSetChatGender( args[1], args[2] );
-		return 0;
-	case BOTLIB_AI_SET_CHAT_NAME:
-		botlib_export->ai.BotSetChatName( args[1], (char *)VMA(2), args[3] );
-		return 0;
-
-	case BOTLIB_AI_RESET_GOAL_STATE:
-		botlib_export->ai.BotResetGoalState( args[1] );
-		return 0;
-	case BOTLIB_AI_RESET_AVOID_GOALS:
-		botlib_export->ai.BotResetAvoidGoals( args[1] );
-		return 0;
-	case BOTLIB_AI_REMOVE_FROM_AVOID_GOALS:
-		botlib_export->ai.BotRemoveFromAvoidGoals( args[1], args[2] );
-		return 0;
-	case BOTLIB_AI_PUSH_GOAL:
-		botlib_export->ai.BotPushGoal( args[1], (struct bot_goal_s *)VMA(2) );
-		return 0;
-	case BOTLIB_AI_POP_GOAL:
-		botlib_export->ai.BotPopGoal( args[1] );
-		return 0;
-	case BOTLIB_AI_EMPTY_GOAL_STACK:
-		botlib_export->ai.BotEmptyGoalStack( args[1] );
-		return 0;
-	case BOTLIB_AI_DUMP_AVOID_GOALS:
-		botlib_export->ai.BotDumpAvoidGoals( args[1] );
-		return 0;
-	case BOTLIB_AI_DUMP_GOAL_STACK:
-		botlib_export->ai.BotDumpGoalStack( args[1] );
-		return 0;
-	case BOTLIB_AI_GOAL_NAME:
-		botlib_export->ai.BotGoalName( args[1], (char *)VMA(2), args[3] );
-		return 0;
-	case BOTLIB_AI_GET_TOP_GOAL:
-		return botlib_export->ai.BotGetTopGoal( args[1], (struct bot_goal_s *)VMA(2) );
-	case BOTLIB_AI_GET_SECOND_GOAL:
-		return botlib_export->ai.BotGetSecondGoal( args[1], (struct bot_goal_s *)VMA(2) );
-	case BOTLIB_AI_CHOOSE_LTG_ITEM:
-		return botlib_export->ai.BotChooseLTGItem( args[1], (float *)VMA(2), (int *)VMA(3), args[4] );
-	case BOTLIB_AI_CHOOSE_NBG_ITEM:
-		return botlib_export->ai.BotChooseNBGItem( args[1], (float *)VMA(2), (int *)VMA(3), args[4], (struct bot_goal_s *)VMA(5), VMF(6) );
-	case BOTLIB_AI_TOUCHING_GOAL:
-		return botlib_export->ai.BotTouchingGoal( (float *)VMA(1), (struct bot_goal_s *)VMA(2) );
-	case BOTLIB_AI_ITEM_GOAL_IN_VIS_BUT_NOT_VISIBLE:
-		return botlib_export->ai.BotItemGoalInVisButNotVisible( args[1], (float *)VMA(2), (float *)VMA(3), (struct bot_goal_s *)VMA(4) );
-	case BOTLIB_AI_GET_LEVEL_ITEM_GOAL:
-		return botlib_export->ai.BotGetLevelItemGoal( args[1], (char *)VMA(2), (struct bot_goal_s *)VMA(3) );
-	case BOTLIB_AI_GET_NEXT_CAMP_SPOT_GOAL:
-		return botlib_export->ai.BotGetNextCampSpotGoal( args[1], (struct bot_goal_s *)VMA(2) );
-	case BOTLIB_AI_GET_MAP_LOCATION_GOAL:
-		return botlib_export->ai.BotGetMapLocationGoal( (char *)VMA(1), (struct bot_goal_s *)VMA(2) );
-	case BOTLIB_AI_AVOID_GOAL_TIME:
-		return FloatAsInt( botlib_export->ai.BotAvoidGoalTime( args[1], args[2] ) );
-	case BOTLIB_AI_SET_AVOID_GOAL_TIME:
-		botlib_export->ai.BotSetAvoidGoalTime( args[1], args[2], VMF(3));
-		return 0;
-	case BOTLIB_AI_INIT_LEVEL_ITEMS:
-		botlib_export->ai.BotInitLevelItems();
-		return 0;
-	case BOTLIB_AI_UPDATE_ENTITY_ITEMS:
-		botlib_export->ai.BotUpdateEntityItems();
-		return 0;
-	case BOTLIB_AI_LOAD_ITEM_WEIGHTS:
-		return botlib_export->ai.BotLoadItemWeights( args[1], (char *)VMA(2) );
-	case BOTLIB_AI_FREE_ITEM_WEIGHTS:
-		botlib_export->ai.BotFreeItemWeights( args[1] );
-		return 0;
-	case BOTLIB_AI_INTERBREED_GOAL_FUZZY_LOGIC:
-		botlib_export->ai.BotInterbreedGoalFuzzyLogic( args[1], args[2], args[3] );
-		return 0;
-	case BOTLIB_AI_SAVE_GOAL_FUZZY_LOGIC:
-		botlib_export->ai.BotSaveGoalFuzzyLogic( args[1], (char *)VMA(2) );
-		return 0;
-	case BOTLIB_AI_MUTATE_GOAL_FUZZY_LOGIC:
-		botlib_export->ai.BotMutateGoalFuzzyLogic( args[1], VMF(2) );
-		return 0;
-	case BOTLIB_AI_ALLOC_GOAL_STATE:
-		return botlib_export->ai.BotAllocGoalState( args[1] );
-	case BOTLIB_AI_FREE_GOAL_STATE:
-		botlib_export->ai.BotFreeGoalState( args[1] );
-		return 0;
-
-	case BOTLIB_AI_RESET_MOVE_STATE:
-		botlib_export->ai.BotResetMoveState( args[1] );
-		return 0;
-	case BOTLIB_AI_ADD_AVOID_SPOT:
-		botlib_export->ai.BotAddAvoidSpot( args[1], (float *)VMA(2), VMF(3), args[4] );
-		return 0;
-	case BOTLIB_AI_MOVE_TO_GOAL:
-		botlib_export->ai.BotMoveToGoal( (struct bot_moveresult_s *)VMA(1), args[2], (struct bot_goal_s *)VMA(3), args[4] );
-		return 0;
-	case BOTLIB_AI_MOVE_IN_DIRECTION:
-		return botlib_export->ai.BotMoveInDirection( args[1], (float *)VMA(2), VMF(3), args[4] );
-	case BOTLIB_AI_RESET_AVOID_REACH:
-		botlib_export->ai.BotResetAvoidReach( args[1] );
-		return 0;
-	case BOTLIB_AI_RESET_LAST_AVOID_REACH:
-		botlib_export->ai.BotResetLastAvoidReach( args[1] );
-		return 0;
-	case BOTLIB_AI_REACHABILITY_AREA:
-		return botlib_export->ai.BotReachabilityArea( (float *)VMA(1), args[2] );
-	case BOTLIB_AI_MOVEMENT_VIEW_TARGET:
-		return botlib_export->ai.BotMovementViewTarget( args[1], (struct bot_goal_s *)VMA(2), args[3], VMF(4), (float *)VMA(5) );
-	case BOTLIB_AI_PREDICT_VISIBLE_POSITION:
-		return botlib_export->ai.BotPredictVisiblePosition( (float *)VMA(1), args[2], (struct bot_goal_s *)VMA(3), args[4], (float *)VMA(5) );
-	case BOTLIB_AI_ALLOC_MOVE_STATE:
-		return botlib_export->ai.BotAllocMoveState();
-	case BOTLIB_AI_FREE_MOVE_STATE:
-		botlib_export->ai.BotFreeMoveState( args[1] );
-		return 0;
-	case BOTLIB_AI_INIT_MOVE_STATE:
-		botlib_export->ai.BotInitMoveState( args[1], (struct bot_initmove_s *)VMA(2) );
-		return 0;
-
-	case BOTLIB_AI_CHOOSE_BEST_FIGHT_WEAPON:
-		return botlib_export->ai.BotChooseBestFightWeapon( args[1], (int *)VMA(2) );
-	case BOTLIB_AI_GET_WEAPON_INFO:
-		botlib_export->ai.BotGetWeaponInfo( args[1], args[2], (struct weaponinfo_s *)VMA(3) );
-		return 0;
-	case BOTLIB_AI_LOAD_WEAPON_WEIGHTS:
-		return botlib_export->ai.BotLoadWeaponWeights( args[1], (char *)VMA(2) );
-	case BOTLIB_AI_ALLOC_WEAPON_STATE:
-		return botlib_export->ai.BotAllocWeaponState();
-	case BOTLIB_AI_FREE_WEAPON_STATE:
-		botlib_export->ai.BotFreeWeaponState( args[1] );
-		return 0;
-	case BOTLIB_AI_RESET_WEAPON_STATE:
-		botlib_export->ai.BotResetWeaponState( args[1] );
-		return 0;
-
-	case BOTLIB_AI_GENETIC_PARENTS_AND_CHILD_SELECTION:
-		return botlib_export->ai.GeneticParentsAndChildSelection(args[1], (float *)VMA(2), (int *)VMA(3), (int *)VMA(4), (int *)VMA(5));
-
-	case TRAP_MEMSET:
-		Com_Memset( VMA(1), args[2], args[3] );
-		return 0;
-
-	case TRAP_MEMCPY:
-		Com_Memcpy( VMA(1), VMA(2), args[3] );
-		return 0;
-
-	case TRAP_STRNCPY:
-		return (intptr_t)strncpy( (char *)VMA(1), (const char *)VMA(2), args[3] );
-
-	case TRAP_SIN:
-		return FloatAsInt( sin( VMF(1) ) );
-
-	case TRAP_COS:
-		return FloatAsInt( cos( VMF(1) ) );
-
-	case TRAP_ATAN2:
-		return FloatAsInt( atan2( VMF(1), VMF(2) ) );
-
-	case TRAP_SQRT:
-		return FloatAsInt( sqrt( VMF(1) ) );
-
-	case TRAP_MATRIXMULTIPLY:
-		MatrixMultiply( (vec3_t *)VMA(1), (vec3_t *)VMA(2), (vec3_t *)VMA(3) );
-		return 0;
-
-	case TRAP_ANGLEVECTORS:
-		AngleVectors( (const float *)VMA(1), (float *)VMA(2), (float *)VMA(3), (float *)VMA(4) );
-		return 0;
-
-	case TRAP_PERPENDICULARVECTOR:
-		PerpendicularVector( (float *)VMA(1), (const float *)VMA(2) );
-		return 0;
-
-	case TRAP_FLOOR:
-		return FloatAsInt( floor( VMF(1) ) );
-
-	case TRAP_CEIL:
-		return FloatAsInt( ceil( VMF(1) ) );
-
-	case G_G2_LISTBONES:
-		G2API_ListBones( (CGhoul2Info *) VMA(1), args[2]);
-		return 0;
-
-	case G_G2_LISTSURFACES:
-		G2API_ListSurfaces( (CGhoul2Info *) args[1] );
-		return 0;
-
-	case G_G2_HAVEWEGHOULMODELS:
-		return G2API_HaveWeGhoul2Models(GhoulHandle(args[1]));
-
-	case G_G2_SETMODELS:
-		G2API_SetGhoul2ModelIndexes(GhoulHandle(args[1]), (qhandle_t *)VMA(2), (qhandle_t *)VMA(3));
-		return 0;
-
-	case G_G2_GETBOLT:
-		return G2API_GetBoltMatrix(GhoulHandle(args[1]), args[2], args[3], (mdxaBone_t *)VMA(4), (const float *)VMA(5), (const float *)VMA(6), args[7], (qhandle_t *)VMA(8), (float *)VMA(9));
-
-	case G_G2_GETBOLT_NOREC:
-		gG2_GBMNoReconstruct = qtrue;
-		return G2API_GetBoltMatrix(GhoulHandle(args[1]), args[2], args[3], (mdxaBone_t *)VMA(4), (const float *)VMA(5), (const float *)VMA(6), args[7], (qhandle_t *)VMA(8), (float *)VMA(9));
-
-	case G_G2_GETBOLT_NOREC_NOROT:
-		gG2_GBMNoReconstruct = qtrue;
-		gG2_GBMUseSPMethod = qtrue;
-		return G2API_GetBoltMatrix(GhoulHandle(args[1]), args[2], args[3], (mdxaBone_t *)VMA(4), (const float *)VMA(5), (const float *)VMA(6), args[7], (qhandle_t *)VMA(8), (float *)VMA(9));
-
-	case G_G2_INITGHOUL2MODEL:
-		RicksCrazyOnServer=true;
+GAME_TRAP( BOTLIB_AI_GET_TOP_GOAL ) {
+	return botlib_export->ai.BotGetTopGoal( args[1], (struct bot_goal_s *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_GET_SECOND_GOAL ) {
+	return botlib_export->ai.BotGetSecondGoal( args[1], (struct bot_goal_s *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_CHOOSE_LTG_ITEM ) {
+	return botlib_export->ai.BotChooseLTGItem( args[1], (float *)VMA(2), (int *)VMA(3), args[4] );
+}
+
+GAME_TRAP( BOTLIB_AI_CHOOSE_NBG_ITEM ) {
+	return botlib_export->ai.BotChooseNBGItem( args[1], (float *)VMA(2), (int *)VMA(3), args[4], (struct bot_goal_s *)VMA(5), VMF(6) );
+}
+
+GAME_TRAP( BOTLIB_AI_TOUCHING_GOAL ) {
+	return botlib_export->ai.BotTouchingGoal( (float *)VMA(1), (struct bot_goal_s *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_ITEM_GOAL_IN_VIS_BUT_NOT_VISIBLE ) {
+	return botlib_export->ai.BotItemGoalInVisButNotVisible( args[1], (float *)VMA(2), (float *)VMA(3), (struct bot_goal_s *)VMA(4) );
+}
+
+GAME_TRAP( BOTLIB_AI_GET_LEVEL_ITEM_GOAL ) {
+	return botlib_export->ai.BotGetLevelItemGoal( args[1], (char *)VMA(2), (struct bot_goal_s *)VMA(3) );
+}
+
+GAME_TRAP( BOTLIB_AI_GET_NEXT_CAMP_SPOT_GOAL ) {
+	return botlib_export->ai.BotGetNextCampSpotGoal( args[1], (struct bot_goal_s *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_GET_MAP_LOCATION_GOAL ) {
+	return botlib_export->ai.BotGetMapLocationGoal( (char *)VMA(1), (struct bot_goal_s *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_AVOID_GOAL_TIME ) {
+	return FloatAsInt( botlib_export->ai.BotAvoidGoalTime( args[1], args[2] ) );
+}
+
+GAME_TRAP( BOTLIB_AI_SET_AVOID_GOAL_TIME ) {
+	botlib_export->ai.BotSetAvoidGoalTime( args[1], args[2], VMF(3));
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_INIT_LEVEL_ITEMS ) {
+	botlib_export->ai.BotInitLevelItems();
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_UPDATE_ENTITY_ITEMS ) {
+	botlib_export->ai.BotUpdateEntityItems();
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_LOAD_ITEM_WEIGHTS ) {
+	return botlib_export->ai.BotLoadItemWeights( args[1], (char *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_FREE_ITEM_WEIGHTS ) {
+	botlib_export->ai.BotFreeItemWeights( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_INTERBREED_GOAL_FUZZY_LOGIC ) {
+	botlib_export->ai.BotInterbreedGoalFuzzyLogic( args[1], args[2], args[3] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_SAVE_GOAL_FUZZY_LOGIC ) {
+	botlib_export->ai.BotSaveGoalFuzzyLogic( args[1], (char *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_MUTATE_GOAL_FUZZY_LOGIC ) {
+	botlib_export->ai.BotMutateGoalFuzzyLogic( args[1], VMF(2) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_ALLOC_GOAL_STATE ) {
+	return botlib_export->ai.BotAllocGoalState( args[1] );
+}
+
+GAME_TRAP( BOTLIB_AI_FREE_GOAL_STATE ) {
+	botlib_export->ai.BotFreeGoalState( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_RESET_MOVE_STATE ) {
+	botlib_export->ai.BotResetMoveState( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_ADD_AVOID_SPOT ) {
+	botlib_export->ai.BotAddAvoidSpot( args[1], (float *)VMA(2), VMF(3), args[4] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_MOVE_TO_GOAL ) {
+	botlib_export->ai.BotMoveToGoal( (struct bot_moveresult_s *)VMA(1), args[2], (struct bot_goal_s *)VMA(3), args[4] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_MOVE_IN_DIRECTION ) {
+	return botlib_export->ai.BotMoveInDirection( args[1], (float *)VMA(2), VMF(3), args[4] );
+}
+
+GAME_TRAP( BOTLIB_AI_RESET_AVOID_REACH ) {
+	botlib_export->ai.BotResetAvoidReach( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_RESET_LAST_AVOID_REACH ) {
+	botlib_export->ai.BotResetLastAvoidReach( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_REACHABILITY_AREA ) {
+	return botlib_export->ai.BotReachabilityArea( (float *)VMA(1), args[2] );
+}
+
+GAME_TRAP( BOTLIB_AI_MOVEMENT_VIEW_TARGET ) {
+	return botlib_export->ai.BotMovementViewTarget( args[1], (struct bot_goal_s *)VMA(2), args[3], VMF(4), (float *)VMA(5) );
+}
+
+GAME_TRAP( BOTLIB_AI_PREDICT_VISIBLE_POSITION ) {
+	return botlib_export->ai.BotPredictVisiblePosition( (float *)VMA(1), args[2], (struct bot_goal_s *)VMA(3), args[4], (float *)VMA(5) );
+}
+
+GAME_TRAP( BOTLIB_AI_ALLOC_MOVE_STATE ) {
+	return botlib_export->ai.BotAllocMoveState();
+}
+
+GAME_TRAP( BOTLIB_AI_FREE_MOVE_STATE ) {
+	botlib_export->ai.BotFreeMoveState( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_INIT_MOVE_STATE ) {
+	botlib_export->ai.BotInitMoveState( args[1], (struct bot_initmove_s *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_CHOOSE_BEST_FIGHT_WEAPON ) {
+	return botlib_export->ai.BotChooseBestFightWeapon( args[1], (int *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_GET_WEAPON_INFO ) {
+	botlib_export->ai.BotGetWeaponInfo( args[1], args[2], (struct weaponinfo_s *)VMA(3) );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_LOAD_WEAPON_WEIGHTS ) {
+	return botlib_export->ai.BotLoadWeaponWeights( args[1], (char *)VMA(2) );
+}
+
+GAME_TRAP( BOTLIB_AI_ALLOC_WEAPON_STATE ) {
+	return botlib_export->ai.BotAllocWeaponState();
+}
+
+GAME_TRAP( BOTLIB_AI_FREE_WEAPON_STATE ) {
+	botlib_export->ai.BotFreeWeaponState( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_RESET_WEAPON_STATE ) {
+	botlib_export->ai.BotResetWeaponState( args[1] );
+	return 0;
+}
+
+GAME_TRAP( BOTLIB_AI_GENETIC_PARENTS_AND_CHILD_SELECTION ) {
+	return botlib_export->ai.GeneticParentsAndChildSelection(args[1], (float *)VMA(2), (int *)VMA(3), (int *)VMA(4), (int *)VMA(5));
+}
+
+GAME_TRAP( TRAP_MEMSET ) {
+	Com_Memset( VMA(1), args[2], args[3] );
+	return 0;
+}
+
+GAME_TRAP( TRAP_MEMCPY ) {
+	Com_Memcpy( VMA(1), VMA(2), args[3] );
+	return 0;
+}
+
+GAME_TRAP( TRAP_STRNCPY ) {
+	return (intptr_t)strncpy( (char *)VMA(1), (const char *)VMA(2), args[3] );
+}
+
+GAME_TRAP( TRAP_SIN ) {
+	return FloatAsInt( sin( VMF(1) ) );
+}
+
+GAME_TRAP( TRAP_COS ) {
+	return FloatAsInt( cos( VMF(1) ) );
+}
+
+GAME_TRAP( TRAP_ATAN2 ) {
+	return FloatAsInt( atan2( VMF(1), VMF(2) ) );
+}
+
+GAME_TRAP( TRAP_SQRT ) {
+	return FloatAsInt( sqrt( VMF(1) ) );
+}
+
+GAME_TRAP( TRAP_MATRIXMULTIPLY ) {
+	MatrixMultiply( (vec3_t *)VMA(1), (vec3_t *)VMA(2), (vec3_t *)VMA(3) );
+	return 0;
+}
+
+GAME_TRAP( TRAP_ANGLEVECTORS ) {
+	AngleVectors( (const float *)VMA(1), (float *)VMA(2), (float *)VMA(3), (float *)VMA(4) );
+	return 0;
+}
+
+GAME_TRAP( TRAP_PERPENDICULARVECTOR ) {
+	PerpendicularVector( (float *)VMA(1), (const float *)VMA(2) );
+	return 0;
+}
+
+GAME_TRAP( TRAP_FLOOR ) {
+	return FloatAsInt( floor( VMF(1) ) );
+}
+
+GAME_TRAP( TRAP_CEIL ) {
+	return FloatAsInt( ceil( VMF(1) ) );
+}
+
+GAME_TRAP( G_G2_LISTBONES ) {
+	G2API_ListBones( (CGhoul2Info *) VMA(1), args[2]);
+	return 0;
+}
+
+GAME_TRAP( G_G2_LISTSURFACES ) {
+	G2API_ListSurfaces( (CGhoul2Info *) args[1] );
+	return 0;
+}
+
+GAME_TRAP( G_G2_HAVEWEGHOULMODELS ) {
+	return G2API_HaveWeGhoul2Models(GhoulHandle(args[1]));
+}
+
+GAME_TRAP( G_G2_SETMODELS ) {
+	G2API_SetGhoul2ModelIndexes(GhoulHandle(args[1]), (qhandle_t *)VMA(2), (qhandle_t *)VMA(3));
+	return 0;
+}
+
+GAME_TRAP( G_G2_GETBOLT ) {
+	return G2API_GetBoltMatrix(GhoulHandle(args[1]), args[2], args[3], (mdxaBone_t *)VMA(4), (const float *)VMA(5), (const float *)VMA(6), args[7], (qhandle_t *)VMA(8), (float *)VMA(9));
+}
+
+GAME_TRAP( G_G2_GETBOLT_NOREC ) {
+	gG2_GBMNoReconstruct = qtrue;
+	return G2API_GetBoltMatrix(GhoulHandle(args[1]), args[2], args[3], (mdxaBone_t *)VMA(4), (const float *)VMA(5), (const float *)VMA(6), args[7], (qhandle_t *)VMA(8), (float *)VMA(9));
+}
+
+GAME_TRAP( G_G2_GETBOLT_NOREC_NOROT ) {
+	gG2_GBMNoReconstruct = qtrue;
+	gG2_GBMUseSPMethod = qtrue;
+	return G2API_GetBoltMatrix(GhoulHandle(args[1]), args[2], args[3], (mdxaBone_t *)VMA(4), (const float *)VMA(5), (const float *)VMA(6), args[7], (qhandle_t *)VMA(8), (float *)VMA(9));
+}
+
+GAME_TRAP( G_G2_INITGHOUL2MODEL ) {
+	RicksCrazyOnServer=true;
 #if id386
-		return	G2API_InitGhoul2Model((CGhoul2Info_v **)VMA(1), (const char *)VMA(2), args[3], (qhandle_t)args[4],
-			(qhandle_t)args[5], args[6], args[7]);
+	return	G2API_InitGhoul2Model((CGhoul2Info_v **)VMA(1), (const char *)VMA(2), args[3], (qhandle_t)args[4],
+		(qhandle_t)args[5], args[6], args[7]);
 #else
-		return	G2API_VM_InitGhoul2Model((qhandle_t *)VMA(1), (const char *)VMA(2), args[3], (qhandle_t)args[4],
-			(qhandle_t)args[5], args[6], args[7]);
+	return	G2API_VM_InitGhoul2Model((qhandle_t *)VMA(1), (const char *)VMA(2), args[3], (qhandle_t)args[4],
+		(qhandle_t)args[5], args[6], args[7]);
 #endif
+}
 
-	case G_G2_ADDBOLT:
-		return	G2API_AddBolt(GhoulHandle(args[1]), args[2], (const char *)VMA(3));
-
-	case G_G2_SETBOLTINFO:
-		G2API_SetBoltInfo(GhoulHandle(args[1]), args[2], args[3]);
-		return 0;
-
-	case G_G2_ANGLEOVERRIDE:
-		return G2API_SetBoneAngles(GhoulHandle(args[1]), args[2], (const char *)VMA(3), (float *)VMA(4), args[5],
-			(const Eorientations)args[6], (const Eorientations)args[7], (const Eorientations)args[8],
-			(qhandle_t *)VMA(9), args[10], args[11]);
-
-	case G_G2_PLAYANIM:
-		return G2API_SetBoneAnim(GhoulHandle(args[1]), args[2], (const char *)VMA(3), args[4], args[5],
-								args[6], VMF(7), args[8], VMF(9), args[10]);
-
-	case G_G2_GETGLANAME:
-		//return (int)G2API_GetGLAName(*((CGhoul2Info_v *)args[1]), args[2]);
-		{ //Since returning a pointer in such a way to a VM seems to cause MASSIVE FAILURE<tm>, we will shove data into the pointer the vm passes instead
-			char *point = ((char *)VMA(3));
-			char *local;
-			local = G2API_GetGLAName(GhoulHandle(args[1]), args[2]);
-			if (local)
-			{
-				strcpy(point, local);
-			}
-		}
+GAME_TRAP( G_G2_ADDBOLT ) {
+	return	G2API_AddBolt(GhoulHandle(args[1]), args[2], (const char *)VMA(3));
+}
+
+GAME_TRAP( G_G2_SETBOLTINFO ) {
+	G2API_SetBoltInfo(GhoulHandle(args[1]), args[2], args[3]);
+	return 0;
+}
+
+GAME_TRAP( G_G2_ANGLEOVERRIDE ) {
+	return G2API_SetBoneAngles(GhoulHandle(args[1]), args[2], (const char *)VMA(3), (float *)VMA(4), args[5],
+		(const Eorientations)args[6], (const Eorientations)args[7], (const Eorientations)args[8],
+		(qhandle_t *)VMA(9), args[10], args[11]);
+}
+
+GAME_TRAP( G_G2_PLAYANIM ) {
+	return G2API_SetBoneAnim(GhoulHandle(args[1]), args[2], (const char *)VMA(3), args[4], args[5],
+							args[6], VMF(7), args[8], VMF(9), args[10]);
+}
+
+GAME_TRAP( G_G2_GETGLANAME ) {
+	//return (int)G2API_GetGLAName(*((CGhoul2Info_v *)args[1]), args[2]);
+	//Since returning a pointer in such a way to a VM seems to cause MASSIVE FAILURE<tm>, we will shove data into the pointer the vm passes instead
+	char *point = ((char *)VMA(3));
+	char *local;
+	local = G2API_GetGLAName(GhoulHandle(args[1]), args[2]);
+	if (local)
+	{
+		strcpy(point, local);
+	}
 
-		return 0;
+	return 0;
+}
 
-	case G_G2_COPYGHOUL2INSTANCE:
-		return (int)G2API_CopyGhoul2Instance(GhoulHandle(args[1]), GhoulHandle(args[2]), args[3]);
+GAME_TRAP( G_G2_COPYGHOUL2INSTANCE ) {
+	return (int)G2API_CopyGhoul2Instance(GhoulHandle(args[1]), GhoulHandle(args[2]), args[3]);
+}
 
-	case G_G2_COPYSPECIFICGHOUL2MODEL:
-		G2API_CopySpecificG2Model(GhoulHandle(args[1]), args[2], GhoulHandle(args[3]), args[4]);
-		return 0;
+GAME_TRAP( G_G2_COPYSPECIFICGHOUL2MODEL ) {
+	G2API_CopySpecificG2Model(GhoulHandle(args[1]), args[2], GhoulHandle(args[3]), args[4]);
+	return 0;
+}
 
-	case G_G2_DUPLICATEGHOUL2INSTANCE:
+GAME_TRAP( G_G2_DUPLICATEGHOUL2INSTANCE ) {
 #if id386
-		G2API_DuplicateGhoul2Instance(GhoulHandle(args[1]), (CGhoul2Info_v **)VMA(2));
+	G2API_DuplicateGhoul2Instance(GhoulHandle(args[1]), (CGhoul2Info_v **)VMA(2));
 #else
-		G2API_VM_DuplicateGhoul2Instance(GhoulHandle(args[1]), (qhandle_t *)VMA(2));
+	G2API_VM_DuplicateGhoul2Instance(GhoulHandle(args[1]), (qhandle_t *)VMA(2));
 #endif
-		return 0;
+	return 0;
+}
 
-	case G_G2_HASGHOUL2MODELONINDEX:
+GAME_TRAP( G_G2_HASGHOUL2MODELONINDEX ) {
 #if id386
-		return (int)G2API_HasGhoul2ModelOnIndex((CGhoul2Info_v **)VMA(1), args[2]);
+	return (int)G2API_HasGhoul2ModelOnIndex((CGhoul2Info_v **)VMA(1), args[2]);
 #else
-		{
-			CGhoul2Info_v *ptr = GhoulHandle(*(qhandle_t *)VMA(1));
-			return (int)G2API_HasGhoul2ModelOnIndex(&ptr, args[2]);
-		}
+	{
+		CGhoul2Info_v *ptr = GhoulHandle(*(qhandle_t *)VMA(1));
+		return (int)G2API_HasGhoul2ModelOnIndex(&ptr, args[2]);
+	}
 #endif
+}
 
-	case G_G2_REMOVEGHOUL2MODEL:
+GAME_TRAP( G_G2_REMOVEGHOUL2MODEL ) {
 #if id386
-		return (int)G2API_RemoveGhoul2Model((CGhoul2Info_v **)VMA(1), args[2]);
+	return (int)G2API_RemoveGhoul2Model((CGhoul2Info_v **)VMA(1), args[2]);
 #else
-		return (int)G2API_VM_RemoveGhoul2Model((qhandle_t *)VMA(1), args[2]);
+	return (int)G2API_VM_RemoveGhoul2Model((qhandle_t *)VMA(1), args[2]);
 #endif
+}
 
-	case G_G2_CLEANMODELS:
+GAME_TRAP( G_G2_CLEANMODELS ) {
 #if id386
-		G2API_CleanGhoul2Models((CGhoul2Info_v **)VMA(1));
+	G2API_CleanGhoul2Models((CGhoul2Info_v **)VMA(1));
 #else
-		G2API_VM_CleanGhoul2Models((qhandle_t *)VMA(1));
+	G2API_VM_CleanGhoul2Models((qhandle_t *)VMA(1));
 #endif
-		return 0;
+	return 0;
+}
 
-	case G_G2_COLLISIONDETECT:
+GAME_TRAP( G_G2_COLLISIONDETECT ) {
 #ifdef G2_COLLISION_ENABLED
-		G2API_CollisionDetect((CollisionRecord_t*)VMA(1), GhoulHandle(args[2]),
-			(const float*)VMA(3),
-			(const float*)VMA(4),
-			args[5],
-			args[6],
-			(float*)VMA(7),
-			(float*)VMA(8),
-			(float*)VMA(9),
-			G2VertSpaceServer,
-			args[10],
-			args[11],
-			VMF(12));
+	G2API_CollisionDetect((CollisionRecord_t*)VMA(1), GhoulHandle(args[2]),
+		(const float*)VMA(3),
+		(const float*)VMA(4),
+		args[5],
+		args[6],
+		(float*)VMA(7),
+		(float*)VMA(8),
+		(float*)VMA(9),
+		G2VertSpaceServer,
+		args[10],
+		args[11],
+		VMF(12));
 #endif
-		return 0;
+	return 0;
+}
+
+GAME_TRAP( MVAPI_GET_CONNECTIONLESSPACKET ) {
+	return (int)MVAPI_GetConnectionlessPacket((mvaddr_t *)VMA(1), (char*)VMA(2), (unsigned int)args[3]);
+}
+
+GAME_TRAP( MVAPI_SEND_CONNECTIONLESSPACKET ) {
+	return (int)MVAPI_SendConnectionlessPacket((const mvaddr_t *)VMA(1), (const char*)VMA(2));
+}
+
+GAME_TRAP( MVAPI_CONTROL_FIXES ) {
+	return (int)SV_MVAPI_ControlFixes((mvfix_t)args[1]);
+}
+
+GAME_TRAP( MVAPI_GET_VERSION ) {
+	return (int)MV_GetCurrentGameversion();
+}
+
+GAME_TRAP( MVAPI_DISABLE_STRUCT_CONVERSION ) {
+	return (int)MVAPI_DisableStructConversion((qboolean)args[1]);
+}
+
+GAME_TRAP( MVAPI_TRACE_BATCH ) {
+	return (int)MVAPI_TraceBatch(args[1], args[2], args[3]);
+}
+
+//====================================
+
+typedef struct {
+	int			num;
+	const char	*name;
+	gameTrap_t	func;
+} gameTrapDef_t;
+
+#define GAME_TRAP_DEF( num )	{ num, #num, SV_Trap_##num }
+
+static const gameTrapDef_t gameTrapDefs[] = {
+	GAME_TRAP_DEF( G_PRINT ),
+	GAME_TRAP_DEF( G_ERROR ),
+	GAME_TRAP_DEF( G_MILLISECONDS ),
+	GAME_TRAP_DEF( G_CVAR_REGISTER ),
+	GAME_TRAP_DEF( G_CVAR_UPDATE ),
+	GAME_TRAP_DEF( G_CVAR_SET ),
+	GAME_TRAP_DEF( G_CVAR_VARIABLE_INTEGER_VALUE ),
+	GAME_TRAP_DEF( G_CVAR_VARIABLE_STRING_BUFFER ),
+	GAME_TRAP_DEF( G_ARGC ),
+	GAME_TRAP_DEF( G_ARGV ),
+	GAME_TRAP_DEF( G_SEND_CONSOLE_COMMAND ),
+	GAME_TRAP_DEF( G_FS_FOPEN_FILE ),
+	GAME_TRAP_DEF( G_FS_READ ),
+	GAME_TRAP_DEF( G_FS_WRITE ),
+	GAME_TRAP_DEF( G_FS_FCLOSE_FILE ),
+	GAME_TRAP_DEF( G_FS_GETFILELIST ),
+	GAME_TRAP_DEF( G_LOCATE_GAME_DATA ),
+	GAME_TRAP_DEF( MVAPI_LOCATE_GAME_DATA ),
+	GAME_TRAP_DEF( G_DROP_CLIENT ),
+	GAME_TRAP_DEF( G_SEND_SERVER_COMMAND ),
+	GAME_TRAP_DEF( G_LINKENTITY ),
+	GAME_TRAP_DEF( G_UNLINKENTITY ),
+	GAME_TRAP_DEF( G_ENTITIES_IN_BOX ),
+	GAME_TRAP_DEF( G_ENTITY_CONTACT ),
+	GAME_TRAP_DEF( G_ENTITY_CONTACTCAPSULE ),
+	GAME_TRAP_DEF( G_TRACE ),
+	GAME_TRAP_DEF( G_TRACECAPSULE ),
+	GAME_TRAP_DEF( G_POINT_CONTENTS ),
+	GAME_TRAP_DEF( G_SET_BRUSH_MODEL ),
+	GAME_TRAP_DEF( G_IN_PVS ),
+	GAME_TRAP_DEF( G_IN_PVS_IGNORE_PORTALS ),
+	GAME_TRAP_DEF( G_SET_CONFIGSTRING ),
+	GAME_TRAP_DEF( G_GET_CONFIGSTRING ),
+	GAME_TRAP_DEF( G_SET_USERINFO ),
+	GAME_TRAP_DEF( G_GET_USERINFO ),
+	GAME_TRAP_DEF( G_GET_SERVERINFO ),
+	GAME_TRAP_DEF( G_ADJUST_AREA_PORTAL_STATE ),
+	GAME_TRAP_DEF( G_AREAS_CONNECTED ),
+	GAME_TRAP_DEF( G_BOT_ALLOCATE_CLIENT ),
+	GAME_TRAP_DEF( G_BOT_FREE_CLIENT ),
+	GAME_TRAP_DEF( G_GET_USERCMD ),
+	GAME_TRAP_DEF( G_GET_ENTITY_TOKEN ),
+	GAME_TRAP_DEF( G_DEBUG_POLYGON_CREATE ),
+	GAME_TRAP_DEF( G_DEBUG_POLYGON_DELETE ),
+	GAME_TRAP_DEF( G_REAL_TIME ),
+	GAME_TRAP_DEF( G_SNAPVECTOR ),
+	GAME_TRAP_DEF( SP_REGISTER_SERVER_CMD ),
+	GAME_TRAP_DEF( SP_GETSTRINGTEXTSTRING ),
+	GAME_TRAP_DEF( G_ROFF_CLEAN ),
+	GAME_TRAP_DEF( G_ROFF_UPDATE_ENTITIES ),
+	GAME_TRAP_DEF( G_ROFF_CACHE ),
+	GAME_TRAP_DEF( G_ROFF_PLAY ),
+	GAME_TRAP_DEF( G_ROFF_PURGE_ENT ),
+	GAME_TRAP_DEF( BOTLIB_SETUP ),
+	GAME_TRAP_DEF( BOTLIB_SHUTDOWN ),
+	GAME_TRAP_DEF( BOTLIB_LIBVAR_SET ),
+	GAME_TRAP_DEF( BOTLIB_LIBVAR_GET ),
+	GAME_TRAP_DEF( BOTLIB_PC_ADD_GLOBAL_DEFINE ),
+	GAME_TRAP_DEF( BOTLIB_PC_LOAD_SOURCE ),
+	GAME_TRAP_DEF( BOTLIB_PC_FREE_SOURCE ),
+	GAME_TRAP_DEF( BOTLIB_PC_READ_TOKEN ),
+	GAME_TRAP_DEF( BOTLIB_PC_SOURCE_FILE_AND_LINE ),
+	GAME_TRAP_DEF( BOTLIB_START_FRAME ),
+	GAME_TRAP_DEF( BOTLIB_LOAD_MAP ),
+	GAME_TRAP_DEF( BOTLIB_UPDATENTITY ),
+	GAME_TRAP_DEF( BOTLIB_TEST ),
+	GAME_TRAP_DEF( BOTLIB_GET_SNAPSHOT_ENTITY ),
+	GAME_TRAP_DEF( BOTLIB_GET_CONSOLE_MESSAGE ),
+	GAME_TRAP_DEF( BOTLIB_USER_COMMAND ),
+	GAME_TRAP_DEF( BOTLIB_AAS_BBOX_AREAS ),
+	GAME_TRAP_DEF( BOTLIB_AAS_AREA_INFO ),
+	GAME_TRAP_DEF( BOTLIB_AAS_ALTERNATIVE_ROUTE_GOAL ),
+	GAME_TRAP_DEF( BOTLIB_AAS_ENTITY_INFO ),
+	GAME_TRAP_DEF( BOTLIB_AAS_INITIALIZED ),
+	GAME_TRAP_DEF( BOTLIB_AAS_PRESENCE_TYPE_BOUNDING_BOX ),
+	GAME_TRAP_DEF( BOTLIB_AAS_TIME ),
+	GAME_TRAP_DEF( BOTLIB_AAS_POINT_AREA_NUM ),
+	GAME_TRAP_DEF( BOTLIB_AAS_POINT_REACHABILITY_AREA_INDEX ),
+	GAME_TRAP_DEF( BOTLIB_AAS_TRACE_AREAS ),
+	GAME_TRAP_DEF( BOTLIB_AAS_POINT_CONTENTS ),
+	GAME_TRAP_DEF( BOTLIB_AAS_NEXT_BSP_ENTITY ),
+	GAME_TRAP_DEF( BOTLIB_AAS_VALUE_FOR_BSP_EPAIR_KEY ),
+	GAME_TRAP_DEF( BOTLIB_AAS_VECTOR_FOR_BSP_EPAIR_KEY ),
+	GAME_TRAP_DEF( BOTLIB_AAS_FLOAT_FOR_BSP_EPAIR_KEY ),
+	GAME_TRAP_DEF( BOTLIB_AAS_INT_FOR_BSP_EPAIR_KEY ),
+	GAME_TRAP_DEF( BOTLIB_AAS_AREA_REACHABILITY ),
+	GAME_TRAP_DEF( BOTLIB_AAS_AREA_TRAVEL_TIME_TO_GOAL_AREA ),
+	GAME_TRAP_DEF( BOTLIB_AAS_ENABLE_ROUTING_AREA ),
+	GAME_TRAP_DEF( BOTLIB_AAS_PREDICT_ROUTE ),
+	GAME_TRAP_DEF( BOTLIB_AAS_SWIMMING ),
+	GAME_TRAP_DEF( BOTLIB_AAS_PREDICT_CLIENT_MOVEMENT ),
+	GAME_TRAP_DEF( BOTLIB_EA_SAY ),
+	GAME_TRAP_DEF( BOTLIB_EA_SAY_TEAM ),
+	GAME_TRAP_DEF( BOTLIB_EA_COMMAND ),
+	GAME_TRAP_DEF( BOTLIB_EA_ACTION ),
+	GAME_TRAP_DEF( BOTLIB_EA_GESTURE ),
+	GAME_TRAP_DEF( BOTLIB_EA_TALK ),
+	GAME_TRAP_DEF( BOTLIB_EA_ATTACK ),
+	GAME_TRAP_DEF( BOTLIB_EA_ALT_ATTACK ),
+	GAME_TRAP_DEF( BOTLIB_EA_FORCEPOWER ),
+	GAME_TRAP_DEF( BOTLIB_EA_USE ),
+	GAME_TRAP_DEF( BOTLIB_EA_RESPAWN ),
+	GAME_TRAP_DEF( BOTLIB_EA_CROUCH ),
+	GAME_TRAP_DEF( BOTLIB_EA_MOVE_UP ),
+	GAME_TRAP_DEF( BOTLIB_EA_MOVE_DOWN ),
+	GAME_TRAP_DEF( BOTLIB_EA_MOVE_FORWARD ),
+	GAME_TRAP_DEF( BOTLIB_EA_MOVE_BACK ),
+	GAME_TRAP_DEF( BOTLIB_EA_MOVE_LEFT ),
+	GAME_TRAP_DEF( BOTLIB_EA_MOVE_RIGHT ),
+	GAME_TRAP_DEF( BOTLIB_EA_SELECT_WEAPON ),
+	GAME_TRAP_DEF( BOTLIB_EA_JUMP ),
+	GAME_TRAP_DEF( BOTLIB_EA_DELAYED_JUMP ),
+	GAME_TRAP_DEF( BOTLIB_EA_MOVE ),
+	GAME_TRAP_DEF( BOTLIB_EA_VIEW ),
+	GAME_TRAP_DEF( BOTLIB_EA_END_REGULAR ),
+	GAME_TRAP_DEF( BOTLIB_EA_GET_INPUT ),
+	GAME_TRAP_DEF( BOTLIB_EA_RESET_INPUT ),
+	GAME_TRAP_DEF( BOTLIB_AI_LOAD_CHARACTER ),
+	GAME_TRAP_DEF( BOTLIB_AI_FREE_CHARACTER ),
+	GAME_TRAP_DEF( BOTLIB_AI_CHARACTERISTIC_FLOAT ),
+	GAME_TRAP_DEF( BOTLIB_AI_CHARACTERISTIC_BFLOAT ),
+	GAME_TRAP_DEF( BOTLIB_AI_CHARACTERISTIC_INTEGER ),
+	GAME_TRAP_DEF( BOTLIB_AI_CHARACTERISTIC_BINTEGER ),
+	GAME_TRAP_DEF( BOTLIB_AI_CHARACTERISTIC_STRING ),
+	GAME_TRAP_DEF( BOTLIB_AI_ALLOC_CHAT_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_FREE_CHAT_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_QUEUE_CONSOLE_MESSAGE ),
+	GAME_TRAP_DEF( BOTLIB_AI_REMOVE_CONSOLE_MESSAGE ),
+	GAME_TRAP_DEF( BOTLIB_AI_NEXT_CONSOLE_MESSAGE ),
+	GAME_TRAP_DEF( BOTLIB_AI_NUM_CONSOLE_MESSAGE ),
+	GAME_TRAP_DEF( BOTLIB_AI_INITIAL_CHAT ),
+	GAME_TRAP_DEF( BOTLIB_AI_NUM_INITIAL_CHATS ),
+	GAME_TRAP_DEF( BOTLIB_AI_REPLY_CHAT ),
+	GAME_TRAP_DEF( BOTLIB_AI_CHAT_LENGTH ),
+	GAME_TRAP_DEF( BOTLIB_AI_ENTER_CHAT ),
+	GAME_TRAP_DEF( BOTLIB_AI_GET_CHAT_MESSAGE ),
+	GAME_TRAP_DEF( BOTLIB_AI_STRING_CONTAINS ),
+	GAME_TRAP_DEF( BOTLIB_AI_FIND_MATCH ),
+	GAME_TRAP_DEF( BOTLIB_AI_MATCH_VARIABLE ),
+	GAME_TRAP_DEF( BOTLIB_AI_UNIFY_WHITE_SPACES ),
+	GAME_TRAP_DEF( BOTLIB_AI_REPLACE_SYNONYMS ),
+	GAME_TRAP_DEF( BOTLIB_AI_LOAD_CHAT_FILE ),
+	GAME_TRAP_DEF( BOTLIB_AI_SET_CHAT_GENDER ),
+	GAME_TRAP_DEF( BOTLIB_AI_SET_CHAT_NAME ),
+	GAME_TRAP_DEF( BOTLIB_AI_RESET_GOAL_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_RESET_AVOID_GOALS ),
+	GAME_TRAP_DEF( BOTLIB_AI_REMOVE_FROM_AVOID_GOALS ),
+	GAME_TRAP_DEF( BOTLIB_AI_PUSH_GOAL ),
+	GAME_TRAP_DEF( BOTLIB_AI_POP_GOAL ),
+	GAME_TRAP_DEF( BOTLIB_AI_EMPTY_GOAL_STACK ),
+	GAME_TRAP_DEF( BOTLIB_AI_DUMP_AVOID_GOALS ),
+	GAME_TRAP_DEF( BOTLIB_AI_DUMP_GOAL_STACK ),
+	GAME_TRAP_DEF( BOTLIB_AI_GOAL_NAME ),
+	GAME_TRAP_DEF( BOTLIB_AI_GET_TOP_GOAL ),
+	GAME_TRAP_DEF( BOTLIB_AI_GET_SECOND_GOAL ),
+	GAME_TRAP_DEF( BOTLIB_AI_CHOOSE_LTG_ITEM ),
+	GAME_TRAP_DEF( BOTLIB_AI_CHOOSE_NBG_ITEM ),
+	GAME_TRAP_DEF( BOTLIB_AI_TOUCHING_GOAL ),
+	GAME_TRAP_DEF( BOTLIB_AI_ITEM_GOAL_IN_VIS_BUT_NOT_VISIBLE ),
+	GAME_TRAP_DEF( BOTLIB_AI_GET_LEVEL_ITEM_GOAL ),
+	GAME_TRAP_DEF( BOTLIB_AI_GET_NEXT_CAMP_SPOT_GOAL ),
+	GAME_TRAP_DEF( BOTLIB_AI_GET_MAP_LOCATION_GOAL ),
+	GAME_TRAP_DEF( BOTLIB_AI_AVOID_GOAL_TIME ),
+	GAME_TRAP_DEF( BOTLIB_AI_SET_AVOID_GOAL_TIME ),
+	GAME_TRAP_DEF( BOTLIB_AI_INIT_LEVEL_ITEMS ),
+	GAME_TRAP_DEF( BOTLIB_AI_UPDATE_ENTITY_ITEMS ),
+	GAME_TRAP_DEF( BOTLIB_AI_LOAD_ITEM_WEIGHTS ),
+	GAME_TRAP_DEF( BOTLIB_AI_FREE_ITEM_WEIGHTS ),
+	GAME_TRAP_DEF( BOTLIB_AI_INTERBREED_GOAL_FUZZY_LOGIC ),
+	GAME_TRAP_DEF( BOTLIB_AI_SAVE_GOAL_FUZZY_LOGIC ),
+	GAME_TRAP_DEF( BOTLIB_AI_MUTATE_GOAL_FUZZY_LOGIC ),
+	GAME_TRAP_DEF( BOTLIB_AI_ALLOC_GOAL_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_FREE_GOAL_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_RESET_MOVE_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_ADD_AVOID_SPOT ),
+	GAME_TRAP_DEF( BOTLIB_AI_MOVE_TO_GOAL ),
+	GAME_TRAP_DEF( BOTLIB_AI_MOVE_IN_DIRECTION ),
+	GAME_TRAP_DEF( BOTLIB_AI_RESET_AVOID_REACH ),
+	GAME_TRAP_DEF( BOTLIB_AI_RESET_LAST_AVOID_REACH ),
+	GAME_TRAP_DEF( BOTLIB_AI_REACHABILITY_AREA ),
+	GAME_TRAP_DEF( BOTLIB_AI_MOVEMENT_VIEW_TARGET ),
+	GAME_TRAP_DEF( BOTLIB_AI_PREDICT_VISIBLE_POSITION ),
+	GAME_TRAP_DEF( BOTLIB_AI_ALLOC_MOVE_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_FREE_MOVE_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_INIT_MOVE_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_CHOOSE_BEST_FIGHT_WEAPON ),
+	GAME_TRAP_DEF( BOTLIB_AI_GET_WEAPON_INFO ),
+	GAME_TRAP_DEF( BOTLIB_AI_LOAD_WEAPON_WEIGHTS ),
+	GAME_TRAP_DEF( BOTLIB_AI_ALLOC_WEAPON_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_FREE_WEAPON_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_RESET_WEAPON_STATE ),
+	GAME_TRAP_DEF( BOTLIB_AI_GENETIC_PARENTS_AND_CHILD_SELECTION ),
+	GAME_TRAP_DEF( TRAP_MEMSET ),
+	GAME_TRAP_DEF( TRAP_MEMCPY ),
+	GAME_TRAP_DEF( TRAP_STRNCPY ),
+	GAME_TRAP_DEF( TRAP_SIN ),
+	GAME_TRAP_DEF( TRAP_COS ),
+	GAME_TRAP_DEF( TRAP_ATAN2 ),
+	GAME_TRAP_DEF( TRAP_SQRT ),
+	GAME_TRAP_DEF( TRAP_MATRIXMULTIPLY ),
+	GAME_TRAP_DEF( TRAP_ANGLEVECTORS ),
+	GAME_TRAP_DEF( TRAP_PERPENDICULARVECTOR ),
+	GAME_TRAP_DEF( TRAP_FLOOR ),
+	GAME_TRAP_DEF( TRAP_CEIL ),
+	GAME_TRAP_DEF( G_G2_LISTBONES ),
+	GAME_TRAP_DEF( G_G2_LISTSURFACES ),
+	GAME_TRAP_DEF( G_G2_HAVEWEGHOULMODELS ),
+	GAME_TRAP_DEF( G_G2_SETMODELS ),
+	GAME_TRAP_DEF( G_G2_GETBOLT ),
+	GAME_TRAP_DEF( G_G2_GETBOLT_NOREC ),
+	GAME_TRAP_DEF( G_G2_GETBOLT_NOREC_NOROT ),
+	GAME_TRAP_DEF( G_G2_INITGHOUL2MODEL ),
+	GAME_TRAP_DEF( G_G2_ADDBOLT ),
+	GAME_TRAP_DEF( G_G2_SETBOLTINFO ),
+	GAME_TRAP_DEF( G_G2_ANGLEOVERRIDE ),
+	GAME_TRAP_DEF( G_G2_PLAYANIM ),
+	GAME_TRAP_DEF( G_G2_GETGLANAME ),
+	GAME_TRAP_DEF( G_G2_COPYGHOUL2INSTANCE ),
+	GAME_TRAP_DEF( G_G2_COPYSPECIFICGHOUL2MODEL ),
+	GAME_TRAP_DEF( G_G2_DUPLICATEGHOUL2INSTANCE ),
+	GAME_TRAP_DEF( G_G2_HASGHOUL2MODELONINDEX ),
+	GAME_TRAP_DEF( G_G2_REMOVEGHOUL2MODEL ),
+	GAME_TRAP_DEF( G_G2_CLEANMODELS ),
+	GAME_TRAP_DEF( G_G2_COLLISIONDETECT ),
+	GAME_TRAP_DEF( MVAPI_GET_CONNECTIONLESSPACKET ),
+	GAME_TRAP_DEF( MVAPI_SEND_CONNECTIONLESSPACKET ),
+	GAME_TRAP_DEF( MVAPI_CONTROL_FIXES ),
+	GAME_TRAP_DEF( MVAPI_GET_VERSION ),
+	GAME_TRAP_DEF( MVAPI_DISABLE_STRUCT_CONVERSION ),
+	GAME_TRAP_DEF( MVAPI_TRACE_BATCH ),
+};
+
+#define	MAX_GAME_TRAPS	1024
+
+typedef struct {
+	int64_t		calls;
+	int64_t		time;			// nanoseconds, including nested traps
+} gameTrapStats_t;
+
+static gameTrap_t		gameTraps[MAX_GAME_TRAPS];
+static const char		*gameTrapNames[MAX_GAME_TRAPS];
+static gameTrapStats_t	gameTrapStats[MAX_GAME_TRAPS];
+
+/*
+====================
+SV_InitGameTraps
+====================
+*/
+static void SV_InitGameTraps( void ) {
+	const gameTrapDef_t	*def;
+	int					i;
+
+	Com_Memset( gameTraps, 0, sizeof( gameTraps ) );
+	for ( i = 0 ; i < (int)ARRAY_LEN( gameTrapDefs ) ; i++ ) {
+		def = &gameTrapDefs[i];
+		if ( def->num < 0 || def->num >= MAX_GAME_TRAPS || gameTraps[def->num] ) {
+			Com_Error( ERR_FATAL, "SV_InitGameTraps: bad trap number %i for %s", def->num, def->name );
+		}
+		gameTraps[def->num] = def->func;
+		gameTrapNames[def->num] = def->name;
+	}
+}
+
+/*
+====================
+SV_GameSystemCalls
+
+The module is making a system call
+====================
+*/
+intptr_t SV_GameSystemCalls( intptr_t *args ) {
+	intptr_t	num;
+	int64_t		start;
+	intptr_t	ret;
+
+	// fix syscalls from 1.02 to match 1.04
+	// this is a mess... can it be done better?
+	if (MV_GetCurrentGameversion() == VERSION_1_02) {
+		if (args[0] > G_G2_GETBOLT_NOREC && args[0] <= G_G2_COLLISIONDETECT) {
+			args[0]++;
+		}
+	}
+
+	num = args[0];
+	if ( num < 0 || num >= MAX_GAME_TRAPS || !gameTraps[num] ) {
+		Com_Error( ERR_DROP, "Bad game system trap: %i", (int)num );
+	}
+
+	if ( !sv_syscallStats->integer ) {
+		return gameTraps[num]( args );
+	}
+
+	start = Sys_Nanoseconds();
+	ret = gameTraps[num]( args );
+	gameTrapStats[num].calls++;
+	gameTrapStats[num].time += Sys_Nanoseconds() - start;
+
+	return ret;
+}
+
+/*
+====================
+SV_CompareTrapTime
+====================
+*/
+static int SV_CompareTrapTime( const void *a, const void *b ) {
+	int64_t	ta, tb;
+
+	ta = gameTrapStats[*(const int *)a].time;
+	tb = gameTrapStats[*(const int *)b].time;
+
+	return ( ta < tb ) - ( ta > tb );
+}
 
-	case MVAPI_GET_CONNECTIONLESSPACKET:
-		return (int)MVAPI_GetConnectionlessPacket((mvaddr_t *)VMA(1), (char*)VMA(2), (unsigned int)args[3]);
+/*
+====================
+SV_SyscallStats_f
+
+syscallstats [reset]
+====================
+*/
+void SV_SyscallStats_f( void ) {
+	int		order[MAX_GAME_TRAPS];
+	int		count;
+	int64_t	calls, time;
+	int		i;
 
-	case MVAPI_SEND_CONNECTIONLESSPACKET:
-		return (int)MVAPI_SendConnectionlessPacket((const mvaddr_t *)VMA(1), (const char*)VMA(2));
+	count = 0;
+	for ( i = 0 ; i < MAX_GAME_TRAPS ; i++ ) {
+		if ( gameTrapStats[i].calls ) {
+			order[count++] = i;
+		}
+	}
 
-	case MVAPI_CONTROL_FIXES:
-		return (int)SV_MVAPI_ControlFixes((mvfix_t)args[1]);
+	if ( !count ) {
+		Com_Printf( "No game system calls recorded%s.\n", sv_syscallStats->integer ? "" : ", set sv_syscallStats 1" );
+		return;
+	}
 
-	case MVAPI_GET_VERSION:
-		return (int)MV_GetCurrentGameversion();
+	qsort( order, count, sizeof( order[0] ), SV_CompareTrapTime );
 
-	case MVAPI_DISABLE_STRUCT_CONVERSION:
-		return (int)MVAPI_DisableStructConversion((qboolean)args[1]);
+	Com_Printf( "      calls       msec  usec/call  trap\n" );
+	Com_Printf( "-----------  ---------  ---------  ----\n" );
+	for ( i = 0 ; i < count ; i++ ) {
+		calls = gameTrapStats[order[i]].calls;
+		time = gameTrapStats[order[i]].time;
+		Com_Printf( "%11lld  %9.1f  %9.2f  %s\n", (long long)calls, time / 1e6,
+			time / 1e3 / calls, gameTrapNames[order[i]] );
+	}
+	Com_Printf( "(time includes traps that call back into the game)\n" );
 
-	default:
-		Com_Error( ERR_DROP, "Bad game system trap: %i", args[0] );
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( gameTrapStats, 0, sizeof( gameTrapStats ) );
 	}
-	return -1;
 }
 
 /*
@@ -1181,6 +1951,8 @@ void SV_InitGameProgs( void ) {
 		bot_enable = 0;
 	}
 
+	SV_InitGameTraps();
+
 	// load the dll or bytecode
 	gvm = VM_Create( "jk2mpgame", qfalse, SV_GameSystemCalls, (vmInterpret_t)(int)Cvar_VariableValue( "vm_game" ) );
 	if ( !gvm ) {
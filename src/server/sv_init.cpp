@@ -46,6 +46,7 @@ void SV_SetConfigstring (int index, const char *val) {
 	// change the string in sv
 	Z_Free( sv.configstrings[index] );
 	sv.configstrings[index] = CopyString( val );
+	SV_DemoConfigstringModified( index );
 
 	// send it to all the clients if we aren't
 	// spawning a new server
@@ -463,6 +464,8 @@ void SV_SpawnServer( char *server, qboolean killBots, ForceReload_e eForceReload
 
 	SV_SendMapChange();
 
+	SV_DemoStop();
+
 	RE_RegisterMedia_LevelLoadBegin(server, eForceReload);
 
 	// shut down the existing game if it is running
@@ -734,6 +737,8 @@ Ghoul2 Insert End
 	// send a heartbeat now so the master will get up to date info
 	SV_Heartbeat_f();
 
+	SV_DemoAutoStart();
+
 	Hunk_SetMark();
 
 	Com_Printf ("-----------------------------------\n");
@@ -815,6 +820,7 @@ void SV_Init (void) {
 	sv_hostname = Cvar_Get ("sv_hostname", "noname", CVAR_SERVERINFO | CVAR_ARCHIVE );
 	sv_maxclients = Cvar_Get ("sv_maxclients", "8", CVAR_SERVERINFO | CVAR_LATCH);
 	sv_maxRate = Cvar_Get ("sv_maxRate", "0", CVAR_ARCHIVE | CVAR_SERVERINFO );
+	sv_rateControl = Cvar_Get ("sv_rateControl", "0", CVAR_ARCHIVE );
 	sv_minPing = Cvar_Get ("sv_minPing", "0", CVAR_ARCHIVE | CVAR_SERVERINFO );
 	sv_maxPing = Cvar_Get ("sv_maxPing", "0", CVAR_ARCHIVE | CVAR_SERVERINFO );
 	sv_floodProtect = Cvar_Get ("sv_floodProtect", "1", CVAR_ARCHIVE | CVAR_SERVERINFO );
@@ -837,6 +843,7 @@ void SV_Init (void) {
 	sv_rconPassword = Cvar_Get ("rconPassword", "", CVAR_TEMP );
 	sv_privatePassword = Cvar_Get ("sv_privatePassword", "", CVAR_TEMP );
 	sv_fps = Cvar_Get ("sv_fps", "20", CVAR_TEMP );
+	sv_frameExact = Cvar_Get ("sv_frameExact", "0", CVAR_ARCHIVE );
 	sv_timeout = Cvar_Get ("sv_timeout", "200", CVAR_TEMP );
 	sv_zombietime = Cvar_Get ("sv_zombietime", "2", CVAR_TEMP );
 	Cvar_Get ("nextmap", "", CVAR_TEMP );
@@ -856,6 +863,9 @@ void SV_Init (void) {
 	sv_reconnectlimit = Cvar_Get ("sv_reconnectlimit", "3", 0);
 	sv_showloss = Cvar_Get ("sv_showloss", "0", 0);
 	sv_padPackets = Cvar_Get ("sv_padPackets", "0", 0);
+	sv_snapshotThreads = Cvar_Get ("sv_snapshotThreads", "0", CVAR_ARCHIVE);
+	sv_autoDemo = Cvar_Get ("sv_autoDemo", "0", CVAR_ARCHIVE);
+	sv_syscallStats = Cvar_Get ("sv_syscallStats", "0", 0);
 	sv_killserver = Cvar_Get ("sv_killserver", "0", 0);
 	sv_mapChecksum = Cvar_Get ("sv_mapChecksum", "", CVAR_ROM);
 
@@ -925,7 +935,9 @@ void SV_Shutdown( char *finalmsg )
 	}
 
 	SV_RemoveOperatorCommands();
+	SV_DemoStop();
 	SV_MasterShutdown();
+	SV_ShutdownSnapshotWorkers();
 	SV_ShutdownGameProgs();
 /*
 Ghoul2 Insert Start
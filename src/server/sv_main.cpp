@@ -6,6 +6,7 @@ server_t		sv;					// local server
 vm_t			*gvm = NULL;				// game virtual machine // bk001212 init
 
 cvar_t	*sv_fps;				// time rate for running non-clients
+cvar_t	*sv_frameExact;			// spread 1000 % sv_fps over the frames of a second
 cvar_t	*sv_timeout;			// seconds without any message
 cvar_t	*sv_zombietime;			// seconds to sink messages after disconnect
 cvar_t	*sv_rconPassword;		// password for remote server commands
@@ -20,11 +21,15 @@ cvar_t	*sv_master[MAX_MASTER_SERVERS];		// master server ip address
 cvar_t	*sv_reconnectlimit;		// minimum seconds between connect messages
 cvar_t	*sv_showloss;			// report when usercmds are lost
 cvar_t	*sv_padPackets;			// add nop bytes to messages
+cvar_t	*sv_snapshotThreads;	// worker threads for encoding snapshots
+cvar_t	*sv_autoDemo;			// record a server demo of every map
+cvar_t	*sv_syscallStats;		// count and time the system calls of the game module
 cvar_t	*sv_killserver;			// menu system can set to 1 to shut server down
 cvar_t	*sv_mapname;
 cvar_t	*sv_mapChecksum;
 cvar_t	*sv_serverid;
 cvar_t	*sv_maxRate;
+cvar_t	*sv_rateControl;		// pace clients by measured bandwidth and round trip
 cvar_t	*sv_minPing;
 cvar_t	*sv_maxPing;
 cvar_t	*sv_gametype;
@@ -173,6 +178,8 @@ void QDECL SV_SendServerCommand(client_t *cl, const char *fmt, ...) {
 		return;
 	}
 
+	SV_DemoServerCommand( (char *)message );
+
 	// hack to echo broadcast prints to console
 	if ( com_dedicated->integer && !strncmp( (char *)message, "print", 5) ) {
 		Com_Printf ("broadcast: %s\n", SV_ExpandNewlines((char *)message) );
@@ -899,7 +906,12 @@ void SV_CalcPings( void ) {
 			if ( cl->frames[j].messageAcked <= 0 ) {
 				continue;
 			}
-			delta = cl->frames[j].messageAcked - cl->frames[j].messageSent;
+			if ( cl->frames[j].messageAckedTime ) {
+				// the receive thread knows when the ack actually arrived
+				delta = (int)( ( cl->frames[j].messageAckedTime - cl->frames[j].messageSentTime ) / 1000 );
+			} else {
+				delta = cl->frames[j].messageAcked - cl->frames[j].messageSent;
+			}
 			count++;
 			total += delta;
 		}
@@ -998,6 +1010,115 @@ qboolean SV_CheckPaused( void ) {
 	return qtrue;
 }
 
+/*
+==================
+SV_NextFrameLength
+
+Length of the next game frame in milliseconds. With sv_frameExact the
+remainder of 1000 / sv_fps is carried over so frames alternate between
+the two nearest integer lengths (33, 33, 34 for sv_fps 30) and a second
+holds exactly sv_fps frames instead of drifting ahead.
+==================
+*/
+static int SV_NextFrameLength( void ) {
+	if ( sv_frameExact->integer )
+		return ( 1000 + sv.frameRemainder ) / sv_fps->integer;
+
+	return 1000 / sv_fps->integer;
+}
+
+/*
+==================
+SV_AdvanceFrameLength
+==================
+*/
+static void SV_AdvanceFrameLength( void ) {
+	if ( sv_frameExact->integer )
+		sv.frameRemainder = ( 1000 + sv.frameRemainder ) % sv_fps->integer;
+	else
+		sv.frameRemainder = 0;
+}
+
+/*
+==================
+Frame pacing statistics
+
+Compares the wall clock time between server frames with the game time
+they advanced, using the monotonic microsecond clock.
+==================
+*/
+#define FRAMESTATS_RESYNC_USEC	1000000		// don't count hitches, map loads and pauses
+
+static struct {
+	int64_t		lastUsec;
+	int			lastTime;
+
+	int			frames;
+	double		sum;			// of absolute jitter, usec
+	double		sumSq;
+	int64_t		maxEarly;
+	int64_t		maxLate;
+} frameStats;
+
+static void SV_FrameStatsSample( int64_t now ) {
+	int64_t	jitter;
+
+	if ( frameStats.lastUsec && svs.time > frameStats.lastTime ) {
+		jitter = ( now - frameStats.lastUsec ) - (int64_t)( svs.time - frameStats.lastTime ) * 1000;
+
+		if ( jitter > -FRAMESTATS_RESYNC_USEC && jitter < FRAMESTATS_RESYNC_USEC ) {
+			frameStats.frames++;
+			frameStats.sum += jitter < 0 ? -jitter : jitter;
+			frameStats.sumSq += (double)jitter * jitter;
+			if ( jitter < frameStats.maxEarly )
+				frameStats.maxEarly = jitter;
+			if ( jitter > frameStats.maxLate )
+				frameStats.maxLate = jitter;
+		}
+	}
+
+	frameStats.lastUsec = now;
+	frameStats.lastTime = svs.time;
+}
+
+/*
+==================
+SV_FrameStats_f
+
+framestats [reset]
+==================
+*/
+void SV_FrameStats_f( void ) {
+	double	mean;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( frameStats.frames ) {
+		mean = frameStats.sum / frameStats.frames;
+
+		Com_Printf( "%i frames at sv_fps %i (%s frame length)\n", frameStats.frames,
+			sv_fps->integer, sv_frameExact->integer ? "exact" : "truncated" );
+		Com_Printf( "jitter mean %.3f ms, stddev %.3f ms\n", mean / 1000.0,
+			sqrt( frameStats.sumSq / frameStats.frames ) / 1000.0 );
+		Com_Printf( "earliest %.3f ms, latest %.3f ms\n", frameStats.maxEarly / 1000.0,
+			frameStats.maxLate / 1000.0 );
+	} else {
+		Com_Printf( "No frames sampled yet.\n" );
+	}
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		int64_t lastUsec = frameStats.lastUsec;
+		int lastTime = frameStats.lastTime;
+
+		memset( &frameStats, 0, sizeof( frameStats ) );
+		frameStats.lastUsec = lastUsec;
+		frameStats.lastTime = lastTime;
+	}
+}
+
 /*
 ==================
 SV_FrameMsec
@@ -1005,10 +1126,10 @@ Return time in millseconds until processing of the next server frame.
 ==================
 */
 int SV_FrameMsec() {
-	if (sv_fps) {
+	if (sv_fps && sv_fps->integer >= 1) {
 		int frameMsec;
 
-		frameMsec = 1000.0f / sv_fps->value;
+		frameMsec = SV_NextFrameLength();
 
 		if (frameMsec < sv.timeResidual)
 			return 0;
@@ -1045,6 +1166,8 @@ happen before SV_Frame is called
 void SV_Frame( int msec ) {
 	int		frameMsec;
 	int		startTime;
+	int64_t	frameStart;
+	PROF_SCOPE( "SV_Frame" );
 
 	// the menu kills the server with this cvar
 	if ( sv_killserver->integer ) {
@@ -1066,7 +1189,7 @@ void SV_Frame( int msec ) {
 	if ( sv_fps->integer < 1 ) {
 		Cvar_Set( "sv_fps", "10" );
 	}
-	frameMsec = 1000 / sv_fps->integer ;
+	frameMsec = SV_NextFrameLength();
 
 	sv.timeResidual += msec;
 
@@ -1120,14 +1243,27 @@ void SV_Frame( int msec ) {
 		sv.saberBlockTime = svs.time + 1000;
 	}
 
+	// the frames are due now, measure against the time they advance to
+	frameStart = sv.timeResidual >= frameMsec ? Sys_Microseconds() : 0;
+
 	// run the game simulation in chunks
 	while ( sv.timeResidual >= frameMsec ) {
 		sv.timeResidual -= frameMsec;
 		svs.time += frameMsec;
+		SV_AdvanceFrameLength();
 
 		// let everything in the world think and move
 		VM_Call( gvm, GAME_RUN_FRAME, svs.time );
 		MV_FixSaberStealing();
+
+		// every frame goes into the demo, even when catching up
+		SV_DemoFrame();
+
+		frameMsec = SV_NextFrameLength();
+	}
+
+	if ( frameStart ) {
+		SV_FrameStatsSample( frameStart );
 	}
 
 	if ( com_speeds->integer ) {
@@ -1138,7 +1274,9 @@ void SV_Frame( int msec ) {
 	SV_CheckTimeouts();
 
 	// send messages back to the clients
+	NET_BeginSendBatch();
 	SV_SendClientMessages();
+	NET_FlushSendBatch();
 
 	// send a heartbeat to the master if needed
 	SV_MasterHeartbeat();
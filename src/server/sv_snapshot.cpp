@@ -1,6 +1,11 @@
 
 #include "server.h"
 
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
 
 /*
 =============================================================================
@@ -24,6 +29,155 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Entity delta cache
+
+Most clients delta from a snapshot sent in the same server frame, so the
+same entity delta gets encoded over and over. Encoded deltas are kept for
+the current SV_SendClientMessages pass, keyed by entity number and the
+time the source snapshot was sent, and copied bit for bit into the other
+clients' messages. Both states are compared in full before reusing an
+entry, the game may change entities between two passes at the same time.
+
+The mutex is only taken while snapshot workers share the cache. A miss
+is encoded straight into the client's message and its bits are copied
+into the pool afterwards if there is room.
+
+=============================================================================
+*/
+
+#define	MAX_DELTA_CACHE			2048		// must be a power of two
+#define	DELTA_CACHE_POOL		(256*1024)
+
+typedef struct {
+	int				generation;
+	int				number;
+	int				fromTime;			// -1 when sent from the baseline
+	qboolean		force;
+	entityState_t	from;
+	entityState_t	to;
+	int				ofs;				// into pool
+	int				numBits;
+} entityDeltaCache_t;
+
+static struct {
+	std::mutex			mutex;
+	bool				threaded;			// workers encode during this pass
+	int					generation;
+	int					numEntries;
+	int					poolUsed;
+	entityDeltaCache_t	entries[MAX_DELTA_CACHE];
+	byte				pool[DELTA_CACHE_POOL];
+} deltaCache;
+
+/*
+=============
+SV_ClearDeltaCache
+
+Called at the start of each pass over the clients, while no worker is busy
+=============
+*/
+static void SV_ClearDeltaCache( bool threaded ) {
+	deltaCache.threaded = threaded;
+	deltaCache.generation++;
+	deltaCache.numEntries = 0;
+	deltaCache.poolUsed = 0;
+}
+
+/*
+=============
+SV_WriteDeltaEntityCached
+=============
+*/
+static void SV_WriteDeltaEntityCached( msg_t *msg, entityState_t *from, entityState_t *to, qboolean force, int fromTime ) {
+	entityDeltaCache_t	*entry;
+	unsigned	hash;
+	int			startBit, numBits, numBytes;
+	int			ofs;
+	int			i;
+
+	// unchanged entities don't generate any bits at all
+	if ( !force && !memcmp( from, to, sizeof( *from ) ) ) {
+		return;
+	}
+
+	hash = ( to->number * 31 + fromTime ) & ( MAX_DELTA_CACHE - 1 );
+
+	std::unique_lock<std::mutex> lk(deltaCache.mutex, std::defer_lock);
+	if ( deltaCache.threaded ) {
+		lk.lock();
+	}
+
+	for ( i = 0 ; i < MAX_DELTA_CACHE ; i++ ) {
+		entry = &deltaCache.entries[( hash + i ) & ( MAX_DELTA_CACHE - 1 )];
+		if ( entry->generation != deltaCache.generation ) {
+			break;
+		}
+		if ( entry->number != to->number || entry->fromTime != fromTime || entry->force != force ) {
+			continue;
+		}
+		if ( memcmp( &entry->from, from, sizeof( *from ) ) || memcmp( &entry->to, to, sizeof( *to ) ) ) {
+			continue;
+		}
+
+		// entries and their pool bits don't change until the next pass,
+		// so the copy doesn't need to hold the lock
+		ofs = entry->ofs;
+		numBits = entry->numBits;
+		if ( lk.owns_lock() ) {
+			lk.unlock();
+		}
+		MSG_WriteBitstream( msg, deltaCache.pool + ofs, numBits );
+		return;
+	}
+
+	if ( lk.owns_lock() ) {
+		lk.unlock();
+	}
+
+	startBit = msg->bit;
+	MSG_WriteDeltaEntity( msg, from, to, force );
+
+	if ( msg->overflowed ) {
+		return;
+	}
+
+	numBits = msg->bit - startBit;
+	numBytes = ( numBits + 7 ) >> 3;
+
+	if ( deltaCache.threaded ) {
+		lk.lock();
+	}
+
+	// keep the probe chains short
+	if ( deltaCache.numEntries >= MAX_DELTA_CACHE * 3 / 4 ||
+		deltaCache.poolUsed + numBytes > DELTA_CACHE_POOL ) {
+		return;
+	}
+
+	for ( i = 0 ; i < MAX_DELTA_CACHE ; i++ ) {
+		entry = &deltaCache.entries[( hash + i ) & ( MAX_DELTA_CACHE - 1 )];
+		if ( entry->generation == deltaCache.generation ) {
+			continue;
+		}
+
+		entry->generation = deltaCache.generation;
+		entry->number = to->number;
+		entry->fromTime = fromTime;
+		entry->force = force;
+		entry->from = *from;
+		entry->to = *to;
+		entry->ofs = deltaCache.poolUsed;
+		entry->numBits = numBits;
+		MSG_CopyBitstream( msg, startBit, deltaCache.pool + entry->ofs );
+		deltaCache.poolUsed += numBytes;
+		deltaCache.numEntries++;
+		return;
+	}
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -67,7 +221,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity (msg, oldent, newent, qfalse );
+			SV_WriteDeltaEntityCached (msg, oldent, newent, qfalse, from->messageSent );
 			oldindex++;
 			newindex++;
 			continue;
@@ -75,7 +229,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 		if ( newnum < oldnum ) {
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
+			SV_WriteDeltaEntityCached (msg, &sv.svEntities[newnum].baseline, newent, qtrue, -1 );
 			newindex++;
 			continue;
 		}
@@ -95,42 +249,56 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SnapshotDeltaSource
+
+Picks a previous frame as the source for delta compressing the snapshot
 ==================
 */
-static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
-	clientSnapshot_t	*frame, *oldframe;
-	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+static clientSnapshot_t *SV_SnapshotDeltaSource( client_t *client, int *lastframe ) {
+	clientSnapshot_t	*oldframe;
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( client->deltaMessage <= 0 || client->state != CS_ACTIVE ) {
 		// client is asking for a retransmit
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else if ( client->netchan.outgoingSequence - client->deltaMessage
 		>= (PACKET_BACKUP - 3) ) {
 		// client hasn't gotten a good message through in a long time
 		Com_DPrintf ("%s: Delta request from out of date packet.\n", client->name);
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else {
 		// we have a valid snapshot to delta from
 		oldframe = &client->frames[ client->deltaMessage & PACKET_MASK ];
-		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+		*lastframe = client->netchan.outgoingSequence - client->deltaMessage;
 
 		// the snapshot's entities may still have rolled off the buffer, though
 		if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
 			Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
 			oldframe = NULL;
-			lastframe = 0;
+			*lastframe = 0;
 		}
 	}
 
+	return oldframe;
+}
+
+/*
+==================
+SV_WriteSnapshotToClient
+
+Only touches the client's own state and may run on a snapshot worker thread
+==================
+*/
+static void SV_WriteSnapshotToClient( client_t *client, clientSnapshot_t *oldframe, int lastframe, msg_t *msg ) {
+	clientSnapshot_t	*frame;
+	int					i;
+	int					snapFlags;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
 	MSG_WriteByte (msg, svc_snapshot);
 
 	// NOTE, MRE: now sent at the start of every message from server to client
@@ -254,6 +422,106 @@ static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapsh
 	eNums->numSnapshotEntities++;
 }
 
+/*
+===============
+SV_EntityInPVS
+
+Area and cluster test of an entity against the view from a given area / pvs
+===============
+*/
+static qboolean SV_EntityInPVS( svEntity_t *svEnt, int clientarea, byte *bitvector ) {
+	int		i, l;
+
+	// ignore if not touching a PV leaf
+	// check area
+	if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
+		// doors can legally straddle two areas, so
+		// we may need to check another one
+		if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
+			return qfalse;		// blocked by a door
+		}
+	}
+
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return qfalse;
+	}
+	l = 0;
+	for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+			break;
+		}
+	}
+
+	// if we haven't found it to be visible,
+	// check overflow clusters that coudln't be stored
+	if ( i == svEnt->numClusters ) {
+		if ( svEnt->lastCluster ) {
+			for ( ; l <= svEnt->lastCluster ; l++ ) {
+				if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+					break;
+				}
+			}
+			if ( l == svEnt->lastCluster ) {
+				return qfalse;	// not visible
+			}
+		} else {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+===============
+SV_VisCacheForCluster
+
+All clients standing in the same cluster and area see the same entities
+through the pvs, so the test is only done once per server frame and then
+shared. The cache is flushed when an entity gets relinked or an areaportal
+changes state. Returns NULL if the cache is full.
+===============
+*/
+static const byte *SV_VisCacheForCluster( int clientcluster, int clientarea ) {
+	snapshotVisCache_t	*cache;
+	byte	*clientpvs;
+	int		e;
+	int		i;
+
+	if ( sv.visCacheTime != svs.time ) {
+		sv.visCacheTime = svs.time;
+		sv.numVisCache = 0;
+	}
+
+	for ( i = 0 ; i < sv.numVisCache ; i++ ) {
+		cache = &sv.visCache[i];
+		if ( cache->cluster == clientcluster && cache->area == clientarea ) {
+			return cache->visible;
+		}
+	}
+
+	if ( sv.numVisCache == MAX_SNAPSHOT_VIS_CACHE ) {
+		return NULL;
+	}
+	cache = &sv.visCache[sv.numVisCache++];
+
+	cache->cluster = clientcluster;
+	cache->area = clientarea;
+	Com_Memset( cache->visible, 0, sizeof( cache->visible ) );
+
+	clientpvs = CM_ClusterPVS( clientcluster );
+
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		if ( SV_EntityInPVS( &sv.svEntities[e], clientarea, clientpvs ) ) {
+			cache->visible[e >> 3] |= 1 << ( e & 7 );
+		}
+	}
+
+	return cache->visible;
+}
+
 /*
 ===============
 SV_AddEntitiesVisibleFromPoint
@@ -261,15 +529,13 @@ SV_AddEntitiesVisibleFromPoint
 */
 static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame,
 									snapshotEntityNumbers_t *eNums, qboolean portal ) {
-	int		e, i;
+	int		e;
 	sharedEntity_t *ent;
 	svEntity_t	*svEnt;
-	int		l;
 	int		clientarea, clientcluster;
 	int		leafnum;
-	int		c_fullsend;
 	byte	*clientpvs;
-	byte	*bitvector;
+	const byte	*visible;
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -286,8 +552,7 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
 
 	clientpvs = CM_ClusterPVS (clientcluster);
-
-	c_fullsend = 0;
+	visible = SV_VisCacheForCluster( clientcluster, clientarea );
 
 	for ( e = 0 ; e < sv.num_entities ; e++ ) {
 		ent = SV_GentityNum(e);
@@ -364,45 +629,13 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 			continue;
 		}
 
-		// ignore if not touching a PV leaf
-		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
-			// doors can legally straddle two areas, so
-			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				continue;		// blocked by a door
-			}
-		}
-
-		bitvector = clientpvs;
-
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
-			continue;
-		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
-			}
-		}
-
-		// if we haven't found it to be visible,
-		// check overflow clusters that coudln't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
-				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
-				}
-			} else {
+		// area and cluster checks are shared by all clients in this cluster
+		if ( visible ) {
+			if ( !( visible[e >> 3] & ( 1 << ( e & 7 ) ) ) ) {
 				continue;
 			}
+		} else if ( !SV_EntityInPVS( svEnt, clientarea, clientpvs ) ) {
+			continue;
 		}
 
 		// add it
@@ -446,6 +679,7 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	svEntity_t					*svEnt;
 	sharedEntity_t				*clent;
 	playerState_t				*ps;
+	PROF_SCOPE( "SV_BuildClientSnapshot" );
 
 	// bump the counter used to prevent double adding
 	sv.snapshotCounter++;
@@ -526,23 +760,24 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 }
 
 
+#define	HEADER_RATE_BYTES	48		// include our header, IP header, and some overhead
+
+#define	RATE_CONTROL_MIN		4000	// never throttle a client below this
+#define	RATE_CONTROL_MAX		90000	// same as the highest rate a client can ask for
+#define	RATE_CONTROL_PERIOD		250		// msec between rate adjustments
+#define	RATE_CONTROL_DELAY		40		// msec of queueing that counts as congestion
+#define	RATE_CONTROL_MINRTT		10000	// msec until the lowest round trip is measured again
+
 /*
 ====================
-SV_RateMsec
+SV_MaxRate
 
-Return the number of msec a given size message is supposed
-to take to clear, based on the current rate
+The rate the client asked for, capped by sv_maxRate
 ====================
 */
-#define	HEADER_RATE_BYTES	48		// include our header, IP header, and some overhead
-static int SV_RateMsec( client_t *client, int messageSize ) {
+static int SV_MaxRate( client_t *client ) {
 	int		rate;
-	int		rateMsec;
 
-	// individual messages will never be larger than fragment size
-	if ( messageSize > 1500 ) {
-		messageSize = 1500;
-	}
 	rate = client->rate;
 	if ( sv_maxRate->integer ) {
 		if ( sv_maxRate->integer < 1000 ) {
@@ -552,6 +787,137 @@ static int SV_RateMsec( client_t *client, int messageSize ) {
 			rate = sv_maxRate->integer;
 		}
 	}
+
+	return rate;
+}
+
+/*
+====================
+SV_ClientRate
+
+Bytes per second the client can be sent. With sv_rateControl snapshots
+never go faster than the measured bandwidth, and downloads may use all
+of it, even beyond the rate the client asked for.
+====================
+*/
+int SV_ClientRate( client_t *client, qboolean download ) {
+	int		rate;
+
+	rate = SV_MaxRate( client );
+	if ( !sv_rateControl->integer || !client->rateControl ) {
+		return rate;
+	}
+
+	if ( download || client->rateControl < rate ) {
+		rate = client->rateControl;
+	}
+
+	return rate;
+}
+
+/*
+====================
+SV_RateControlAck
+
+Called the first time the client acknowledges a snapshot. The round trip
+of every acked snapshot is compared with the lowest one seen lately: if
+the difference grows the snapshots are queueing up somewhere on the way
+and the rate is cut, otherwise a client that is held back by its rate is
+allowed a little more every period.
+====================
+*/
+void SV_RateControlAck( client_t *client, clientSnapshot_t *frame ) {
+	int64_t	ackTime;
+	int		rtt;
+	int		elapsed;
+	int		delivered;
+	int		ceiling;
+
+	if ( !sv_rateControl->integer || !frame->messageSentTime ) {
+		return;
+	}
+
+	// downloads may go past the client's rate, up to what the server allows
+	ceiling = sv_maxRate->integer ? sv_maxRate->integer : RATE_CONTROL_MAX;
+	if ( !client->rateControl ) {
+		client->rateControl = SV_MaxRate( client );
+		client->rateAdjustTime = svs.time;
+		client->rateAckedBytes = 0;
+		client->rateMinRtt = 0;
+		client->rateSmoothRtt = 0;
+	}
+
+	// without the receive thread the packet is run right after select
+	// returns, which is only late while a frame is running
+	ackTime = NET_PacketTime();
+	if ( !ackTime ) {
+		ackTime = Sys_Microseconds();
+	}
+
+	rtt = (int)( ( ackTime - frame->messageSentTime ) / 1000 );
+	if ( rtt < 0 ) {
+		return;
+	}
+
+	if ( !client->rateMinRtt || rtt < client->rateMinRtt || svs.time - client->rateMinRttTime > RATE_CONTROL_MINRTT ) {
+		client->rateMinRtt = rtt ? rtt : 1;
+		client->rateMinRttTime = svs.time;
+	}
+
+	if ( !client->rateSmoothRtt ) {
+		client->rateSmoothRtt = rtt;
+	} else {
+		client->rateSmoothRtt += ( rtt - client->rateSmoothRtt ) / 8;
+	}
+
+	client->rateAckedBytes += frame->messageSize + HEADER_RATE_BYTES;
+
+	elapsed = svs.time - client->rateAdjustTime;
+	if ( elapsed < RATE_CONTROL_PERIOD || elapsed < client->rateSmoothRtt ) {
+		return;
+	}
+
+	delivered = (int)( (int64_t)client->rateAckedBytes * 1000 / elapsed );
+
+	if ( client->rateSmoothRtt - client->rateMinRtt > RATE_CONTROL_DELAY ) {
+		// back off, but not below what actually got through
+		client->rateControl -= client->rateControl / 4;
+		if ( client->rateControl < delivered ) {
+			client->rateControl = delivered;
+		}
+	} else if ( client->rateDelayed || *client->downloadName ) {
+		// only probe for more while the rate is what holds the client back
+		client->rateControl += client->rateControl / 8;
+	}
+
+	if ( client->rateControl < RATE_CONTROL_MIN ) {
+		client->rateControl = RATE_CONTROL_MIN;
+	}
+	if ( client->rateControl > ceiling ) {
+		client->rateControl = ceiling;
+	}
+
+	client->rateAdjustTime = svs.time;
+	client->rateAckedBytes = 0;
+}
+
+/*
+====================
+SV_RateMsec
+
+Return the number of msec a given size message is supposed
+to take to clear, based on the current rate
+====================
+*/
+static int SV_RateMsec( client_t *client, int messageSize ) {
+	int		rate;
+	int		rateMsec;
+
+	// individual messages will never be larger than fragment size
+	if ( messageSize > 1500 ) {
+		messageSize = 1500;
+	}
+	rate = SV_ClientRate( client, qfalse );
 	rateMsec = ( messageSize + HEADER_RATE_BYTES ) * 1000 / rate;
 
 	return rateMsec;
@@ -581,6 +947,8 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client ) {
 	client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageSize = msg->cursize;
 	client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageSent = svs.time;
 	client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageAcked = -1;
+	client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageSentTime = Sys_Microseconds();
+	client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageAckedTime = 0;
 
 	// send the datagram
 	SV_Netchan_Transmit( client, msg );	//msg->cursize, msg->data );
@@ -618,6 +986,27 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client ) {
 }
 
 
+/*
+=======================
+SV_FinishClientSnapshot
+
+Appends download data to an encoded snapshot and sends it
+=======================
+*/
+static void SV_FinishClientSnapshot( client_t *client, msg_t *msg ) {
+	// Add any download data if the client is downloading
+	SV_WriteDownloadToClient( client, msg );
+
+	// check for overflow
+	if ( msg->overflowed ) {
+		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
+		MSG_Clear (msg);
+	}
+
+	SV_SendMessageToClient( msg, client );
+}
+
+
 /*
 =======================
 SV_SendClientSnapshot
@@ -629,6 +1018,8 @@ Also called by SV_FinalMessage
 void SV_SendClientSnapshot( client_t *client ) {
 	byte		msg_buf[MAX_MSGLEN];
 	msg_t		msg;
+	clientSnapshot_t	*oldframe;
+	int			lastframe;
 
 	// build the snapshot
 	SV_BuildClientSnapshot( client );
@@ -651,18 +1042,181 @@ void SV_SendClientSnapshot( client_t *client ) {
 
 	// send over all the relevant entityState_t
 	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+	oldframe = SV_SnapshotDeltaSource( client, &lastframe );
+	SV_WriteSnapshotToClient( client, oldframe, lastframe, &msg );
 
-	// Add any download data if the client is downloading
-	SV_WriteDownloadToClient( client, &msg );
+	SV_FinishClientSnapshot( client, &msg );
+}
 
-	// check for overflow
-	if ( msg.overflowed ) {
-		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		MSG_Clear (&msg);
+
+/*
+=============================================================================
+
+Parallel snapshot encoding
+
+With sv_snapshotThreads > 0 the entity lists of all clients due for a
+snapshot are built on the main thread first, which also reserves their
+range of svs.snapshotEntities. Delta and huffman encoding of the messages
+is then spread over a pool of worker threads, each client writing to its
+own buffer. Downloads and the netchan transmit stay on the main thread.
+
+=============================================================================
+*/
+
+#define	MAX_SNAPSHOT_THREADS	16
+
+typedef struct {
+	client_t			*client;
+	clientSnapshot_t	*oldframe;
+	int					lastframe;
+	msg_t				msg;
+	byte				msg_buf[MAX_MSGLEN];
+} snapshotJob_t;
+
+static struct {
+	std::thread		threads[MAX_SNAPSHOT_THREADS];
+	int				numThreads;
+
+	std::mutex		mutex;
+	std::condition_variable	cv_work;
+	std::condition_variable	cv_done;
+	int				generation;		// bumped for every batch of jobs
+	int				busy;			// workers still on the current batch
+	bool			quit;
+
+	std::atomic_int	nextJob;
+	int				numJobs;
+	snapshotJob_t	*jobs;			// [MAX_CLIENTS]
+} snapWorkers;
+
+/*
+=======================
+SV_RunSnapshotJobs
+=======================
+*/
+static void SV_RunSnapshotJobs( void ) {
+	snapshotJob_t	*job;
+	int				i;
+
+	while ( ( i = snapWorkers.nextJob++ ) < snapWorkers.numJobs ) {
+		PROF_SCOPE( "SV_WriteSnapshotToClient" );
+
+		job = &snapWorkers.jobs[i];
+
+		MSG_WriteLong( &job->msg, job->client->lastClientCommand );
+		SV_UpdateServerCommandsToClient( job->client, &job->msg );
+		SV_WriteSnapshotToClient( job->client, job->oldframe, job->lastframe, &job->msg );
+	}
+}
+
+/*
+=======================
+SV_SnapshotWorker
+=======================
+*/
+static void SV_SnapshotWorker( int num ) {
+	char	name[32];
+	int		generation = 0;
+
+	Com_sprintf( name, sizeof( name ), "snapshot worker %i", num );
+	Prof_SetThreadName( name );
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lk(snapWorkers.mutex);
+			snapWorkers.cv_work.wait(lk, [&] { return snapWorkers.quit || snapWorkers.generation != generation; });
+			if ( snapWorkers.quit ) {
+				return;
+			}
+			generation = snapWorkers.generation;
+		}
+
+		SV_RunSnapshotJobs();
+
+		{
+			std::lock_guard<std::mutex> lk(snapWorkers.mutex);
+			snapWorkers.busy--;
+		}
+		snapWorkers.cv_done.notify_one();
+	}
+}
+
+/*
+=======================
+SV_ShutdownSnapshotWorkers
+=======================
+*/
+void SV_ShutdownSnapshotWorkers( void ) {
+	int		i;
+
+	if ( !snapWorkers.numThreads ) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(snapWorkers.mutex);
+		snapWorkers.quit = true;
+	}
+	snapWorkers.cv_work.notify_all();
+
+	for ( i = 0 ; i < snapWorkers.numThreads ; i++ ) {
+		snapWorkers.threads[i].join();
+	}
+	snapWorkers.numThreads = 0;
+
+	delete[] snapWorkers.jobs;
+	snapWorkers.jobs = NULL;
+}
+
+/*
+=======================
+SV_InitSnapshotWorkers
+=======================
+*/
+static void SV_InitSnapshotWorkers( int numThreads ) {
+	int		i;
+
+	SV_ShutdownSnapshotWorkers();
+
+	if ( numThreads > MAX_SNAPSHOT_THREADS ) {
+		numThreads = MAX_SNAPSHOT_THREADS;
 	}
+	if ( numThreads <= 0 ) {
+		return;
+	}
+
+	snapWorkers.jobs = new snapshotJob_t[MAX_CLIENTS];
+	snapWorkers.quit = false;
+	snapWorkers.generation = 0;
+	snapWorkers.busy = 0;
 
-	SV_SendMessageToClient( &msg, client );
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		snapWorkers.threads[i] = std::thread(SV_SnapshotWorker, i + 1);
+	}
+	snapWorkers.numThreads = numThreads;
+}
+
+/*
+=======================
+SV_EncodeSnapshotJobs
+
+Encodes all queued snapshots, the calling thread helps out
+=======================
+*/
+static void SV_EncodeSnapshotJobs( void ) {
+	snapWorkers.nextJob = 0;
+
+	{
+		std::lock_guard<std::mutex> lk(snapWorkers.mutex);
+		snapWorkers.generation++;
+		snapWorkers.busy = snapWorkers.numThreads;
+	}
+	snapWorkers.cv_work.notify_all();
+
+	SV_RunSnapshotJobs();
+
+	std::unique_lock<std::mutex> lk(snapWorkers.mutex);
+	snapWorkers.cv_done.wait(lk, [] { return snapWorkers.busy == 0; });
 }
 
 
@@ -674,6 +1228,22 @@ SV_SendClientMessages
 void SV_SendClientMessages( void ) {
 	int			i;
 	client_t	*c;
+	snapshotJob_t	*job;
+	int			numThreads;
+	PROF_SCOPE( "SV_SendClientMessages" );
+
+	numThreads = sv_snapshotThreads->integer;
+	if ( numThreads > MAX_SNAPSHOT_THREADS ) {
+		numThreads = MAX_SNAPSHOT_THREADS;
+	} else if ( numThreads < 0 ) {
+		numThreads = 0;
+	}
+	if ( numThreads != snapWorkers.numThreads ) {
+		SV_InitSnapshotWorkers( numThreads );
+	}
+
+	snapWorkers.numJobs = 0;
+	SV_ClearDeltaCache( snapWorkers.numThreads > 0 );
 
 	// send a message to each connected client
 	for (i=0, c = svs.clients ; i < sv_maxclients->integer ; i++, c++) {
@@ -694,8 +1264,35 @@ void SV_SendClientMessages( void ) {
 			continue;
 		}
 
-		// generate and send a new message
-		SV_SendClientSnapshot( c );
+		if ( !snapWorkers.numThreads ) {
+			// generate and send a new message
+			SV_SendClientSnapshot( c );
+			continue;
+		}
+
+		// build the snapshot now, encode it later on the workers
+		SV_BuildClientSnapshot( c );
+
+		if ( c->gentity && c->gentity->r.svFlags & SVF_BOT ) {
+			continue;
+		}
+
+		job = &snapWorkers.jobs[snapWorkers.numJobs++];
+		job->client = c;
+		job->oldframe = SV_SnapshotDeltaSource( c, &job->lastframe );
+		MSG_Init( &job->msg, job->msg_buf, sizeof(job->msg_buf) );
+		job->msg.allowoverflow = qtrue;
 	}
-}
 
+	if ( !snapWorkers.numJobs ) {
+		return;
+	}
+
+	SV_EncodeSnapshotJobs();
+
+	for ( i = 0 ; i < snapWorkers.numJobs ; i++ ) {
+		job = &snapWorkers.jobs[i];
+		SV_FinishClientSnapshot( job->client, &job->msg );
+	}
+	snapWorkers.numJobs = 0;
+}
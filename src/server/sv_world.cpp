@@ -37,22 +37,39 @@ the world is carved up with an evenly spaced, axially aligned bsp tree.  Entitie
 are kept in chains either at the final leafs, or at the first node that splits
 them, which prevents having to deal with multiple fragments of a single entity.
 
+The tree starts out uniform at AREA_DEPTH and leafs that collect more than
+AREA_SPLIT_COUNT entities are split in half, so crowded parts of large open
+maps get finer sectors while empty space stays coarse. When a split node and
+its two leafs drop to AREA_MERGE_COUNT entities they are merged again and the
+leafs go back to the pool.
+
 ===============================================================================
 */
 
 typedef struct worldSector_s {
 	int		axis;		// -1 = leaf node
 	float	dist;
-	struct worldSector_s	*children[2];
+	struct worldSector_s	*children[2];	// children[0] links the free list
+	struct worldSector_s	*parent;
 	svEntity_t	*entities;
+	int		numEntities;
+	int		depth;		// -1 = free
+	vec3_t	mins, maxs;
 } worldSector_t;
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	64
+#define	AREA_DEPTH			4
+#define	AREA_MAX_DEPTH		12
+#define	AREA_SPLIT_COUNT	16		// entities in a leaf before it gets split
+#define	AREA_MERGE_COUNT	( AREA_SPLIT_COUNT / 2 )	// well below the split count so moving entities don't thrash
+#define	AREA_MIN_SIZE		128		// don't split sectors smaller than this
+#define	AREA_NODES			1024
 
 worldSector_t	sv_worldSectors[AREA_NODES];
 int			sv_numworldSectors;
 
+static worldSector_t	*sv_freeWorldSectors;
+static int				sv_numFreeWorldSectors;
+
 
 /*
 ===============
@@ -64,15 +81,19 @@ void SV_SectorList_f( void ) {
 	worldSector_t	*sec;
 	svEntity_t		*ent;
 
-	for ( i = 0 ; i < AREA_NODES ; i++ ) {
+	for ( i = 0 ; i < sv_numworldSectors ; i++ ) {
 		sec = &sv_worldSectors[i];
+		if ( sec->depth == -1 ) {
+			continue;
+		}
 
 		c = 0;
 		for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
 			c++;
 		}
-		Com_Printf( "sector %i: %i entities\n", i, c );
+		Com_Printf( "sector %i: depth %i, %i entities\n", i, sec->depth, c );
 	}
+	Com_Printf( "%i of %i sectors used\n", sv_numworldSectors - sv_numFreeWorldSectors, AREA_NODES );
 }
 
 /*
@@ -90,6 +111,10 @@ worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs ) {
 	anode = &sv_worldSectors[sv_numworldSectors];
 	sv_numworldSectors++;
 
+	anode->depth = depth;
+	VectorCopy (mins, anode->mins);
+	VectorCopy (maxs, anode->maxs);
+
 	if (depth == AREA_DEPTH) {
 		anode->axis = -1;
 		anode->children[0] = anode->children[1] = NULL;
@@ -113,10 +138,196 @@ worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs ) {
 
 	anode->children[0] = SV_CreateworldSector (depth+1, mins2, maxs2);
 	anode->children[1] = SV_CreateworldSector (depth+1, mins1, maxs1);
+	anode->children[0]->parent = anode->children[1]->parent = anode;
 
 	return anode;
 }
 
+/*
+===============
+SV_SectorForBounds
+
+Finds the first node below start that the box crosses
+===============
+*/
+static worldSector_t *SV_SectorForBounds( worldSector_t *node, const vec3_t absmin, const vec3_t absmax ) {
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if ( absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if ( absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
+
+	return node;
+}
+
+/*
+===============
+SV_AddToWorldSector
+===============
+*/
+static void SV_AddToWorldSector( worldSector_t *node, svEntity_t *ent ) {
+	ent->worldSector = node;
+	ent->nextEntityInWorldSector = node->entities;
+	node->entities = ent;
+	node->numEntities++;
+}
+
+/*
+===============
+SV_AllocWorldSector
+===============
+*/
+static worldSector_t *SV_AllocWorldSector( void ) {
+	worldSector_t	*sec;
+
+	if ( sv_freeWorldSectors ) {
+		sec = sv_freeWorldSectors;
+		sv_freeWorldSectors = sec->children[0];
+		sv_numFreeWorldSectors--;
+	} else {
+		sec = &sv_worldSectors[sv_numworldSectors++];
+	}
+
+	Com_Memset( sec, 0, sizeof( *sec ) );
+	return sec;
+}
+
+/*
+===============
+SV_FreeWorldSector
+===============
+*/
+static void SV_FreeWorldSector( worldSector_t *sec ) {
+	sec->axis = -1;
+	sec->depth = -1;
+	sec->entities = NULL;
+	sec->numEntities = 0;
+	sec->parent = NULL;
+	sec->children[1] = NULL;
+	sec->children[0] = sv_freeWorldSectors;
+	sv_freeWorldSectors = sec;
+	sv_numFreeWorldSectors++;
+}
+
+/*
+===============
+SV_SplitWorldSector
+
+Turns a crowded leaf into a node and moves its entities down, keeping
+their order in the chains
+===============
+*/
+static void SV_SplitWorldSector( worldSector_t *node ) {
+	worldSector_t	*child, *sec;
+	svEntity_t		*ent, *next;
+	svEntity_t		**tail[3];
+	sharedEntity_t	*gEnt;
+	vec3_t			size;
+	int				i;
+
+	if ( node->depth >= AREA_MAX_DEPTH || AREA_NODES - sv_numworldSectors + sv_numFreeWorldSectors < 2 ) {
+		return;
+	}
+
+	VectorSubtract (node->maxs, node->mins, size);
+	node->axis = size[0] > size[1] ? 0 : 1;
+	if ( size[node->axis] < 2 * AREA_MIN_SIZE ) {
+		node->axis = -1;
+		return;
+	}
+	node->dist = 0.5 * (node->maxs[node->axis] + node->mins[node->axis]);
+
+	// children[0] is the side above dist, as in SV_CreateworldSector
+	for ( i = 0 ; i < 2 ; i++ ) {
+		child = SV_AllocWorldSector();
+		child->axis = -1;
+		child->parent = node;
+		child->depth = node->depth + 1;
+		VectorCopy (node->mins, child->mins);
+		VectorCopy (node->maxs, child->maxs);
+		if ( i == 0 ) {
+			child->mins[node->axis] = node->dist;
+		} else {
+			child->maxs[node->axis] = node->dist;
+		}
+		node->children[i] = child;
+	}
+
+	ent = node->entities;
+	node->entities = NULL;
+	node->numEntities = 0;
+
+	// append rather than push, so each chain keeps the old relative order
+	tail[0] = &node->entities;
+	tail[1] = &node->children[0]->entities;
+	tail[2] = &node->children[1]->entities;
+
+	for ( ; ent ; ent = next ) {
+		next = ent->nextEntityInWorldSector;
+		gEnt = SV_GEntityForSvEntity( ent );
+		sec = SV_SectorForBounds( node, gEnt->r.absmin, gEnt->r.absmax );
+		i = sec == node ? 0 : sec == node->children[0] ? 1 : 2;
+
+		ent->worldSector = sec;
+		ent->nextEntityInWorldSector = NULL;
+		*tail[i] = ent;
+		tail[i] = &ent->nextEntityInWorldSector;
+		sec->numEntities++;
+	}
+}
+
+/*
+===============
+SV_MergeWorldSector
+
+Turns a split node whose leafs have emptied out back into a leaf, then
+tries the same on its parent
+===============
+*/
+static void SV_MergeWorldSector( worldSector_t *node ) {
+	worldSector_t	*child;
+	svEntity_t		**tail;
+	svEntity_t		*ent;
+	int				i;
+
+	for ( ; node ; node = node->parent ) {
+		// the uniform tree from SV_CreateworldSector is never merged
+		if ( node->axis == -1 || node->depth < AREA_DEPTH ) {
+			return;
+		}
+		if ( node->children[0]->axis != -1 || node->children[1]->axis != -1 ) {
+			return;
+		}
+		if ( node->numEntities + node->children[0]->numEntities + node->children[1]->numEntities > AREA_MERGE_COUNT ) {
+			return;
+		}
+
+		// the entities crossing the node stay first, then those of each leaf
+		for ( tail = &node->entities ; *tail ; tail = &(*tail)->nextEntityInWorldSector ) {
+		}
+
+		for ( i = 0 ; i < 2 ; i++ ) {
+			child = node->children[i];
+			*tail = child->entities;
+			for ( ent = child->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
+				ent->worldSector = node;
+				tail = &ent->nextEntityInWorldSector;
+			}
+			node->numEntities += child->numEntities;
+			SV_FreeWorldSector( child );
+		}
+
+		node->axis = -1;
+		node->children[0] = node->children[1] = NULL;
+	}
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -129,6 +340,8 @@ void SV_ClearWorld( void ) {
 
 	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
 	sv_numworldSectors = 0;
+	sv_freeWorldSectors = NULL;
+	sv_numFreeWorldSectors = 0;
 
 	// get world map bounds
 	h = CM_InlineModel( 0 );
@@ -157,19 +370,23 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 		return;		// not linked in anywhere
 	}
 	ent->worldSector = NULL;
+	ws->numEntities--;
 
 	if ( ws->entities == ent ) {
 		ws->entities = ent->nextEntityInWorldSector;
+		SV_MergeWorldSector( ws->axis == -1 ? ws->parent : ws );
 		return;
 	}
 
 	for ( scan = ws->entities ; scan ; scan = scan->nextEntityInWorldSector ) {
 		if ( scan->nextEntityInWorldSector == ent ) {
 			scan->nextEntityInWorldSector = ent->nextEntityInWorldSector;
+			SV_MergeWorldSector( ws->axis == -1 ? ws->parent : ws );
 			return;
 		}
 	}
 
+	ws->numEntities++;
 	Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
 }
 
@@ -198,6 +415,9 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 		SV_UnlinkEntity( gEnt );	// unlink from old position
 	}
 
+	// pvs information is about to change
+	sv.numVisCache = 0;
+
 	if (gEnt->s.eType == ET_EVENTS + EV_SABER_BLOCK) {
 		if (mv_fixturretcrash->integer && !(sv.fixes & MVFIX_TURRETCRASH)) {
 			sv.saberBlockCounter++;
@@ -327,23 +547,15 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	gEnt->r.linkcount++;
 
 	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if ( gEnt->r.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if ( gEnt->r.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
-	}
+	node = SV_SectorForBounds( sv_worldSectors, gEnt->r.absmin, gEnt->r.absmax );
 
 	// link it in
-	ent->worldSector = node;
-	ent->nextEntityInWorldSector = node->entities;
-	node->entities = ent;
+	SV_AddToWorldSector( node, ent );
+
+	// refine crowded leafs
+	if ( node->axis == -1 && node->numEntities > AREA_SPLIT_COUNT ) {
+		SV_SplitWorldSector( node );
+	}
 
 	gEnt->r.linked = qtrue;
 }
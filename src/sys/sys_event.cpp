@@ -16,17 +16,16 @@ EVENT LOOP
 static sysEvent_t	eventQue[MAX_QUED_EVENTS] = {};
 static int			eventHead = 0, eventTail = 0;
 
-sysEvent_t Sys_GetEvent( void ) {
-	sysEvent_t	ev;
-	char		*s;
+/*
+================
+Sys_QueConsoleInput
 
-	// return if we have data
-	if ( eventHead > eventTail ) {
-		eventTail++;
-		return eventQue[ ( eventTail - 1 ) & MASK_QUED_EVENTS ];
-	}
+Queues a console command if one has been typed
+================
+*/
+void Sys_QueConsoleInput( void ) {
+	char	*s;
 
-	// check for console commands
 	s = Sys_ConsoleInput();
 	if ( s ) {
 		char	*b;
@@ -37,6 +36,19 @@ sysEvent_t Sys_GetEvent( void ) {
 		strcpy( b, s );
 		Sys_QueEvent( 0, SE_CONSOLE, 0, 0, len, b );
 	}
+}
+
+sysEvent_t Sys_GetEvent( void ) {
+	sysEvent_t	ev;
+
+	// return if we have data
+	if ( eventHead > eventTail ) {
+		eventTail++;
+		return eventQue[ ( eventTail - 1 ) & MASK_QUED_EVENTS ];
+	}
+
+	// check for console commands
+	Sys_QueConsoleInput();
 
 	// return if we have data
 	if ( eventHead > eventTail ) {
@@ -86,7 +86,12 @@ void CON_DeleteConsoleWindow(void);
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (bool baseTime = false);
 int		Sys_Milliseconds2(void);
+// monotonic, for measuring intervals only
+int64_t	Sys_Microseconds(void);
+int64_t	Sys_Nanoseconds(void);
 void	Sys_Sleep( int msec );
+int		Sys_ConsoleInputFd( void );
+void	Sys_QueConsoleInput( void );
 
 extern "C" void	Sys_SnapVector( float *v );
 
@@ -124,6 +129,10 @@ void	Sys_FreeFileList( char **fileList );
 
 time_t Sys_FileTime( const char *path );
 
+// copy-on-write mapping of part of a file, it stays valid after the file is closed
+void	*Sys_MapFile( FILE *f, int64_t offset, int len );
+void	Sys_UnmapFile( void *data, int len );
+
 qboolean Sys_LowPhysicalMemory();
 
 void Sys_SetProcessorAffinity( void );
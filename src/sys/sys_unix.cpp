@@ -77,6 +77,30 @@ int Sys_Milliseconds2( void )
     return Sys_Milliseconds(false);
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+int64_t Sys_Microseconds( void )
+{
+	return Sys_Nanoseconds() / 1000;
+}
+
+/*
+================
+Sys_Nanoseconds
+================
+*/
+int64_t Sys_Nanoseconds( void )
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 qboolean Sys_Mkdir( const char *path )
 {
     int result = mkdir( path, 0750 );
@@ -87,6 +111,42 @@ qboolean Sys_Mkdir( const char *path )
     return qtrue;
 }
 
+/*
+==================
+Sys_MapFile
+==================
+*/
+void *Sys_MapFile( FILE *f, int64_t offset, int len )
+{
+	int64_t	pageOffset;
+	byte	*base;
+
+	if ( len <= 0 ) {
+		return NULL;
+	}
+
+	pageOffset = offset & ( sysconf( _SC_PAGESIZE ) - 1 );
+	base = (byte *)mmap( NULL, len + pageOffset, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno( f ), offset - pageOffset );
+	if ( base == MAP_FAILED ) {
+		return NULL;
+	}
+
+	return base + pageOffset;
+}
+
+/*
+==================
+Sys_UnmapFile
+==================
+*/
+void Sys_UnmapFile( void *data, int len )
+{
+	intptr_t	pageOffset;
+
+	pageOffset = (intptr_t)data & ( sysconf( _SC_PAGESIZE ) - 1 );
+	munmap( (byte *)data - pageOffset, len + pageOffset );
+}
+
 //============================================
 
 #define	MAX_FOUND_FILES	0x1000
@@ -594,6 +654,18 @@ void Sys_Sleep( int msec )
 	}
 }
 
+/*
+==================
+Sys_ConsoleInputFd
+
+Descriptor the console reads from, or -1 once it is closed.
+==================
+*/
+int Sys_ConsoleInputFd( void )
+{
+	return stdin_active ? STDIN_FILENO : -1;
+}
+
 /*
 =================
 Sys_UnloadModuleLibrary
@@ -74,6 +74,11 @@ char *Sys_DefaultInstallPath(void)
 	return Sys_Cwd();
 }
 
+int Sys_ConsoleInputFd(void) {
+	// console input can't be waited on together with sockets
+	return -1;
+}
+
 void Sys_Sleep(int msec) {
 	if (msec == 0)
 		return;
@@ -387,6 +392,48 @@ qboolean Sys_Mkdir(const char *path) {
 	return qtrue;
 }
 
+/*
+==============
+Sys_MapFile
+==============
+*/
+void *Sys_MapFile(FILE *f, int64_t offset, int len) {
+	SYSTEM_INFO	info;
+	HANDLE		mapping;
+	int64_t		viewOffset;
+	byte		*base;
+
+	if (len <= 0)
+		return NULL;
+
+	GetSystemInfo(&info);
+	viewOffset = offset & ~(int64_t)(info.dwAllocationGranularity - 1);
+
+	mapping = CreateFileMappingA((HANDLE)_get_osfhandle(_fileno(f)), NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (!mapping)
+		return NULL;
+
+	base = (byte *)MapViewOfFile(mapping, FILE_MAP_COPY, (DWORD)(viewOffset >> 32), (DWORD)viewOffset, (SIZE_T)(offset - viewOffset + len));
+	// the view keeps the mapping alive
+	CloseHandle(mapping);
+	if (!base)
+		return NULL;
+
+	return base + (offset - viewOffset);
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile(void *data, int len) {
+	SYSTEM_INFO	info;
+
+	GetSystemInfo(&info);
+	UnmapViewOfFile((void *)((uintptr_t)data & ~(uintptr_t)(info.dwAllocationGranularity - 1)));
+}
+
 /*
 ================
 Sys_Milliseconds
@@ -408,6 +455,33 @@ int Sys_Milliseconds2(void) {
 	return Sys_Milliseconds(false);
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+int64_t Sys_Microseconds(void) {
+	return Sys_Nanoseconds() / 1000;
+}
+
+/*
+================
+Sys_Nanoseconds
+================
+*/
+int64_t Sys_Nanoseconds(void) {
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if (!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+
+	QueryPerformanceCounter(&counter);
+
+	return (counter.QuadPart / frequency.QuadPart) * 1000000000 +
+		(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+}
+
 static UINT timerResolution = 0;
 
 void Sys_PlatformInit(void) {